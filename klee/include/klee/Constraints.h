@@ -11,8 +11,12 @@
 #define KLEE_CONSTRAINTS_H
 
 #include "klee/Expr.h"
+#include "klee/Internal/ADT/ImmutableMap.h"
 #include <llvm/Support/raw_ostream.h>
 
+#include <iterator>
+#include <vector>
+
 // FIXME: Currently we use ConstraintManager for two things: to pass
 // sets of constraints around, and to optimize constraints. We should
 // move the first usage into a separate data structure
@@ -21,22 +25,46 @@ namespace klee {
 
 class ExprVisitor;
   
+/// ConstraintManager - A set of constraints, in the order they were added.
+///
+/// The constraints are kept in an immutable tree keyed by their position,
+/// like the objects of an AddressSpace. Copying the set on a fork is O(1),
+/// and the states forked from each other share the nodes of the constraints
+/// they have in common.
 class ConstraintManager {
 public:
-  typedef std::vector< ref<Expr> > constraints_ty;
-  typedef constraints_ty::iterator iterator;
-  typedef constraints_ty::const_iterator const_iterator;
+  typedef ImmutableMap<unsigned, ref<Expr> > constraints_ty;
 
-  ConstraintManager() {}
+  class const_iterator
+    : public std::iterator<std::forward_iterator_tag, ref<Expr> > {
+    // ImmutableTree iterators only have non-const accessors
+    mutable constraints_ty::iterator it;
 
-  // create from constraints with no optimization
-  explicit
-  ConstraintManager(const std::vector< ref<Expr> > &_constraints) :
-    constraints(_constraints) {}
+  public:
+    const_iterator(const constraints_ty::iterator &_it) : it(_it) {}
+
+    const ref<Expr> &operator*() const { return it->second; }
+    const ref<Expr> *operator->() const { return &it->second; }
+
+    const_iterator &operator++() { ++it; return *this; }
+    const_iterator operator++(int) {
+      const_iterator res(*this);
+      ++it;
+      return res;
+    }
+
+    bool operator==(const const_iterator &b) const { return it == b.it; }
+    bool operator!=(const const_iterator &b) const { return it != b.it; }
+  };
 
-  ConstraintManager(const ConstraintManager &cs) : constraints(cs.constraints) {}
+  typedef const_iterator iterator;
+  typedef const_iterator constraint_iterator;
 
-  typedef std::vector< ref<Expr> >::const_iterator constraint_iterator;
+  ConstraintManager() : nextKey(0), numConstraints(0) {}
+
+  // create from constraints with no optimization
+  explicit
+  ConstraintManager(const std::vector< ref<Expr> > &_constraints);
 
   // given a constraint which is known to be valid, attempt to 
   // simplify the existing constraint set
@@ -45,12 +73,28 @@ public:
   ref<Expr> simplifyExpr(ref<Expr> e) const;
 
   void addConstraint(ref<Expr> e);
+
+  /// getRelatedConstraints - Append the constraints that read the bytes
+  /// read by e, directly or through other constraints, in their order in
+  /// the set. The other constraints cannot affect the value of e.
+  void getRelatedConstraints(ref<Expr> e,
+                             std::vector< ref<Expr> > &result) const;
+
+  /// getMemoryUsage - Return the bytes used by the nodes of the set and
+  /// of its independence index, split between the nodes only this set
+  /// references and the ones it shares with other sets, e.g., the states
+  /// it was forked from. Expressions are not counted.
+  void getMemoryUsage(uint64_t &exclusive, uint64_t &shared) const;
+
+  /// getTotalMemoryUsage - Return the bytes used by the nodes of all the
+  /// sets.
+  static uint64_t getTotalMemoryUsage();
   
   bool empty() const {
-    return constraints.empty();
+    return numConstraints == 0;
   }
   ref<Expr> back() const {
-    return constraints.back();
+    return constraints.max().second;
   }
   constraint_iterator begin() const {
     return constraints.begin();
@@ -59,27 +103,58 @@ public:
     return constraints.end();
   }
   size_t size() const {
-    return constraints.size();
+    return numConstraints;
   }
 
-  bool operator==(const ConstraintManager &other) const {
-    return constraints == other.constraints;
-  }
+  bool operator==(const ConstraintManager &other) const;
   
   void print(llvm::raw_ostream &os) {
-      const_iterator it;
-      for (it = begin(); it != end(); ++it) {
+      for (const_iterator it = begin(), ie = end(); it != ie; ++it) {
           os << "Constraint " << *it << "\n";
       }
   }
 
 private:
-  std::vector< ref<Expr> > constraints;
+  typedef std::pair<const Array*, unsigned> byte_ty;
+
+  /// IndependenceIndex - Union-find of the constraints, where constraints
+  /// that read the same array bytes are in the same cluster. The maps are
+  /// immutable, so that forks share the index as well.
+  struct IndependenceIndex {
+    bool built;
+    /// The cluster of each constraint, by key, named after the key of its
+    /// first constraint
+    ImmutableMap<unsigned, unsigned> clusters;
+    /// The constraints of each cluster, by cluster and key
+    ImmutableMap<std::pair<unsigned, unsigned>, ref<Expr> > members;
+    /// The number of constraints in each cluster
+    ImmutableMap<unsigned, unsigned> sizes;
+    /// The cluster that reads each byte, for arrays that are only read at
+    /// constant indexes
+    ImmutableMap<byte_ty, unsigned> bytes;
+    /// The cluster that reads each array at a symbolic index
+    ImmutableMap<const Array*, unsigned> wholeArrays;
+
+    IndependenceIndex() : built(false) {}
+
+    unsigned find(unsigned key) const;
+    unsigned unite(unsigned a, unsigned b);
+  };
+
+  constraints_ty constraints;
+  unsigned nextKey;
+  unsigned numConstraints;
+
+  /// Built by the first call to getRelatedConstraints, then maintained
+  /// as constraints are added
+  mutable IndependenceIndex index;
 
   // returns true iff the constraints were modified
   bool rewriteConstraints(ExprVisitor &visitor);
 
   void addConstraintInternal(ref<Expr> e);
+  void pushConstraint(ref<Expr> e);
+  void indexConstraint(unsigned key, ref<Expr> e) const;
 };
 
 }
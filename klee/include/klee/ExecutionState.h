@@ -106,6 +106,10 @@ public:
   bool speculative;
   ref<Expr> speculativeCondition;
 
+  /// Ticket of the background query that computes the concolic values of
+  /// this speculative state, 0 if there is none.
+  uint64_t speculativeTicket;
+
   // Used by the checkpoint/rollback methods for fake objects.
   // FIXME: not freeing things on branch deletion.
   MemoryMap shadowObjects;
@@ -152,6 +156,10 @@ public:
   bool isSpeculative() const {
       return speculative;
   }
+
+  bool isSolutionPending() const {
+      return speculativeTicket != 0;
+  }
 };
 
 }
@@ -47,6 +47,7 @@ namespace llvm {
 
 namespace klee {
   class Array;
+  class BackgroundSolver;
   struct Cell;
   class ExecutionState;
   class ExternalDispatcher;
@@ -104,6 +105,14 @@ protected:
 
   ExternalDispatcher *externalDispatcher;
   TimingSolver *solver;
+
+  /// Computes the concolic values of speculative states while execution
+  /// goes on, NULL if they are computed when the states are selected.
+  BackgroundSolver *concolicSolver;
+
+  /// The speculative states whose values are being computed, by ticket
+  std::map<uint64_t, ExecutionState*> pendingSpeculativeStates;
+
   MemoryManager *memory;
   std::set<ExecutionState*> states;
   StatsTracker *statsTracker;
@@ -406,6 +415,20 @@ public:
   bool resolveSpeculativeState(ExecutionState &state);
   bool checkSpeculativeState(ExecutionState &state);
 
+  /// Hands the computation of the concolic values of a speculative state
+  /// to the background solver.
+  void submitSpeculativeState(ExecutionState &state);
+
+  /// Forgets the background query of a speculative state, whose result
+  /// will be ignored. The state is left to the synchronous resolution.
+  void dropSpeculativeTicket(ExecutionState &state);
+
+  /// Applies the values computed for speculative states since the last
+  /// call. States that turned out to be infeasible are terminated.
+  ///
+  /// \param wait - Whether to wait until all pending states are resolved.
+  void processSpeculativeResults(bool wait);
+
   virtual bool merge(ExecutionState &base, ExecutionState &other);
 
   // remove state from queue and delete
@@ -88,6 +88,13 @@ public:
   static unsigned count;
   static const unsigned MAGIC_HASH_CONSTANT = 39;
 
+  /// Number of expressions allocated so far, including the ones that were
+  /// discarded because an equal expression already existed.
+  static uint64_t allocCount;
+
+  /// Number of expressions that were replaced by an equal existing one.
+  static uint64_t hashConsHits;
+
   /// The type of an expression is simply its width, in bits. 
   typedef unsigned Width; 
   
@@ -169,10 +176,42 @@ public:
 
 protected:  
   unsigned hashValue;
+
+private:
+  /// The next expression in the same bucket of the hash-consing table.
+  Expr *nextInBucket;
+
+  /// Whether this expression is in the hash-consing table.
+  bool hashConsed;
+
+  static Expr *intern(Expr *e);
+  static void unintern(Expr *e);
   
 public:
-  Expr() : refCount(0) { Expr::count++; }
-  virtual ~Expr() { Expr::count--; } 
+  Expr() : refCount(0), nextInBucket(0), hashConsed(false) { Expr::count++; }
+  virtual ~Expr() {
+    if (hashConsed)
+      unintern(this);
+    Expr::count--;
+  }
+
+  /// Expressions are allocated from slabs, with a free list per size.
+  static void *operator new(size_t size);
+  static void operator delete(void *p, size_t size);
+
+  /// hashCons - Compute the hash of a new expression, and return the
+  /// existing expression that is structurally equal to it if there is
+  /// one, or the new expression otherwise. The table only holds weak
+  /// references: an expression leaves it when its last reference goes.
+  ///
+  /// Equal expressions built through hashCons are thus the same object,
+  /// and comparing them for equality takes a pointer comparison.
+  template<class T>
+  static ref<T> hashCons(T *e) {
+    ref<T> r(e);
+    r->computeHash();
+    return ref<T>(static_cast<T*>(intern(e)));
+  }
 
   virtual Kind getKind() const = 0;
   virtual Width getWidth() const = 0;
@@ -194,6 +233,16 @@ public:
   
   /// Returns 0 iff b is structuraly equivalent to *this
   int compare(const Expr &b) const;
+
+  /// Returns true iff b is structuraly equivalent to *this
+  bool equals(const Expr &b) const {
+    if (this == &b)
+      return true;
+    // Two hash-consed expressions are equal only if they are the same
+    if (hashConsed && b.hashConsed)
+      return false;
+    return compare(b) == 0;
+  }
   virtual int compareContents(const Expr &b) const { return 0; }
 
   // Given an array of new kids return a copy of the expression
@@ -257,7 +306,7 @@ struct Expr::CreateArg {
 // Comparison operators
 
 inline bool operator==(const Expr &lhs, const Expr &rhs) {
-  return lhs.compare(rhs) == 0;
+  return lhs.equals(rhs);
 }
 
 inline bool operator<(const Expr &lhs, const Expr &rhs) {
@@ -380,9 +429,7 @@ public:
   void toMemory(void *address);
 
   static ref<ConstantExpr> alloc(const llvm::APInt &v) {
-    ref<ConstantExpr> r(new ConstantExpr(v));
-    r->computeHash();
-    return r;
+    return hashCons(new ConstantExpr(v));
   }
 
   static ref<ConstantExpr> alloc(uint64_t v, Width w) {
@@ -521,9 +568,7 @@ public:
   ref<Expr> src;
 
   static ref<Expr> alloc(const ref<Expr> &src) {
-    ref<Expr> r(new NotOptimizedExpr(src));
-    r->computeHash();
-    return r;
+    return hashCons(new NotOptimizedExpr(src));
   }
   
   static ref<Expr> create(ref<Expr> src);
@@ -667,9 +712,7 @@ public:
 
 public:
   static ref<Expr> alloc(const UpdateList &updates, const ref<Expr> &index) {
-    ref<Expr> r(new ReadExpr(updates, index));
-    r->computeHash();
-    return r;
+    return hashCons(new ReadExpr(updates, index));
   }
   
   static ref<Expr> create(const UpdateList &updates, ref<Expr> i);
@@ -712,9 +755,7 @@ public:
 public:
   static ref<Expr> alloc(const ref<Expr> &c, const ref<Expr> &t, 
                          const ref<Expr> &f) {
-    ref<Expr> r(new SelectExpr(c, t, f));
-    r->computeHash();
-    return r;
+    return hashCons(new SelectExpr(c, t, f));
   }
   
   static ref<Expr> create(ref<Expr> c, ref<Expr> t, ref<Expr> f);
@@ -769,9 +810,7 @@ private:
 
 public:
   static ref<Expr> alloc(const ref<Expr> &l, const ref<Expr> &r) {
-    ref<Expr> c(new ConcatExpr(l, r));
-    c->computeHash();
-    return c;
+    return hashCons(new ConcatExpr(l, r));
   }
   
   static ref<Expr> create(const ref<Expr> &l, const ref<Expr> &r);
@@ -828,9 +867,7 @@ public:
 
 public:  
   static ref<Expr> alloc(const ref<Expr> &e, unsigned o, Width w) {
-    ref<Expr> r(new ExtractExpr(e, o, w));
-    r->computeHash();
-    return r;
+    return hashCons(new ExtractExpr(e, o, w));
   }
   
   /// Creates an ExtractExpr with the given bit offset and width
@@ -879,9 +916,7 @@ public:
 
 public:  
   static ref<Expr> alloc(const ref<Expr> &e) {
-    ref<Expr> r(new NotExpr(e));
-    r->computeHash();
-    return r;
+    return hashCons(new NotExpr(e));
   }
   
   static ref<Expr> create(const ref<Expr> &e);
@@ -956,9 +991,7 @@ public:                                                          \
 public:                                                          \
     _class_kind ## Expr(ref<Expr> e, Width w) : CastExpr(e,w) {} \
     static ref<Expr> alloc(const ref<Expr> &e, Width w) {        \
-      ref<Expr> r(new _class_kind ## Expr(e, w));                \
-      r->computeHash();                                          \
-      return r;                                                  \
+      return hashCons(new _class_kind ## Expr(e, w));            \
     }                                                            \
     static ref<Expr> create(const ref<Expr> &e, Width w);        \
     Kind getKind() const { return _class_kind; }                 \
@@ -988,9 +1021,7 @@ public:                                                              \
     _class_kind ## Expr(const ref<Expr> &l,                          \
                         const ref<Expr> &r) : BinaryExpr(l,r) {}     \
     static ref<Expr> alloc(const ref<Expr> &l, const ref<Expr> &r) { \
-      ref<Expr> res(new _class_kind ## Expr (l, r));                 \
-      res->computeHash();                                            \
-      return res;                                                    \
+      return hashCons(new _class_kind ## Expr (l, r));               \
     }                                                                \
     static ref<Expr> create(const ref<Expr> &l, const ref<Expr> &r); \
     Width getWidth() const { return left->getWidth(); }              \
@@ -1032,9 +1063,7 @@ public:                                                              \
     _class_kind ## Expr(const ref<Expr> &l,                          \
                         const ref<Expr> &r) : CmpExpr(l,r) {}        \
     static ref<Expr> alloc(const ref<Expr> &l, const ref<Expr> &r) { \
-      ref<Expr> res(new _class_kind ## Expr (l, r));                 \
-      res->computeHash();                                            \
-      return res;                                                    \
+      return hashCons(new _class_kind ## Expr (l, r));               \
     }                                                                \
     static ref<Expr> create(const ref<Expr> &l, const ref<Expr> &r); \
     Kind getKind() const { return _class_kind; }                     \
@@ -64,6 +64,9 @@ namespace klee {
       return elts.size(); 
     }
 
+    static ImmutableMap fromSorted(const std::vector<value_type> &values) {
+      return Tree::fromSorted(values);
+    }
     ImmutableMap insert(const value_type &value) const { 
       return elts.insert(value); 
     }
@@ -97,6 +100,11 @@ namespace klee {
     }
 
     static size_t getAllocated() { return Tree::allocated; }
+
+    void countNodes(size_t &exclusive, size_t &shared) const {
+      elts.countNodes(exclusive, shared);
+    }
+    static size_t getNodeSize() { return Tree::getNodeSize(); }
   };
 
 }
@@ -94,6 +94,11 @@ namespace klee {
     }
 
     static size_t getAllocated() { return Tree::allocated; }
+
+    void countNodes(size_t &exclusive, size_t &shared) const {
+      elts.countNodes(exclusive, shared);
+    }
+    static size_t getNodeSize() { return Tree::getNodeSize(); }
   };
 
 }
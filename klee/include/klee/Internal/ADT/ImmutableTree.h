@@ -45,6 +45,9 @@ namespace klee {
     const value_type &max() const;
     size_t size() const;
 
+    // build a balanced tree from values sorted by key, without duplicates
+    static ImmutableTree fromSorted(const std::vector<value_type> &values);
+
     ImmutableTree insert(const value_type &value) const;
     ImmutableTree replace(const value_type &value) const;
     ImmutableTree remove(const key_type &key) const;
@@ -59,6 +62,11 @@ namespace klee {
 
     static size_t getAllocated() { return allocated; }
 
+    // count the nodes that are only reachable from this tree, and the
+    // ones that are shared with other trees
+    void countNodes(size_t &exclusive, size_t &shared) const;
+    static size_t getNodeSize();
+
   private:
     class Node;
 
@@ -80,6 +88,9 @@ namespace klee {
     Node(); // solely for creating the terminator node
     static Node *balance(Node *left, const value_type &value, Node *right);
 
+  public:
+    static Node *build(const value_type *begin, const value_type *end);
+
   public:
 
     Node(Node *_left, Node *_right, const value_type &_value);
@@ -91,6 +102,7 @@ namespace klee {
     bool isTerminator();
 
     size_t size();
+    void countNodes(size_t &exclusive, size_t &shared, bool isShared);
     Node *popMin(value_type &valueOut);
     Node *popMax(value_type &valueOut);
     Node *insert(const value_type &v);
@@ -331,6 +343,16 @@ namespace klee {
     }
   }
 
+  template<class K, class V, class KOV, class CMP>
+  typename ImmutableTree<K,V,KOV,CMP>::Node *
+  ImmutableTree<K,V,KOV,CMP>::Node::build(const value_type *begin,
+                                          const value_type *end) {
+    if (begin == end)
+      return terminator.incref();
+    const value_type *mid = begin + (end - begin) / 2;
+    return new Node(build(begin, mid), build(mid + 1, end), *mid);
+  }
+
   template<class K, class V, class KOV, class CMP>
   size_t ImmutableTree<K,V,KOV,CMP>::Node::size() {
     if (isTerminator()) {
@@ -340,6 +362,19 @@ namespace klee {
     }
   }
 
+  template<class K, class V, class KOV, class CMP>
+  void ImmutableTree<K,V,KOV,CMP>::Node::countNodes(size_t &exclusive,
+                                                    size_t &shared,
+                                                    bool isShared) {
+    if (isTerminator())
+      return;
+    // a node referenced twice is shared along with everything below it
+    isShared = isShared || references > 1;
+    ++(isShared ? shared : exclusive);
+    left->countNodes(exclusive, shared, isShared);
+    right->countNodes(exclusive, shared, isShared);
+  }
+
   template<class K, class V, class KOV, class CMP>
   typename ImmutableTree<K,V,KOV,CMP>::Node *
   ImmutableTree<K,V,KOV,CMP>::Node::popMin(value_type &valueOut) {
@@ -528,6 +563,25 @@ namespace klee {
     return node->size();
   }
 
+  template<class K, class V, class KOV, class CMP>
+  void ImmutableTree<K,V,KOV,CMP>::countNodes(size_t &exclusive,
+                                              size_t &shared) const {
+    node->countNodes(exclusive, shared, false);
+  }
+
+  template<class K, class V, class KOV, class CMP>
+  size_t ImmutableTree<K,V,KOV,CMP>::getNodeSize() {
+    return sizeof(Node);
+  }
+
+  template<class K, class V, class KOV, class CMP>
+  ImmutableTree<K,V,KOV,CMP>
+  ImmutableTree<K,V,KOV,CMP>::fromSorted(const std::vector<value_type> &values) {
+    if (values.empty())
+      return ImmutableTree();
+    return ImmutableTree(Node::build(&values[0], &values[0] + values.size()));
+  }
+
   template<class K, class V, class KOV, class CMP>
   ImmutableTree<K,V,KOV,CMP> 
   ImmutableTree<K,V,KOV,CMP>::insert(const value_type &value) const { 
@@ -27,6 +27,7 @@ namespace klee {
 
 class BitArray;
 class MemoryManager;
+class SharedConcreteStore;
 class Solver;
 
 class MemoryObject {
@@ -169,6 +170,10 @@ private:
   //XXX: made it public for fast access
   uint8_t *concreteStore;
 
+  /// Non-null when concreteStore is shared with other object states
+  /// that have the same contents (see shareConcreteStore)
+  SharedConcreteStore *sharedStore;
+
   // XXX cleanup name of flushMask (its backwards or something)
   // mutable because may need flushed during read of const
   mutable BitArray *flushMask;
@@ -246,7 +251,21 @@ public:
   const uint8_t *getConcreteStore(bool allowSymbolic = false) const;
   uint8_t *getConcreteStore(bool allowSymolic = false);
 
+  /// Replaces the contents of the concrete store with data. The store
+  /// is shared (by content hash) with all other object states holding
+  /// the same bytes, and copied again on the first write or non-const
+  /// getConcreteStore(). The address of the store changes: callers that
+  /// cached pointers to it (e.g., the S2E TLB) must update them.
+  /// Returns true if another object state already had these contents.
+  bool shareConcreteStore(const uint8_t *data);
+
+  bool isConcreteStoreShared() const {
+    return sharedStore != 0;
+  }
+
 private:
+  void unshareConcreteStore();
+
   const UpdateList &getUpdates() const;
 
   void makeConcrete();
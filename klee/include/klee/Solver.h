@@ -18,6 +18,7 @@ namespace klee {
   class ConstraintManager;
   class Expr;
   class SolverImpl;
+  class STPWorkerPool;
 
   struct Query {
   public:
@@ -44,6 +45,39 @@ namespace klee {
     }
   };
 
+  /// InitialValuesRequest - One of several independent counterexample
+  /// queries given to STPSolver::computeInitialValuesConcurrently.
+  struct InitialValuesRequest {
+    const Query *query;
+    std::vector<const Array*> objects;
+
+    /// Outputs, hasSolution and values are valid if success is true.
+    bool success;
+    bool hasSolution;
+    std::vector< std::vector<unsigned char> > values;
+
+    InitialValuesRequest(const Query *_query,
+                         const std::vector<const Array*> &_objects)
+      : query(_query), objects(_objects), success(false), hasSolution(false) {
+    }
+  };
+
+  /// InitialValuesResult - The outcome of a query given to
+  /// BackgroundSolver::submit.
+  struct InitialValuesResult {
+    /// The ticket returned by submit.
+    uint64_t ticket;
+
+    /// hasSolution and values are valid if success is true.
+    bool success;
+    bool hasSolution;
+    std::vector< std::vector<unsigned char> > values;
+
+    InitialValuesResult()
+      : ticket(0), success(false), hasSolution(false) {
+    }
+  };
+
   class Solver {
     // DO NOT IMPLEMENT.
     Solver(const Solver&);
@@ -156,10 +190,16 @@ namespace klee {
     /// STPSolver - Construct a new STPSolver.
     ///
     /// \param useForkedSTP - Whether STP should be run in a separate process
-    /// (required for using timeouts).
+    /// (required for using timeouts). The queries are sent to a pool of
+    /// -stp-workers long-lived processes, or to a process forked for each
+    /// query if that option is 0.
     STPSolver(bool useForkedSTP);
 
-    
+    /// computeInitialValuesConcurrently - Compute the initial values of
+    /// independent queries, several at a time when there is more than one
+    /// worker process. Bypasses any solver stacked on top of this one.
+    void computeInitialValuesConcurrently(
+        std::vector<InitialValuesRequest> &requests);
     
     /// getConstraintLog - Return the constraint log for the given state in CVC
     /// format.
@@ -168,6 +208,54 @@ namespace klee {
     /// setTimeout - Set constraint solver timeout delay to the given value; 0
     /// is off.
     void setTimeout(double timeout);
+
+    /// setIncremental - Keep the constraints asserted between queries, and
+    /// only assert those added since the previous query (-incremental-stp).
+    /// Has no effect when the queries go to -stp-workers processes.
+    void setIncremental(bool incremental);
+  };
+
+  /// BackgroundSolver - Computes initial values in STP worker processes of
+  /// its own, while the caller keeps running.
+  ///
+  /// Queries are serialized when they are submitted, so the caller does not
+  /// have to keep their constraints alive. At most maxPending queries may be
+  /// queued or being solved at once: past that, submit() waits for one of
+  /// them to finish, which throttles callers that produce queries faster
+  /// than the workers solve them.
+  class BackgroundSolver {
+    // DO NOT IMPLEMENT.
+    BackgroundSolver(const BackgroundSolver&);
+    void operator=(const BackgroundSolver&);
+
+    STPWorkerPool *pool;
+    unsigned maxPending;
+    double timeout;
+
+    /// Results collected while submit() was waiting for a free slot
+    std::vector<InitialValuesResult> finished;
+
+  public:
+    BackgroundSolver(unsigned numWorkers, unsigned _maxPending);
+    ~BackgroundSolver();
+
+    /// setTimeout - Set the time allowed for each query; 0 is off.
+    void setTimeout(double _timeout) { timeout = _timeout; }
+
+    /// submit - Hand a counterexample query to the workers.
+    ///
+    /// \return The ticket that identifies the result of the query.
+    uint64_t submit(const Query&, const std::vector<const Array*> &objects);
+
+    /// getResults - Append the results of the queries that finished since
+    /// the last call.
+    ///
+    /// \param wait - Whether to wait until all submitted queries finish.
+    void getResults(std::vector<InitialValuesResult> &results, bool wait);
+
+    /// getNumPending - Return the number of queries that were submitted and
+    /// whose results were not returned yet.
+    unsigned getNumPending() const;
   };
 
   /* *** */
@@ -187,6 +275,18 @@ namespace klee {
   /// \param s - The underlying solver to use.
   Solver *createCachingSolver(Solver *s);
 
+  /// createPersistentCachingSolver - Create a solver which caches query
+  /// validities in a memory-mapped file. The file can be shared by several
+  /// processes at once and is kept across runs. Queries are identified by a
+  /// structural hash of the constraints (regardless of their order) and the
+  /// query expression.
+  ///
+  /// \param s - The underlying solver to use.
+  /// \param path - The cache file, created if it does not exist.
+  /// \param capacity - The number of entries of a new cache file.
+  Solver *createPersistentCachingSolver(Solver *s, std::string path,
+                                        uint64_t capacity);
+
   /// createCexCachingSolver - Create a counterexample caching solver. This is a
   /// more sophisticated cache which records counterexamples for a constraint
   /// set and uses subset/superset relations among constraints to try and
@@ -16,13 +16,17 @@ namespace klee {
 namespace stats {
 
   extern Statistic cexCacheTime;
+  extern Statistic persistentCacheHits;
+  extern Statistic persistentCacheMisses;
   extern Statistic queries;
   extern Statistic queriesInvalid;
   extern Statistic queriesValid;
   extern Statistic queryCacheHits;
   extern Statistic queryCacheMisses;
   extern Statistic queryConstructTime;
+  extern Statistic queryConstraintsReused;
   extern Statistic queryConstructs;
+  extern Statistic queryContextSwitches;
   extern Statistic queryCounterexamples;
   extern Statistic queryTime;
 
@@ -57,7 +57,7 @@ namespace klee {
     }
 
     template<typename InputIterator>
-    bool satisfies(InputIterator begin, InputIterator end);
+    bool satisfies(InputIterator begin, InputIterator end) const;
   };
   
   class AssignmentEvaluator : public ExprEvaluator {
@@ -95,7 +95,8 @@ namespace klee {
   }
 
   template<typename InputIterator>
-  inline bool Assignment::satisfies(InputIterator begin, InputIterator end) {
+  inline bool Assignment::satisfies(InputIterator begin,
+                                    InputIterator end) const {
     AssignmentEvaluator v(*this);
     for (; begin!=end; ++begin)
       if (!v.visit(*begin)->isTrue())
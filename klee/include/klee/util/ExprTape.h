@@ -0,0 +1,104 @@
+//===-- ExprTape.h ----------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_UTIL_EXPRTAPE_H
+#define KLEE_UTIL_EXPRTAPE_H
+
+#include "klee/Expr.h"
+
+#include <map>
+#include <vector>
+
+namespace klee {
+  class Array;
+  class Assignment;
+
+  /// ExprTape - A set of expressions compiled to a linear sequence of
+  /// instructions, which evaluates them against many assignments at once.
+  ///
+  /// Every node of the expression DAG gets a register, which holds its value
+  /// for each assignment of a batch. Instructions compute a register for the
+  /// whole batch in a tight loop. The arrays that are read get a dense index,
+  /// so that the bindings of an assignment are looked up once per batch
+  /// instead of once per read.
+  ///
+  /// Only expressions whose nodes are at most 64 bits wide can be compiled.
+  /// An assignment leaves the value of an expression undefined when it does
+  /// not bind some byte it reads and allows free values, or when it divides
+  /// by zero. Assignment::evaluate must then be used instead.
+  class ExprTape {
+  public:
+    /// The maximum number of assignments evaluated in one pass
+    static const unsigned MaxLanes = 64;
+
+  private:
+    struct Instruction {
+      uint8_t kind;
+      /// The width of the result
+      uint8_t width;
+      /// The width of the operands of SExt and signed comparisons, the
+      /// width of the right operand of Concat, the offset of Extract.
+      uint8_t aux;
+      unsigned dst, a, b, c;
+    };
+
+    struct Read {
+      /// The dense index of the array
+      unsigned array;
+      /// The registers of the index and value of each update, newest first
+      std::vector< std::pair<unsigned, unsigned> > updates;
+    };
+
+    std::vector< ref<Expr> > roots;
+    std::vector<unsigned> rootRegisters;
+    std::vector<Instruction> instructions;
+    std::vector<Read> reads;
+    std::vector< std::pair<unsigned, uint64_t> > constants;
+    std::vector<const Array*> arrays;
+    unsigned numRegisters;
+    bool valid;
+
+    std::map<const Expr*, unsigned> registers;
+    std::map<const Array*, unsigned> arrayIndexes;
+
+    unsigned compile(const ref<Expr> &e);
+    unsigned getArrayIndex(const Array *array);
+
+    void evaluateBatch(const Assignment * const *assignments, unsigned lanes,
+                       uint64_t *regs, bool *undefined) const;
+
+  public:
+    ExprTape(const std::vector< ref<Expr> > &_roots);
+
+    /// isValid - Whether the expressions could be compiled.
+    bool isValid() const { return valid; }
+
+    unsigned getNumRoots() const { return roots.size(); }
+    unsigned getNumInstructions() const { return instructions.size(); }
+
+    /// getArrays - Return the arrays read by the expressions.
+    const std::vector<const Array*> &getArrays() const { return arrays; }
+
+    /// evaluate - Evaluate the expressions for each assignment.
+    ///
+    /// \param values [out] - The value of each expression, for the first
+    /// assignment, then for the second one, etc.
+    /// \param defined [out] - Whether the values of each assignment are
+    /// defined.
+    void evaluate(const std::vector<const Assignment*> &assignments,
+                  std::vector<uint64_t> &values,
+                  std::vector<bool> &defined) const;
+
+    /// findSatisfying - Return the index of the first assignment for which
+    /// all expressions are true, or -1 if there is none.
+    int findSatisfying(const std::vector<const Assignment*> &assignments) const;
+  };
+}
+
+#endif
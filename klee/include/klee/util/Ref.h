@@ -102,10 +102,16 @@ public:
     return get()->compare(*rhs.get());
   }
 
+  // assumes non-null arguments
+  bool equals(const ref &rhs) const {
+    assert(!isNull() && !rhs.isNull() && "Invalid call to equals()");
+    return get()->equals(*rhs.get());
+  }
+
   // assumes non-null arguments
   bool operator<(const ref &rhs) const { return compare(rhs)<0; }
-  bool operator==(const ref &rhs) const { return compare(rhs)==0; }
-  bool operator!=(const ref &rhs) const { return compare(rhs)!=0; }
+  bool operator==(const ref &rhs) const { return equals(rhs); }
+  bool operator!=(const ref &rhs) const { return !equals(rhs); }
 };
 
 template<class T>
@@ -75,7 +75,8 @@ ExecutionState::ExecutionState(KFunction *kf)
     forkDisabled(false),
     ptreeNode(0),
     concolics(true),
-    speculative(false){
+    speculative(false),
+    speculativeTicket(0) {
   pushFrame(0, kf);
 }
 
@@ -87,7 +88,8 @@ ExecutionState::ExecutionState(const std::vector<ref<Expr> > &assumptions)
     addressSpace(this),
     ptreeNode(0),
     concolics(true),
-    speculative(false) {
+    speculative(false),
+    speculativeTicket(0) {
 }
 
 ExecutionState::~ExecutionState() {
@@ -179,6 +179,18 @@ namespace {
            cl::init(true),
 	   cl::desc("Use validity caching"));
 
+  cl::opt<std::string>
+  PersistentCacheFile("persistent-cache-file",
+                      cl::desc("Keep query validities in this file, shared by "
+                               "all the processes of a run and across runs "
+                               "(default=off)"));
+
+  cl::opt<unsigned>
+  PersistentCacheEntries("persistent-cache-entries",
+                         cl::init(1 << 22),
+                         cl::desc("Number of entries of a new persistent "
+                                  "cache file (default=4M)"));
+
   cl::opt<bool>
   OnlyReplaySeeds("only-replay-seeds", 
                   cl::desc("Discard states that do not have a seed."));
@@ -271,6 +283,19 @@ namespace {
   EnableSpeculativeForking("enable-speculative-forking",
             cl::desc("Enable speculative forking for concolic execution"),
             cl::init(true));
+
+  cl::opt<unsigned>
+  ConcolicSolverWorkers("concolic-solver-workers",
+            cl::desc("Number of STP processes computing the concolic values of "
+                     "speculative states in the background, 0 computes them "
+                     "when the states are selected (default=0)"),
+            cl::init(0));
+
+  cl::opt<unsigned>
+  ConcolicSolverMaxPending("concolic-solver-max-pending",
+            cl::desc("Maximum number of speculative states waiting for their "
+                     "concolic values (default=64)"),
+            cl::init(64));
 }
 
 //S2E: we want these to be accessible in S2E executor
@@ -308,6 +333,10 @@ Solver *constructSolverChain(STPSolver *stpSolver,
   if (UseCexCache)
     solver = createCexCachingSolver(solver);
 
+  if (!PersistentCacheFile.empty())
+    solver = createPersistentCachingSolver(solver, PersistentCacheFile,
+                                           PersistentCacheEntries);
+
   if (UseCache)
     solver = createCachingSolver(solver);
 
@@ -348,6 +377,7 @@ Executor::Executor(const InterpreterOptions &opts,
     interpreterHandler(ih),
     searcher(0),
     externalDispatcher(new ExternalDispatcher(engine)),
+    concolicSolver(0),
     statsTracker(0),
     pathWriter(0),
     symPathWriter(0),
@@ -373,6 +403,12 @@ Executor::Executor(const InterpreterOptions &opts,
   this->solver = NULL;
   initializeSolver();
 
+  if (ConcolicSolverWorkers) {
+    concolicSolver = new BackgroundSolver(ConcolicSolverWorkers,
+                                          ConcolicSolverMaxPending);
+    concolicSolver->setTimeout(stpTimeout);
+  }
+
   memory = new MemoryManager();
 
   //Mandatory for AddressSpace
@@ -418,6 +454,7 @@ Executor::~Executor() {
     delete specialFunctionHandler;
   if (statsTracker)
     delete statsTracker;
+  delete concolicSolver;
   delete solver;
   delete kmodule;
 }
@@ -872,6 +909,10 @@ Executor::concolicFork(ExecutionState &current, ref<Expr> condition, bool isInte
         trueState = branchedState;
     }
 
+    if (concolicSolver) {
+        submitSpeculativeState(*branchedState);
+    }
+
     current.ptreeNode->data = 0;
     std::pair<PTree::Node*, PTree::Node*> res =
       processTree->split(current.ptreeNode, falseState, trueState);
@@ -927,6 +968,91 @@ bool Executor::resolveSpeculativeState(ExecutionState &state)
     return true;
 }
 
+void Executor::submitSpeculativeState(ExecutionState &state)
+{
+    assert(state.isSpeculative() && !state.isSolutionPending());
+
+    //The values must satisfy the speculative condition,
+    //i.e., be a counterexample to its negation.
+    Query query(state.constraints,
+                Expr::createIsZero(state.speculativeCondition));
+
+    std::vector<const Array*> symbObjects;
+    for (unsigned i=0; i<state.symbolics.size(); ++i) {
+        symbObjects.push_back(state.symbolics[i].second);
+    }
+
+    uint64_t ticket = concolicSolver->submit(query, symbObjects);
+    state.speculativeTicket = ticket;
+    pendingSpeculativeStates[ticket] = &state;
+}
+
+void Executor::dropSpeculativeTicket(ExecutionState &state)
+{
+    if (state.isSolutionPending()) {
+        pendingSpeculativeStates.erase(state.speculativeTicket);
+        state.speculativeTicket = 0;
+    }
+}
+
+void Executor::processSpeculativeResults(bool wait)
+{
+    if (!concolicSolver || pendingSpeculativeStates.empty()) {
+        return;
+    }
+
+    std::vector<InitialValuesResult> results;
+    concolicSolver->getResults(results, wait);
+
+    std::set<ExecutionState*> empty;
+
+    for (unsigned i=0; i<results.size(); ++i) {
+        InitialValuesResult &result = results[i];
+
+        //The state may have been terminated in the meantime
+        std::map<uint64_t, ExecutionState*>::iterator it =
+                pendingSpeculativeStates.find(result.ticket);
+        if (it == pendingSpeculativeStates.end()) {
+            continue;
+        }
+
+        ExecutionState &state = *it->second;
+        pendingSpeculativeStates.erase(it);
+        state.speculativeTicket = 0;
+
+        //The state will be resolved when it is selected
+        if (!result.success) {
+            continue;
+        }
+
+        if (!result.hasSolution) {
+            //Speculative state is infeasible
+            terminateState(state);
+            continue;
+        }
+
+        state.addConstraint(state.speculativeCondition);
+        for (unsigned j=0; j<state.symbolics.size(); ++j) {
+            state.concolics.add(state.symbolics[j].second, result.values[j]);
+        }
+        state.speculative = false;
+
+        searcher->update(&state, empty, empty);
+    }
+
+    //Queries can be dropped, e.g., in a new S2E process, whose
+    //background solver does not inherit the queries of its parent.
+    //The corresponding states are resolved when they are selected.
+    if (!concolicSolver->getNumPending()) {
+        for (std::map<uint64_t, ExecutionState*>::iterator it =
+                pendingSpeculativeStates.begin();
+             it != pendingSpeculativeStates.end(); ++it) {
+            it->second->speculativeTicket = 0;
+        }
+        pendingSpeculativeStates.clear();
+    }
+}
+
 
 Executor::StatePair 
 Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
@@ -2857,6 +2983,8 @@ void Executor::terminateState(ExecutionState &state) {
 
   interpreterHandler->incPathsExplored();
 
+  dropSpeculativeTicket(state);
+
   std::set<ExecutionState*>::iterator it = addedStates.find(&state);
   if (it==addedStates.end()) {
     // XXX: the following line makes delayed state termination impossible
@@ -26,7 +26,11 @@
 
 #include <iostream>
 #include <cassert>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
 #include <sstream>
+#include <tr1/unordered_map>
 
 using namespace llvm;
 using namespace klee;
@@ -89,12 +93,101 @@ void MemoryObject::getAllocInfo(std::string &result) const {
 
 /***/
 
+namespace klee {
+/// Immutable concrete store shared by all the object states that have
+/// the same contents. Allocated with the data inline.
+class SharedConcreteStore {
+public:
+  uint64_t hash;
+  unsigned size;
+  unsigned refCount;
+  uint8_t data[1];
+};
+}
+
+namespace {
+typedef std::tr1::unordered_multimap<uint64_t, SharedConcreteStore*>
+  SharedConcreteStores;
+
+// Never freed: object states may still be destroyed at exit
+SharedConcreteStores &getSharedConcreteStores() {
+  static SharedConcreteStores *stores = new SharedConcreteStores();
+  return *stores;
+}
+
+uint64_t hashConcreteStore(const uint8_t *data, unsigned size) {
+  uint64_t hash = 14695981039346656037ULL;
+  unsigned i = 0;
+  for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, data + i, sizeof(word));
+    hash = (hash ^ word) * 1099511628211ULL;
+  }
+  for (; i < size; ++i) {
+    hash = (hash ^ data[i]) * 1099511628211ULL;
+  }
+  return hash ^ size;
+}
+
+/// Returns a referenced store holding data, reusing an existing
+/// one if possible.
+SharedConcreteStore *internConcreteStore(const uint8_t *data, unsigned size,
+                                         bool *found) {
+  SharedConcreteStores &stores = getSharedConcreteStores();
+  uint64_t hash = hashConcreteStore(data, size);
+
+  std::pair<SharedConcreteStores::iterator, SharedConcreteStores::iterator> range =
+      stores.equal_range(hash);
+  for (SharedConcreteStores::iterator it = range.first; it != range.second; ++it) {
+    SharedConcreteStore *store = it->second;
+    if (store->size == size && !memcmp(store->data, data, size)) {
+      ++store->refCount;
+      *found = true;
+      return store;
+    }
+  }
+
+  SharedConcreteStore *store = static_cast<SharedConcreteStore*>(
+      malloc(offsetof(SharedConcreteStore, data) + size));
+  assert(store);
+  store->hash = hash;
+  store->size = size;
+  store->refCount = 1;
+  memcpy(store->data, data, size);
+  stores.insert(std::make_pair(hash, store));
+
+  *found = false;
+  return store;
+}
+
+void releaseConcreteStore(SharedConcreteStore *store) {
+  if (--store->refCount) {
+    return;
+  }
+
+  SharedConcreteStores &stores = getSharedConcreteStores();
+  std::pair<SharedConcreteStores::iterator, SharedConcreteStores::iterator> range =
+      stores.equal_range(store->hash);
+  for (SharedConcreteStores::iterator it = range.first; it != range.second; ++it) {
+    if (it->second == store) {
+      stores.erase(it);
+      break;
+    }
+  }
+
+  free(store);
+}
+}
+
+/***/
+
 ObjectState::ObjectState(const MemoryObject *mo)
   : concreteMask(0),
     copyOnWriteOwner(0),
     refCount(0),
     object(mo),
     concreteStore(new uint8_t[mo->size]),
+    sharedStore(0),
     flushMask(0),
     knownSymbolics(0),
     updates(0, 0),
@@ -116,6 +209,7 @@ ObjectState::ObjectState(const MemoryObject *mo, const Array *array)
     refCount(0),
     object(mo),
     concreteStore(new uint8_t[mo->size]),
+    sharedStore(0),
     flushMask(0),
     knownSymbolics(0),
     updates(array, 0),
@@ -130,7 +224,8 @@ ObjectState::ObjectState(const ObjectState &os)
     copyOnWriteOwner(0),
     refCount(0),
     object(os.object),
-    concreteStore(new uint8_t[os.size]),
+    concreteStore(os.concreteStore),
+    sharedStore(os.sharedStore),
     flushMask(os.flushMask ? new BitArray(*os.flushMask, os.size) : 0),
     knownSymbolics(0),
     updates(os.updates),
@@ -145,14 +240,23 @@ ObjectState::ObjectState(const ObjectState &os)
       knownSymbolics[i] = os.knownSymbolics[i];
   }
 
-  memcpy(concreteStore, os.concreteStore, size*sizeof(*concreteStore));
+  // Shared stores are immutable, they are copied on the first write
+  if (sharedStore) {
+    ++sharedStore->refCount;
+  } else {
+    concreteStore = new uint8_t[size];
+    memcpy(concreteStore, os.concreteStore, size*sizeof(*concreteStore));
+  }
 }
 
 ObjectState::~ObjectState() {
   if (concreteMask) delete concreteMask;
   if (flushMask) delete flushMask;
   if (knownSymbolics) delete[] knownSymbolics;
-  delete[] concreteStore;
+  if (sharedStore)
+    releaseConcreteStore(sharedStore);
+  else
+    delete[] concreteStore;
 }
 
 /***/
@@ -236,11 +340,13 @@ void ObjectState::makeSymbolic() {
 
 void ObjectState::initializeToZero() {
   makeConcrete();
+  unshareConcreteStore();
   memset(concreteStore, 0, size);
 }
 
 void ObjectState::initializeToRandom() {  
   makeConcrete();
+  unshareConcreteStore();
   for (unsigned i=0; i<size; i++) {
     // randomly selected by 256 sided die
     concreteStore[i] = 0xAB;
@@ -331,9 +437,39 @@ uint8_t *ObjectState::getConcreteStore(bool allowSymbolic)
     if (!allowSymbolic && !isAllConcrete()) {
         return NULL;
     }
+    unshareConcreteStore();
     return concreteStore;
 }
 
+bool ObjectState::shareConcreteStore(const uint8_t *data)
+{
+    bool found;
+    SharedConcreteStore *store = internConcreteStore(data, size, &found);
+
+    if (sharedStore)
+        releaseConcreteStore(sharedStore);
+    else
+        delete[] concreteStore;
+
+    sharedStore = store;
+    concreteStore = store->data;
+    return found;
+}
+
+void ObjectState::unshareConcreteStore()
+{
+    if (!sharedStore) {
+        return;
+    }
+
+    uint8_t *store = new uint8_t[size];
+    memcpy(store, concreteStore, size);
+    releaseConcreteStore(sharedStore);
+
+    sharedStore = 0;
+    concreteStore = store;
+}
+
 
 void ObjectState::markByteSymbolic(unsigned offset) {
   if (!concreteMask)
@@ -403,6 +539,7 @@ ref<Expr> ObjectState::read8(ref<Expr> offset) const {
 void ObjectState::write8(unsigned offset, uint8_t value) {
   //assert(read_only == false && "writing to read-only object!");
   if(!object->isSharedConcrete) {
+    unshareConcreteStore();
     concreteStore[offset] = value;
     setKnownSymbolic(offset, 0);
 
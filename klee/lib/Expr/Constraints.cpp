@@ -10,8 +10,10 @@
 #include "klee/Constraints.h"
 
 #include "klee/util/ExprPPrinter.h"
+#include "klee/util/ExprUtil.h"
 #include "klee/util/ExprVisitor.h"
 
+#include <algorithm>
 #include <iostream>
 #include <map>
 
@@ -61,25 +63,52 @@ public:
   }
 };
 
+ConstraintManager::ConstraintManager(const std::vector< ref<Expr> > &_constraints)
+  : nextKey(_constraints.size()), numConstraints(_constraints.size()) {
+  std::vector<constraints_ty::value_type> values;
+  values.reserve(_constraints.size());
+  for (unsigned i = 0; i != _constraints.size(); ++i)
+    values.push_back(std::make_pair(i, _constraints[i]));
+  constraints = constraints_ty::fromSorted(values);
+}
+
+bool ConstraintManager::operator==(const ConstraintManager &other) const {
+  if (size() != other.size())
+    return false;
+  for (const_iterator it = begin(), ie = end(), oit = other.begin();
+       it != ie; ++it, ++oit)
+    if (*it != *oit)
+      return false;
+  return true;
+}
+
 bool ConstraintManager::rewriteConstraints(ExprVisitor &visitor) {
-  ConstraintManager::constraints_ty old;
-  bool changed = false;
+  // The unchanged constraints stay in place, so that they remain shared
+  // with the sets this one was forked from.
+  constraints_ty old = constraints;
+  std::vector< ref<Expr> > rewritten;
 
-  constraints.swap(old);
-  for (ConstraintManager::constraints_ty::iterator 
-         it = old.begin(), ie = old.end(); it != ie; ++it) {
-    ref<Expr> &ce = *it;
+  for (constraints_ty::iterator it = old.begin(), ie = old.end();
+       it != ie; ++it) {
+    const ref<Expr> &ce = it->second;
     ref<Expr> e = visitor.visit(ce);
 
     if (e!=ce) {
-      addConstraintInternal(e); // enable further reductions
-      changed = true;
-    } else {
-      constraints.push_back(ce);
+      constraints = constraints.remove(it->first);
+      --numConstraints;
+      rewritten.push_back(e);
     }
   }
 
-  return changed;
+  if (rewritten.empty())
+    return false;
+
+  // The index is rebuilt on demand
+  index = IndependenceIndex();
+  for (unsigned i = 0; i != rewritten.size(); ++i)
+    addConstraintInternal(rewritten[i]); // enable further reductions
+
+  return true;
 }
 
 void ConstraintManager::simplifyForValidConstraint(ref<Expr> e) {
@@ -92,8 +121,7 @@ ref<Expr> ConstraintManager::simplifyExpr(ref<Expr> e) const {
 
   std::map< ref<Expr>, ref<Expr> > equalities;
   
-  for (ConstraintManager::constraints_ty::const_iterator 
-         it = constraints.begin(), ie = constraints.end(); it != ie; ++it) {
+  for (const_iterator it = begin(), ie = end(); it != ie; ++it) {
     if (const EqExpr *ee = dyn_cast<EqExpr>(*it)) {
       if (isa<ConstantExpr>(ee->left)) {
         equalities.insert(std::make_pair(ee->right,
@@ -140,17 +168,227 @@ void ConstraintManager::addConstraintInternal(ref<Expr> e) {
       ExprReplaceVisitor visitor(be->right, be->left);
       rewriteConstraints(visitor);
     }
-    constraints.push_back(e);
+    pushConstraint(e);
     break;
   }
     
   default:
-    constraints.push_back(e);
+    pushConstraint(e);
     break;
   }
 }
 
+void ConstraintManager::pushConstraint(ref<Expr> e) {
+  unsigned key = nextKey++;
+  constraints = constraints.insert(std::make_pair(key, e));
+  ++numConstraints;
+  if (index.built)
+    indexConstraint(key, e);
+}
+
 void ConstraintManager::addConstraint(ref<Expr> e) {
   e = simplifyExpr(e);
   addConstraintInternal(e);
 }
+
+/***/
+
+unsigned ConstraintManager::IndependenceIndex::find(unsigned key) const {
+  return clusters.lookup(key)->second;
+}
+
+unsigned ConstraintManager::IndependenceIndex::unite(unsigned a, unsigned b) {
+  if (a == b)
+    return a;
+
+  // Move the smaller cluster into the larger one
+  unsigned sizeA = sizes.lookup(a)->second, sizeB = sizes.lookup(b)->second;
+  if (sizeA < sizeB)
+    std::swap(a, b);
+
+  ImmutableMap<std::pair<unsigned, unsigned>, ref<Expr> >::iterator
+    it = members.lower_bound(std::make_pair(b, 0u)), ie = members.end();
+  std::vector< std::pair<unsigned, ref<Expr> > > moved;
+  for (; it != ie && it->first.first == b; ++it)
+    moved.push_back(std::make_pair(it->first.second, it->second));
+
+  for (unsigned i = 0; i != moved.size(); ++i) {
+    unsigned key = moved[i].first;
+    members = members.remove(std::make_pair(b, key));
+    members = members.insert(std::make_pair(std::make_pair(a, key),
+                                            moved[i].second));
+    clusters = clusters.replace(std::make_pair(key, a));
+  }
+
+  sizes = sizes.replace(std::make_pair(a, sizeA + sizeB));
+  sizes = sizes.remove(b);
+  return a;
+}
+
+namespace {
+  struct CompareKeys {
+    bool operator()(const std::pair<unsigned, ref<Expr> > &a,
+                    const std::pair<unsigned, ref<Expr> > &b) const {
+      return a.first < b.first;
+    }
+  };
+}
+
+/// Collect the bytes read by e, or the whole array when it is read at a
+/// symbolic index. Reads of constant arrays without updates are ignored,
+/// they cannot relate constraints.
+static void getReadElements(ref<Expr> e,
+                            std::vector< std::pair<const Array*,
+                                                   unsigned> > &bytes,
+                            std::vector<const Array*> &wholeArrays) {
+  std::vector< ref<ReadExpr> > reads;
+  findReads(e, /* visitUpdates= */ true, reads);
+  for (unsigned i = 0; i != reads.size(); ++i) {
+    ReadExpr *re = reads[i].get();
+    const Array *array = re->updates.root;
+
+    if (array->isConstantArray() && !re->updates.head)
+      continue;
+
+    if (ConstantExpr *CE = dyn_cast<ConstantExpr>(re->index)) {
+      bytes.push_back(std::make_pair(array, (unsigned) CE->getZExtValue(32)));
+    } else {
+      wholeArrays.push_back(array);
+    }
+  }
+}
+
+void ConstraintManager::indexConstraint(unsigned key, ref<Expr> e) const {
+  unsigned cluster = key;
+  index.clusters = index.clusters.insert(std::make_pair(key, key));
+  index.members = index.members.insert(std::make_pair(std::make_pair(key, key),
+                                                      e));
+  index.sizes = index.sizes.insert(std::make_pair(key, 1u));
+
+  std::vector<byte_ty> bytes;
+  std::vector<const Array*> wholeArrays;
+  getReadElements(e, bytes, wholeArrays);
+
+  for (unsigned j = 0; j != wholeArrays.size(); ++j) {
+    const Array *array = wholeArrays[j];
+    if (const std::pair<const Array*, unsigned> *res =
+          index.wholeArrays.lookup(array)) {
+      cluster = index.unite(cluster, index.find(res->second));
+      continue;
+    }
+
+    // All the clusters on bytes of the array join, the bytes need not be
+    // tracked anymore.
+    std::vector<byte_ty> arrayBytes;
+    for (ImmutableMap<byte_ty, unsigned>::iterator
+           it = index.bytes.lower_bound(std::make_pair(array, 0u)),
+           ie = index.bytes.end(); it != ie && it->first.first == array; ++it) {
+      cluster = index.unite(cluster, index.find(it->second));
+      arrayBytes.push_back(it->first);
+    }
+    for (unsigned k = 0; k != arrayBytes.size(); ++k)
+      index.bytes = index.bytes.remove(arrayBytes[k]);
+    index.wholeArrays = index.wholeArrays.insert(std::make_pair(array, key));
+  }
+
+  for (unsigned j = 0; j != bytes.size(); ++j) {
+    if (const std::pair<const Array*, unsigned> *res =
+          index.wholeArrays.lookup(bytes[j].first)) {
+      cluster = index.unite(cluster, index.find(res->second));
+      continue;
+    }
+
+    if (const std::pair<byte_ty, unsigned> *res =
+          index.bytes.lookup(bytes[j])) {
+      cluster = index.unite(cluster, index.find(res->second));
+    } else {
+      index.bytes = index.bytes.insert(std::make_pair(bytes[j], key));
+    }
+  }
+}
+
+void ConstraintManager::getRelatedConstraints(ref<Expr> e,
+                                              std::vector< ref<Expr> > &result)
+  const {
+  if (!index.built) {
+    for (constraints_ty::iterator it = constraints.begin(),
+           ie = constraints.end(); it != ie; ++it)
+      indexConstraint(it->first, it->second);
+    index.built = true;
+  }
+
+  std::vector<byte_ty> bytes;
+  std::vector<const Array*> wholeArrays;
+  getReadElements(e, bytes, wholeArrays);
+
+  std::vector<unsigned> roots;
+  for (unsigned j = 0; j != wholeArrays.size(); ++j) {
+    const Array *array = wholeArrays[j];
+    if (const std::pair<const Array*, unsigned> *res =
+          index.wholeArrays.lookup(array))
+      roots.push_back(index.find(res->second));
+
+    for (ImmutableMap<byte_ty, unsigned>::iterator
+           it = index.bytes.lower_bound(std::make_pair(array, 0u)),
+           ie = index.bytes.end(); it != ie && it->first.first == array; ++it)
+      roots.push_back(index.find(it->second));
+  }
+
+  for (unsigned j = 0; j != bytes.size(); ++j) {
+    if (const std::pair<const Array*, unsigned> *res =
+          index.wholeArrays.lookup(bytes[j].first)) {
+      roots.push_back(index.find(res->second));
+    } else if (const std::pair<byte_ty, unsigned> *res =
+                 index.bytes.lookup(bytes[j])) {
+      roots.push_back(index.find(res->second));
+    }
+  }
+
+  std::sort(roots.begin(), roots.end());
+  roots.erase(std::unique(roots.begin(), roots.end()), roots.end());
+
+  std::vector< std::pair<unsigned, ref<Expr> > > related;
+  for (unsigned j = 0; j != roots.size(); ++j) {
+    for (ImmutableMap<std::pair<unsigned, unsigned>, ref<Expr> >::iterator
+           it = index.members.lower_bound(std::make_pair(roots[j], 0u)),
+           ie = index.members.end(); it != ie && it->first.first == roots[j];
+         ++it)
+      related.push_back(std::make_pair(it->first.second, it->second));
+  }
+  std::sort(related.begin(), related.end(), CompareKeys());
+
+  for (unsigned j = 0; j != related.size(); ++j)
+    result.push_back(related[j].second);
+}
+
+template<class Map>
+static void addMapUsage(const Map &map, uint64_t &exclusive,
+                        uint64_t &shared) {
+  size_t exclusiveNodes = 0, sharedNodes = 0;
+  map.countNodes(exclusiveNodes, sharedNodes);
+  exclusive += exclusiveNodes * Map::getNodeSize();
+  shared += sharedNodes * Map::getNodeSize();
+}
+
+void ConstraintManager::getMemoryUsage(uint64_t &exclusive,
+                                       uint64_t &shared) const {
+  exclusive = shared = 0;
+  addMapUsage(constraints, exclusive, shared);
+  addMapUsage(index.clusters, exclusive, shared);
+  addMapUsage(index.members, exclusive, shared);
+  addMapUsage(index.sizes, exclusive, shared);
+  addMapUsage(index.bytes, exclusive, shared);
+  addMapUsage(index.wholeArrays, exclusive, shared);
+}
+
+uint64_t ConstraintManager::getTotalMemoryUsage() {
+  return constraints_ty::getAllocated() * constraints_ty::getNodeSize() +
+    ImmutableMap<unsigned, unsigned>::getAllocated() *
+      ImmutableMap<unsigned, unsigned>::getNodeSize() +
+    ImmutableMap<std::pair<unsigned, unsigned>, ref<Expr> >::getAllocated() *
+      ImmutableMap<std::pair<unsigned, unsigned>, ref<Expr> >::getNodeSize() +
+    ImmutableMap<byte_ty, unsigned>::getAllocated() *
+      ImmutableMap<byte_ty, unsigned>::getNodeSize() +
+    ImmutableMap<const Array*, unsigned>::getAllocated() *
+      ImmutableMap<const Array*, unsigned>::getNodeSize();
+}
@@ -29,11 +29,149 @@ namespace {
   ConstArrayOpt("const-array-opt",
      cl::init(true),
 	 cl::desc("Enable various optimizations involving all-constant arrays."));
+
+  cl::opt<bool>
+  HashConsExprs("hash-cons-exprs",
+     cl::init(true),
+     cl::desc("Share structurally equal expressions (default=on)"));
 }
 
 /***/
 
 unsigned Expr::count = 0;
+uint64_t Expr::allocCount = 0;
+uint64_t Expr::hashConsHits = 0;
+
+/***/
+
+namespace {
+  /// The hash-consing table. Its buckets are chained through
+  /// Expr::nextInBucket. It is allocated on first use and never freed, so
+  /// that expressions that are destroyed by static destructors can still
+  /// leave it.
+  Expr **exprBuckets;
+  unsigned exprBucketMask;
+  unsigned exprTableSize;
+
+  const unsigned InitialExprBuckets = 4096;
+
+  /// The hashes of expressions are not well distributed in their low bits
+  inline unsigned getBucket(unsigned hash) {
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6b;
+    hash ^= hash >> 13;
+    return hash & exprBucketMask;
+  }
+}
+
+Expr *Expr::intern(Expr *e) {
+  if (!HashConsExprs)
+    return e;
+
+  if (!exprBuckets) {
+    exprBuckets = new Expr*[InitialExprBuckets]();
+    exprBucketMask = InitialExprBuckets - 1;
+  }
+
+  unsigned h = e->hashValue;
+  for (Expr *c = exprBuckets[getBucket(h)]; c; c = c->nextInBucket) {
+    // The kids of both are hash-consed, so this is a shallow comparison
+    if (c->hashValue == h && c->compare(*e) == 0) {
+      ++hashConsHits;
+      return c;
+    }
+  }
+
+  if (exprTableSize > exprBucketMask) {
+    Expr **old = exprBuckets;
+    unsigned oldCount = exprBucketMask + 1;
+
+    exprBuckets = new Expr*[oldCount * 2]();
+    exprBucketMask = oldCount * 2 - 1;
+    for (unsigned i = 0; i < oldCount; ++i) {
+      for (Expr *c = old[i], *next; c; c = next) {
+        next = c->nextInBucket;
+        Expr *&bucket = exprBuckets[getBucket(c->hashValue)];
+        c->nextInBucket = bucket;
+        bucket = c;
+      }
+    }
+    delete[] old;
+  }
+
+  Expr *&bucket = exprBuckets[getBucket(h)];
+  e->nextInBucket = bucket;
+  e->hashConsed = true;
+  bucket = e;
+  ++exprTableSize;
+  return e;
+}
+
+void Expr::unintern(Expr *e) {
+  Expr **prev = &exprBuckets[getBucket(e->hashValue)];
+  while (*prev != e) {
+    assert(*prev && "hash-consed expression not in the table");
+    prev = &(*prev)->nextInBucket;
+  }
+
+  *prev = e->nextInBucket;
+  e->hashConsed = false;
+  --exprTableSize;
+}
+
+/***/
+
+namespace {
+  /// Expressions are carved out of slabs. Freed expressions go to a free
+  /// list per size class, from which expressions of the same size class
+  /// are allocated first. The memory is never returned to the system.
+  const unsigned ExprSizeGranularity = 16;
+  const unsigned ExprSizeClasses = 16;
+  const unsigned ExprSlabSize = 64 * 1024;
+
+  struct FreeExpr {
+    FreeExpr *next;
+  };
+
+  FreeExpr *exprFreeLists[ExprSizeClasses + 1];
+  char *exprSlab, *exprSlabEnd;
+}
+
+void *Expr::operator new(size_t size) {
+  ++allocCount;
+
+  unsigned sizeClass = (size + ExprSizeGranularity - 1) / ExprSizeGranularity;
+  if (sizeClass > ExprSizeClasses)
+    return ::operator new(size);
+
+  if (FreeExpr *free = exprFreeLists[sizeClass]) {
+    exprFreeLists[sizeClass] = free->next;
+    return free;
+  }
+
+  size_t rounded = sizeClass * ExprSizeGranularity;
+  if ((size_t) (exprSlabEnd - exprSlab) < rounded) {
+    // The rest of the previous slab is too small and is lost
+    exprSlab = static_cast<char*>(::operator new(ExprSlabSize));
+    exprSlabEnd = exprSlab + ExprSlabSize;
+  }
+
+  void *p = exprSlab;
+  exprSlab += rounded;
+  return p;
+}
+
+void Expr::operator delete(void *p, size_t size) {
+  unsigned sizeClass = (size + ExprSizeGranularity - 1) / ExprSizeGranularity;
+  if (sizeClass > ExprSizeClasses) {
+    ::operator delete(p);
+    return;
+  }
+
+  FreeExpr *free = static_cast<FreeExpr*>(p);
+  free->next = exprFreeLists[sizeClass];
+  exprFreeLists[sizeClass] = free;
+}
 
 ref<Expr> Expr::createTempRead(const Array *array, Expr::Width w) {
   UpdateList ul(array, 0);
@@ -189,7 +327,7 @@ unsigned ReadExpr::computeHash() {
 }
 
 unsigned NotExpr::computeHash() {
-  unsigned hashValue = expr->hash() * Expr::MAGIC_HASH_CONSTANT * Expr::Not;
+  hashValue = expr->hash() * Expr::MAGIC_HASH_CONSTANT * Expr::Not;
   return hashValue;
 }
 
@@ -0,0 +1,420 @@
+//===-- ExprTape.cpp ------------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/util/ExprTape.h"
+#include "klee/util/Assignment.h"
+
+#include <algorithm>
+
+using namespace klee;
+
+const unsigned ExprTape::MaxLanes;
+
+/***/
+
+static inline uint64_t widthMask(unsigned width) {
+  return width >= 64 ? ~(uint64_t) 0 : ((uint64_t) 1 << width) - 1;
+}
+
+static inline bool isNegative(uint64_t v, unsigned width) {
+  return (v >> (width - 1)) & 1;
+}
+
+static inline int64_t signExtend(uint64_t v, unsigned width) {
+  if (width >= 64)
+    return (int64_t) v;
+  return isNegative(v, width) ? (int64_t) (v | ~widthMask(width)) :
+                                (int64_t) v;
+}
+
+/***/
+
+ExprTape::ExprTape(const std::vector< ref<Expr> > &_roots)
+  : roots(_roots), numRegisters(0), valid(true) {
+  for (unsigned i = 0; i < roots.size() && valid; ++i)
+    rootRegisters.push_back(compile(roots[i]));
+
+  // Only needed while compiling
+  registers.clear();
+  arrayIndexes.clear();
+}
+
+unsigned ExprTape::getArrayIndex(const Array *array) {
+  std::map<const Array*, unsigned>::iterator it = arrayIndexes.find(array);
+  if (it != arrayIndexes.end())
+    return it->second;
+
+  unsigned index = arrays.size();
+  arrays.push_back(array);
+  arrayIndexes.insert(std::make_pair(array, index));
+  return index;
+}
+
+/// Emits the instructions that compute e after the ones of its kids, and
+/// returns the register of e
+unsigned ExprTape::compile(const ref<Expr> &e) {
+  std::map<const Expr*, unsigned>::iterator it = registers.find(e.get());
+  if (it != registers.end())
+    return it->second;
+
+  if (!valid)
+    return 0;
+
+  if (e->getWidth() > 64) {
+    valid = false;
+    return 0;
+  }
+
+  Instruction insn;
+  insn.kind = e->getKind();
+  insn.width = e->getWidth();
+  insn.aux = 0;
+  insn.a = insn.b = insn.c = 0;
+
+  switch (e->getKind()) {
+  case Expr::Constant: {
+    unsigned reg = numRegisters++;
+    constants.push_back(
+        std::make_pair(reg, cast<ConstantExpr>(e)->getZExtValue()));
+    registers.insert(std::make_pair(e.get(), reg));
+    return reg;
+  }
+
+  case Expr::Read: {
+    const ReadExpr *re = cast<ReadExpr>(e);
+    Read read;
+    read.array = getArrayIndex(re->updates.root);
+    for (const UpdateNode *un = re->updates.head; un; un = un->next) {
+      unsigned index = compile(un->index);
+      unsigned value = compile(un->value);
+      read.updates.push_back(std::make_pair(index, value));
+    }
+    insn.a = compile(re->index);
+    insn.b = reads.size();
+    reads.push_back(read);
+    break;
+  }
+
+  case Expr::NotOptimized:
+  case Expr::ZExt:
+    // Values are kept zero-extended, this is a copy
+    insn.kind = Expr::ZExt;
+    insn.a = compile(e->getKid(0));
+    break;
+
+  case Expr::SExt:
+    insn.a = compile(e->getKid(0));
+    insn.aux = e->getKid(0)->getWidth();
+    break;
+
+  case Expr::Extract:
+    insn.a = compile(e->getKid(0));
+    insn.aux = cast<ExtractExpr>(e)->offset;
+    break;
+
+  case Expr::Concat:
+    insn.a = compile(e->getKid(0));
+    insn.b = compile(e->getKid(1));
+    insn.aux = e->getKid(1)->getWidth();
+    break;
+
+  case Expr::Select:
+    insn.a = compile(e->getKid(0));
+    insn.b = compile(e->getKid(1));
+    insn.c = compile(e->getKid(2));
+    break;
+
+  case Expr::Not:
+    insn.a = compile(e->getKid(0));
+    break;
+
+  default:
+    insn.a = compile(e->getKid(0));
+    insn.b = compile(e->getKid(1));
+    insn.aux = e->getKid(0)->getWidth();
+    break;
+  }
+
+  if (!valid)
+    return 0;
+
+  insn.dst = numRegisters++;
+  instructions.push_back(insn);
+  registers.insert(std::make_pair(e.get(), insn.dst));
+  return insn.dst;
+}
+
+/***/
+
+// Lanes are the assignments of a batch. Each register holds one value per
+// lane, and each instruction is a loop over the lanes.
+#define LANES(r) (regs + (r) * lanes)
+
+#define FOREACH_LANE(body)                                      \
+  for (unsigned l = 0; l < lanes; ++l) {                        \
+    body;                                                       \
+  }
+
+void ExprTape::evaluateBatch(const Assignment * const *assignments,
+                             unsigned lanes, uint64_t *regs,
+                             bool *undefined) const {
+  for (unsigned l = 0; l < lanes; ++l)
+    undefined[l] = false;
+
+  for (unsigned i = 0; i < constants.size(); ++i) {
+    uint64_t *dst = LANES(constants[i].first);
+    uint64_t value = constants[i].second;
+    FOREACH_LANE(dst[l] = value);
+  }
+
+  // The bindings of each array, by lane
+  std::vector<const std::vector<unsigned char>*> bindings(arrays.size() * lanes);
+  for (unsigned l = 0; l < lanes; ++l) {
+    const Assignment::bindings_ty &b = assignments[l]->bindings;
+    for (unsigned k = 0; k < arrays.size(); ++k) {
+      Assignment::bindings_ty::const_iterator it = b.find(arrays[k]);
+      bindings[k * lanes + l] = it == b.end() ? 0 : &it->second;
+    }
+  }
+
+  for (unsigned i = 0; i < instructions.size(); ++i) {
+    const Instruction &insn = instructions[i];
+    uint64_t *dst = LANES(insn.dst);
+    const uint64_t *a = LANES(insn.a), *b = LANES(insn.b), *c = LANES(insn.c);
+    uint64_t mask = widthMask(insn.width);
+    unsigned aux = insn.aux;
+
+    switch (insn.kind) {
+    case Expr::Read: {
+      const Read &read = reads[insn.b];
+      const Array *array = arrays[read.array];
+      for (unsigned l = 0; l < lanes; ++l) {
+        uint64_t index = a[l];
+
+        bool found = false;
+        for (unsigned u = 0; u < read.updates.size(); ++u) {
+          if (LANES(read.updates[u].first)[l] == index) {
+            dst[l] = LANES(read.updates[u].second)[l];
+            found = true;
+            break;
+          }
+        }
+        if (found)
+          continue;
+
+        if (array->isConstantArray() && index < array->size) {
+          dst[l] = array->constantValues[index]->getZExtValue(8);
+          continue;
+        }
+
+        const std::vector<unsigned char> *values =
+          bindings[read.array * lanes + l];
+        if (values && index < values->size()) {
+          dst[l] = (*values)[index];
+        } else {
+          dst[l] = 0;
+          if (assignments[l]->allowFreeValues)
+            undefined[l] = true;
+        }
+      }
+      break;
+    }
+
+    case Expr::ZExt:
+      FOREACH_LANE(dst[l] = a[l]);
+      break;
+    case Expr::SExt:
+      FOREACH_LANE(dst[l] = (uint64_t) signExtend(a[l], aux) & mask);
+      break;
+    case Expr::Extract:
+      FOREACH_LANE(dst[l] = (a[l] >> aux) & mask);
+      break;
+    case Expr::Concat:
+      FOREACH_LANE(dst[l] = ((a[l] << aux) | b[l]) & mask);
+      break;
+    case Expr::Select:
+      FOREACH_LANE(dst[l] = a[l] ? b[l] : c[l]);
+      break;
+
+    case Expr::Add:
+      FOREACH_LANE(dst[l] = (a[l] + b[l]) & mask);
+      break;
+    case Expr::Sub:
+      FOREACH_LANE(dst[l] = (a[l] - b[l]) & mask);
+      break;
+    case Expr::Mul:
+      FOREACH_LANE(dst[l] = (a[l] * b[l]) & mask);
+      break;
+
+    // The evaluator leaves divisions by zero unevaluated
+    case Expr::UDiv:
+      FOREACH_LANE(
+        if (!b[l]) { undefined[l] = true; dst[l] = 0; }
+        else dst[l] = a[l] / b[l]);
+      break;
+    case Expr::URem:
+      FOREACH_LANE(
+        if (!b[l]) { undefined[l] = true; dst[l] = 0; }
+        else dst[l] = a[l] % b[l]);
+      break;
+    case Expr::SDiv:
+      // As APInt::sdiv, on the magnitudes
+      for (unsigned l = 0; l < lanes; ++l) {
+        if (!b[l]) {
+          undefined[l] = true;
+          dst[l] = 0;
+          continue;
+        }
+        bool na = isNegative(a[l], aux), nb = isNegative(b[l], aux);
+        uint64_t ua = na ? -a[l] & mask : a[l];
+        uint64_t ub = nb ? -b[l] & mask : b[l];
+        uint64_t q = ua / ub;
+        dst[l] = (na != nb ? -q : q) & mask;
+      }
+      break;
+    case Expr::SRem:
+      // As APInt::srem, the result has the sign of the dividend
+      for (unsigned l = 0; l < lanes; ++l) {
+        if (!b[l]) {
+          undefined[l] = true;
+          dst[l] = 0;
+          continue;
+        }
+        bool na = isNegative(a[l], aux), nb = isNegative(b[l], aux);
+        uint64_t ua = na ? -a[l] & mask : a[l];
+        uint64_t ub = nb ? -b[l] & mask : b[l];
+        uint64_t r = ua % ub;
+        dst[l] = (na ? -r : r) & mask;
+      }
+      break;
+
+    case Expr::Not:
+      FOREACH_LANE(dst[l] = ~a[l] & mask);
+      break;
+    case Expr::And:
+      FOREACH_LANE(dst[l] = a[l] & b[l]);
+      break;
+    case Expr::Or:
+      FOREACH_LANE(dst[l] = a[l] | b[l]);
+      break;
+    case Expr::Xor:
+      FOREACH_LANE(dst[l] = a[l] ^ b[l]);
+      break;
+
+    // Shifting by the width or more gives 0, or the sign for AShr
+    case Expr::Shl:
+      FOREACH_LANE(dst[l] = b[l] >= insn.width ? 0 : (a[l] << b[l]) & mask);
+      break;
+    case Expr::LShr:
+      FOREACH_LANE(dst[l] = b[l] >= insn.width ? 0 : a[l] >> b[l]);
+      break;
+    case Expr::AShr:
+      FOREACH_LANE(
+        int64_t v = signExtend(a[l], insn.width);
+        dst[l] = (uint64_t) (v >> (b[l] >= insn.width ? insn.width - 1 :
+                                                         b[l])) & mask);
+      break;
+
+    case Expr::Eq:
+      FOREACH_LANE(dst[l] = a[l] == b[l]);
+      break;
+    case Expr::Ne:
+      FOREACH_LANE(dst[l] = a[l] != b[l]);
+      break;
+    case Expr::Ult:
+      FOREACH_LANE(dst[l] = a[l] < b[l]);
+      break;
+    case Expr::Ule:
+      FOREACH_LANE(dst[l] = a[l] <= b[l]);
+      break;
+    case Expr::Ugt:
+      FOREACH_LANE(dst[l] = a[l] > b[l]);
+      break;
+    case Expr::Uge:
+      FOREACH_LANE(dst[l] = a[l] >= b[l]);
+      break;
+    case Expr::Slt:
+      FOREACH_LANE(dst[l] = signExtend(a[l], aux) < signExtend(b[l], aux));
+      break;
+    case Expr::Sle:
+      FOREACH_LANE(dst[l] = signExtend(a[l], aux) <= signExtend(b[l], aux));
+      break;
+    case Expr::Sgt:
+      FOREACH_LANE(dst[l] = signExtend(a[l], aux) > signExtend(b[l], aux));
+      break;
+    case Expr::Sge:
+      FOREACH_LANE(dst[l] = signExtend(a[l], aux) >= signExtend(b[l], aux));
+      break;
+
+    default:
+      assert(0 && "invalid instruction in expression tape");
+    }
+  }
+}
+
+#undef FOREACH_LANE
+#undef LANES
+
+void ExprTape::evaluate(const std::vector<const Assignment*> &assignments,
+                        std::vector<uint64_t> &values,
+                        std::vector<bool> &defined) const {
+  assert(valid && "evaluating an expression that could not be compiled");
+
+  values.resize(assignments.size() * roots.size());
+  defined.resize(assignments.size());
+
+  std::vector<uint64_t> regs(numRegisters *
+                             std::min((unsigned) assignments.size(), MaxLanes));
+  bool undefined[MaxLanes];
+
+  for (unsigned first = 0; first < assignments.size(); first += MaxLanes) {
+    unsigned lanes = std::min((unsigned) assignments.size() - first, MaxLanes);
+    evaluateBatch(&assignments[first], lanes,
+                  regs.empty() ? 0 : &regs[0], undefined);
+
+    for (unsigned l = 0; l < lanes; ++l) {
+      defined[first + l] = !undefined[l];
+      for (unsigned i = 0; i < roots.size(); ++i)
+        values[(first + l) * roots.size() + i] =
+          regs[rootRegisters[i] * lanes + l];
+    }
+  }
+}
+
+int ExprTape::findSatisfying(
+    const std::vector<const Assignment*> &assignments) const {
+  assert(valid && "evaluating an expression that could not be compiled");
+
+  std::vector<uint64_t> regs(numRegisters *
+                             std::min((unsigned) assignments.size(), MaxLanes));
+  bool undefined[MaxLanes];
+
+  for (unsigned first = 0; first < assignments.size(); first += MaxLanes) {
+    unsigned lanes = std::min((unsigned) assignments.size() - first, MaxLanes);
+    evaluateBatch(&assignments[first], lanes,
+                  regs.empty() ? 0 : &regs[0], undefined);
+
+    for (unsigned l = 0; l < lanes; ++l) {
+      bool satisfied;
+      if (undefined[l]) {
+        satisfied = assignments[first + l]->satisfies(roots.begin(),
+                                                      roots.end());
+      } else {
+        satisfied = true;
+        for (unsigned i = 0; i < roots.size() && satisfied; ++i)
+          satisfied = regs[rootRegisters[i] * lanes + l];
+      }
+
+      if (satisfied)
+        return first + l;
+    }
+  }
+
+  return -1;
+}
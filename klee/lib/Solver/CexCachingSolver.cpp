@@ -14,6 +14,7 @@
 #include "klee/SolverImpl.h"
 #include "klee/TimerStatIncrementer.h"
 #include "klee/util/Assignment.h"
+#include "klee/util/ExprTape.h"
 #include "klee/util/ExprUtil.h"
 #include "klee/util/ExprVisitor.h"
 #include "klee/Internal/ADT/MapOfSets.h"
@@ -22,6 +23,8 @@
 
 #include "llvm/Support/CommandLine.h"
 
+#include <iterator>
+
 using namespace klee;
 using namespace llvm;
 
@@ -37,6 +40,12 @@ namespace {
   cl::opt<bool>
   CexCacheExperimental("cex-cache-exp", cl::init(false));
 
+  cl::opt<bool>
+  CexCacheCompiled("cex-cache-compiled",
+                   cl::desc("Compile queries to check them against cached "
+                            "counterexamples (default=on)"),
+                   cl::init(true));
+
 }
 
 ///
@@ -86,6 +95,43 @@ public:
 
 ///
 
+/// KeyChecker - Checks assignments against the constraints of a key. Since
+/// compiling the key costs about as much as checking a couple of
+/// assignments, it is only compiled to an ExprTape once more than one
+/// assignment has to be checked.
+class KeyChecker {
+  KeyType &key;
+  ExprTape *tape;
+  unsigned numChecked;
+
+public:
+  KeyChecker(KeyType &_key) : key(_key), tape(0), numChecked(0) {}
+  ~KeyChecker() { delete tape; }
+
+  /// findSatisfying - Return the index of the first assignment which
+  /// satisfies the key, or -1 if there is none.
+  int findSatisfying(const std::vector<const Assignment*> &assignments);
+
+  bool isSatisfiedBy(const Assignment *a) {
+    return findSatisfying(std::vector<const Assignment*>(1, a)) == 0;
+  }
+};
+
+int KeyChecker::findSatisfying(
+    const std::vector<const Assignment*> &assignments) {
+  numChecked += assignments.size();
+  if (CexCacheCompiled && !tape && numChecked > 1)
+    tape = new ExprTape(std::vector< ref<Expr> >(key.begin(), key.end()));
+
+  if (tape && tape->isValid())
+    return tape->findSatisfying(assignments);
+
+  for (unsigned i = 0; i < assignments.size(); ++i)
+    if (assignments[i]->satisfies(key.begin(), key.end()))
+      return i;
+  return -1;
+}
+
 struct NullAssignment {
   bool operator()(Assignment *a) const { return !a; }
 };
@@ -95,12 +141,12 @@ struct NonNullAssignment {
 };
 
 struct NullOrSatisfyingAssignment {
-  KeyType &key;
+  KeyChecker &checker;
   
-  NullOrSatisfyingAssignment(KeyType &_key) : key(_key) {}
+  NullOrSatisfyingAssignment(KeyChecker &_checker) : checker(_checker) {}
 
   bool operator()(Assignment *a) const { 
-    return !a || a->satisfies(key.begin(), key.end()); 
+    return !a || checker.isSatisfiedBy(a);
   }
 };
 
@@ -133,15 +179,16 @@ bool CexCachingSolver::searchForAssignment(KeyType &key, Assignment *&result) {
       return true;
     }
 
-    // Otherwise, iterate through the set of current assignments to see if one
-    // of them satisfies the query.
-    for (assignmentsTable_ty::iterator it = assignmentsTable.begin(), 
-           ie = assignmentsTable.end(); it != ie; ++it) {
-      Assignment *a = *it;
-      if (a->satisfies(key.begin(), key.end())) {
-        result = a;
-        return true;
-      }
+    // Otherwise, check the set of current assignments all at once to see if
+    // one of them satisfies the query.
+    std::vector<const Assignment*> candidates(assignmentsTable.begin(),
+                                              assignmentsTable.end());
+    int index = KeyChecker(key).findSatisfying(candidates);
+    if (index >= 0) {
+      assignmentsTable_ty::iterator it = assignmentsTable.begin();
+      std::advance(it, index);
+      result = *it;
+      return true;
     }
   } else {
     // FIXME: Which order? one is sure to be better.
@@ -155,8 +202,9 @@ bool CexCachingSolver::searchForAssignment(KeyType &key, Assignment *&result) {
     // assignment. While searching subsets, we also explicitly the solutions for
     // satisfiable subsets to see if they solve the current query and return
     // them if so. This is cheap and frequently succeeds.
+    KeyChecker checker(key);
     if (!lookup) 
-      lookup = cache.findSubset(key, NullOrSatisfyingAssignment(key));
+      lookup = cache.findSubset(key, NullOrSatisfyingAssignment(checker));
 
     // If either lookup succeeded, then we have a cached solution.
     if (lookup) {
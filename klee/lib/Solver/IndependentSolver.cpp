@@ -15,6 +15,8 @@
 
 #include "klee/util/ExprUtil.h"
 
+#include "llvm/Support/CommandLine.h"
+
 #include <map>
 #include <vector>
 #include <ostream>
@@ -23,6 +25,15 @@
 using namespace klee;
 using namespace llvm;
 
+namespace {
+  cl::opt<bool>
+  UseIndependenceIndex("use-independence-index",
+                       cl::desc("Look up the constraints related to a query "
+                                "in the index maintained by the constraint "
+                                "manager (default=on)"),
+                       cl::init(true));
+}
+
 template<class T>
 class DenseSet {
   typedef std::set<T> set_ty;
@@ -265,6 +276,14 @@ IndependentElementSet getIndependentConstraints(const Query& query,
   return eltsClosure;
 }
 
+static void getRequiredConstraints(const Query& query,
+                                   std::vector< ref<Expr> > &result) {
+  if (UseIndependenceIndex)
+    query.constraints.getRelatedConstraints(query.expr, result);
+  else
+    getIndependentConstraints(query, result);
+}
+
 class IndependentSolver : public SolverImpl {
 private:
   Solver *solver;
@@ -289,8 +308,7 @@ public:
 bool IndependentSolver::computeValidity(const Query& query,
                                         Solver::Validity &result) {
   std::vector< ref<Expr> > required;
-  IndependentElementSet eltsClosure =
-    getIndependentConstraints(query, required);
+  getRequiredConstraints(query, required);
   ConstraintManager tmp(required);
   return solver->impl->computeValidity(Query(tmp, query.expr), 
                                        result);
@@ -298,8 +316,7 @@ bool IndependentSolver::computeValidity(const Query& query,
 
 bool IndependentSolver::computeTruth(const Query& query, bool &isValid) {
   std::vector< ref<Expr> > required;
-  IndependentElementSet eltsClosure = 
-    getIndependentConstraints(query, required);
+  getRequiredConstraints(query, required);
   ConstraintManager tmp(required);
   return solver->impl->computeTruth(Query(tmp, query.expr), 
                                     isValid);
@@ -307,8 +324,7 @@ bool IndependentSolver::computeTruth(const Query& query, bool &isValid) {
 
 bool IndependentSolver::computeValue(const Query& query, ref<Expr> &result) {
   std::vector< ref<Expr> > required;
-  IndependentElementSet eltsClosure = 
-    getIndependentConstraints(query, required);
+  getRequiredConstraints(query, required);
   ConstraintManager tmp(required);
   return solver->impl->computeValue(Query(tmp, query.expr), result);
 }
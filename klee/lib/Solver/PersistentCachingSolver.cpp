@@ -0,0 +1,484 @@
+//===-- PersistentCachingSolver.cpp - On-disk validity cache --------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Solver.h"
+
+#include "klee/Common.h"
+#include "klee/Constraints.h"
+#include "klee/Expr.h"
+#include "klee/IncompleteSolver.h"
+#include "klee/SolverImpl.h"
+
+#include "klee/SolverStats.h"
+#include "klee/util/ExprHashMap.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace klee;
+
+namespace {
+
+/// Structural hash of expressions that only depends on their contents
+/// (kinds, widths, constants, array names and updates), so that it is
+/// the same in every process and every run.
+///
+/// Every node gets two 64-bit hashes computed from different seeds in
+/// the same traversal: the first one locates the query in the table and
+/// the second one tells apart the queries that land on the same key.
+class StructuralHasher {
+public:
+  typedef std::pair<uint64_t, uint64_t> Hash;
+
+private:
+  ExprHashMap<Hash> cache;
+  Hash seed;
+
+  static uint64_t mix(uint64_t h, uint64_t v) {
+    h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+    return h * 0x100000001b3ULL;
+  }
+
+  static Hash mix(const Hash &h, uint64_t v) {
+    return Hash(mix(h.first, v), mix(h.second, v));
+  }
+
+  static Hash mix(const Hash &h, const Hash &v) {
+    return Hash(mix(h.first, v.first), mix(h.second, v.second));
+  }
+
+  Hash hashString(const std::string &s) {
+    Hash h = seed;
+    for (unsigned i = 0; i < s.size(); ++i)
+      h = mix(h, (uint8_t) s[i]);
+    return mix(h, s.size());
+  }
+
+  Hash hashArray(const Array *array) {
+    Hash h = mix(hashString(array->name), array->size);
+    for (unsigned i = 0; i < array->constantValues.size(); ++i)
+      h = mix(h, hash(array->constantValues[i]));
+    return h;
+  }
+
+public:
+  StructuralHasher(uint64_t seed1, uint64_t seed2) : seed(seed1, seed2) {}
+
+  Hash hash(const ref<Expr> &e) {
+    ExprHashMap<Hash>::iterator it = cache.find(e);
+    if (it != cache.end())
+      return it->second;
+
+    Hash h = mix(mix(seed, e->getKind()), e->getWidth());
+
+    if (const ConstantExpr *ce = dyn_cast<ConstantExpr>(e)) {
+      const llvm::APInt &value = ce->getAPValue();
+      for (unsigned i = 0; i < value.getNumWords(); ++i)
+        h = mix(h, value.getRawData()[i]);
+    } else if (const ReadExpr *re = dyn_cast<ReadExpr>(e)) {
+      h = mix(h, hashArray(re->updates.root));
+      for (const UpdateNode *un = re->updates.head; un; un = un->next) {
+        h = mix(h, hash(un->index));
+        h = mix(h, hash(un->value));
+      }
+      h = mix(h, hash(re->index));
+    } else {
+      if (const ExtractExpr *ee = dyn_cast<ExtractExpr>(e))
+        h = mix(h, ee->offset);
+      for (unsigned i = 0; i < e->getNumKids(); ++i)
+        h = mix(h, hash(e->getKid(i)));
+    }
+
+    cache.insert(std::make_pair(e, h));
+    return h;
+  }
+
+  /// The order of the constraints does not matter
+  Hash hash(const ConstraintManager &constraints, const ref<Expr> &query) {
+    std::vector<Hash> hashes;
+    for (ConstraintManager::constraint_iterator it = constraints.begin();
+         it != constraints.end(); ++it)
+      hashes.push_back(hash(*it));
+
+    std::sort(hashes.begin(), hashes.end());
+    hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+
+    Hash h = mix(seed, hashes.size());
+    for (unsigned i = 0; i < hashes.size(); ++i)
+      h = mix(h, hashes[i]);
+    return mix(h, hash(query));
+  }
+};
+
+/// Memory-mapped open-addressing table of partial validities.
+///
+/// Slots are claimed with an atomic compare-and-swap of the key, and the
+/// result is published with a single 64-bit store. This lets the forked
+/// S2E workers of a run share the table without any other locking.
+class PersistentQueryCache {
+  struct Header {
+    char magic[8];
+    uint64_t capacity;
+    uint64_t count;
+  };
+
+  struct Entry {
+    uint64_t key;
+    /// Upper half: second hash of the query, lower half: result.
+    /// Zero while the entry is being written.
+    uint64_t value;
+  };
+
+  static const char Magic[8];
+  static const unsigned MaxProbes = 32;
+
+  Header *header;
+  Entry *entries;
+  size_t mappedSize;
+
+  static uint64_t encode(uint32_t check, IncompleteSolver::PartialValidity pv) {
+    return ((uint64_t) check << 32) | (uint32_t) (pv + 3);
+  }
+
+public:
+  PersistentQueryCache() : header(0), entries(0), mappedSize(0) {}
+
+  ~PersistentQueryCache() {
+    if (header)
+      munmap(header, mappedSize);
+  }
+
+  bool isOpen() const { return header != 0; }
+
+  bool open(const std::string &path, uint64_t capacity);
+
+  bool lookup(uint64_t key, uint32_t check,
+              IncompleteSolver::PartialValidity &result) const;
+
+  void insert(uint64_t key, uint32_t check,
+              IncompleteSolver::PartialValidity result);
+};
+
+const char PersistentQueryCache::Magic[8] = { 'K', 'L', 'E', 'E', 'Q', 'C', '1', 0 };
+
+bool PersistentQueryCache::open(const std::string &path, uint64_t capacity) {
+  // Power of two, so that the probe sequence is a mask
+  uint64_t cap = 1;
+  while (cap < capacity)
+    cap <<= 1;
+
+  int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd < 0) {
+    klee_warning("could not open the persistent query cache %s", path.c_str());
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    ::close(fd);
+    return false;
+  }
+
+  bool created = st.st_size == 0;
+  if (created) {
+    mappedSize = sizeof(Header) + cap * sizeof(Entry);
+    if (ftruncate(fd, mappedSize) < 0) {
+      klee_warning("could not resize the persistent query cache %s", path.c_str());
+      ::close(fd);
+      return false;
+    }
+  } else {
+    mappedSize = st.st_size;
+  }
+
+  void *map = mmap(NULL, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED) {
+    klee_warning("could not map the persistent query cache %s", path.c_str());
+    return false;
+  }
+
+  header = static_cast<Header*>(map);
+  entries = reinterpret_cast<Entry*>(header + 1);
+
+  if (created) {
+    memcpy(header->magic, Magic, sizeof(Magic));
+    header->capacity = cap;
+    header->count = 0;
+    return true;
+  }
+
+  // Existing caches keep their own capacity
+  uint64_t existing = header->capacity;
+  if (memcmp(header->magic, Magic, sizeof(Magic)) ||
+      !existing || (existing & (existing - 1)) ||
+      mappedSize != sizeof(Header) + existing * sizeof(Entry)) {
+    klee_warning("%s is not a valid persistent query cache", path.c_str());
+    munmap(map, mappedSize);
+    header = 0;
+    entries = 0;
+    return false;
+  }
+
+  return true;
+}
+
+bool PersistentQueryCache::lookup(uint64_t key, uint32_t check,
+                                  IncompleteSolver::PartialValidity &result) const {
+  uint64_t mask = header->capacity - 1;
+  for (unsigned i = 0; i < MaxProbes; ++i) {
+    const volatile Entry &e = entries[(key + i) & mask];
+    uint64_t k = e.key;
+    if (!k)
+      return false;
+    if (k != key)
+      continue;
+
+    uint64_t value = e.value;
+    if ((uint32_t) (value >> 32) != check || !(uint32_t) value)
+      return false;
+
+    result = (IncompleteSolver::PartialValidity) ((int) (uint32_t) value - 3);
+    return true;
+  }
+  return false;
+}
+
+void PersistentQueryCache::insert(uint64_t key, uint32_t check,
+                                  IncompleteSolver::PartialValidity result) {
+  // Keep the probe sequences short
+  if (header->count >= header->capacity / 4 * 3)
+    return;
+
+  uint64_t mask = header->capacity - 1;
+  for (unsigned i = 0; i < MaxProbes; ++i) {
+    volatile Entry &e = entries[(key + i) & mask];
+    uint64_t k = e.key;
+    if (!k) {
+      k = __sync_val_compare_and_swap(&e.key, 0, key);
+      if (!k) {
+        __sync_fetch_and_add(&header->count, 1);
+        k = key;
+      }
+    }
+
+    if (k == key) {
+      e.value = encode(check, result);
+      return;
+    }
+  }
+}
+
+/// Keys are 0 when the slot is free
+uint64_t makeKey(uint64_t h) {
+  return h ? h : 1;
+}
+
+class PersistentCachingSolver : public SolverImpl {
+private:
+  Solver *solver;
+  PersistentQueryCache cache;
+
+  ref<Expr> canonicalizeQuery(ref<Expr> originalQuery, bool &negationUsed);
+
+  /// Location of a query in the table, computed once per query and
+  /// shared by its lookup and its insertion.
+  struct CacheKey {
+    uint64_t key;
+    uint32_t check;
+    bool negationUsed;
+  };
+
+  void computeKey(const Query &query, CacheKey &ck);
+
+  bool cacheLookup(const CacheKey &ck,
+                   IncompleteSolver::PartialValidity &result);
+  void cacheInsert(const CacheKey &ck,
+                   IncompleteSolver::PartialValidity result);
+
+public:
+  PersistentCachingSolver(Solver *s, const std::string &path, uint64_t capacity)
+    : solver(s) {
+    cache.open(path, capacity);
+  }
+  ~PersistentCachingSolver() { delete solver; }
+
+  bool computeValidity(const Query&, Solver::Validity &result);
+  bool computeTruth(const Query&, bool &isValid);
+  bool computeValue(const Query& query, ref<Expr> &result) {
+    return solver->impl->computeValue(query, result);
+  }
+  bool computeInitialValues(const Query& query,
+                            const std::vector<const Array*> &objects,
+                            std::vector< std::vector<unsigned char> > &values,
+                            bool &hasSolution) {
+    return solver->impl->computeInitialValues(query, objects, values,
+                                              hasSolution);
+  }
+};
+
+/// Same canonical form as in the in-memory CachingSolver
+ref<Expr> PersistentCachingSolver::canonicalizeQuery(ref<Expr> originalQuery,
+                                                     bool &negationUsed) {
+  ref<Expr> negatedQuery = Expr::createIsZero(originalQuery);
+
+  if (originalQuery.compare(negatedQuery) < 0) {
+    negationUsed = false;
+    return originalQuery;
+  } else {
+    negationUsed = true;
+    return negatedQuery;
+  }
+}
+
+void PersistentCachingSolver::computeKey(const Query &query, CacheKey &ck) {
+  if (!cache.isOpen())
+    return;
+
+  ref<Expr> canonicalQuery = canonicalizeQuery(query.expr, ck.negationUsed);
+
+  // Two independent hashes make a collision between different queries
+  // (which would return a wrong answer) very unlikely.
+  StructuralHasher hasher(0xcbf29ce484222325ULL, 0x84222325cbf29ce4ULL);
+  StructuralHasher::Hash h = hasher.hash(query.constraints, canonicalQuery);
+  ck.key = makeKey(h.first);
+  ck.check = (uint32_t) h.second;
+}
+
+bool PersistentCachingSolver::cacheLookup(const CacheKey &ck,
+                                          IncompleteSolver::PartialValidity &result) {
+  if (!cache.isOpen())
+    return false;
+
+  if (!cache.lookup(ck.key, ck.check, result))
+    return false;
+
+  if (ck.negationUsed)
+    result = IncompleteSolver::negatePartialValidity(result);
+  return true;
+}
+
+void PersistentCachingSolver::cacheInsert(const CacheKey &ck,
+                                          IncompleteSolver::PartialValidity result) {
+  if (!cache.isOpen())
+    return;
+
+  cache.insert(ck.key, ck.check, ck.negationUsed ?
+               IncompleteSolver::negatePartialValidity(result) : result);
+}
+
+bool PersistentCachingSolver::computeValidity(const Query& query,
+                                              Solver::Validity &result) {
+  CacheKey ck;
+  computeKey(query, ck);
+
+  IncompleteSolver::PartialValidity cachedResult;
+  bool tmp, cacheHit = cacheLookup(ck, cachedResult);
+
+  if (cacheHit) {
+    switch(cachedResult) {
+    case IncompleteSolver::MustBeTrue:
+      ++stats::persistentCacheHits;
+      result = Solver::True;
+      return true;
+    case IncompleteSolver::MustBeFalse:
+      ++stats::persistentCacheHits;
+      result = Solver::False;
+      return true;
+    case IncompleteSolver::TrueOrFalse:
+      ++stats::persistentCacheHits;
+      result = Solver::Unknown;
+      return true;
+    case IncompleteSolver::MayBeTrue:
+      ++stats::persistentCacheHits;
+      if (!solver->impl->computeTruth(query, tmp))
+        return false;
+      result = tmp ? Solver::True : Solver::Unknown;
+      cacheInsert(ck, tmp ? IncompleteSolver::MustBeTrue :
+                               IncompleteSolver::TrueOrFalse);
+      return true;
+    case IncompleteSolver::MayBeFalse:
+      ++stats::persistentCacheHits;
+      if (!solver->impl->computeTruth(query.negateExpr(), tmp))
+        return false;
+      result = tmp ? Solver::False : Solver::Unknown;
+      cacheInsert(ck, tmp ? IncompleteSolver::MustBeFalse :
+                               IncompleteSolver::TrueOrFalse);
+      return true;
+    default: assert(0 && "unreachable");
+    }
+  }
+
+  ++stats::persistentCacheMisses;
+
+  if (!solver->impl->computeValidity(query, result))
+    return false;
+
+  switch (result) {
+  case Solver::True:
+    cachedResult = IncompleteSolver::MustBeTrue; break;
+  case Solver::False:
+    cachedResult = IncompleteSolver::MustBeFalse; break;
+  default:
+    cachedResult = IncompleteSolver::TrueOrFalse; break;
+  }
+
+  cacheInsert(ck, cachedResult);
+  return true;
+}
+
+bool PersistentCachingSolver::computeTruth(const Query& query,
+                                           bool &isValid) {
+  CacheKey ck;
+  computeKey(query, ck);
+
+  IncompleteSolver::PartialValidity cachedResult;
+  bool cacheHit = cacheLookup(ck, cachedResult);
+
+  // a cached result of MayBeTrue forces us to check whether
+  // a False assignment exists.
+  if (cacheHit && cachedResult != IncompleteSolver::MayBeTrue) {
+    ++stats::persistentCacheHits;
+    isValid = (cachedResult == IncompleteSolver::MustBeTrue);
+    return true;
+  }
+
+  ++stats::persistentCacheMisses;
+
+  if (!solver->impl->computeTruth(query, isValid))
+    return false;
+
+  if (isValid) {
+    cachedResult = IncompleteSolver::MustBeTrue;
+  } else if (cacheHit) {
+    assert(cachedResult == IncompleteSolver::MayBeTrue);
+    cachedResult = IncompleteSolver::TrueOrFalse;
+  } else {
+    cachedResult = IncompleteSolver::MayBeFalse;
+  }
+
+  cacheInsert(ck, cachedResult);
+  return true;
+}
+
+}
+
+///
+
+Solver *klee::createPersistentCachingSolver(Solver *_solver,
+                                            std::string path,
+                                            uint64_t capacity) {
+  return new Solver(new PersistentCachingSolver(_solver, path, capacity));
+}
@@ -0,0 +1,987 @@
+//===-- STPWorkerPool.cpp -------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "STPWorkerPool.h"
+#include "STPBuilder.h"
+
+#include "klee/Constraints.h"
+#include "klee/Expr.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <map>
+#include <string>
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace klee;
+
+namespace {
+
+/// Queries solved by a worker before its STP instance is recreated.
+/// Keeping the instance lets identical sub-expressions of consecutive
+/// queries reuse the STP expressions that were already built.
+const unsigned QueriesPerSTPInstance = 256;
+
+enum RecordKind {
+  ArrayRecord,
+  UpdateRecord,
+  ExprRecord,
+  QueryRecord
+};
+
+enum ReplyStatus {
+  ReplySolved,
+  ReplyFailed
+};
+
+/***/
+
+class Writer {
+public:
+  std::vector<unsigned char> buf;
+
+  void put8(uint8_t v) { buf.push_back(v); }
+  void put32(uint32_t v) {
+    for (unsigned i = 0; i < 4; ++i)
+      buf.push_back((v >> (8 * i)) & 0xff);
+  }
+  void put64(uint64_t v) {
+    put32((uint32_t) v);
+    put32((uint32_t) (v >> 32));
+  }
+  void putBytes(const unsigned char *p, unsigned n) {
+    buf.insert(buf.end(), p, p + n);
+  }
+};
+
+class Reader {
+  const unsigned char *pos, *end;
+
+public:
+  bool error;
+
+  Reader(const std::vector<unsigned char> &buf)
+    : pos(buf.empty() ? 0 : &buf[0]), end(pos + buf.size()), error(false) {}
+
+  const unsigned char *get(unsigned n) {
+    static const unsigned char zeros[8] = { 0 };
+    if ((unsigned) (end - pos) < n) {
+      error = true;
+      return n <= sizeof(zeros) ? zeros : 0;
+    }
+    const unsigned char *p = pos;
+    pos += n;
+    return p;
+  }
+
+  uint8_t get8() { return *get(1); }
+  uint32_t get32() {
+    const unsigned char *p = get(4);
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+  }
+  uint64_t get64() {
+    uint64_t lo = get32();
+    return lo | ((uint64_t) get32() << 32);
+  }
+};
+
+/***/
+
+/// Flattens a query into records, so that shared sub-expressions, update
+/// nodes and arrays are sent only once.
+class QueryWriter {
+  Writer &w;
+  std::map<const Expr*, uint32_t> exprs;
+  std::map<const UpdateNode*, uint32_t> updates;
+  std::map<const Array*, uint32_t> arrays;
+
+public:
+  QueryWriter(Writer &_w) : w(_w) {}
+
+  uint32_t write(const Array *array) {
+    std::map<const Array*, uint32_t>::iterator it = arrays.find(array);
+    if (it != arrays.end())
+      return it->second;
+
+    w.put8(ArrayRecord);
+    w.put32(array->name.size());
+    w.putBytes((const unsigned char*) array->name.data(), array->name.size());
+    w.put32(array->size);
+    w.put32(array->constantValues.size());
+    for (unsigned i = 0; i < array->constantValues.size(); ++i)
+      w.put8(array->constantValues[i]->getZExtValue(8));
+
+    uint32_t id = arrays.size();
+    arrays[array] = id;
+    return id;
+  }
+
+  /// Update node ids start at 1, 0 is the empty list
+  uint32_t write(const UpdateNode *un) {
+    if (!un)
+      return 0;
+
+    std::map<const UpdateNode*, uint32_t>::iterator it = updates.find(un);
+    if (it != updates.end())
+      return it->second;
+
+    uint32_t next = write(un->next);
+    uint32_t index = write(un->index);
+    uint32_t value = write(un->value);
+
+    w.put8(UpdateRecord);
+    w.put32(next);
+    w.put32(index);
+    w.put32(value);
+
+    uint32_t id = updates.size() + 1;
+    updates[un] = id;
+    return id;
+  }
+
+  uint32_t write(const ref<Expr> &e) {
+    std::map<const Expr*, uint32_t>::iterator it = exprs.find(e.get());
+    if (it != exprs.end())
+      return it->second;
+
+    std::vector<uint32_t> kids;
+    uint32_t extra = 0, updateList = 0;
+
+    if (const ReadExpr *re = dyn_cast<ReadExpr>(e)) {
+      extra = write(re->updates.root);
+      updateList = write(re->updates.head);
+      kids.push_back(write(re->index));
+    } else if (!isa<ConstantExpr>(e)) {
+      if (const ExtractExpr *ee = dyn_cast<ExtractExpr>(e))
+        extra = ee->offset;
+      for (unsigned i = 0; i < e->getNumKids(); ++i)
+        kids.push_back(write(e->getKid(i)));
+    }
+
+    w.put8(ExprRecord);
+    w.put8(e->getKind());
+    w.put32(e->getWidth());
+
+    if (const ConstantExpr *ce = dyn_cast<ConstantExpr>(e)) {
+      const llvm::APInt &value = ce->getAPValue();
+      w.put32(value.getNumWords());
+      for (unsigned i = 0; i < value.getNumWords(); ++i)
+        w.put64(value.getRawData()[i]);
+    } else {
+      w.put32(extra);
+      w.put32(updateList);
+      w.put32(kids.size());
+      for (unsigned i = 0; i < kids.size(); ++i)
+        w.put32(kids[i]);
+    }
+
+    uint32_t id = exprs.size();
+    exprs[e.get()] = id;
+    return id;
+  }
+
+  void writeQuery(const Query &query, const std::vector<const Array*> &objects) {
+    std::vector<uint32_t> constraints;
+    for (ConstraintManager::const_iterator it = query.constraints.begin(),
+           ie = query.constraints.end(); it != ie; ++it)
+      constraints.push_back(write(*it));
+    uint32_t expr = write(query.expr);
+
+    std::vector<uint32_t> objectIds;
+    for (unsigned i = 0; i < objects.size(); ++i)
+      objectIds.push_back(write(objects[i]));
+
+    w.put8(QueryRecord);
+    w.put32(constraints.size());
+    for (unsigned i = 0; i < constraints.size(); ++i)
+      w.put32(constraints[i]);
+    w.put32(expr);
+    w.put32(objectIds.size());
+    for (unsigned i = 0; i < objectIds.size(); ++i)
+      w.put32(objectIds[i]);
+  }
+};
+
+typedef std::multimap<std::string, const Array*> ArrayMap;
+
+/// Rebuilds a query in a worker. Arrays are looked up by contents in
+/// knownArrays, so that consecutive queries over the same arrays build
+/// equal expressions.
+class QueryReader {
+  Reader &r;
+  ArrayMap &knownArrays;
+
+  std::vector<const Array*> arrays;
+  std::vector< ref<Expr> > exprs;
+  std::vector<UpdateList> updates;
+
+  ref<Expr> kid(uint32_t id) {
+    if (id >= exprs.size()) {
+      r.error = true;
+      return ConstantExpr::alloc(0, Expr::Bool);
+    }
+    return exprs[id];
+  }
+
+  void readArray();
+  void readUpdate();
+  void readExpr();
+
+public:
+  std::vector< ref<Expr> > constraints;
+  ref<Expr> expr;
+  std::vector<const Array*> objects;
+
+  QueryReader(Reader &_r, ArrayMap &_knownArrays)
+    : r(_r), knownArrays(_knownArrays) {
+    updates.push_back(UpdateList(0, 0));
+  }
+
+  bool read();
+};
+
+void QueryReader::readArray() {
+  uint32_t nameSize = r.get32();
+  const unsigned char *name = r.get(nameSize);
+  uint32_t size = r.get32();
+  uint32_t numConstants = r.get32();
+  const unsigned char *constants = r.get(numConstants);
+  if (r.error || (numConstants && numConstants != size)) {
+    r.error = true;
+    return;
+  }
+
+  std::string arrayName((const char*) name, nameSize);
+  std::pair<ArrayMap::iterator, ArrayMap::iterator> range =
+    knownArrays.equal_range(arrayName);
+  for (ArrayMap::iterator it = range.first; it != range.second; ++it) {
+    const Array *array = it->second;
+    if (array->size != size || array->constantValues.size() != numConstants)
+      continue;
+
+    bool same = true;
+    for (unsigned i = 0; i < numConstants && same; ++i)
+      same = array->constantValues[i]->getZExtValue(8) == constants[i];
+
+    if (same) {
+      arrays.push_back(array);
+      return;
+    }
+  }
+
+  std::vector< ref<ConstantExpr> > values;
+  for (unsigned i = 0; i < numConstants; ++i)
+    values.push_back(ConstantExpr::alloc(constants[i], Expr::Int8));
+
+  const Array *array = values.empty() ? new Array(arrayName, size) :
+    new Array(arrayName, size, &values[0], &values[0] + values.size());
+  knownArrays.insert(std::make_pair(arrayName, array));
+  arrays.push_back(array);
+}
+
+void QueryReader::readUpdate() {
+  uint32_t next = r.get32();
+  ref<Expr> index = kid(r.get32());
+  ref<Expr> value = kid(r.get32());
+  if (r.error || next >= updates.size() ||
+      index->getWidth() != Expr::Int32 || value->getWidth() != Expr::Int8) {
+    r.error = true;
+    return;
+  }
+
+  updates.push_back(UpdateList(0, new UpdateNode(updates[next].head,
+                                                 index, value)));
+}
+
+void QueryReader::readExpr() {
+  Expr::Kind kind = (Expr::Kind) r.get8();
+  Expr::Width width = r.get32();
+
+  if (kind == Expr::Constant) {
+    uint32_t numWords = r.get32();
+    std::vector<uint64_t> words;
+    for (unsigned i = 0; i < numWords && !r.error; ++i)
+      words.push_back(r.get64());
+    if (r.error || !width || words.empty()) {
+      r.error = true;
+      return;
+    }
+    llvm::APInt value(width, (unsigned) words.size(), &words[0]);
+    exprs.push_back(ConstantExpr::alloc(value));
+    return;
+  }
+
+  uint32_t extra = r.get32();
+  uint32_t updateList = r.get32();
+  uint32_t numKids = r.get32();
+  std::vector< ref<Expr> > kids;
+  for (unsigned i = 0; i < numKids && !r.error; ++i)
+    kids.push_back(kid(r.get32()));
+  if (r.error)
+    return;
+
+  unsigned expectedKids;
+  switch (kind) {
+  case Expr::Read: case Expr::Extract: case Expr::ZExt: case Expr::SExt:
+  case Expr::Not: case Expr::NotOptimized:
+    expectedKids = 1;
+    break;
+  case Expr::Select:
+    expectedKids = 3;
+    break;
+  default:
+    if (kind < Expr::Concat || kind > Expr::LastKind) {
+      r.error = true;
+      return;
+    }
+    expectedKids = 2;
+    break;
+  }
+
+  if (kids.size() != expectedKids) {
+    r.error = true;
+    return;
+  }
+
+  ref<Expr> e;
+  switch (kind) {
+  case Expr::Read:
+    if (extra >= arrays.size() || updateList >= updates.size()) {
+      r.error = true;
+      return;
+    }
+    e = ReadExpr::alloc(UpdateList(arrays[extra], updates[updateList].head),
+                        kids[0]);
+    break;
+  case Expr::Extract: e = ExtractExpr::alloc(kids[0], extra, width); break;
+  case Expr::ZExt: e = ZExtExpr::alloc(kids[0], width); break;
+  case Expr::SExt: e = SExtExpr::alloc(kids[0], width); break;
+  case Expr::Not: e = NotExpr::alloc(kids[0]); break;
+  case Expr::NotOptimized: e = NotOptimizedExpr::alloc(kids[0]); break;
+  case Expr::Select: e = SelectExpr::alloc(kids[0], kids[1], kids[2]); break;
+  case Expr::Concat: e = ConcatExpr::alloc(kids[0], kids[1]); break;
+
+#define BINARY_EXPR_CASE(T) \
+  case Expr::T: e = T ## Expr::alloc(kids[0], kids[1]); break;
+
+  BINARY_EXPR_CASE(Add);
+  BINARY_EXPR_CASE(Sub);
+  BINARY_EXPR_CASE(Mul);
+  BINARY_EXPR_CASE(UDiv);
+  BINARY_EXPR_CASE(SDiv);
+  BINARY_EXPR_CASE(URem);
+  BINARY_EXPR_CASE(SRem);
+  BINARY_EXPR_CASE(And);
+  BINARY_EXPR_CASE(Or);
+  BINARY_EXPR_CASE(Xor);
+  BINARY_EXPR_CASE(Shl);
+  BINARY_EXPR_CASE(LShr);
+  BINARY_EXPR_CASE(AShr);
+  BINARY_EXPR_CASE(Eq);
+  BINARY_EXPR_CASE(Ne);
+  BINARY_EXPR_CASE(Ult);
+  BINARY_EXPR_CASE(Ule);
+  BINARY_EXPR_CASE(Ugt);
+  BINARY_EXPR_CASE(Uge);
+  BINARY_EXPR_CASE(Slt);
+  BINARY_EXPR_CASE(Sle);
+  BINARY_EXPR_CASE(Sgt);
+  BINARY_EXPR_CASE(Sge);
+
+#undef BINARY_EXPR_CASE
+
+  default:
+    r.error = true;
+    return;
+  }
+
+  exprs.push_back(e);
+}
+
+bool QueryReader::read() {
+  while (!r.error) {
+    switch (r.get8()) {
+    case ArrayRecord: readArray(); break;
+    case UpdateRecord: readUpdate(); break;
+    case ExprRecord: readExpr(); break;
+
+    case QueryRecord: {
+      uint32_t numConstraints = r.get32();
+      for (unsigned i = 0; i < numConstraints && !r.error; ++i)
+        constraints.push_back(kid(r.get32()));
+      expr = kid(r.get32());
+      uint32_t numObjects = r.get32();
+      for (unsigned i = 0; i < numObjects && !r.error; ++i) {
+        uint32_t id = r.get32();
+        if (id >= arrays.size())
+          r.error = true;
+        else
+          objects.push_back(arrays[id]);
+      }
+      return !r.error;
+    }
+
+    default:
+      r.error = true;
+      break;
+    }
+  }
+  return false;
+}
+
+/***/
+
+bool writeMessage(int fd, const std::vector<unsigned char> &payload) {
+  Writer frame;
+  frame.put32(payload.size());
+  frame.putBytes(payload.empty() ? 0 : &payload[0], payload.size());
+
+  const unsigned char *p = &frame.buf[0];
+  size_t left = frame.buf.size();
+  while (left) {
+    ssize_t n = send(fd, p, left, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    p += n;
+    left -= n;
+  }
+  return true;
+}
+
+bool readFully(int fd, unsigned char *p, size_t size) {
+  while (size) {
+    ssize_t n = ::read(fd, p, size);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+bool readMessage(int fd, std::vector<unsigned char> &payload) {
+  unsigned char header[4];
+  if (!readFully(fd, header, sizeof(header)))
+    return false;
+
+  uint32_t size = header[0] | (header[1] << 8) | (header[2] << 16) |
+                  ((uint32_t) header[3] << 24);
+  payload.resize(size);
+  return !size || readFully(fd, &payload[0], size);
+}
+
+/// Decodes the reply to a query over objects of the given sizes
+bool readReply(const std::vector<unsigned char> &payload,
+               const std::vector<unsigned> &sizes, bool &hasSolution,
+               std::vector< std::vector<unsigned char> > &values) {
+  Reader r(payload);
+  if (r.get8() != ReplySolved)
+    return false;
+
+  hasSolution = r.get8();
+  values.clear();
+  if (hasSolution) {
+    for (unsigned k = 0; k < sizes.size(); ++k) {
+      const unsigned char *data = r.get(sizes[k]);
+      if (r.error)
+        break;
+      values.push_back(std::vector<unsigned char>(data, data + sizes[k]));
+    }
+  }
+  return !r.error;
+}
+
+uint64_t getTimeMs() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (uint64_t) tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+/***/
+
+void workerErrorHandler(const char *err_msg) {
+  fprintf(stderr, "error: STP Error: %s\n", err_msg);
+  _exit(-1);
+}
+
+/// One STP instance of a worker, with the arrays of the queries it solved
+class STPInstance {
+  ::VC vc;
+  STPBuilder *builder;
+  ArrayMap arrays;
+
+public:
+  STPInstance()
+    : vc(vc_createValidityChecker()),
+      builder(new STPBuilder(vc)) {
+#ifdef HAVE_EXT_STP
+    vc_setInterfaceFlags(vc, EXPRDELETE, 0);
+#endif
+  }
+
+  ~STPInstance() {
+    // The builder holds the expressions, which refer to the arrays
+    delete builder;
+    for (ArrayMap::iterator it = arrays.begin(); it != arrays.end(); ++it)
+      delete it->second;
+    vc_Destroy(vc);
+  }
+
+  void solve(const std::vector<unsigned char> &request, Writer &reply);
+};
+
+void STPInstance::solve(const std::vector<unsigned char> &request,
+                        Writer &reply) {
+  Reader r(request);
+  QueryReader query(r, arrays);
+
+  if (!query.read()) {
+    reply.put8(ReplyFailed);
+    return;
+  }
+
+  vc_push(vc);
+
+  for (unsigned i = 0; i < query.constraints.size(); ++i)
+    vc_assertFormula(vc, builder->construct(query.constraints[i]));
+
+  ExprHandle q = builder->construct(query.expr);
+  int result = vc_query(vc, q);
+
+  if (result < 0) {
+    vc_pop(vc);
+    reply.put8(ReplyFailed);
+    return;
+  }
+
+  bool hasSolution = !result;
+  reply.put8(ReplySolved);
+  reply.put8(hasSolution);
+
+  if (hasSolution) {
+    for (unsigned i = 0; i < query.objects.size(); ++i) {
+      const Array *array = query.objects[i];
+      for (unsigned offset = 0; offset < array->size; ++offset) {
+        ExprHandle counter =
+          vc_getCounterExample(vc, builder->getInitialRead(array, offset));
+        reply.put8(getBVUnsigned(counter));
+      }
+    }
+  }
+
+  vc_pop(vc);
+}
+
+void workerMain(int fd) {
+  vc_registerErrorHandler(workerErrorHandler);
+
+  STPInstance *stp = 0;
+  unsigned solved = 0;
+
+  std::vector<unsigned char> request;
+  while (readMessage(fd, request)) {
+    if (!stp || solved == QueriesPerSTPInstance) {
+      delete stp;
+      stp = new STPInstance();
+      solved = 0;
+    }
+
+    Writer reply;
+    try {
+      stp->solve(request, reply);
+      ++solved;
+    } catch (...) {
+      // The instance may be in any state
+      delete stp;
+      stp = 0;
+      reply.buf.clear();
+      reply.put8(ReplyFailed);
+    }
+
+    if (!writeMessage(fd, reply.buf))
+      break;
+  }
+
+  // Don't run the exit handlers of the process we were forked from
+  _exit(0);
+}
+
+}
+
+/***/
+
+STPWorkerPool::STPWorkerPool(unsigned _numWorkers)
+  : numWorkers(_numWorkers),
+    owner(getpid()),
+    numRunning(0),
+    nextTicket(1) {
+  assert(numWorkers && "the pool needs at least one worker");
+
+  Worker none = { -1, -1 };
+  workers.resize(numWorkers, none);
+  running.resize(numWorkers);
+  for (unsigned i = 0; i < numWorkers; ++i)
+    running[i].ticket = 0;
+  for (unsigned i = 0; i < numWorkers; ++i)
+    spawn(workers[i]);
+}
+
+STPWorkerPool::~STPWorkerPool() {
+  if (owner != getpid())
+    return;
+
+  for (unsigned i = 0; i < workers.size(); ++i)
+    kill(workers[i]);
+}
+
+bool STPWorkerPool::spawn(Worker &w) {
+  int sv[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+    perror("socketpair() for STP worker");
+    return false;
+  }
+
+  fflush(stdout);
+  fflush(stderr);
+
+  sigset_t sig_mask, sig_mask_old;
+  sigfillset(&sig_mask);
+  sigemptyset(&sig_mask_old);
+  sigprocmask(SIG_SETMASK, &sig_mask, &sig_mask_old);
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    // The worker only talks to us
+    for (unsigned i = 0; i < workers.size(); ++i)
+      if (workers[i].fd >= 0)
+        close(workers[i].fd);
+    close(sv[0]);
+
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    sigprocmask(SIG_SETMASK, &sig_mask_old, NULL);
+    workerMain(sv[1]);
+  }
+
+  sigprocmask(SIG_SETMASK, &sig_mask_old, NULL);
+  close(sv[1]);
+
+  if (pid < 0) {
+    fprintf(stderr, "error: fork failed (for STP worker)\n");
+    close(sv[0]);
+    return false;
+  }
+
+  w.pid = pid;
+  w.fd = sv[0];
+  return true;
+}
+
+void STPWorkerPool::kill(Worker &w) {
+  if (w.pid > 0) {
+    ::kill(w.pid, SIGKILL);
+    while (waitpid(w.pid, NULL, 0) < 0 && errno == EINTR)
+      ;
+  }
+
+  if (w.fd >= 0)
+    close(w.fd);
+
+  w.pid = -1;
+  w.fd = -1;
+}
+
+/// The workers of a pool inherited through fork() belong to the parent
+void STPWorkerPool::checkOwner() {
+  if (owner == getpid())
+    return;
+
+  owner = getpid();
+  for (unsigned i = 0; i < workers.size(); ++i) {
+    if (workers[i].fd >= 0)
+      close(workers[i].fd);
+    workers[i].pid = -1;
+    workers[i].fd = -1;
+  }
+
+  // The submitted queries are the parent's, which gets their results
+  queued.clear();
+  for (unsigned i = 0; i < running.size(); ++i)
+    running[i].ticket = 0;
+  numRunning = 0;
+
+  for (unsigned i = 0; i < workers.size(); ++i)
+    spawn(workers[i]);
+}
+
+void STPWorkerPool::computeInitialValues(std::vector<InitialValuesRequest> &requests,
+                                         double timeout) {
+  checkOwner();
+  assert(!getNumSubmitted() && "the pool is used asynchronously");
+
+  std::vector< std::vector<unsigned char> > messages(requests.size());
+  for (unsigned i = 0; i < requests.size(); ++i) {
+    Writer w;
+    QueryWriter(w).writeQuery(*requests[i].query, requests[i].objects);
+    messages[i].swap(w.buf);
+    requests[i].success = false;
+  }
+
+  // Request being solved by each worker, or -1
+  std::vector<int> assigned(workers.size(), -1);
+  std::vector<uint64_t> deadlines(workers.size(), 0);
+  uint64_t timeoutMs = timeout > 0 ? (uint64_t) (timeout * 1000) : 0;
+
+  unsigned next = 0, pending = requests.size();
+  while (pending) {
+    unsigned busy = 0;
+    for (unsigned i = 0; i < workers.size(); ++i) {
+      if (assigned[i] < 0 && next < requests.size()) {
+        if (workers[i].pid < 0 && !spawn(workers[i]))
+          continue;
+
+        if (!writeMessage(workers[i].fd, messages[next])) {
+          fprintf(stderr, "error: STP worker %d died\n", workers[i].pid);
+          kill(workers[i]);
+          spawn(workers[i]);
+          --pending;
+          ++next;
+          continue;
+        }
+
+        assigned[i] = next++;
+        deadlines[i] = getTimeMs() + timeoutMs;
+      }
+
+      if (assigned[i] >= 0)
+        ++busy;
+    }
+
+    // No worker could be started, the remaining requests fail
+    if (!busy)
+      break;
+
+    std::vector<struct pollfd> fds;
+    std::vector<unsigned> fdWorkers;
+    uint64_t now = getTimeMs(), firstDeadline = 0;
+    for (unsigned i = 0; i < workers.size(); ++i) {
+      if (assigned[i] < 0)
+        continue;
+      struct pollfd pfd = { workers[i].fd, POLLIN, 0 };
+      fds.push_back(pfd);
+      fdWorkers.push_back(i);
+      if (timeoutMs && (!firstDeadline || deadlines[i] < firstDeadline))
+        firstDeadline = deadlines[i];
+    }
+
+    int wait = -1;
+    if (firstDeadline)
+      wait = firstDeadline > now ? (int) (firstDeadline - now) : 0;
+
+    int res = poll(&fds[0], fds.size(), wait);
+    if (res < 0 && errno != EINTR) {
+      perror("poll() for STP workers");
+    }
+
+    now = getTimeMs();
+    for (unsigned j = 0; j < fds.size(); ++j) {
+      unsigned i = fdWorkers[j];
+      InitialValuesRequest &request = requests[assigned[i]];
+
+      if (res > 0 && fds[j].revents) {
+        std::vector<unsigned char> payload;
+        if (!readMessage(workers[i].fd, payload)) {
+          fprintf(stderr, "error: STP did not return successfully\n");
+          kill(workers[i]);
+          spawn(workers[i]);
+        } else {
+          std::vector<unsigned> sizes;
+          for (unsigned k = 0; k < request.objects.size(); ++k)
+            sizes.push_back(request.objects[k]->size);
+          request.success = readReply(payload, sizes, request.hasSolution,
+                                      request.values);
+        }
+      } else if (timeoutMs && now >= deadlines[i]) {
+        fprintf(stderr, "error: STP timed out\n");
+        kill(workers[i]);
+        spawn(workers[i]);
+      } else {
+        continue;
+      }
+
+      assigned[i] = -1;
+      --pending;
+    }
+  }
+}
+
+/***/
+
+uint64_t STPWorkerPool::submit(const Query &query,
+                               const std::vector<const Array*> &objects,
+                               double timeout) {
+  checkOwner();
+
+  queued.push_back(Job());
+  Job &job = queued.back();
+  job.ticket = nextTicket++;
+  job.deadline = 0;
+
+  Writer w;
+  QueryWriter(w).writeQuery(query, objects);
+  job.message.swap(w.buf);
+  for (unsigned i = 0; i < objects.size(); ++i)
+    job.sizes.push_back(objects[i]->size);
+
+  uint64_t ticket = job.ticket;
+  dispatch(timeout);
+  return ticket;
+}
+
+/// Gives the queued queries to the idle workers
+void STPWorkerPool::dispatch(double timeout) {
+  uint64_t timeoutMs = timeout > 0 ? (uint64_t) (timeout * 1000) : 0;
+
+  for (unsigned i = 0; i < workers.size() && !queued.empty(); ++i) {
+    if (running[i].ticket)
+      continue;
+
+    if (workers[i].pid < 0 && !spawn(workers[i]))
+      continue;
+
+    // A worker that died is replaced, the query waits for the next round
+    Job &job = queued.front();
+    if (!writeMessage(workers[i].fd, job.message)) {
+      fprintf(stderr, "error: STP worker %d died\n", workers[i].pid);
+      kill(workers[i]);
+      spawn(workers[i]);
+      continue;
+    }
+
+    job.deadline = timeoutMs ? getTimeMs() + timeoutMs : 0;
+    job.message.clear();
+    std::swap(running[i], job);
+    queued.pop_front();
+    ++numRunning;
+  }
+}
+
+/// Reads the result of the query of a worker that has answered
+void STPWorkerPool::finish(unsigned worker, InitialValuesResult &result) {
+  Job &job = running[worker];
+  result.ticket = job.ticket;
+  result.success = false;
+
+  std::vector<unsigned char> payload;
+  if (!readMessage(workers[worker].fd, payload)) {
+    fprintf(stderr, "error: STP did not return successfully\n");
+    kill(workers[worker]);
+    spawn(workers[worker]);
+  } else {
+    result.success = readReply(payload, job.sizes, result.hasSolution,
+                               result.values);
+  }
+
+  job.ticket = 0;
+  --numRunning;
+}
+
+void STPWorkerPool::collect(std::vector<InitialValuesResult> &results,
+                            int waitMs, double timeout) {
+  checkOwner();
+  dispatch(timeout);
+
+  // No worker could be started, the queued queries fail
+  if (!numRunning) {
+    for (unsigned i = 0; i < queued.size(); ++i) {
+      InitialValuesResult result;
+      result.ticket = queued[i].ticket;
+      results.push_back(result);
+    }
+    queued.clear();
+  }
+
+  uint64_t waitUntil = waitMs > 0 ? getTimeMs() + waitMs : 0;
+  bool collected = false;
+  while (numRunning) {
+    std::vector<struct pollfd> fds;
+    std::vector<unsigned> fdWorkers;
+    uint64_t now = getTimeMs(), firstDeadline = 0;
+    for (unsigned i = 0; i < workers.size(); ++i) {
+      if (!running[i].ticket)
+        continue;
+      struct pollfd pfd = { workers[i].fd, POLLIN, 0 };
+      fds.push_back(pfd);
+      fdWorkers.push_back(i);
+      if (running[i].deadline &&
+          (!firstDeadline || running[i].deadline < firstDeadline))
+        firstDeadline = running[i].deadline;
+    }
+
+    int wait = -1;
+    if (collected || !waitMs)
+      wait = 0;
+    else if (waitUntil)
+      wait = waitUntil > now ? (int) (waitUntil - now) : 0;
+
+    if (firstDeadline) {
+      int untilDeadline = firstDeadline > now ? (int) (firstDeadline - now) : 0;
+      if (wait < 0 || untilDeadline < wait)
+        wait = untilDeadline;
+    }
+
+    int res = poll(&fds[0], fds.size(), wait);
+    if (res < 0 && errno != EINTR) {
+      perror("poll() for STP workers");
+      break;
+    }
+
+    now = getTimeMs();
+    bool progress = false;
+    for (unsigned j = 0; j < fds.size(); ++j) {
+      unsigned i = fdWorkers[j];
+
+      if (res > 0 && fds[j].revents) {
+        results.push_back(InitialValuesResult());
+        finish(i, results.back());
+      } else if (running[i].deadline && now >= running[i].deadline) {
+        fprintf(stderr, "error: STP timed out\n");
+        kill(workers[i]);
+        spawn(workers[i]);
+
+        InitialValuesResult result;
+        result.ticket = running[i].ticket;
+        results.push_back(result);
+        running[i].ticket = 0;
+        --numRunning;
+      } else {
+        continue;
+      }
+
+      progress = true;
+    }
+
+    if (progress) {
+      collected = true;
+      dispatch(timeout);
+    } else if (collected || !waitMs || (waitUntil && now >= waitUntil)) {
+      break;
+    }
+  }
+}
@@ -0,0 +1,92 @@
+//===-- STPWorkerPool.h -----------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_STPWORKERPOOL_H
+#define KLEE_STPWORKERPOOL_H
+
+#include "klee/Solver.h"
+
+#include <sys/types.h>
+#include <deque>
+#include <vector>
+
+namespace klee {
+  class Array;
+
+  /// STPWorkerPool - Long-lived STP processes that solve serialized queries.
+  ///
+  /// The workers are forked once, when the pool is created (or when a query
+  /// is first solved in a process that was forked from the pool owner), so
+  /// the cost of forking a large address space is not paid for every query.
+  /// Queries and counterexamples are exchanged over a socket pair per
+  /// worker. A worker that does not answer within the timeout is killed and
+  /// replaced by a new one.
+  ///
+  /// A pool is used either synchronously, with computeInitialValues, or
+  /// asynchronously, with submit and collect, but not both.
+  class STPWorkerPool {
+    struct Worker {
+      pid_t pid;
+      int fd;
+    };
+
+    /// A query given to submit
+    struct Job {
+      uint64_t ticket;
+      std::vector<unsigned char> message;
+      std::vector<unsigned> sizes;
+      uint64_t deadline;
+    };
+
+    unsigned numWorkers;
+    pid_t owner;
+    std::vector<Worker> workers;
+
+    /// Submitted queries that wait for a worker, and the query solved by
+    /// each worker (ticket 0 when the worker is idle)
+    std::deque<Job> queued;
+    std::vector<Job> running;
+    unsigned numRunning;
+    uint64_t nextTicket;
+
+    bool spawn(Worker &w);
+    void kill(Worker &w);
+    void checkOwner();
+    void dispatch(double timeout);
+    void finish(unsigned worker, InitialValuesResult &result);
+
+  public:
+    STPWorkerPool(unsigned _numWorkers);
+    ~STPWorkerPool();
+
+    unsigned getNumWorkers() const { return numWorkers; }
+
+    /// Solves the requests, up to one per worker at a time.
+    /// \param timeout - Seconds allowed for each query, 0 is off.
+    void computeInitialValues(std::vector<InitialValuesRequest> &requests,
+                              double timeout);
+
+    /// Queues a query for the next idle worker and returns immediately.
+    /// \return The ticket of the query, never 0.
+    uint64_t submit(const Query &query,
+                    const std::vector<const Array*> &objects, double timeout);
+
+    /// Appends the results of the submitted queries that finished.
+    /// \param waitMs - How long to wait for at least one of them when none
+    /// is finished yet; -1 waits as long as needed, 0 does not wait.
+    /// \param timeout - Seconds allowed for each query, 0 is off.
+    void collect(std::vector<InitialValuesResult> &results, int waitMs,
+                 double timeout);
+
+    /// The number of submitted queries that did not finish yet
+    unsigned getNumSubmitted() const { return queued.size() + numRunning; }
+  };
+}
+
+#endif
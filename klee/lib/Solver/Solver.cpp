@@ -13,6 +13,7 @@
 
 #include "klee/SolverStats.h"
 #include "STPBuilder.h"
+#include "STPWorkerPool.h"
 
 #include "klee/Constraints.h"
 #include "klee/Expr.h"
@@ -46,6 +47,22 @@ namespace {
   llvm::cl::opt<bool>
   ReinstantiateSolver("reinstantiate-solver",
                       llvm::cl::init(false));
+
+  llvm::cl::opt<unsigned>
+  STPWorkers("stp-workers",
+             llvm::cl::init(1),
+             llvm::cl::desc("Number of long-lived STP processes used by the "
+                            "forked STP solver, 0 forks for every query "
+                            "(default=1)"));
+
+  llvm::cl::opt<bool>
+  IncrementalSTP("incremental-stp",
+                 llvm::cl::init(false),
+                 llvm::cl::desc("Keep the constraints of the last query "
+                                "asserted in STP and only assert the new "
+                                "ones on the next query. Has no effect when "
+                                "the forked solver uses -stp-workers "
+                                "processes (default=off)"));
 }
 
 /***/
@@ -509,8 +526,19 @@ private:
   STPBuilder *builder;
   double timeout;
   bool useForkedSTP;
+  STPWorkerPool *workerPool;
+
+  /// Whether the constraints are kept asserted between queries. The
+  /// workers have contexts of their own, so this is off with a pool.
+  bool incremental;
+
+  /// The constraints asserted in vc when the solver is incremental, each
+  /// in its own push level.
+  std::vector< ref<Expr> > context;
 
   void reinstantiate();
+  void syncContext(const ConstraintManager &constraints);
+  void resetContext();
 
 public:
   STPSolverImpl(STPSolver *_solver, bool _useForkedSTP);
@@ -518,6 +546,7 @@ public:
 
   char *getConstraintLog(const Query&);
   void setTimeout(double _timeout) { timeout = _timeout; }
+  void setIncremental(bool _incremental);
 
   bool computeTruth(const Query&, bool &isValid);
   bool computeValue(const Query&, ref<Expr> &result);
@@ -525,6 +554,8 @@ public:
                             const std::vector<const Array*> &objects,
                             std::vector< std::vector<unsigned char> > &values,
                             bool &hasSolution);
+
+  void computeInitialValuesConcurrently(std::vector<InitialValuesRequest> &requests);
 };
 
 static unsigned char *shared_memory_ptr;
@@ -541,7 +572,9 @@ STPSolverImpl::STPSolverImpl(STPSolver *_solver, bool _useForkedSTP)
     vc(vc_createValidityChecker()),
     builder(new STPBuilder(vc)),
     timeout(0.0),
-    useForkedSTP(_useForkedSTP)
+    useForkedSTP(_useForkedSTP),
+    workerPool(0),
+    incremental(false)
 {
   assert(vc && "unable to create validity checker");
   assert(builder && "unable to create STPBuilder");
@@ -552,7 +585,13 @@ STPSolverImpl::STPSolverImpl(STPSolver *_solver, bool _useForkedSTP)
 
   vc_registerErrorHandler(::stp_error_handler);
 
-  if (useForkedSTP) {
+  if (useForkedSTP && STPWorkers) {
+#ifdef __MINGW32__
+    assert(false && "Cannot use forked stp solver on Windows");
+#else
+    workerPool = new STPWorkerPool(STPWorkers);
+#endif
+  } else if (useForkedSTP) {
 #ifdef __MINGW32__
     assert(false && "Cannot use forked stp solver on Windows");
 #else
@@ -563,9 +602,15 @@ STPSolverImpl::STPSolverImpl(STPSolver *_solver, bool _useForkedSTP)
     shmctl(shared_memory_id, IPC_RMID, NULL);
 #endif
   }
+
+  if (IncrementalSTP && workerPool)
+    klee_warning("-incremental-stp has no effect with -stp-workers processes, "
+                 "use -stp-workers=0 to keep the constraints between queries");
+  setIncremental(IncrementalSTP);
 }
 
 STPSolverImpl::~STPSolverImpl() {
+  delete workerPool;
   delete builder;
 
   vc_Destroy(vc);
@@ -576,6 +621,7 @@ void STPSolverImpl::reinstantiate()
     //XXX: This seems to cause crashes.
     //Will have to find other ways of preventing slowdown
     if (ReinstantiateSolver) {
+        context.clear();
         delete builder;
         vc_Destroy(vc);
         vc = vc_createValidityChecker();
@@ -589,6 +635,51 @@ void STPSolverImpl::reinstantiate()
     }
 }
 
+/// Brings the asserted constraints in line with the given ones. The levels
+/// past the longest common prefix are popped and the remaining constraints
+/// are pushed, so that consecutive queries on a path only assert the
+/// constraints added since the last one. After a fork or a state switch,
+/// this falls back to rebuilding the context from the common prefix.
+void STPSolverImpl::syncContext(const ConstraintManager &constraints) {
+  ConstraintManager::const_iterator it = constraints.begin(),
+    ie = constraints.end();
+
+  // Expressions are hash-consed, so this is mostly pointer comparisons
+  unsigned common = 0;
+  while (common < context.size() && it != ie && context[common] == *it) {
+    ++common;
+    ++it;
+  }
+
+  stats::queryConstraintsReused += common;
+  if (common < context.size())
+    ++stats::queryContextSwitches;
+
+  while (context.size() > common) {
+    vc_pop(vc);
+    context.pop_back();
+  }
+
+  for (; it != ie; ++it) {
+    vc_push(vc);
+    vc_assertFormula(vc, builder->construct(*it));
+    context.push_back(*it);
+  }
+}
+
+void STPSolverImpl::resetContext() {
+  while (!context.empty()) {
+    vc_pop(vc);
+    context.pop_back();
+  }
+}
+
+void STPSolverImpl::setIncremental(bool _incremental) {
+  if (!_incremental)
+    resetContext();
+  incremental = _incremental && !workerPool;
+}
+
 /***/
 
 STPSolver::STPSolver(bool useForkedSTP)
@@ -604,11 +695,76 @@ void STPSolver::setTimeout(double timeout) {
   static_cast<STPSolverImpl*>(impl)->setTimeout(timeout);
 }
 
+void STPSolver::setIncremental(bool incremental) {
+  static_cast<STPSolverImpl*>(impl)->setIncremental(incremental);
+}
+
+void STPSolver::computeInitialValuesConcurrently(
+    std::vector<InitialValuesRequest> &requests) {
+  static_cast<STPSolverImpl*>(impl)->computeInitialValuesConcurrently(requests);
+}
+
+/***/
+
+BackgroundSolver::BackgroundSolver(unsigned numWorkers, unsigned _maxPending)
+  : pool(0),
+    maxPending(_maxPending ? _maxPending : 1),
+    timeout(0.0)
+{
+#ifdef __MINGW32__
+  assert(false && "Cannot use background stp solver on Windows");
+#else
+  pool = new STPWorkerPool(numWorkers ? numWorkers : 1);
+#endif
+}
+
+BackgroundSolver::~BackgroundSolver() {
+  delete pool;
+}
+
+uint64_t BackgroundSolver::submit(const Query &query,
+                                  const std::vector<const Array*> &objects) {
+  // Make room for the query
+  while (pool->getNumSubmitted() >= maxPending)
+    pool->collect(finished, -1, timeout);
+
+  ++stats::queries;
+  ++stats::queryCounterexamples;
+
+  return pool->submit(query, objects, timeout);
+}
+
+void BackgroundSolver::getResults(std::vector<InitialValuesResult> &results,
+                                  bool wait) {
+  pool->collect(finished, 0, timeout);
+  while (wait && pool->getNumSubmitted())
+    pool->collect(finished, -1, timeout);
+
+  for (unsigned i = 0; i < finished.size(); ++i) {
+    if (!finished[i].success)
+      continue;
+    if (finished[i].hasSolution)
+      ++stats::queriesInvalid;
+    else
+      ++stats::queriesValid;
+  }
+
+  results.insert(results.end(), finished.begin(), finished.end());
+  finished.clear();
+}
+
+unsigned BackgroundSolver::getNumPending() const {
+  return pool->getNumSubmitted() + finished.size();
+}
+
 /***/
 
 char *STPSolverImpl::getConstraintLog(const Query &query) {
+  // The log must only contain the constraints of the query
+  resetContext();
+
   vc_push(vc);
-  for (std::vector< ref<Expr> >::const_iterator it = query.constraints.begin(),
+  for (ConstraintManager::const_iterator it = query.constraints.begin(),
          ie = query.constraints.end(); it != ie; ++it)
     vc_assertFormula(vc, builder->construct(*it));
   assert(query.expr == ConstantExpr::alloc(0, Expr::Bool) &&
@@ -827,15 +983,34 @@ STPSolverImpl::computeInitialValues(const Query &query,
                                     std::vector< std::vector<unsigned char> >
                                       &values,
                                     bool &hasSolution) {
+  if (workerPool) {
+    std::vector<InitialValuesRequest> requests;
+    requests.push_back(InitialValuesRequest(&query, objects));
+    computeInitialValuesConcurrently(requests);
+
+    InitialValuesRequest &request = requests[0];
+    if (request.success) {
+      hasSolution = request.hasSolution;
+      values.swap(request.values);
+    }
+    return request.success;
+  }
+
   TimerStatIncrementer t(stats::queryTime);
 
   reinstantiate();
 
-  vc_push(vc);
-
-  for (ConstraintManager::const_iterator it = query.constraints.begin(),
-         ie = query.constraints.end(); it != ie; ++it)
-    vc_assertFormula(vc, builder->construct(*it));
+  // The query itself is checked in a level of its own, on top of the
+  // constraints kept by the incremental mode
+  if (incremental) {
+    syncContext(query.constraints);
+    vc_push(vc);
+  } else {
+    vc_push(vc);
+    for (ConstraintManager::const_iterator it = query.constraints.begin(),
+           ie = query.constraints.end(); it != ie; ++it)
+      vc_assertFormula(vc, builder->construct(*it));
+  }
 
   ++stats::queries;
   ++stats::queryCounterexamples;
@@ -885,3 +1060,32 @@ STPSolverImpl::computeInitialValues(const Query &query,
 
   return success;
 }
+
+void STPSolverImpl::computeInitialValuesConcurrently(
+    std::vector<InitialValuesRequest> &requests) {
+  if (!workerPool) {
+    for (unsigned i = 0; i < requests.size(); ++i) {
+      InitialValuesRequest &request = requests[i];
+      request.success = computeInitialValues(*request.query, request.objects,
+                                             request.values,
+                                             request.hasSolution);
+    }
+    return;
+  }
+
+  TimerStatIncrementer t(stats::queryTime);
+
+  stats::queries += requests.size();
+  stats::queryCounterexamples += requests.size();
+
+  workerPool->computeInitialValues(requests, timeout);
+
+  for (unsigned i = 0; i < requests.size(); ++i) {
+    if (!requests[i].success)
+      continue;
+    if (requests[i].hasSolution)
+      ++stats::queriesInvalid;
+    else
+      ++stats::queriesValid;
+  }
+}
@@ -12,12 +12,16 @@
 using namespace klee;
 
 Statistic stats::cexCacheTime("CexCacheTime", "CCtime");
+Statistic stats::persistentCacheHits("PersistentCacheHits", "PChits");
+Statistic stats::persistentCacheMisses("PersistentCacheMisses", "PCmisses");
 Statistic stats::queries("Queries", "Q");
 Statistic stats::queriesInvalid("QueriesInvalid", "Qiv");
 Statistic stats::queriesValid("QueriesValid", "Qv");
 Statistic stats::queryCacheHits("QueryCacheHits", "QChits") ;
 Statistic stats::queryCacheMisses("QueryCacheMisses", "QCmisses");
 Statistic stats::queryConstructTime("QueryConstructTime", "QBtime") ;
+Statistic stats::queryConstraintsReused("QueryConstraintsReused", "QCreused");
 Statistic stats::queryConstructs("QueriesConstructs", "QB");
+Statistic stats::queryContextSwitches("QueryContextSwitches", "QCswitches");
 Statistic stats::queryCounterexamples("QueriesCEX", "Qcex");
 Statistic stats::queryTime("QueryTime", "Qtime");
@@ -1,4 +1,5 @@
 #include <iostream>
+#include <list>
 
 #include "expr/Lexer.h"
 #include "expr/Parser.h"
@@ -8,6 +9,8 @@
 #include "klee/ExprBuilder.h"
 #include "klee/Solver.h"
 #include "klee/Statistics.h"
+#include "klee/Internal/System/Time.h"
+#include "klee/util/ExprHashMap.h"
 #include "klee/util/ExprPPrinter.h"
 #include "klee/util/ExprVisitor.h"
 
@@ -32,7 +35,8 @@ namespace {
   enum ToolActions {
     PrintTokens,
     PrintAST,
-    Evaluate
+    Evaluate,
+    BenchmarkBuild
   };
 
   static llvm::cl::opt<ToolActions> 
@@ -45,6 +49,8 @@ namespace {
                         "Print parsed AST nodes from the input file."),
              clEnumValN(Evaluate, "evaluate",
                         "Print parsed AST nodes from the input file."),
+             clEnumValN(BenchmarkBuild, "benchmark-build",
+                        "Report the cost of building the expressions of the input file."),
              clEnumValEnd));
 
   enum BuilderKinds {
@@ -77,6 +83,17 @@ namespace {
   cl::opt<bool>
   UseSTPQueryPCLog("use-stp-query-pc-log",
                    cl::init(false));
+
+  cl::opt<bool>
+  UseForkedSTP("use-forked-stp",
+               cl::desc("Run STP in separate processes (see -stp-workers)"),
+               cl::init(false));
+
+  cl::opt<bool>
+  SolveConcurrently("solve-concurrently",
+                    cl::desc("Submit all counterexample queries to STP at "
+                             "once, bypassing the other solvers"),
+                    cl::init(false));
 }
 
 static std::string escapedString(const char *start, unsigned length) {
@@ -165,7 +182,7 @@ static bool EvaluateInputAST(const char *Filename,
 
   // FIXME: Support choice of solver.
   Solver *S, *STP = S = 
-    UseDummySolver ? createDummySolver() : new STPSolver(false);
+    UseDummySolver ? createDummySolver() : new STPSolver(UseForkedSTP);
   if (UseSTPQueryPCLog)
     S = createPCLoggingSolver(S, "stp-queries.pc");
   if (UseFastCexSolver)
@@ -176,7 +193,28 @@ static bool EvaluateInputAST(const char *Filename,
   if (0)
     S = createValidatingSolver(S, STP);
 
-  unsigned Index = 0;
+  double StartTime = util::getWallTime();
+
+  // With -solve-concurrently, the counterexample queries are solved up front
+  // and their results are printed in order by the loop below.
+  std::list<ConstraintManager> BatchConstraints;
+  std::list<Query> BatchQueries;
+  std::vector<InitialValuesRequest> Batch;
+  if (SolveConcurrently && !UseDummySolver) {
+    for (std::vector<Decl*>::iterator it = Decls.begin(),
+           ie = Decls.end(); it != ie; ++it) {
+      QueryCommand *QC = dyn_cast<QueryCommand>(*it);
+      if (!QC || QC->Objects.empty())
+        continue;
+      BatchConstraints.push_back(ConstraintManager(QC->Constraints));
+      BatchQueries.push_back(Query(BatchConstraints.back(), QC->Query));
+      Batch.push_back(InitialValuesRequest(&BatchQueries.back(), QC->Objects));
+    }
+
+    static_cast<STPSolver*>(STP)->computeInitialValuesConcurrently(Batch);
+  }
+
+  unsigned Index = 0, BatchIndex = 0;
   for (std::vector<Decl*>::iterator it = Decls.begin(),
          ie = Decls.end(); it != ie; ++it) {
     Decl *D = *it;
@@ -210,10 +248,19 @@ static bool EvaluateInputAST(const char *Filename,
         }
       } else {
         std::vector< std::vector<unsigned char> > result;
-        
-        if (S->getInitialValues(Query(ConstraintManager(QC->Constraints), 
-                                      QC->Query),
-                                QC->Objects, result)) {
+        bool hasSolution;
+
+        if (!Batch.empty()) {
+          InitialValuesRequest &R = Batch[BatchIndex++];
+          hasSolution = R.success && R.hasSolution;
+          result.swap(R.values);
+        } else {
+          hasSolution = S->getInitialValues(
+              Query(ConstraintManager(QC->Constraints), QC->Query),
+              QC->Objects, result);
+        }
+
+        if (hasSolution) {
           std::cout << "INVALID\n";
 
           for (unsigned i = 0, e = result.size(); i != e; ++i) {
@@ -246,6 +293,8 @@ static bool EvaluateInputAST(const char *Filename,
 
   delete S;
 
+  double ElapsedTime = util::getWallTime() - StartTime;
+
   if (uint64_t queries = *theStatisticManager->getStatisticByName("Queries")) {
     std::cout 
       << "--\n"
@@ -257,9 +306,70 @@ static bool EvaluateInputAST(const char *Filename,
       << "invalid queries = " 
       << *theStatisticManager->getStatisticByName("QueriesInvalid") << "\n"
       << "query cex = " 
-      << *theStatisticManager->getStatisticByName("QueriesCEX") << "\n";
+      << *theStatisticManager->getStatisticByName("QueriesCEX") << "\n"
+      << "elapsed time = " << ElapsedTime << "s\n"
+      << "queries per second = " << queries / ElapsedTime << "\n";
+  }
+
+  return success;
+}
+
+static bool BenchmarkInputAST(const char *Filename,
+                              const MemoryBuffer *MB,
+                              ExprBuilder *Builder) {
+  std::vector<Decl*> Decls;
+  uint64_t StartAllocs = Expr::allocCount;
+  uint64_t StartHits = Expr::hashConsHits;
+  unsigned StartLive = Expr::count;
+  double StartTime = util::getWallTime();
+
+  Parser *P = Parser::Create(Filename, MB, Builder);
+  P->SetMaxErrors(20);
+  while (Decl *D = P->ParseTopLevelDecl()) {
+    Decls.push_back(D);
+  }
+
+  double BuildTime = util::getWallTime() - StartTime;
+
+  bool success = true;
+  if (unsigned N = P->GetNumErrors()) {
+    std::cerr << Filename << ": parse failure: "
+               << N << " errors.\n";
+    success = false;
   }
 
+  // Deduplicate the constraints of all queries, as the caches of the
+  // solver chain do.
+  StartTime = util::getWallTime();
+  unsigned NumQueries = 0, NumConstraints = 0;
+  ExprHashSet Unique;
+  for (std::vector<Decl*>::iterator it = Decls.begin(),
+         ie = Decls.end(); it != ie; ++it) {
+    if (QueryCommand *QC = dyn_cast<QueryCommand>(*it)) {
+      ++NumQueries;
+      NumConstraints += QC->Constraints.size();
+      Unique.insert(QC->Constraints.begin(), QC->Constraints.end());
+      Unique.insert(QC->Query);
+    }
+  }
+  double DedupTime = util::getWallTime() - StartTime;
+
+  std::cout
+    << "queries = " << NumQueries << "\n"
+    << "constraints = " << NumConstraints << "\n"
+    << "unique expressions = " << Unique.size() << "\n"
+    << "allocated expressions = " << Expr::allocCount - StartAllocs << "\n"
+    << "shared expressions = " << Expr::hashConsHits - StartHits << "\n"
+    << "live expressions = " << Expr::count - StartLive << "\n"
+    << "build time = " << BuildTime << "s\n"
+    << "dedup time = " << DedupTime << "s\n";
+
+  Unique.clear();
+  for (std::vector<Decl*>::iterator it = Decls.begin(),
+         ie = Decls.end(); it != ie; ++it)
+    delete *it;
+  delete P;
+
   return success;
 }
 
@@ -304,6 +414,10 @@ int main(int argc, char **argv) {
     success = EvaluateInputAST(InputFile=="-" ? "<stdin>" : InputFile.c_str(),
                                MB.get(), Builder);
     break;
+  case BenchmarkBuild:
+    success = BenchmarkInputAST(InputFile=="-" ? "<stdin>" : InputFile.c_str(),
+                                MB.get(), Builder);
+    break;
   default:
     std::cerr << argv[0] << ": error: Unknown program action!\n";
   }
@@ -10,7 +10,10 @@
 #include <iostream>
 #include "gtest/gtest.h"
 
+#include "klee/Constraints.h"
 #include "klee/Expr.h"
+#include "klee/util/Assignment.h"
+#include "klee/util/ExprTape.h"
 
 using namespace klee;
 
@@ -110,4 +113,264 @@ TEST(ExprTest, ExtractConcat) {
   EXPECT_EQ(Expr::Extract, concat2->getKid(1)->getKind());
 }
 
+TEST(ExprTest, HashConsing) {
+  Array *array = new Array("arr4", 256);
+  unsigned live = Expr::count;
+
+  {
+    // Built separately, with separate update lists
+    ref<Expr> a = AddExpr::create(getConstant(3, 32),
+                                  Expr::createTempRead(array, 32));
+    ref<Expr> b = AddExpr::create(getConstant(3, 32),
+                                  Expr::createTempRead(array, 32));
+    EXPECT_EQ(a.get(), b.get());
+    EXPECT_EQ(a->getKid(1).get(), b->getKid(1).get());
+
+    ref<Expr> c = AddExpr::create(getConstant(4, 32),
+                                  Expr::createTempRead(array, 32));
+    EXPECT_NE(a.get(), c.get());
+    EXPECT_NE(a, c);
+    EXPECT_EQ(a->getKid(1).get(), c->getKid(1).get());
+
+    ref<Expr> n1 = NotExpr::create(a);
+    ref<Expr> n2 = NotExpr::create(b);
+    EXPECT_EQ(n1.get(), n2.get());
+
+    ref<Expr> e1 = ExtractExpr::create(a, 8, Expr::Int8);
+    ref<Expr> e2 = ExtractExpr::create(b, 8, Expr::Int8);
+    ref<Expr> e3 = ExtractExpr::create(b, 16, Expr::Int8);
+    EXPECT_EQ(e1.get(), e2.get());
+    EXPECT_NE(e1.get(), e3.get());
+  }
+
+  // The table does not keep the expressions alive
+  EXPECT_EQ(live, Expr::count);
+
+  ref<Expr> x = SExtExpr::create(Expr::createTempRead(array, 8), Expr::Int32);
+  ref<Expr> y = SExtExpr::create(Expr::createTempRead(array, 8), Expr::Int32);
+  EXPECT_EQ(x.get(), y.get());
+}
+
+ref<Expr> createBinary(Expr::Kind k, ref<Expr> l, ref<Expr> r) {
+  std::vector<Expr::CreateArg> args;
+  args.push_back(l);
+  args.push_back(r);
+  return Expr::createFromKind(k, args);
+}
+
+TEST(ExprTest, ExprTape) {
+  Array *array = new Array("arr5", 8);
+  UpdateList ul(array, 0);
+  ref<Expr> bytes[8];
+  for (unsigned i = 0; i < 8; ++i)
+    bytes[i] = ReadExpr::create(ul, getConstant(i, Expr::Int32));
+
+  ref<Expr> x = ConcatExpr::create4(bytes[3], bytes[2], bytes[1], bytes[0]);
+  ref<Expr> y = ConcatExpr::create4(bytes[7], bytes[6], bytes[5], bytes[4]);
+  ref<Expr> wx = ZExtExpr::create(x, Expr::Int64);
+  ref<Expr> wy = SExtExpr::create(y, Expr::Int64);
+  ref<Expr> shift = AndExpr::create(y, getConstant(39, Expr::Int32));
+
+  UpdateList written(array, 0);
+  written.extend(AndExpr::create(x, getConstant(7, Expr::Int32)), bytes[5]);
+
+  ref<ConstantExpr> values[8];
+  for (unsigned i = 0; i < 8; ++i)
+    values[i] = ConstantExpr::alloc(i + 1, Expr::Int8);
+  Array *constants = new Array("const5", 8, values, values + 8);
+  UpdateList cul(constants, 0);
+
+  std::vector< ref<Expr> > exprs;
+  for (int k = Expr::Add; k <= Expr::Sge; ++k) {
+    if (k == Expr::Not)
+      continue;
+    exprs.push_back(createBinary((Expr::Kind) k, x, y));
+    exprs.push_back(createBinary((Expr::Kind) k, wx, wy));
+  }
+  exprs.push_back(ShlExpr::create(x, shift));
+  exprs.push_back(LShrExpr::create(x, shift));
+  exprs.push_back(AShrExpr::create(x, shift));
+  exprs.push_back(NotExpr::create(x));
+  exprs.push_back(SExtExpr::create(ExtractExpr::create(x, 3, 9),
+                                   Expr::Int64));
+  exprs.push_back(SelectExpr::create(SltExpr::create(x, y), wx, wy));
+  exprs.push_back(ReadExpr::create(written,
+                                   AndExpr::create(y, getConstant(7, 32))));
+  exprs.push_back(ReadExpr::create(cul,
+                                   AndExpr::create(y, getConstant(15, 32))));
+
+  ExprTape tape(exprs);
+  ASSERT_TRUE(tape.isValid());
+  EXPECT_EQ(2U, tape.getArrays().size());
+
+  // Random assignments, plus corner cases of the signed operations
+  std::vector<Assignment> assignments;
+  uint64_t seed = 1;
+  for (unsigned i = 0; i < 100; ++i) {
+    std::vector<unsigned char> data;
+    for (unsigned j = 0; j < 8; ++j) {
+      seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+      data.push_back(seed >> 56);
+    }
+    assignments.push_back(Assignment());
+    assignments.back().add(array, data);
+  }
+
+  unsigned char corners[][8] = {
+    { 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 0, 0, 0x80, 0xff, 0xff, 0xff, 0xff },
+    { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff },
+    { 0xfe, 0xff, 0xff, 0xff, 32, 0, 0, 0 }
+  };
+  for (unsigned i = 0; i < 4; ++i) {
+    assignments.push_back(Assignment());
+    assignments.back().add(array, std::vector<unsigned char>(corners[i],
+                                                             corners[i] + 8));
+  }
+
+  // No binding and free values, reads stay symbolic
+  assignments.push_back(Assignment(true));
+
+  std::vector<const Assignment*> batch;
+  for (unsigned i = 0; i < assignments.size(); ++i)
+    batch.push_back(&assignments[i]);
+
+  std::vector<uint64_t> results;
+  std::vector<bool> defined;
+  tape.evaluate(batch, results, defined);
+  ASSERT_EQ(batch.size() * exprs.size(), results.size());
+
+  unsigned numDefined = 0;
+  for (unsigned i = 0; i < batch.size(); ++i) {
+    if (!defined[i])
+      continue;
+    ++numDefined;
+    for (unsigned j = 0; j < exprs.size(); ++j) {
+      ref<Expr> expected = batch[i]->evaluate(exprs[j]);
+      ASSERT_TRUE(isa<ConstantExpr>(expected));
+      EXPECT_EQ(cast<ConstantExpr>(expected)->getZExtValue(),
+                results[i * exprs.size() + j])
+        << "assignment " << i << ", expression " << exprs[j];
+    }
+  }
+
+  // Only divisions by zero and free values are left to the evaluator
+  EXPECT_LE(100U, numDefined);
+  EXPECT_FALSE(defined[100]);
+  EXPECT_FALSE(defined[assignments.size() - 1]);
+
+  std::vector< ref<Expr> > constraints;
+  constraints.push_back(EqExpr::create(getConstant(0x80, 8), bytes[3]));
+  constraints.push_back(EqExpr::create(getConstant(0xff, 8), bytes[4]));
+  ExprTape constraintTape(constraints);
+  EXPECT_EQ(101, constraintTape.findSatisfying(batch));
+  batch.erase(batch.begin() + 101);
+  EXPECT_EQ(-1, constraintTape.findSatisfying(batch));
+}
+
+TEST(ExprTest, ConstraintIndependence) {
+  Array *a = new Array("arr6", 8);
+  Array *b = new Array("arr7", 8);
+  UpdateList aul(a, 0), bul(b, 0);
+  ref<Expr> as[8], bs[8];
+  for (unsigned i = 0; i < 8; ++i) {
+    as[i] = ReadExpr::create(aul, getConstant(i, Expr::Int32));
+    bs[i] = ReadExpr::create(bul, getConstant(i, Expr::Int32));
+  }
+
+  std::vector< ref<Expr> > c;
+  c.push_back(UltExpr::create(as[0], getConstant(10, 8)));
+  c.push_back(UltExpr::create(bs[0], getConstant(5, 8)));
+  c.push_back(UltExpr::create(as[1], bs[0]));
+  // Reads all of b
+  c.push_back(UltExpr::create(
+                ReadExpr::create(bul, ZExtExpr::create(as[2], Expr::Int32)),
+                getConstant(3, 8)));
+  c.push_back(UltExpr::create(as[5], getConstant(7, 8)));
+
+  ConstraintManager cm;
+  cm.addConstraint(c[0]);
+  cm.addConstraint(c[1]);
+
+  // The index is built by the first lookup, then maintained
+  std::vector< ref<Expr> > related;
+  cm.getRelatedConstraints(as[0], related);
+  ASSERT_EQ(1U, related.size());
+  EXPECT_EQ(c[0], related[0]);
+
+  for (unsigned i = 2; i < c.size(); ++i)
+    cm.addConstraint(c[i]);
+  ConstraintManager forked(cm);
+
+  related.clear();
+  cm.getRelatedConstraints(as[1], related);
+  ASSERT_EQ(3U, related.size());
+  EXPECT_EQ(c[1], related[0]);
+  EXPECT_EQ(c[2], related[1]);
+  EXPECT_EQ(c[3], related[2]);
+
+  related.clear();
+  cm.getRelatedConstraints(bs[7], related);
+  EXPECT_EQ(3U, related.size());
+
+  related.clear();
+  cm.getRelatedConstraints(as[6], related);
+  EXPECT_EQ(0U, related.size());
+
+  related.clear();
+  cm.getRelatedConstraints(ReadExpr::create(aul, ZExtExpr::create(bs[5],
+                                                                Expr::Int32)),
+                           related);
+  EXPECT_EQ(c.size(), related.size());
+
+  // Rewriting the constraints with a known equality drops c[4]
+  ref<Expr> eq = EqExpr::create(getConstant(4, 8), as[5]);
+  forked.addConstraint(eq);
+  related.clear();
+  forked.getRelatedConstraints(as[5], related);
+  ASSERT_EQ(1U, related.size());
+  EXPECT_EQ(eq, related[0]);
+
+  // The original set is unaffected by the fork
+  related.clear();
+  cm.getRelatedConstraints(as[5], related);
+  ASSERT_EQ(1U, related.size());
+  EXPECT_EQ(c[4], related[0]);
+}
+
+TEST(ExprTest, ConstraintSharing) {
+  Array *array = new Array("arr8", 64);
+  UpdateList ul(array, 0);
+  ConstraintManager base;
+  for (unsigned i = 0; i < 64; ++i)
+    base.addConstraint(UltExpr::create(
+                         ReadExpr::create(ul, getConstant(i, Expr::Int32)),
+                         getConstant(100, 8)));
+
+  uint64_t exclusive, shared;
+  base.getMemoryUsage(exclusive, shared);
+  EXPECT_LT(0U, exclusive);
+  EXPECT_EQ(0U, shared);
+
+  // Forked sets share all but the path to their new constraint
+  ConstraintManager forked(base);
+  ref<Expr> c = UltExpr::create(ReadExpr::create(ul, getConstant(0, 32)),
+                                getConstant(50, 8));
+  forked.addConstraint(c);
+  EXPECT_EQ(64U, base.size());
+  EXPECT_EQ(65U, forked.size());
+  EXPECT_EQ(c, forked.back());
+
+  uint64_t forkedExclusive, forkedShared;
+  forked.getMemoryUsage(forkedExclusive, forkedShared);
+  EXPECT_LT(0U, forkedShared);
+  EXPECT_LT(forkedExclusive, forkedShared);
+
+  std::vector< ref<Expr> > constraints(base.begin(), base.end());
+  EXPECT_TRUE(ConstraintManager(constraints) == base);
+  constraints.push_back(c);
+  EXPECT_TRUE(ConstraintManager(constraints) == forked);
+  EXPECT_FALSE(forked == base);
+}
+
 }
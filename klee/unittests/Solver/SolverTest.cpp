@@ -7,7 +7,10 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include <algorithm>
 #include <iostream>
+#include <cstdlib>
+#include <unistd.h>
 #include "gtest/gtest.h"
 
 #include "klee/Constraints.h"
@@ -163,4 +166,161 @@ TEST(SolverTest, Evaluation) {
   delete solver;
 }
 
+TEST(SolverTest, PersistentCache) {
+  char path[] = "/tmp/klee-query-cache-XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_NE(-1, fd);
+  close(fd);
+  unlink(path);
+
+  Array *array = new Array("persistent", 4);
+  ref<Expr> x = Expr::createTempRead(array, Expr::Int32);
+  ref<Expr> c1 = UltExpr::create(x, getConstant(100, Expr::Int32));
+  ref<Expr> c2 = NeExpr::create(x, getConstant(7, Expr::Int32));
+  ref<Expr> query = EqExpr::create(x, getConstant(50, Expr::Int32));
+
+  ConstraintManager constraints;
+  constraints.addConstraint(c1);
+  constraints.addConstraint(c2);
+
+  Solver::Validity result;
+  Solver *solver = createPersistentCachingSolver(new STPSolver(true), path, 1024);
+  ASSERT_TRUE(solver->evaluate(Query(constraints, query), result));
+  EXPECT_EQ(Solver::Unknown, result);
+  delete solver;
+
+  // A solver that always fails can only answer from the cache, which
+  // does not depend on the order of the constraints
+  ConstraintManager reordered;
+  reordered.addConstraint(c2);
+  reordered.addConstraint(c1);
+
+  solver = createPersistentCachingSolver(createDummySolver(), path, 1024);
+  EXPECT_TRUE(solver->evaluate(Query(reordered, query), result));
+  EXPECT_EQ(Solver::Unknown, result);
+
+  bool res;
+  ref<Expr> other = UltExpr::create(x, getConstant(200, Expr::Int32));
+  EXPECT_FALSE(solver->mustBeTrue(Query(reordered, other), res));
+  delete solver;
+
+  unlink(path);
+}
+
+TEST(SolverTest, IncrementalSTP) {
+  Array *array = new Array("incremental", 4);
+  ref<Expr> x = Expr::createTempRead(array, Expr::Int32);
+  std::vector<const Array*> objects(1, array);
+
+  ref<Expr> lt100 = UltExpr::create(x, getConstant(100, Expr::Int32));
+  ref<Expr> ne7 = NeExpr::create(x, getConstant(7, Expr::Int32));
+  ref<Expr> gt50 = UgtExpr::create(x, getConstant(50, Expr::Int32));
+  ref<Expr> lt52 = UltExpr::create(x, getConstant(52, Expr::Int32));
+  ref<Expr> le50 = UleExpr::create(x, getConstant(50, Expr::Int32));
+  ref<Expr> eq51 = EqExpr::create(x, getConstant(51, Expr::Int32));
+
+  // Queries of a path that goes deeper, then of a path that forked
+  // before the last two constraints, which pops them
+  std::vector<ConstraintManager> paths(4);
+  paths[0].addConstraint(lt100);
+  paths[0].addConstraint(ne7);
+  paths[1] = paths[0];
+  paths[1].addConstraint(gt50);
+  paths[2] = paths[1];
+  paths[2].addConstraint(lt52);
+  paths[3] = paths[0];
+  paths[3].addConstraint(le50);
+
+  ref<Expr> exprs[] = { eq51, gt50, le50, ne7 };
+
+  STPSolver incrementalSolver(false);
+  incrementalSolver.setIncremental(true);
+  STPSolver plainSolver(false);
+  plainSolver.setIncremental(false);
+
+  for (unsigned i = 0; i < paths.size(); ++i) {
+    for (unsigned j = 0; j < sizeof(exprs) / sizeof(exprs[0]); ++j) {
+      Query query(paths[i], exprs[j]);
+
+      Solver::Validity expected, result;
+      ASSERT_TRUE(plainSolver.evaluate(query, expected));
+      ASSERT_TRUE(incrementalSolver.evaluate(query, result));
+      EXPECT_EQ(expected, result) << "path " << i << " expr " << j;
+    }
+
+    std::vector< std::vector<unsigned char> > expected, values;
+    Query query(paths[i], getConstant(0, Expr::Bool));
+    ASSERT_TRUE(plainSolver.getInitialValues(query, objects, expected));
+    ASSERT_TRUE(incrementalSolver.getInitialValues(query, objects, values));
+    ASSERT_EQ(1u, values.size());
+    ASSERT_EQ(4u, values[0].size());
+
+    // The values may differ, the constraints must hold for both
+    uint32_t value = values[0][0] | (values[0][1] << 8) |
+                     (values[0][2] << 16) | ((uint32_t) values[0][3] << 24);
+    EXPECT_LT(value, 100u);
+    EXPECT_NE(value, 7u);
+    if (i == 1 || i == 2)
+      EXPECT_GT(value, 50u);
+    if (i == 2)
+      EXPECT_EQ(51u, value);
+    if (i == 3)
+      EXPECT_LE(value, 50u);
+  }
+
+  // Going back to the deepest path pushes its constraints again
+  bool res;
+  ASSERT_TRUE(incrementalSolver.mustBeTrue(Query(paths[2], eq51), res));
+  EXPECT_TRUE(res);
+  ASSERT_TRUE(incrementalSolver.mustBeFalse(Query(paths[3], gt50), res));
+  EXPECT_TRUE(res);
+}
+
+TEST(SolverTest, BackgroundSolver) {
+  Array *array = new Array("background", 4);
+  ref<Expr> x = Expr::createTempRead(array, Expr::Int32);
+  std::vector<const Array*> objects(1, array);
+
+  // More queries than may be pending, so that submit has to wait
+  BackgroundSolver solver(2, 3);
+  std::vector<uint64_t> tickets;
+  for (unsigned i = 0; i < 8; ++i) {
+    // The constraints do not need to outlive submit
+    ConstraintManager constraints;
+    constraints.addConstraint(EqExpr::create(x, getConstant(i, Expr::Int32)));
+    tickets.push_back(solver.submit(Query(constraints, getConstant(0, Expr::Bool)),
+                                    objects));
+    EXPECT_LE(solver.getNumPending(), 8u);
+  }
+
+  ConstraintManager unsat;
+  unsat.addConstraint(UltExpr::create(x, getConstant(1, Expr::Int32)));
+  unsat.addConstraint(UgtExpr::create(x, getConstant(2, Expr::Int32)));
+  uint64_t unsatTicket = solver.submit(Query(unsat, getConstant(0, Expr::Bool)),
+                                       objects);
+
+  std::vector<InitialValuesResult> results;
+  solver.getResults(results, true);
+  ASSERT_EQ(9u, results.size());
+  EXPECT_EQ(0u, solver.getNumPending());
+
+  for (unsigned i = 0; i < results.size(); ++i) {
+    const InitialValuesResult &result = results[i];
+    ASSERT_TRUE(result.success);
+
+    if (result.ticket == unsatTicket) {
+      EXPECT_FALSE(result.hasSolution);
+      continue;
+    }
+
+    unsigned index = std::find(tickets.begin(), tickets.end(), result.ticket) -
+                     tickets.begin();
+    ASSERT_LT(index, tickets.size());
+    ASSERT_TRUE(result.hasSolution);
+    ASSERT_EQ(1u, result.values.size());
+    ASSERT_EQ(4u, result.values[0].size());
+    EXPECT_EQ(index, result.values[0][0]);
+  }
+}
+
 }
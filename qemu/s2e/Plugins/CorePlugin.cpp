@@ -65,6 +65,10 @@ using namespace s2e;
 
 extern "C" {
     unsigned g_s2e_enable_mmio_checks = 0;
+
+    uint8_t g_s2e_hijacked_pages[1 << (32 - S2E_HIJACK_PAGE_BITS - 3)];
+    unsigned g_s2e_hijack_high_pages = 0;
+    unsigned g_s2e_hijack_all_pages = 1;
 }
 
 static void s2e_timer_cb(void *opaque)
@@ -77,6 +81,37 @@ static void s2e_timer_cb(void *opaque)
     qemu_mod_timer(c->getTimer(), qemu_get_clock_ms(rt_clock) + 1000);
 }
 
+void CorePlugin::clearHijackedPages()
+{
+    memset(g_s2e_hijacked_pages, 0, sizeof(g_s2e_hijacked_pages));
+    g_s2e_hijack_high_pages = 0;
+}
+
+void CorePlugin::addHijackedPages(uint64_t address, uint64_t size)
+{
+    if (!size) {
+        return;
+    }
+
+    uint64_t first = address >> S2E_HIJACK_PAGE_BITS;
+    uint64_t last = (address + size - 1) >> S2E_HIJACK_PAGE_BITS;
+    uint64_t lowPages = (uint64_t) 1 << (32 - S2E_HIJACK_PAGE_BITS);
+
+    //The range wraps around the end of the address space
+    if (last < first) {
+        last = ~(uint64_t) 0 >> S2E_HIJACK_PAGE_BITS;
+    }
+
+    if (last >= lowPages) {
+        g_s2e_hijack_high_pages = 1;
+        last = lowPages - 1;
+    }
+
+    for (uint64_t page = first; page <= last; ++page) {
+        g_s2e_hijacked_pages[page >> 3] |= 1 << (page & 7);
+    }
+}
+
 void CorePlugin::initializeTimers()
 {
     s2e()->getDebugStream() << "Initializing periodic timer" << '\n';
@@ -103,6 +103,19 @@ public:
         g_s2e_enable_mmio_checks = enable;
     }
 
+    /**
+     * When enabled, onHijackMemoryRead/Write are only emitted for accesses
+     * to pages marked with addHijackedPages(). Other accesses stay on the
+     * native path and never build klee expressions.
+     * The plugin that connects to these signals owns the filter.
+     */
+    void enableHijackPageFilter(bool enable) {
+        g_s2e_hijack_all_pages = !enable;
+    }
+
+    void clearHijackedPages();
+    void addHijackedPages(uint64_t address, uint64_t size);
+
     inline bool isPortSymbolic(uint16_t port) const {
         if (m_isPortSymbolicCb) {
             return m_isPortSymbolicCb(port, m_isPortSymbolicOpaque);
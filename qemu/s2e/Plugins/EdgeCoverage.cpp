@@ -0,0 +1,273 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in the S2E-AUTHORS file.
+ */
+
+#include <llvm/Support/TimeValue.h>
+
+#include <s2e/S2E.h>
+#include <s2e/ConfigFile.h>
+#include <s2e/Utils.h>
+#include <s2e/Plugins/ExecutionTracers/TraceEntries.h>
+
+#include "EdgeCoverage.h"
+
+#include <stdio.h>
+
+namespace s2e {
+namespace plugins {
+
+S2E_DEFINE_PLUGIN(EdgeCoverage, "Edge coverage bitmap shared by all S2E processes", "EdgeCoverage");
+
+//Spreads the block addresses, which are often aligned, over the map
+static inline uint32_t hashPc(uint64_t pc)
+{
+    pc ^= pc >> 33;
+    pc *= 0xff51afd7ed558ccdULL;
+    pc ^= pc >> 33;
+    return (uint32_t) pc & (EdgeCoverageShared::MAP_SIZE - 1);
+}
+
+EdgeCoverage::~EdgeCoverage()
+{
+    if (m_writeInterval) {
+        writeBitmap();
+    }
+}
+
+void EdgeCoverage::initialize()
+{
+    ConfigFile *cfg = s2e()->getConfig();
+
+    //Only record the edges between blocks of the modules configured
+    //in ModuleExecutionDetector
+    bool moduleOnly = cfg->getBool(getConfigKey() + ".moduleOnly", false);
+
+    //Seconds between two writes of the bitmap, 0 to never write it
+    m_writeInterval = cfg->getInt(getConfigKey() + ".writeInterval", 10);
+
+    m_fileName = s2e()->getOutputFilename("EdgeCoverage.bitmap");
+    m_prevLoc = 0;
+    m_elapsedTics = 0;
+    m_writtenEdgeCount = (uint64_t) -1;
+
+    if (moduleOnly) {
+        ModuleExecutionDetector *detector =
+                static_cast<ModuleExecutionDetector*>(s2e()->getPlugin("ModuleExecutionDetector"));
+        if (!detector) {
+            s2e()->getWarningsStream() << "EdgeCoverage: moduleOnly requires ModuleExecutionDetector\n";
+            exit(-1);
+        }
+
+        detector->onModuleTranslateBlockStart.connect(
+                sigc::mem_fun(*this, &EdgeCoverage::onModuleTranslateBlockStart));
+    } else {
+        s2e()->getCorePlugin()->onTranslateBlockStart.connect(
+                sigc::mem_fun(*this, &EdgeCoverage::onTranslateBlockStart));
+    }
+
+    s2e()->getCorePlugin()->onStateSwitch.connect(
+            sigc::mem_fun(*this, &EdgeCoverage::onStateSwitch));
+
+    s2e()->getCorePlugin()->onStateFork.connect(
+            sigc::mem_fun(*this, &EdgeCoverage::onStateFork));
+
+    if (m_writeInterval) {
+        s2e()->getCorePlugin()->onTimer.connect(
+                sigc::mem_fun(*this, &EdgeCoverage::onTimer));
+
+        s2e()->getCorePlugin()->onProcessFork.connect(
+                sigc::mem_fun(*this, &EdgeCoverage::onProcessFork));
+    }
+}
+
+void EdgeCoverage::onTranslateBlockStart(ExecutionSignal *signal,
+                                         S2EExecutionState *state,
+                                         TranslationBlock *tb,
+                                         uint64_t pc)
+{
+    signal->connect(
+        sigc::mem_fun(*this, &EdgeCoverage::onExecuteBlockStart)
+    );
+}
+
+void EdgeCoverage::onModuleTranslateBlockStart(ExecutionSignal *signal,
+                                               S2EExecutionState *state,
+                                               const ModuleDescriptor &module,
+                                               TranslationBlock *tb,
+                                               uint64_t pc)
+{
+    signal->connect(
+        sigc::mem_fun(*this, &EdgeCoverage::onExecuteBlockStart)
+    );
+}
+
+void EdgeCoverage::onExecuteBlockStart(S2EExecutionState *state, uint64_t pc)
+{
+    uint32_t cur = hashPc(pc);
+    uint32_t edge = cur ^ m_prevLoc;
+    m_prevLoc = cur >> 1;
+
+    uint8_t *counter = &m_shared.get()->bitmap[edge];
+    uint8_t value = *counter;
+
+    if (value == 0) {
+        //Only one process wins the race for a new edge
+        if (__sync_bool_compare_and_swap(counter, 0, 1)) {
+            onNewEdgeFound(state, pc, edge);
+        }
+    } else if (value != 0xff) {
+        //Lost updates only make the counter lower
+        *counter = value + 1;
+    }
+}
+
+void EdgeCoverage::onNewEdgeFound(S2EExecutionState *state, uint64_t pc, uint32_t edge)
+{
+    EdgeCoverageShared *shared = m_shared.get();
+    AtomicFunctions::add(&shared->edgeCount, 1);
+    AtomicFunctions::write(&shared->timeOfLastNewEdge, llvm::sys::TimeValue::now().seconds());
+
+    DECLARE_PLUGINSTATE(EdgeCoverageState, state);
+    ++plgState->m_newEdges;
+
+    onNewEdge.emit(state, pc, edge);
+}
+
+uint64_t EdgeCoverage::getNewEdgeCount(S2EExecutionState *state)
+{
+    DECLARE_PLUGINSTATE(EdgeCoverageState, state);
+    return plgState->m_newEdges;
+}
+
+void EdgeCoverage::onStateSwitch(S2EExecutionState *currentState,
+                                 S2EExecutionState *nextState)
+{
+    if (currentState) {
+        DECLARE_PLUGINSTATE_N(EdgeCoverageState, current, currentState);
+        current->m_prevLoc = m_prevLoc;
+    }
+
+    DECLARE_PLUGINSTATE_N(EdgeCoverageState, next, nextState);
+    m_prevLoc = next->m_prevLoc;
+}
+
+void EdgeCoverage::onStateFork(S2EExecutionState *state,
+                               const std::vector<S2EExecutionState*> &newStates,
+                               const std::vector<klee::ref<klee::Expr> > &newConditions)
+{
+    //The states were cloned from the value saved at the last switch
+    for (unsigned i = 0; i < newStates.size(); ++i) {
+        DECLARE_PLUGINSTATE(EdgeCoverageState, newStates[i]);
+        plgState->m_prevLoc = m_prevLoc;
+    }
+}
+
+void EdgeCoverage::onTimer()
+{
+    if (++m_elapsedTics < m_writeInterval) {
+        return;
+    }
+
+    m_elapsedTics = 0;
+    if (getEdgeCount() != m_writtenEdgeCount) {
+        writeBitmap();
+    }
+}
+
+void EdgeCoverage::onProcessFork(bool preFork, bool isChild, unsigned parentProcId)
+{
+    //The child has its own output directory
+    if (!preFork && isChild) {
+        m_fileName = s2e()->getOutputFilename("EdgeCoverage.bitmap");
+        m_writtenEdgeCount = (uint64_t) -1;
+    }
+}
+
+bool EdgeCoverage::writeBitmap()
+{
+    const EdgeCoverageShared *shared = m_shared.get();
+
+    ExecutionTraceEdgeBitmapHeader hdr;
+    hdr.magic = EXECTRACE_EDGE_MAGIC;
+    hdr.version = EXECTRACE_EDGE_VERSION;
+    hdr.timeStamp = llvm::sys::TimeValue::now().seconds();
+    hdr.timeOfLastNewEdge = getTimeOfLastNewEdge();
+    hdr.edgeCount = getEdgeCount();
+    hdr.mapSize = EdgeCoverageShared::MAP_SIZE;
+
+    //Readers see either the previous bitmap or the complete new one.
+    //Other processes keep updating the map while it is written.
+    std::string tmpName = m_fileName + ".tmp";
+    FILE *fp = fopen(tmpName.c_str(), "wb");
+    if (!fp) {
+        s2e()->getWarningsStream() << "EdgeCoverage: could not create " << tmpName << '\n';
+        return false;
+    }
+
+    bool ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1;
+    ok = ok && fwrite(shared->bitmap, sizeof(shared->bitmap), 1, fp) == 1;
+    ok = fclose(fp) == 0 && ok;
+    if (!ok || rename(tmpName.c_str(), m_fileName.c_str())) {
+        s2e()->getWarningsStream() << "EdgeCoverage: could not write " << m_fileName << '\n';
+        remove(tmpName.c_str());
+        return false;
+    }
+
+    m_writtenEdgeCount = hdr.edgeCount;
+    return true;
+}
+
+EdgeCoverageState::EdgeCoverageState()
+{
+    m_prevLoc = 0;
+    m_newEdges = 0;
+}
+
+EdgeCoverageState::~EdgeCoverageState()
+{
+
+}
+
+PluginState *EdgeCoverageState::clone() const
+{
+    return new EdgeCoverageState(*this);
+}
+
+PluginState *EdgeCoverageState::factory(Plugin *p, S2EExecutionState *s)
+{
+    return new EdgeCoverageState();
+}
+
+} // namespace plugins
+} // namespace s2e
@@ -0,0 +1,168 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in the S2E-AUTHORS file.
+ */
+
+#ifndef S2E_PLUGINS_EDGECOVERAGE_H
+#define S2E_PLUGINS_EDGECOVERAGE_H
+
+#include <s2e/Plugin.h>
+#include <s2e/Plugins/CorePlugin.h>
+#include <s2e/Plugins/ModuleExecutionDetector.h>
+#include <s2e/S2EExecutionState.h>
+#include <s2e/Synchronization.h>
+
+#include <string.h>
+#include <string>
+
+namespace s2e {
+namespace plugins {
+
+struct EdgeCoverageShared {
+    enum {
+        MAP_SIZE = 1 << 16
+    };
+
+    //Saturating hit counter of each edge hash
+    uint8_t bitmap[MAP_SIZE];
+    uint64_t edgeCount;
+    uint64_t timeOfLastNewEdge;
+
+    EdgeCoverageShared() {
+        memset(bitmap, 0, sizeof(bitmap));
+        edgeCount = 0;
+        timeOfLastNewEdge = 0;
+    }
+};
+
+/**
+ *  Maintains an AFL-style edge coverage bitmap while translation blocks
+ *  execute.
+ *
+ *  Each edge between two blocks is hashed to one byte of the bitmap,
+ *  which counts its executions. The bitmap is in shared memory, so that
+ *  all the S2E processes forked by the load balancer update the same
+ *  global coverage. onNewEdge is emitted the first time any process
+ *  executes an edge, in the state that executed it.
+ *
+ *  The bitmap is periodically written to EdgeCoverage.bitmap in the
+ *  output directory. The edgecov tool exports these files.
+ */
+class EdgeCoverage : public Plugin
+{
+    S2E_PLUGIN
+public:
+    EdgeCoverage(S2E* s2e): Plugin(s2e) {}
+    ~EdgeCoverage();
+
+    void initialize();
+
+    /** Emitted when the state executes an edge not seen before */
+    sigc::signal<void, S2EExecutionState*,
+                 uint64_t /* pc of the destination block */,
+                 uint32_t /* edge hash */>
+            onNewEdge;
+
+    /** Number of distinct edge hashes executed by all the processes */
+    uint64_t getEdgeCount() const {
+        return AtomicFunctions::read(&m_shared.get()->edgeCount);
+    }
+
+    /** Seconds since the epoch at which the last new edge was seen */
+    uint64_t getTimeOfLastNewEdge() const {
+        return AtomicFunctions::read(&m_shared.get()->timeOfLastNewEdge);
+    }
+
+    /** Number of new edges found by the state and its ancestors */
+    uint64_t getNewEdgeCount(S2EExecutionState *state);
+
+    /** Atomically replaces the bitmap file, returns false on error */
+    bool writeBitmap();
+
+private:
+    S2ESynchronizedObject<EdgeCoverageShared> m_shared;
+
+    //Hash of the previous block of the current state, shifted by one
+    //so that A->B and B->A are different edges. It is saved to the
+    //state on state switches to keep the TB path free of lookups.
+    uint32_t m_prevLoc;
+
+    std::string m_fileName;
+    unsigned m_writeInterval;
+    unsigned m_elapsedTics;
+    uint64_t m_writtenEdgeCount;
+
+    void onTranslateBlockStart(ExecutionSignal *signal,
+                               S2EExecutionState *state,
+                               TranslationBlock *tb,
+                               uint64_t pc);
+
+    void onModuleTranslateBlockStart(ExecutionSignal *signal,
+                                     S2EExecutionState *state,
+                                     const ModuleDescriptor &module,
+                                     TranslationBlock *tb,
+                                     uint64_t pc);
+
+    void onExecuteBlockStart(S2EExecutionState *state, uint64_t pc);
+    void onNewEdgeFound(S2EExecutionState *state, uint64_t pc, uint32_t edge);
+
+    void onStateSwitch(S2EExecutionState *currentState,
+                       S2EExecutionState *nextState);
+
+    void onStateFork(S2EExecutionState *state,
+                     const std::vector<S2EExecutionState*> &newStates,
+                     const std::vector<klee::ref<klee::Expr> > &newConditions);
+
+    void onTimer();
+    void onProcessFork(bool preFork, bool isChild, unsigned parentProcId);
+};
+
+class EdgeCoverageState: public PluginState
+{
+private:
+    uint32_t m_prevLoc;
+    uint64_t m_newEdges;
+
+public:
+    EdgeCoverageState();
+    virtual ~EdgeCoverageState();
+    virtual PluginState *clone() const;
+    static PluginState *factory(Plugin *p, S2EExecutionState *s);
+
+    friend class EdgeCoverage;
+};
+
+} // namespace plugins
+} // namespace s2e
+
+#endif
@@ -50,6 +50,27 @@ S2E_DEFINE_PLUGIN(ExecutionTracer, "ExecutionTracer plugin", "",);
 
 void ExecutionTracer::initialize()
 {
+    ConfigFile *cfg = s2e()->getConfig();
+
+    m_writeTrace = cfg->getBool(getConfigKey() + ".writeTrace", true);
+
+    //The flat format writes each item with stdio, as older versions did
+    if (m_writeTrace && !cfg->getBool(getConfigKey() + ".flatTrace")) {
+        unsigned chunkSize = cfg->getInt(getConfigKey() + ".chunkSize", 256) * 1024;
+        unsigned chunkCount = cfg->getInt(getConfigKey() + ".chunkCount", 64);
+        bool compress = cfg->getBool(getConfigKey() + ".compress", true);
+        bool deltaEncoding = cfg->getBool(getConfigKey() + ".deltaEncoding", true);
+        m_writer = new TraceWriter(chunkSize, chunkCount, compress, deltaEncoding);
+    }
+
+    m_benchmark = cfg->getBool(getConfigKey() + ".benchmark");
+    m_benchmarkStart = TraceClock::usec();
+    m_benchmarkTicks = 0;
+    m_benchmarkItems = 0;
+    m_benchmarkBytes = 0;
+    m_lastSample.usec = m_benchmarkStart;
+    m_lastSample.ticks = m_lastSample.items = m_lastSample.bytes = 0;
+
     createNewTraceFile(false);
 
     s2e()->getCorePlugin()->onStateFork.connect(
@@ -66,6 +87,19 @@ void ExecutionTracer::initialize()
 
 ExecutionTracer::~ExecutionTracer()
 {
+    onClose.emit();
+
+    if (m_writer) {
+        m_writer->close();
+    }
+
+    if (m_benchmark) {
+        BenchmarkSample start = { m_benchmarkStart, 0, 0, 0 };
+        reportBenchmark(start, "total");
+    }
+
+    delete m_writer;
+
     if (m_LogFile) {
         fclose(m_LogFile);
     }
@@ -73,32 +107,157 @@ ExecutionTracer::~ExecutionTracer()
 
 void ExecutionTracer::createNewTraceFile(bool append)
 {
+    m_CurrentIndex = 0;
+    if (!m_writeTrace) {
+        return;
+    }
 
-    if (append) {
-        assert(m_fileName.size() > 0);
-        m_LogFile = fopen(m_fileName.c_str(), "a");
-    }else {
+    if (!append) {
         m_fileName = s2e()->getOutputFilename("ExecutionTracer.dat");
-        m_LogFile = fopen(m_fileName.c_str(), "wb");
+    }
+    assert(m_fileName.size() > 0);
+
+    bool ok;
+    if (m_writer) {
+        ok = m_writer->open(m_fileName, append);
+    } else {
+        m_LogFile = fopen(m_fileName.c_str(), append ? "a" : "wb");
+        ok = m_LogFile != NULL;
     }
 
-    if (!m_LogFile) {
+    if (!ok) {
         s2e()->getWarningsStream() << "Could not create ExecutionTracer.dat" << '\n';
         exit(-1);
     }
-    m_CurrentIndex = 0;
 }
 
 void ExecutionTracer::onTimer()
 {
+    if (m_writer) {
+        //Bound the delay after which items reach the file
+        m_writer->commit();
+        m_writer->getClock().calibrate();
+    }
+
     if (m_LogFile) {
         fflush(m_LogFile);
     }
+
+    if (m_benchmark) {
+        m_benchmarkClock.calibrate();
+
+        BenchmarkSample cur;
+        cur.usec = TraceClock::usec();
+        if (cur.usec - m_lastSample.usec >= 10000000) {
+            reportBenchmark(m_lastSample, "last period");
+            m_lastSample.usec = cur.usec;
+            m_lastSample.ticks = m_benchmarkTicks;
+            m_lastSample.items = m_benchmarkItems;
+            m_lastSample.bytes = m_writer ? m_writer->getStats().bytes : m_benchmarkBytes;
+        }
+    }
+}
+
+/**
+ *  Prints the throughput of the tracer and the share of the time spent
+ *  in writeData since the given sample. Without tracing, the emulation
+ *  would have been faster by that much.
+ */
+void ExecutionTracer::reportBenchmark(const BenchmarkSample &from, const char *what)
+{
+    double elapsed = (TraceClock::usec() - from.usec) / 1000000.0;
+    double traced = m_benchmarkClock.ticksToSeconds(m_benchmarkTicks - from.ticks);
+    uint64_t items = m_benchmarkItems - from.items;
+    uint64_t bytes = (m_writer ? m_writer->getStats().bytes : m_benchmarkBytes) - from.bytes;
+
+    if (elapsed <= 0) {
+        return;
+    }
+
+    double share = traced / elapsed;
+    s2e()->getMessagesStream()
+            << "ExecutionTracer benchmark (" << what << ", "
+            << (m_writer ? "chunked" : m_writeTrace ? "flat" : "not written") << "): "
+            << (uint64_t) (items / elapsed) << " items/s, "
+            << (uint64_t) (bytes / elapsed / 1024) << " KiB/s, "
+            << (uint64_t) (share * 100) << "% of the time spent tracing";
+
+    if (share < 1) {
+        s2e()->getMessagesStream() << ", slowdown x" << 1 / (1 - share);
+    }
+
+    if (m_writer) {
+        const TraceWriter::Stats &stats = m_writer->getStats();
+        if (stats.bytes) {
+            s2e()->getMessagesStream() << ", compression ratio "
+                    << (double) stats.rawBytes / stats.bytes;
+        }
+        s2e()->getMessagesStream() << ", " << stats.stalls << " stalls";
+    }
+
+    s2e()->getMessagesStream() << '\n';
 }
 
 uint32_t ExecutionTracer::writeData(
         const S2EExecutionState *state,
         void *data, unsigned size, ExecTraceEntryType type)
+{
+    uint64_t start = 0;
+    if (m_benchmark) {
+        start = TraceClock::ticks();
+    }
+
+    if (!onItem.empty()) {
+        onItem.emit(state, type, data, size);
+    }
+
+    uint32_t ret = writeItem(state->getID(), state->getPid(), data, size, type);
+
+    if (m_benchmark) {
+        m_benchmarkTicks += TraceClock::ticks() - start;
+        ++m_benchmarkItems;
+    }
+
+    return ret;
+}
+
+uint32_t ExecutionTracer::writeData(
+        uint32_t stateId, uint64_t pid,
+        void *data, unsigned size, ExecTraceEntryType type)
+{
+    uint64_t start = 0;
+    if (m_benchmark) {
+        start = TraceClock::ticks();
+    }
+
+    uint32_t ret = writeItem(stateId, pid, data, size, type);
+
+    if (m_benchmark) {
+        m_benchmarkTicks += TraceClock::ticks() - start;
+        ++m_benchmarkItems;
+    }
+
+    return ret;
+}
+
+uint32_t ExecutionTracer::writeItem(
+        uint32_t stateId, uint64_t pid,
+        void *data, unsigned size, ExecTraceEntryType type)
+{
+    if (!m_writeTrace) {
+        return ++m_CurrentIndex;
+    } else if (m_writer) {
+        assert(m_writer->isOpen());
+        m_writer->write(stateId, pid, type, data, size);
+        return ++m_CurrentIndex;
+    } else {
+        return writeFlat(stateId, pid, data, size, type);
+    }
+}
+
+uint32_t ExecutionTracer::writeFlat(
+        uint32_t stateId, uint64_t pid,
+        void *data, unsigned size, ExecTraceEntryType type)
 {
     ExecutionTraceItemHeader item;
 
@@ -107,8 +266,8 @@ uint32_t ExecutionTracer::writeData(
     item.timeStamp = llvm::sys::TimeValue::now().usec();
     item.size = size;
     item.type = type;
-    item.stateId = state->getID();
-    item.pid = state->getPid();
+    item.stateId = stateId;
+    item.pid = pid;
 
     if (fwrite(&item, sizeof(item), 1, m_LogFile) != 1) {
         return 0;
@@ -121,11 +280,16 @@ uint32_t ExecutionTracer::writeData(
         }
     }
 
+    m_benchmarkBytes += sizeof(item) + size;
     return ++m_CurrentIndex;
 }
 
 void ExecutionTracer::flush()
 {
+    if (m_writer) {
+        m_writer->flush();
+    }
+
     if (m_LogFile) {
         fflush(m_LogFile);
     }
@@ -134,8 +298,13 @@ void ExecutionTracer::flush()
 void ExecutionTracer::onProcessFork(bool preFork, bool isChild, unsigned parentProcId)
 {
     if (preFork) {
-        fclose(m_LogFile);
-        m_LogFile = NULL;
+        //The writer thread would not survive the fork
+        if (m_writer) {
+            m_writer->close();
+        } else if (m_LogFile) {
+            fclose(m_LogFile);
+            m_LogFile = NULL;
+        }
     }else {
         if (isChild) {
             createNewTraceFile(false);
@@ -44,6 +44,7 @@
 #include <stdio.h>
 
 #include "TraceEntries.h"
+#include "TraceWriter.h"
 
 namespace s2e {
 namespace plugins {
@@ -67,12 +68,55 @@ class ExecutionTracer : public Plugin
     OSMonitor *m_Monitor;
     ExecTracerModules m_Modules;
 
+    //Writes chunked traces, NULL when the flat format is used
+    TraceWriter *m_writer;
+
+    //When false, items only go to the listeners of onItem
+    bool m_writeTrace;
+
+    //Measures the cost of writing the items
+    bool m_benchmark;
+    TraceClock m_benchmarkClock;
+    uint64_t m_benchmarkStart;
+    uint64_t m_benchmarkTicks;
+    uint64_t m_benchmarkItems;
+    uint64_t m_benchmarkBytes;
+
+    struct BenchmarkSample {
+        uint64_t usec, ticks, items, bytes;
+    };
+    BenchmarkSample m_lastSample;
+
     uint16_t getCompressedId(const ModuleDescriptor *desc);
 
     void onTimer();
     void createNewTraceFile(bool append);
+    uint32_t writeItem(uint32_t stateId, uint64_t pid,
+                       void *data, unsigned size, ExecTraceEntryType type);
+    uint32_t writeFlat(uint32_t stateId, uint64_t pid,
+                       void *data, unsigned size, ExecTraceEntryType type);
+    void reportBenchmark(const BenchmarkSample &from, const char *what);
 public:
-    ExecutionTracer(S2E* s2e): Plugin(s2e) {}
+    /**
+     *  Emitted for each item, before it is written to the trace.
+     *  Lets plugins aggregate the trace while it is produced.
+     */
+    sigc::signal<void,
+                 const S2EExecutionState*,
+                 ExecTraceEntryType,
+                 const void *, /* data */
+                 unsigned /* size */>
+            onItem;
+
+    /**
+     *  Emitted when S2E exits, before the trace is closed.
+     *  Plugins that write items late, e.g., once a background job completes,
+     *  write their last items then.
+     */
+    sigc::signal<void> onClose;
+
+    ExecutionTracer(S2E* s2e): Plugin(s2e), m_LogFile(NULL), m_writer(NULL),
+                               m_writeTrace(true), m_benchmark(false) {}
     ~ExecutionTracer();
     void initialize();
 
@@ -80,6 +124,14 @@ public:
             const S2EExecutionState *state,
             void *data, unsigned size, ExecTraceEntryType type);
 
+    /**
+     *  Writes an item on behalf of a state that may not exist anymore.
+     *  Such items are not seen by the listeners of onItem.
+     */
+    uint32_t writeData(
+            uint32_t stateId, uint64_t pid,
+            void *data, unsigned size, ExecTraceEntryType type);
+
     void flush();
 private:
 
@@ -38,6 +38,7 @@
 #include <s2e/ConfigFile.h>
 #include <s2e/Utils.h>
 
+#include <cstring>
 #include <iostream>
 #include <list>
 #include <sstream>
@@ -52,6 +53,8 @@ static std::list<std::pair<std::string, unsigned>  > REGISTERS;
 void InstructionTracer::initialize()
 {
     m_tracer = (ExecutionTracer *)s2e()->getPlugin("ExecutionTracer");
+    //Only trace the sampled blocks when TraceSampler is enabled
+    m_sampler = (TraceSampler *)s2e()->getPlugin("TraceSampler");
 
 	s2e()->getCorePlugin()->onTranslateInstructionStart.connect(
             sigc::mem_fun(*this, &InstructionTracer::slotTranslateInstructionStart));
@@ -72,7 +75,12 @@ void InstructionTracer::slotExecuteInstruction(
             S2EExecutionState *state,
             uint64_t pc)
 {
+    if (m_sampler && !m_sampler->isSampling(state)) {
+        return;
+    }
+
     ExecutionTraceInstr instrTrace;
+    memset(&instrTrace, 0, sizeof(instrTrace));
 
     // Current PC
     instrTrace.pc = pc;
@@ -41,6 +41,7 @@
 #include <s2e/S2EExecutionState.h>
 #include "ExecutionTracer.h"
 #include "TraceEntries.h"
+#include "TraceSampler.h"
 
 namespace s2e {
 namespace plugins {
@@ -69,6 +70,7 @@ public:
 
 private:
     ExecutionTracer *m_tracer;
+    TraceSampler *m_sampler;
 };
 
 } // namespace plugins
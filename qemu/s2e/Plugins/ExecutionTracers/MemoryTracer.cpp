@@ -63,6 +63,8 @@ void MemoryTracer::initialize()
 
     m_tracer = static_cast<ExecutionTracer*>(s2e()->getPlugin("ExecutionTracer"));
     m_execDetector = static_cast<ModuleExecutionDetector*>(s2e()->getPlugin("ModuleExecutionDetector"));
+    //Only trace the accesses of sampled blocks when TraceSampler is enabled
+    m_sampler = static_cast<TraceSampler*>(s2e()->getPlugin("TraceSampler"));
 
     //Retrict monitoring to configured modules only
     m_monitorModules = s2e()->getConfig()->getBool(getConfigKey() + ".monitorModules");
@@ -113,6 +115,10 @@ void MemoryTracer::traceDataMemoryAccess(S2EExecutionState *state,
                                klee::ref<klee::Expr> &value,
                                bool isWrite, bool isIO)
 {
+    if (m_sampler && !m_sampler->isSampling(state)) {
+        return;
+    }
+
     if (m_catchAbove || m_catchBelow) {
         if (m_catchAbove && (m_catchAbove >= state->getPc())) {
             return;
@@ -40,6 +40,7 @@
 #include <s2e/Plugins/Opcodes.h>
 #include <string>
 #include "ExecutionTracer.h"
+#include "TraceSampler.h"
 #include <s2e/Plugins/ModuleExecutionDetector.h>
 
 namespace s2e{
@@ -84,6 +85,7 @@ private:
 
     ExecutionTracer *m_tracer;
     ModuleExecutionDetector *m_execDetector;
+    TraceSampler *m_sampler;
 
     void onTlbMiss(S2EExecutionState *state, uint64_t addr, bool is_write);
     void onPageFault(S2EExecutionState *state, uint64_t addr, bool is_write);
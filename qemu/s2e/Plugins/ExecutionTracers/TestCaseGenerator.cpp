@@ -37,12 +37,16 @@
 #include <cctype>
 
 #include <s2e/S2E.h>
+#include <s2e/ConfigFile.h>
 #include <s2e/Utils.h>
 #include <s2e/S2EExecutionState.h>
 #include <s2e/S2EExecutor.h>
 #include "TestCaseGenerator.h"
 #include "ExecutionTracer.h"
 
+#include <klee/Memory.h>
+#include <klee/Solver.h>
+
 namespace s2e {
 namespace plugins {
 
@@ -53,12 +57,56 @@ TestCaseGenerator::TestCaseGenerator(S2E* s2e)
 {
     m_testIndex = 0;
     m_pathsExplored = 0;
+    m_tracer = NULL;
+    m_solver = NULL;
+}
+
+TestCaseGenerator::~TestCaseGenerator()
+{
+    //The tracer is still there if it was not closed yet
+    if (m_tracer && m_solver) {
+        processResults(true);
+    }
 
+    delete m_solver;
 }
 
 void TestCaseGenerator::initialize()
 {
-    s2e()->getCorePlugin()->onTestCaseGeneration.connect(
+    ConfigFile *cfg = s2e()->getConfig();
+
+    m_tracer = static_cast<ExecutionTracer*>(s2e()->getPlugin("ExecutionTracer"));
+    assert(m_tracer);
+
+    //Number of STP processes that solve the inputs in the background,
+    //0 solves them on the emulation thread when the test case is requested
+    unsigned workers = cfg->getInt(getConfigKey() + ".asyncWorkers", 0);
+
+    if (workers) {
+        //Test cases requested while that many are being solved wait for one
+        unsigned maxPending = cfg->getInt(getConfigKey() + ".maxPending", 16);
+
+        //Seconds allowed to solve a test case, 0 is unlimited
+        unsigned timeout = cfg->getInt(getConfigKey() + ".timeout", 0);
+
+        m_solver = new klee::BackgroundSolver(workers, maxPending);
+        m_solver->setTimeout(timeout);
+
+        m_timerConnection = s2e()->getCorePlugin()->onTimer.connect(
+                sigc::mem_fun(*this, &TestCaseGenerator::onTimer));
+
+        s2e()->getCorePlugin()->onProcessFork.connect(
+                sigc::mem_fun(*this, &TestCaseGenerator::onProcessFork));
+
+        m_tracer->onClose.connect(
+                sigc::mem_fun(*this, &TestCaseGenerator::onTraceClose));
+
+        s2e()->getMessagesStream() << "TestCaseGenerator: solving test cases with "
+                << workers << " background workers, at most "
+                << maxPending << " at a time" << '\n';
+    }
+
+    m_testCaseConnection = s2e()->getCorePlugin()->onTestCaseGeneration.connect(
             sigc::mem_fun(*this, &TestCaseGenerator::onTestCaseGeneration));
 }
 
@@ -70,6 +118,11 @@ void TestCaseGenerator::onTestCaseGeneration(S2EExecutionState *state, const std
             << " at address " << hexval(state->getPc())
             << '\n';
 
+    if (m_solver && submitTestCase(state)) {
+        processResults(false);
+        return;
+    }
+
     ConcreteInputs out;
     bool success = s2e()->getExecutor()->getSymbolicSolution(*state, out);
 
@@ -86,11 +139,103 @@ void TestCaseGenerator::onTestCaseGeneration(S2EExecutionState *state, const std
 
     s2e()->getMessagesStream() << '\n';
 
-    ExecutionTracer *tracer = (ExecutionTracer*)s2e()->getPlugin("ExecutionTracer");
-    assert(tracer);
+    printTestCase(out);
+
+    if (!m_tracer) {
+        return;
+    }
+
+    unsigned bufsize;
+    ExecutionTraceTestCase *tc = ExecutionTraceTestCase::serialize(&bufsize, out);
+    m_tracer->writeData(state, tc, bufsize, TRACE_TESTCASE);
+    ExecutionTraceTestCase::deallocate(tc);
+}
+
+/**
+ *  Hands the constraints and the symbolic arrays of the state to the
+ *  background solver, which serializes them right away. The state may
+ *  then run on or be deleted.
+ *  Returns false when the test case must be generated synchronously.
+ */
+bool TestCaseGenerator::submitTestCase(S2EExecutionState *state)
+{
+    PendingTestCase tc;
+    tc.stateId = state->getID();
+    tc.pid = state->getPid();
+
+    std::vector<const klee::Array*> objects;
+    for (unsigned i = 0; i < state->symbolics.size(); ++i) {
+        const klee::MemoryObject *mo = state->symbolics[i].first;
+
+        //The preferred values need solver queries on the state
+        if (!mo->cexPreferences.empty()) {
+            return false;
+        }
+
+        objects.push_back(state->symbolics[i].second);
+        tc.names.push_back(mo->name);
+    }
 
+    klee::Query query(state->constraints, klee::ConstantExpr::alloc(0, klee::Expr::Bool));
+    uint64_t ticket = m_solver->submit(query, objects);
+    m_pending[ticket] = tc;
+    return true;
+}
+
+void TestCaseGenerator::processResults(bool wait)
+{
+    if (m_pending.empty()) {
+        return;
+    }
+
+    std::vector<klee::InitialValuesResult> results;
+    m_solver->getResults(results, wait);
+
+    for (unsigned i = 0; i < results.size(); ++i) {
+        klee::InitialValuesResult &result = results[i];
+
+        //Results of the parent process are ignored in a child
+        PendingTestCases::iterator it = m_pending.find(result.ticket);
+        if (it == m_pending.end()) {
+            continue;
+        }
+
+        const PendingTestCase &tc = (*it).second;
+
+        if (!result.success || !result.hasSolution) {
+            s2e()->getWarningsStream()
+                    << "Could not get symbolic solutions for state " << tc.stateId << '\n';
+        } else {
+            assert(result.values.size() == tc.names.size());
+
+            ConcreteInputs out;
+            for (unsigned j = 0; j < tc.names.size(); ++j) {
+                out.push_back(std::make_pair(tc.names[j], std::vector<unsigned char>()));
+                out.back().second.swap(result.values[j]);
+            }
+
+            s2e()->getMessagesStream()
+                    << "TestCaseGenerator: test case of state " << tc.stateId << '\n';
+
+            printTestCase(out);
+
+            //The state may be gone by now
+            if (m_tracer) {
+                unsigned bufsize;
+                ExecutionTraceTestCase *item = ExecutionTraceTestCase::serialize(&bufsize, out);
+                m_tracer->writeData(tc.stateId, tc.pid, item, bufsize, TRACE_TESTCASE);
+                ExecutionTraceTestCase::deallocate(item);
+            }
+        }
+
+        m_pending.erase(it);
+    }
+}
+
+void TestCaseGenerator::printTestCase(const ConcreteInputs &out)
+{
     std::stringstream ss;
-    ConcreteInputs::iterator it;
+    ConcreteInputs::const_iterator it;
     for (it = out.begin(); it != out.end(); ++it) {
         const VarValuePair &vp = *it;
         ss << std::setw(20) << vp.first << ": ";
@@ -120,11 +265,29 @@ void TestCaseGenerator::onTestCaseGeneration(S2EExecutionState *state, const std
     }
 
     s2e()->getMessagesStream() << ss.str();
+}
 
-    unsigned bufsize;
-    ExecutionTraceTestCase *tc = ExecutionTraceTestCase::serialize(&bufsize, out);
-    tracer->writeData(state, tc, bufsize, TRACE_TESTCASE);
-    ExecutionTraceTestCase::deallocate(tc);
+void TestCaseGenerator::onTimer()
+{
+    processResults(false);
+}
+
+void TestCaseGenerator::onProcessFork(bool preFork, bool isChild, unsigned parentProcId)
+{
+    //The parent writes the test cases that were pending at the fork
+    if (!preFork && isChild) {
+        m_pending.clear();
+    }
+}
+
+void TestCaseGenerator::onTraceClose()
+{
+    //Write the test cases still being solved while the trace is open
+    processResults(true);
+
+    m_timerConnection.disconnect();
+    m_testCaseConnection.disconnect();
+    m_tracer = NULL;
 }
 
 }
@@ -38,10 +38,17 @@
 
 #include <s2e/Plugin.h>
 #include <string>
+#include <map>
+
+namespace klee {
+class BackgroundSolver;
+}
 
 namespace s2e{
 namespace plugins{
 
+class ExecutionTracer;
+
 /** Handler required for KLEE interpreter */
 class TestCaseGenerator : public Plugin
 {
@@ -51,16 +58,45 @@ private:
     typedef std::pair<std::string, std::vector<unsigned char> > VarValuePair;
     typedef std::vector<VarValuePair> ConcreteInputs;
 
+    /** A test case whose inputs are being solved in the background */
+    struct PendingTestCase {
+        uint32_t stateId;
+        uint64_t pid;
+        std::vector<std::string> names;
+    };
+
+    typedef std::map<uint64_t, PendingTestCase> PendingTestCases;
+
     unsigned m_testIndex;  // number of tests written so far
     unsigned m_pathsExplored; // number of paths explored so far
 
+    ExecutionTracer *m_tracer;
+
+    //Solves the inputs while the states keep running, NULL when
+    //the test cases are generated synchronously
+    klee::BackgroundSolver *m_solver;
+    PendingTestCases m_pending;
+
+    //Disconnected when the trace closes, as there is nowhere left
+    //to write the test cases
+    sigc::connection m_timerConnection;
+    sigc::connection m_testCaseConnection;
+
 public:
     TestCaseGenerator(S2E* s2e);
+    ~TestCaseGenerator();
 
     void initialize();
 
 private:
     void onTestCaseGeneration(S2EExecutionState *state, const std::string &message);
+    void onTimer();
+    void onProcessFork(bool preFork, bool isChild, unsigned parentProcId);
+    void onTraceClose();
+
+    bool submitTestCase(S2EExecutionState *state);
+    void processResults(bool wait);
+    void printTestCase(const ConcreteInputs &out);
 };
 
 
@@ -0,0 +1,307 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in the S2E-AUTHORS file.
+ */
+
+#include "TraceAggregator.h"
+
+#include <s2e/S2E.h>
+#include <s2e/ConfigFile.h>
+#include <s2e/Utils.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+namespace s2e {
+namespace plugins {
+
+S2E_DEFINE_PLUGIN(TraceAggregator, "Aggregates coverage and fork profiles while tracing",
+                  "TraceAggregator", "ExecutionTracer");
+
+void TraceAggregator::initialize()
+{
+    ConfigFile *cfg = s2e()->getConfig();
+
+    m_snapshotInterval = cfg->getInt(getConfigKey() + ".snapshotInterval", 5);
+    m_fileName = s2e()->getOutputFilename("TraceAggregator.dat");
+
+    m_pathCount = 1;
+    m_tbCount = 0;
+    m_unknownModuleCount = 0;
+    m_lastPid = 0;
+    m_lastModule = NULL;
+    m_startTime = TraceClock::usec();
+    m_lastSnapshot = m_startTime;
+    m_dirty = true;
+
+    ExecutionTracer *tracer = static_cast<ExecutionTracer*>(s2e()->getPlugin("ExecutionTracer"));
+    assert(tracer);
+
+    tracer->onItem.connect(
+            sigc::mem_fun(*this, &TraceAggregator::onItem));
+
+    s2e()->getCorePlugin()->onTimer.connect(
+            sigc::mem_fun(*this, &TraceAggregator::onTimer));
+
+    s2e()->getCorePlugin()->onProcessFork.connect(
+            sigc::mem_fun(*this, &TraceAggregator::onProcessFork));
+}
+
+TraceAggregator::~TraceAggregator()
+{
+    writeSnapshot();
+}
+
+void TraceAggregator::onItem(const S2EExecutionState *state, ExecTraceEntryType type,
+                             const void *data, unsigned size)
+{
+    uint64_t pid = state->getPid();
+
+    switch (type) {
+        case TRACE_TB_START:
+            if (size >= sizeof(ExecutionTraceTb)) {
+                onTb(pid, static_cast<const ExecutionTraceTb*>(data));
+            }
+            break;
+
+        case TRACE_FORK:
+            if (size >= sizeof(ExecutionTraceFork)) {
+                onFork(pid, static_cast<const ExecutionTraceFork*>(data));
+            }
+            break;
+
+        case TRACE_MOD_LOAD:
+            if (size >= sizeof(ExecutionTraceModuleLoad)) {
+                onModuleLoad(pid, static_cast<const ExecutionTraceModuleLoad*>(data));
+            }
+            break;
+
+        case TRACE_MOD_UNLOAD:
+            if (size >= sizeof(ExecutionTraceModuleUnload)) {
+                onModuleUnload(pid, static_cast<const ExecutionTraceModuleUnload*>(data));
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+/**
+ *  All states share the module map of a process. The module loads of the
+ *  states of a process are usually the same, as in the offline tools.
+ */
+void TraceAggregator::onModuleLoad(uint64_t pid, const ExecutionTraceModuleLoad *e)
+{
+    Module m;
+    m.name = std::string(e->name, strnlen(e->name, sizeof(e->name)));
+    m.loadBase = e->loadBase;
+    m.nativeBase = e->nativeBase;
+    m.size = e->size;
+    m.tbs = &m_coverage[m.name];
+
+    m_modules[pid][m.loadBase] = m;
+    m_lastModule = NULL;
+}
+
+void TraceAggregator::onModuleUnload(uint64_t pid, const ExecutionTraceModuleUnload *e)
+{
+    m_modules[pid].erase(e->loadBase);
+    m_lastModule = NULL;
+}
+
+const TraceAggregator::Module *TraceAggregator::findModule(uint64_t pid, uint64_t pc)
+{
+    if (m_lastModule && m_lastPid == pid &&
+        pc >= m_lastModule->loadBase && pc - m_lastModule->loadBase < m_lastModule->size) {
+        return m_lastModule;
+    }
+
+    ProcessModules::const_iterator pit = m_modules.find(pid);
+    if (pit == m_modules.end()) {
+        return NULL;
+    }
+
+    const Modules &modules = (*pit).second;
+    Modules::const_iterator it = modules.upper_bound(pc);
+    if (it == modules.begin()) {
+        return NULL;
+    }
+
+    --it;
+    const Module &m = (*it).second;
+    if (pc - m.loadBase >= m.size) {
+        return NULL;
+    }
+
+    m_lastPid = pid;
+    m_lastModule = &m;
+    return &m;
+}
+
+void TraceAggregator::onTb(uint64_t pid, const ExecutionTraceTb *e)
+{
+    ++m_tbCount;
+
+    const Module *m = findModule(pid, e->pc);
+    if (!m) {
+        ++m_unknownModuleCount;
+        return;
+    }
+
+    uint64_t relPc = e->pc - m->loadBase + m->nativeBase;
+    Tbs::iterator it = m->tbs->lower_bound(relPc);
+    if (it != m->tbs->end() && (*it).first == relPc) {
+        return;
+    }
+
+    Tb tb;
+    tb.end = relPc + e->size - 1;
+    tb.firstSeen = TraceClock::usec() - m_startTime;
+    m->tbs->insert(it, std::make_pair(relPc, tb));
+    m_dirty = true;
+}
+
+void TraceAggregator::onFork(uint64_t pid, const ExecutionTraceFork *e)
+{
+    m_pathCount += e->stateCount - 1;
+
+    ForkPoints::iterator it = m_forkPoints.find(std::make_pair(pid, e->pc));
+    if (it == m_forkPoints.end()) {
+        ForkPoint fp;
+        const Module *m = findModule(pid, e->pc);
+        if (m) {
+            fp.module = m->name;
+            fp.relPc = e->pc - m->loadBase + m->nativeBase;
+        } else {
+            fp.relPc = e->pc;
+        }
+        fp.count = 0;
+        it = m_forkPoints.insert(std::make_pair(std::make_pair(pid, e->pc), fp)).first;
+    }
+
+    ++(*it).second.count;
+    m_dirty = true;
+}
+
+void TraceAggregator::onTimer()
+{
+    uint64_t now = TraceClock::usec();
+    if (!m_dirty || now - m_lastSnapshot < m_snapshotInterval * 1000000ULL) {
+        return;
+    }
+
+    m_lastSnapshot = now;
+    writeSnapshot();
+}
+
+void TraceAggregator::onProcessFork(bool preFork, bool isChild, unsigned parentProcId)
+{
+    //The child has its own output directory
+    if (!preFork && isChild) {
+        m_fileName = s2e()->getOutputFilename("TraceAggregator.dat");
+        m_dirty = true;
+    }
+}
+
+static void append(std::vector<uint8_t> &buffer, const void *data, size_t size)
+{
+    buffer.insert(buffer.end(), (const uint8_t*) data, (const uint8_t*) data + size);
+}
+
+bool TraceAggregator::writeSnapshot()
+{
+    std::vector<uint8_t> buffer;
+
+    ExecutionTraceSnapshotHeader hdr;
+    hdr.magic = EXECTRACE_SNAPSHOT_MAGIC;
+    hdr.version = EXECTRACE_SNAPSHOT_VERSION;
+    hdr.timeStamp = TraceClock::usec() - m_startTime;
+    hdr.pathCount = m_pathCount;
+    hdr.tbCount = m_tbCount;
+    hdr.unknownModuleCount = m_unknownModuleCount;
+    hdr.moduleCount = m_coverage.size();
+    hdr.forkPointCount = m_forkPoints.size();
+    append(buffer, &hdr, sizeof(hdr));
+
+    for (Coverage::const_iterator it = m_coverage.begin(); it != m_coverage.end(); ++it) {
+        ExecutionTraceSnapshotModule m;
+        memset(&m, 0, sizeof(m));
+        strncpy(m.name, (*it).first.c_str(), sizeof(m.name));
+        m.tbCount = (*it).second.size();
+        append(buffer, &m, sizeof(m));
+
+        const Tbs &tbs = (*it).second;
+        for (Tbs::const_iterator tit = tbs.begin(); tit != tbs.end(); ++tit) {
+            ExecutionTraceSnapshotTb tb;
+            tb.start = (*tit).first;
+            tb.end = (*tit).second.end;
+            tb.firstSeen = (*tit).second.firstSeen;
+            append(buffer, &tb, sizeof(tb));
+        }
+    }
+
+    for (ForkPoints::const_iterator it = m_forkPoints.begin(); it != m_forkPoints.end(); ++it) {
+        ExecutionTraceSnapshotForkPoint fp;
+        memset(&fp, 0, sizeof(fp));
+        fp.pid = (*it).first.first;
+        fp.pc = (*it).first.second;
+        fp.relPc = (*it).second.relPc;
+        fp.count = (*it).second.count;
+        strncpy(fp.module, (*it).second.module.c_str(), sizeof(fp.module));
+        append(buffer, &fp, sizeof(fp));
+    }
+
+    //Readers see either the previous snapshot or the complete new one
+    std::string tmpName = m_fileName + ".tmp";
+    FILE *fp = fopen(tmpName.c_str(), "wb");
+    if (!fp) {
+        s2e()->getWarningsStream() << "TraceAggregator: could not create " << tmpName << '\n';
+        return false;
+    }
+
+    bool ok = fwrite(&buffer[0], buffer.size(), 1, fp) == 1;
+    ok = fclose(fp) == 0 && ok;
+    if (!ok || rename(tmpName.c_str(), m_fileName.c_str())) {
+        s2e()->getWarningsStream() << "TraceAggregator: could not write " << m_fileName << '\n';
+        remove(tmpName.c_str());
+        return false;
+    }
+
+    m_dirty = false;
+    return true;
+}
+
+} // namespace plugins
+} // namespace s2e
@@ -0,0 +1,134 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in the S2E-AUTHORS file.
+ */
+
+#ifndef S2E_PLUGINS_TRACEAGGREGATOR_H
+#define S2E_PLUGINS_TRACEAGGREGATOR_H
+
+#include <s2e/Plugin.h>
+#include <s2e/Plugins/CorePlugin.h>
+#include <s2e/S2EExecutionState.h>
+
+#include <map>
+#include <string>
+
+#include "ExecutionTracer.h"
+
+namespace s2e {
+namespace plugins {
+
+/**
+ *  Aggregates the items of ExecutionTracer while they are produced.
+ *
+ *  Keeps the translation blocks covered in each module, as the coverage
+ *  tool does, and the number of forks at each program counter, as the
+ *  forkprofiler tool does. A snapshot of these counters is periodically
+ *  written to a file, which is replaced atomically so that it can be
+ *  read at any time during the run.
+ */
+class TraceAggregator : public Plugin
+{
+    S2E_PLUGIN
+
+    struct Tb {
+        uint64_t end;
+        uint64_t firstSeen;
+    };
+
+    //Covered blocks of a module, by relative start address
+    typedef std::map<uint64_t, Tb> Tbs;
+    typedef std::map<std::string, Tbs> Coverage;
+
+    struct Module {
+        std::string name;
+        uint64_t loadBase, nativeBase, size;
+        Tbs *tbs;
+    };
+
+    //Loaded modules of a process, by load base
+    typedef std::map<uint64_t, Module> Modules;
+    typedef std::map<uint64_t, Modules> ProcessModules;
+
+    struct ForkPoint {
+        std::string module;
+        uint64_t relPc;
+        uint64_t count;
+    };
+
+    //By (pid, pc)
+    typedef std::map<std::pair<uint64_t, uint64_t>, ForkPoint> ForkPoints;
+
+    ProcessModules m_modules;
+    Coverage m_coverage;
+    ForkPoints m_forkPoints;
+    uint64_t m_pathCount;
+    uint64_t m_tbCount;
+    uint64_t m_unknownModuleCount;
+
+    //Last module looked up, blocks tend to execute in the same one
+    uint64_t m_lastPid;
+    const Module *m_lastModule;
+
+    std::string m_fileName;
+    uint64_t m_startTime;
+    uint64_t m_lastSnapshot;
+    unsigned m_snapshotInterval;
+    bool m_dirty;
+
+    const Module *findModule(uint64_t pid, uint64_t pc);
+
+    void onItem(const S2EExecutionState *state, ExecTraceEntryType type,
+                const void *data, unsigned size);
+    void onModuleLoad(uint64_t pid, const ExecutionTraceModuleLoad *e);
+    void onModuleUnload(uint64_t pid, const ExecutionTraceModuleUnload *e);
+    void onTb(uint64_t pid, const ExecutionTraceTb *e);
+    void onFork(uint64_t pid, const ExecutionTraceFork *e);
+
+    void onTimer();
+    void onProcessFork(bool preFork, bool isChild, unsigned parentProcId);
+
+public:
+    TraceAggregator(S2E* s2e): Plugin(s2e) {}
+    ~TraceAggregator();
+
+    void initialize();
+
+    /** Atomically replaces the snapshot file, returns false on error */
+    bool writeSnapshot();
+};
+
+} // namespace plugins
+} // namespace s2e
+
+#endif
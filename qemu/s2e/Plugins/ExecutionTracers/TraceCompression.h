@@ -0,0 +1,224 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in the S2E-AUTHORS file.
+ */
+
+#ifndef S2E_PLUGINS_TRACECOMPRESSION_H
+#define S2E_PLUGINS_TRACECOMPRESSION_H
+
+#include <inttypes.h>
+#include <string.h>
+
+namespace s2e {
+namespace plugins {
+
+/**
+ *  Byte-oriented LZ77 codec for trace chunks, in the spirit of LZ4.
+ *  It is shared by the tracer and the offline tools, so that traces do
+ *  not depend on an external compression library.
+ *
+ *  The stream is a sequence of (literals, match) pairs. A token byte
+ *  holds the literal count in its high nibble and the match length
+ *  minus 4 in its low nibble. A nibble of 15 is followed by extra bytes
+ *  that are added to it, up to the first one lower than 255. Literals
+ *  are followed by the 16-bit little-endian distance of the match. The
+ *  last pair has no match.
+ */
+
+#define TRACE_LZ_HASH_BITS 12
+#define TRACE_LZ_MIN_MATCH 4
+#define TRACE_LZ_MAX_DISTANCE 65535
+
+static inline unsigned traceCompressBound(unsigned size)
+{
+    return size + size / 255 + 16;
+}
+
+static inline uint32_t traceLzRead32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint8_t *traceLzWriteLength(uint8_t *op, unsigned length)
+{
+    for (; length >= 255; length -= 255) {
+        *op++ = 255;
+    }
+    *op++ = length;
+    return op;
+}
+
+static inline uint8_t *traceLzWriteSequence(uint8_t *op, const uint8_t *literals,
+                                            unsigned literalCount,
+                                            unsigned distance, unsigned matchLength)
+{
+    uint8_t *token = op++;
+    unsigned matchCode = matchLength ? matchLength - TRACE_LZ_MIN_MATCH : 0;
+
+    *token = (literalCount < 15 ? literalCount : 15) << 4;
+    if (literalCount >= 15) {
+        op = traceLzWriteLength(op, literalCount - 15);
+    }
+
+    memcpy(op, literals, literalCount);
+    op += literalCount;
+
+    if (matchLength) {
+        *token |= matchCode < 15 ? matchCode : 15;
+        *op++ = distance & 0xff;
+        *op++ = distance >> 8;
+        if (matchCode >= 15) {
+            op = traceLzWriteLength(op, matchCode - 15);
+        }
+    }
+
+    return op;
+}
+
+/**
+ *  Compresses size bytes of src into dst, which must have room for
+ *  traceCompressBound(size) bytes. Returns the compressed size.
+ */
+static inline unsigned traceCompress(const uint8_t *src, unsigned size, uint8_t *dst)
+{
+    uint32_t table[1 << TRACE_LZ_HASH_BITS];
+    memset(table, 0, sizeof(table));
+
+    uint8_t *op = dst;
+    unsigned anchor = 0, ip = 1;
+
+    //Leave enough input after a match to read 4 bytes safely
+    if (size > 12) {
+        unsigned limit = size - 12;
+        while (ip < limit) {
+            uint32_t v = traceLzRead32(src + ip);
+            uint32_t h = (v * 2654435761U) >> (32 - TRACE_LZ_HASH_BITS);
+            unsigned ref = table[h];
+            table[h] = ip;
+
+            if (ip - ref > TRACE_LZ_MAX_DISTANCE || traceLzRead32(src + ref) != v) {
+                //Move faster through data that does not compress
+                ip += 1 + ((ip - anchor) >> 6);
+                continue;
+            }
+
+            unsigned length = TRACE_LZ_MIN_MATCH;
+            while (ip + length < size - 5 && src[ref + length] == src[ip + length]) {
+                ++length;
+            }
+
+            op = traceLzWriteSequence(op, src + anchor, ip - anchor, ip - ref, length);
+            ip += length;
+            anchor = ip;
+        }
+    }
+
+    op = traceLzWriteSequence(op, src + anchor, size - anchor, 0, 0);
+    return op - dst;
+}
+
+static inline bool traceLzReadLength(const uint8_t *src, unsigned srcSize,
+                                     unsigned &ip, unsigned &length)
+{
+    uint8_t b;
+    do {
+        if (ip >= srcSize) {
+            return false;
+        }
+        b = src[ip++];
+        length += b;
+    } while (b == 255);
+    return true;
+}
+
+/**
+ *  Decompresses srcSize bytes of src into dst. Returns false if the
+ *  data is corrupted or does not decompress to exactly dstSize bytes.
+ */
+static inline bool traceDecompress(const uint8_t *src, unsigned srcSize,
+                                   uint8_t *dst, unsigned dstSize)
+{
+    unsigned ip = 0, op = 0;
+
+    while (ip < srcSize) {
+        uint8_t token = src[ip++];
+
+        unsigned literalCount = token >> 4;
+        if (literalCount == 15 && !traceLzReadLength(src, srcSize, ip, literalCount)) {
+            return false;
+        }
+
+        if (literalCount > srcSize - ip || literalCount > dstSize - op) {
+            return false;
+        }
+        memcpy(dst + op, src + ip, literalCount);
+        ip += literalCount;
+        op += literalCount;
+
+        if (ip == srcSize) {
+            break;
+        }
+
+        if (srcSize - ip < 2) {
+            return false;
+        }
+        unsigned distance = src[ip] | (src[ip + 1] << 8);
+        ip += 2;
+
+        unsigned length = token & 15;
+        if (length == 15 && !traceLzReadLength(src, srcSize, ip, length)) {
+            return false;
+        }
+        length += TRACE_LZ_MIN_MATCH;
+
+        if (distance == 0 || distance > op || length > dstSize - op) {
+            return false;
+        }
+
+        //The match may overlap the bytes it produces
+        const uint8_t *match = dst + op - distance;
+        for (unsigned i = 0; i < length; ++i) {
+            dst[op + i] = match[i];
+        }
+        op += length;
+    }
+
+    return op == dstSize;
+}
+
+} // namespace plugins
+} // namespace s2e
+
+#endif
@@ -0,0 +1,421 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in the S2E-AUTHORS file.
+ */
+
+#ifndef S2E_PLUGINS_TRACEENCODING_H
+#define S2E_PLUGINS_TRACEENCODING_H
+
+#include <inttypes.h>
+#include <string.h>
+
+#include "TraceEntries.h"
+
+namespace s2e {
+namespace plugins {
+
+/**
+ *  Compact encoding of the items of a chunk.
+ *
+ *  Each item starts with its type, the difference with the time stamp of
+ *  the previous item, and its size, all as variable-length integers. The
+ *  type has bit 7 set when the payload is delta-encoded. This is the case
+ *  for translation blocks, instructions and memory accesses. Their
+ *  program counters and addresses are stored as differences with the
+ *  previous item of the chunk, and only the registers that changed are
+ *  stored. Since a chunk has the items of only one state, the deltas are
+ *  taken along the execution of that state. Every chunk starts from an
+ *  empty context, so that chunks can still be decoded independently.
+ */
+
+#define TRACE_ITEM_DELTA 0x80
+
+struct TraceDeltaContext {
+    uint64_t timeStamp;
+    uint64_t pc;
+    uint64_t address;
+    uint64_t hostAddress;
+    uint64_t tbRegisters[16];
+    uint64_t instrFlags;
+    uint32_t instrRegisters[16];
+
+    TraceDeltaContext() {
+        memset(this, 0, sizeof(*this));
+    }
+};
+
+static inline uint64_t traceZigZag(int64_t v)
+{
+    return ((uint64_t) v << 1) ^ (uint64_t) (v >> 63);
+}
+
+static inline int64_t traceUnZigZag(uint64_t v)
+{
+    return (int64_t) (v >> 1) ^ -(int64_t) (v & 1);
+}
+
+static inline uint8_t *traceWriteVarint(uint8_t *p, uint64_t v)
+{
+    while (v >= 0x80) {
+        *p++ = (uint8_t) v | 0x80;
+        v >>= 7;
+    }
+    *p++ = (uint8_t) v;
+    return p;
+}
+
+static inline uint8_t *traceWriteDelta(uint8_t *p, uint64_t value, uint64_t previous)
+{
+    return traceWriteVarint(p, traceZigZag((int64_t) (value - previous)));
+}
+
+/** Bounds-checked reader of encoded items */
+class TraceDecoder {
+    const uint8_t *m_p, *m_end;
+    bool m_ok;
+
+public:
+    TraceDecoder(const uint8_t *p, unsigned size) : m_p(p), m_end(p + size), m_ok(true) {}
+
+    bool ok() const { return m_ok; }
+    bool atEnd() const { return m_p == m_end; }
+
+    uint8_t byte() {
+        if (m_p == m_end) {
+            m_ok = false;
+            return 0;
+        }
+        return *m_p++;
+    }
+
+    uint64_t varint() {
+        uint64_t v = 0;
+        for (unsigned shift = 0; shift < 64; shift += 7) {
+            uint8_t b = byte();
+            v |= (uint64_t) (b & 0x7f) << shift;
+            if (!(b & 0x80)) {
+                return v;
+            }
+        }
+        m_ok = false;
+        return 0;
+    }
+
+    uint64_t delta(uint64_t previous) {
+        return previous + (uint64_t) traceUnZigZag(varint());
+    }
+
+    const uint8_t *bytes(unsigned size) {
+        if ((unsigned) (m_end - m_p) < size) {
+            m_ok = false;
+            return NULL;
+        }
+        const uint8_t *ret = m_p;
+        m_p += size;
+        return ret;
+    }
+};
+
+/** Worst-case size of encoded items, any size is fine for the output */
+static inline unsigned traceEncodeBound(unsigned size)
+{
+    return 2 * size + 64;
+}
+
+static inline uint8_t *traceEncodeTb(uint8_t *p, const uint8_t *payload, TraceDeltaContext &ctx)
+{
+    ExecutionTraceTb tb;
+    memcpy(&tb, payload, sizeof(tb));
+
+    p = traceWriteDelta(p, tb.pc, ctx.pc);
+    p = traceWriteDelta(p, tb.targetPc, tb.pc);
+    p = traceWriteVarint(p, tb.size);
+    *p++ = tb.tbType;
+    p = traceWriteVarint(p, tb.symbMask);
+
+    uint32_t changed = 0;
+    for (unsigned i = 0; i < 16; ++i) {
+        if (tb.registers[i] != ctx.tbRegisters[i]) {
+            changed |= 1 << i;
+        }
+    }
+
+    p = traceWriteVarint(p, changed);
+    for (unsigned i = 0; i < 16; ++i) {
+        if (changed & (1 << i)) {
+            p = traceWriteDelta(p, tb.registers[i], ctx.tbRegisters[i]);
+            ctx.tbRegisters[i] = tb.registers[i];
+        }
+    }
+
+    ctx.pc = tb.pc;
+    return p;
+}
+
+static inline bool traceDecodeTb(TraceDecoder &d, uint8_t *payload, TraceDeltaContext &ctx)
+{
+    ExecutionTraceTb tb;
+
+    tb.pc = d.delta(ctx.pc);
+    tb.targetPc = d.delta(tb.pc);
+    tb.size = d.varint();
+    tb.tbType = d.byte();
+    tb.symbMask = d.varint();
+
+    uint64_t changed = d.varint();
+    for (unsigned i = 0; i < 16; ++i) {
+        if (changed & (1 << i)) {
+            ctx.tbRegisters[i] = d.delta(ctx.tbRegisters[i]);
+        }
+        tb.registers[i] = ctx.tbRegisters[i];
+    }
+
+    ctx.pc = tb.pc;
+    memcpy(payload, &tb, sizeof(tb));
+    return d.ok();
+}
+
+static inline uint8_t *traceEncodeInstr(uint8_t *p, const uint8_t *payload, TraceDeltaContext &ctx)
+{
+    ExecutionTraceInstr instr;
+    uint32_t registers[16];
+    memcpy(&instr, payload, sizeof(instr));
+    memcpy(registers, instr.x64_registers, sizeof(registers));
+
+    //Copy the raw byte, the tracer may not have initialized it
+    *p++ = payload[0];
+    p = traceWriteVarint(p, instr.arch);
+    p = traceWriteDelta(p, instr.pc, ctx.pc);
+    p = traceWriteVarint(p, instr.symbMask);
+
+    //Bits 0-15 are the 32-bit register words, bit 16 the flags
+    uint32_t changed = instr.flags != ctx.instrFlags ? 1 << 16 : 0;
+    for (unsigned i = 0; i < 16; ++i) {
+        if (registers[i] != ctx.instrRegisters[i]) {
+            changed |= 1 << i;
+        }
+    }
+
+    p = traceWriteVarint(p, changed);
+    if (changed & (1 << 16)) {
+        p = traceWriteVarint(p, instr.flags);
+        ctx.instrFlags = instr.flags;
+    }
+
+    for (unsigned i = 0; i < 16; ++i) {
+        if (changed & (1 << i)) {
+            p = traceWriteVarint(p, traceZigZag((int32_t) (registers[i] - ctx.instrRegisters[i])));
+            ctx.instrRegisters[i] = registers[i];
+        }
+    }
+
+    ctx.pc = instr.pc;
+    return p;
+}
+
+static inline bool traceDecodeInstr(TraceDecoder &d, uint8_t *payload, TraceDeltaContext &ctx)
+{
+    ExecutionTraceInstr instr;
+
+    uint8_t isSymbolic = d.byte();
+    memcpy(&instr.isSymbolic, &isSymbolic, 1);
+    instr.arch = (ExecutionTraceInstr::CPUType) d.varint();
+    instr.pc = d.delta(ctx.pc);
+    instr.symbMask = d.varint();
+
+    uint64_t changed = d.varint();
+    if (changed & (1 << 16)) {
+        ctx.instrFlags = d.varint();
+    }
+    instr.flags = ctx.instrFlags;
+
+    for (unsigned i = 0; i < 16; ++i) {
+        if (changed & (1 << i)) {
+            ctx.instrRegisters[i] += (uint32_t) traceUnZigZag(d.varint());
+        }
+    }
+    memcpy(instr.x64_registers, ctx.instrRegisters, sizeof(ctx.instrRegisters));
+
+    ctx.pc = instr.pc;
+    memcpy(payload, &instr, sizeof(instr));
+    return d.ok();
+}
+
+static inline uint8_t *traceEncodeMemory(uint8_t *p, const uint8_t *payload, TraceDeltaContext &ctx)
+{
+    ExecutionTraceMemory mem;
+    memcpy(&mem, payload, sizeof(mem));
+
+    p = traceWriteDelta(p, mem.pc, ctx.pc);
+    p = traceWriteDelta(p, mem.address, ctx.address);
+    p = traceWriteVarint(p, mem.value);
+    *p++ = mem.size;
+    *p++ = mem.flags;
+    p = traceWriteDelta(p, mem.hostAddress, ctx.hostAddress);
+
+    ctx.pc = mem.pc;
+    ctx.address = mem.address;
+    ctx.hostAddress = mem.hostAddress;
+    return p;
+}
+
+static inline bool traceDecodeMemory(TraceDecoder &d, uint8_t *payload, TraceDeltaContext &ctx)
+{
+    ExecutionTraceMemory mem;
+
+    mem.pc = d.delta(ctx.pc);
+    mem.address = d.delta(ctx.address);
+    mem.value = d.varint();
+    mem.size = d.byte();
+    mem.flags = d.byte();
+    mem.hostAddress = d.delta(ctx.hostAddress);
+
+    ctx.pc = mem.pc;
+    ctx.address = mem.address;
+    ctx.hostAddress = mem.hostAddress;
+    memcpy(payload, &mem, sizeof(mem));
+    return d.ok();
+}
+
+/** Size of the payload of delta-encoded items of the given type, 0 if none */
+static inline unsigned traceDeltaPayloadSize(uint8_t type)
+{
+    switch (type) {
+        case TRACE_TB_START:
+        case TRACE_TB_END:
+            return sizeof(ExecutionTraceTb);
+        case TRACE_INSTR_START:
+            return sizeof(ExecutionTraceInstr);
+        case TRACE_MEMORY:
+            return sizeof(ExecutionTraceMemory);
+        default:
+            return 0;
+    }
+}
+
+/**
+ *  Encodes the items of a chunk, stored as ExecutionTraceChunkItemHeader
+ *  followed by the payload. out must have room for traceEncodeBound(size)
+ *  bytes. Returns the encoded size.
+ */
+static inline unsigned traceEncodeItems(const uint8_t *items, unsigned size, uint8_t *out)
+{
+    TraceDeltaContext ctx;
+    uint8_t *p = out;
+    unsigned offset = 0;
+
+    while (offset < size) {
+        ExecutionTraceChunkItemHeader hdr;
+        memcpy(&hdr, items + offset, sizeof(hdr));
+        const uint8_t *payload = items + offset + sizeof(hdr);
+        bool delta = hdr.size && hdr.size == traceDeltaPayloadSize(hdr.type);
+
+        *p++ = hdr.type | (delta ? TRACE_ITEM_DELTA : 0);
+        p = traceWriteDelta(p, hdr.timeStamp, ctx.timeStamp);
+        ctx.timeStamp = hdr.timeStamp;
+
+        if (!delta) {
+            p = traceWriteVarint(p, hdr.size);
+            memcpy(p, payload, hdr.size);
+            p += hdr.size;
+        } else if (hdr.type == TRACE_INSTR_START) {
+            p = traceEncodeInstr(p, payload, ctx);
+        } else if (hdr.type == TRACE_MEMORY) {
+            p = traceEncodeMemory(p, payload, ctx);
+        } else {
+            p = traceEncodeTb(p, payload, ctx);
+        }
+
+        offset += sizeof(hdr) + hdr.size;
+    }
+
+    return p - out;
+}
+
+/**
+ *  Decodes itemCount items into exactly outSize bytes.
+ *  Returns false if the data is corrupted.
+ */
+static inline bool traceDecodeItems(const uint8_t *in, unsigned inSize, unsigned itemCount,
+                                    uint8_t *out, unsigned outSize)
+{
+    TraceDeltaContext ctx;
+    TraceDecoder d(in, inSize);
+    unsigned offset = 0;
+
+    for (unsigned i = 0; i < itemCount; ++i) {
+        ExecutionTraceChunkItemHeader hdr;
+        uint8_t type = d.byte();
+        bool delta = type & TRACE_ITEM_DELTA;
+
+        hdr.type = type & ~TRACE_ITEM_DELTA;
+        hdr.timeStamp = d.delta(ctx.timeStamp);
+        hdr.size = delta ? traceDeltaPayloadSize(hdr.type) : d.varint();
+        ctx.timeStamp = hdr.timeStamp;
+
+        if (!d.ok() || (delta && !hdr.size) ||
+            hdr.size > outSize - offset || sizeof(hdr) > outSize - offset - hdr.size) {
+            return false;
+        }
+
+        memcpy(out + offset, &hdr, sizeof(hdr));
+        uint8_t *payload = out + offset + sizeof(hdr);
+
+        bool ok;
+        if (!delta) {
+            const uint8_t *raw = d.bytes(hdr.size);
+            ok = raw != NULL;
+            if (ok) {
+                memcpy(payload, raw, hdr.size);
+            }
+        } else if (hdr.type == TRACE_INSTR_START) {
+            ok = traceDecodeInstr(d, payload, ctx);
+        } else if (hdr.type == TRACE_MEMORY) {
+            ok = traceDecodeMemory(d, payload, ctx);
+        } else {
+            ok = traceDecodeTb(d, payload, ctx);
+        }
+
+        if (!ok) {
+            return false;
+        }
+        offset += sizeof(hdr) + hdr.size;
+    }
+
+    return d.atEnd() && offset == outSize;
+}
+
+} // namespace plugins
+} // namespace s2e
+
+#endif
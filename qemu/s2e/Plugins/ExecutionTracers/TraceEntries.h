@@ -75,6 +75,7 @@ enum ExecTraceEntryType {
     TRACE_ICOUNT,
     TRACE_MEM_CHECKER,
     TRACE_INSTR_START,
+    TRACE_SAMPLE,
     TRACE_MAX
 };
 
@@ -88,6 +89,64 @@ struct ExecutionTraceItemHeader{
     //uint8_t  payload[];
 }__attribute__((packed));
 
+/**
+ *  Chunked traces start with this header. They are made of chunks
+ *  that contain the items of a single state, so that the state id and
+ *  the pid are stored once per chunk instead of once per item.
+ *  The items of a chunk may be delta-encoded (see TraceEncoding.h) and
+ *  compressed, and a complete trace ends with an index of the chunks followed by ExecutionTraceFooter.
+ */
+#define EXECTRACE_MAGIC "S2ETRACE"
+#define EXECTRACE_VERSION 4
+#define EXECTRACE_CHUNK_MAGIC 0x4b4e4843 //"CHNK"
+#define EXECTRACE_INDEX_MAGIC 0x58444e49 //"INDX"
+
+//The items of the chunk are compressed with traceCompress()
+#define EXECTRACE_CHUNK_COMPRESSED 1
+//The items of the chunk are encoded with traceEncodeItems()
+#define EXECTRACE_CHUNK_DELTA 2
+
+struct ExecutionTraceFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+}__attribute__((packed));
+
+struct ExecutionTraceChunkHeader {
+    uint32_t magic;
+    uint32_t size;        //Size of the items
+    uint32_t encodedSize; //Size of the items after delta encoding
+    uint32_t storedSize;  //Size of the data that follows the header
+    uint32_t flags;
+    uint32_t itemCount;
+    uint32_t stateId;
+    uint64_t pid;
+    uint64_t firstItem;  //Index of the first item in the file
+    uint32_t typeMask;   //Bit n is set if there are items of type n
+}__attribute__((packed));
+
+struct ExecutionTraceIndexEntry {
+    uint64_t offset;     //Of the chunk header
+    uint64_t firstItem;
+    uint32_t itemCount;
+    uint32_t stateId;
+    uint32_t typeMask;
+}__attribute__((packed));
+
+struct ExecutionTraceFooter {
+    uint64_t indexOffset;
+    uint64_t itemCount;
+    uint32_t chunkCount;
+    uint32_t magic;
+}__attribute__((packed));
+
+struct ExecutionTraceChunkItemHeader {
+    uint64_t timeStamp;
+    uint32_t size;  //Size of the payload
+    uint8_t  type;
+    //uint8_t  payload[];
+}__attribute__((packed));
+
 struct ExecutionTraceModuleLoad {
     char name[32];
     uint64_t loadBase;
@@ -418,6 +477,82 @@ struct ExecutionTraceInstr
 
 }__attribute__((packed));
 
+/**
+ *  Written by TraceSampler at the start of each sampled translation block.
+ *  The instructions and memory accesses traced until the end of the sampling
+ *  window follow this entry. weight is the number of translation blocks
+ *  executed by the state since its previous sample, including this one.
+ */
+struct ExecutionTraceSample
+{
+    enum ESampleMode
+    {
+        SAMPLE_PERIOD = 0,
+        SAMPLE_RANDOM,
+        SAMPLE_TIME
+    };
+
+    uint64_t pc;
+    uint64_t weight;
+    uint32_t window;   //Translation blocks traced from this one on
+    uint8_t mode;
+}__attribute__((packed));
+
+/**
+ *  Snapshots of the aggregated trace written by TraceAggregator.
+ *  ExecutionTraceSnapshotHeader is followed by moduleCount modules,
+ *  each followed by its translation blocks, then by forkPointCount
+ *  fork points.
+ */
+#define EXECTRACE_SNAPSHOT_MAGIC 0x50414e53 //"SNAP"
+#define EXECTRACE_SNAPSHOT_VERSION 1
+
+struct ExecutionTraceSnapshotHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t timeStamp;           //Microseconds since the start of the run
+    uint64_t pathCount;
+    uint64_t tbCount;             //Translation blocks executed
+    uint64_t unknownModuleCount;  //Blocks executed outside of known modules
+    uint32_t moduleCount;
+    uint32_t forkPointCount;
+}__attribute__((packed));
+
+struct ExecutionTraceSnapshotModule {
+    char name[32];
+    uint32_t tbCount;             //Distinct translation blocks covered
+}__attribute__((packed));
+
+struct ExecutionTraceSnapshotTb {
+    uint64_t start, end;          //Relative to the native base of the module
+    uint64_t firstSeen;           //Microseconds since the start of the run
+}__attribute__((packed));
+
+struct ExecutionTraceSnapshotForkPoint {
+    uint64_t pid;
+    uint64_t pc;
+    uint64_t relPc;               //Same as pc when the module is unknown
+    uint64_t count;
+    char module[32];
+}__attribute__((packed));
+
+/**
+ *  Edge coverage bitmap written by the EdgeCoverage plugin.
+ *  ExecutionTraceEdgeBitmapHeader is followed by mapSize bytes,
+ *  one saturating hit counter per edge hash.
+ */
+#define EXECTRACE_EDGE_MAGIC 0x45474445 //"EDGE"
+#define EXECTRACE_EDGE_VERSION 1
+
+struct ExecutionTraceEdgeBitmapHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t timeStamp;           //Seconds since the epoch
+    uint64_t timeOfLastNewEdge;   //Seconds since the epoch
+    uint64_t edgeCount;           //Non-zero entries of the map
+    uint32_t mapSize;
+}__attribute__((packed));
+
 union ExecutionTraceAll {
     ExecutionTraceModuleLoad moduleLoad;
     ExecutionTraceModuleUnload moduleUnload;
@@ -0,0 +1,207 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in the S2E-AUTHORS file.
+ */
+
+#include "TraceSampler.h"
+
+#include <s2e/S2E.h>
+#include <s2e/ConfigFile.h>
+#include <s2e/Utils.h>
+
+namespace s2e {
+namespace plugins {
+
+S2E_DEFINE_PLUGIN(TraceSampler, "Samples the blocks traced by the instruction and memory tracers",
+                  "TraceSampler", "ExecutionTracer");
+
+//Finalizer of splitmix64, spreads the seed over all the bits
+static uint64_t mixSeed(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    x = x ^ (x >> 31);
+    return x ? x : 1;
+}
+
+void TraceSampler::initialize()
+{
+    ConfigFile *cfg = s2e()->getConfig();
+    bool ok = false;
+
+    m_tracer = static_cast<ExecutionTracer*>(s2e()->getPlugin("ExecutionTracer"));
+
+    std::string mode = cfg->getString(getConfigKey() + ".mode", "period", &ok);
+    if (mode == "period") {
+        m_mode = PERIOD;
+    } else if (mode == "random") {
+        m_mode = RANDOM;
+    } else if (mode == "time") {
+        m_mode = TIME;
+    } else {
+        s2e()->getWarningsStream() << "TraceSampler: unknown mode " << mode
+                << ", must be period, random or time\n";
+        exit(-1);
+    }
+
+    //Average number of blocks between two samples
+    m_period = cfg->getInt(getConfigKey() + ".period", 1000);
+    //Number of consecutive blocks traced in each sample
+    m_window = cfg->getInt(getConfigKey() + ".window", 1);
+    m_seed = cfg->getInt(getConfigKey() + ".seed", 0);
+    m_timerPeriod = cfg->getInt(getConfigKey() + ".timerPeriod", 1);
+
+    if (m_period == 0 || m_window == 0 || m_timerPeriod == 0) {
+        s2e()->getWarningsStream() << "TraceSampler: period, window and timerPeriod must not be zero\n";
+        exit(-1);
+    }
+
+    m_elapsedTics = 0;
+    m_timerArmed = false;
+    m_sampledState = NULL;
+
+    s2e()->getCorePlugin()->onTranslateBlockStart.connect(
+            sigc::mem_fun(*this, &TraceSampler::onTranslateBlockStart));
+
+    if (m_mode == TIME) {
+        s2e()->getCorePlugin()->onTimer.connect(
+                sigc::mem_fun(*this, &TraceSampler::onTimer));
+    }
+}
+
+//Uniform in [1, 2 * period - 1], so that the average stays period
+uint64_t TraceSampler::nextInterval(uint64_t &rng) const
+{
+    if (m_mode != RANDOM || m_period == 1) {
+        return m_period;
+    }
+
+    //xorshift64
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return 1 + rng % (2 * m_period - 1);
+}
+
+void TraceSampler::onTranslateBlockStart(ExecutionSignal *signal,
+                                         S2EExecutionState *state,
+                                         TranslationBlock *tb,
+                                         uint64_t pc)
+{
+    signal->connect(
+        sigc::mem_fun(*this, &TraceSampler::onExecuteBlockStart)
+    );
+}
+
+void TraceSampler::onExecuteBlockStart(S2EExecutionState *state, uint64_t pc)
+{
+    DECLARE_PLUGINSTATE(TraceSamplerState, state);
+
+    ++plgState->m_blocks;
+
+    if (plgState->m_remaining == 0) {
+        bool due;
+        if (m_mode == TIME) {
+            due = m_timerArmed;
+            m_timerArmed = false;
+        } else {
+            if (plgState->m_reseed) {
+                plgState->m_rng = mixSeed(plgState->m_rng ^ state->getID());
+                plgState->m_reseed = false;
+            }
+            due = --plgState->m_countdown == 0;
+            if (due) {
+                plgState->m_countdown = nextInterval(plgState->m_rng);
+            }
+        }
+
+        if (due) {
+            ExecutionTraceSample e;
+            e.pc = pc;
+            e.weight = plgState->m_blocks;
+            e.window = m_window;
+            e.mode = m_mode;
+            m_tracer->writeData(state, &e, sizeof(e), TRACE_SAMPLE);
+
+            plgState->m_blocks = 0;
+            plgState->m_remaining = m_window;
+        }
+    }
+
+    if (plgState->m_remaining > 0) {
+        --plgState->m_remaining;
+        m_sampledState = state;
+    } else {
+        m_sampledState = NULL;
+    }
+}
+
+void TraceSampler::onTimer()
+{
+    if (++m_elapsedTics < m_timerPeriod) {
+        return;
+    }
+
+    m_elapsedTics = 0;
+    m_timerArmed = true;
+}
+
+TraceSamplerState::TraceSamplerState(TraceSampler *sampler, S2EExecutionState *s)
+{
+    m_blocks = 0;
+    m_remaining = 0;
+    m_rng = mixSeed(sampler->m_seed ^ s->getID());
+    m_reseed = false;
+    m_countdown = sampler->nextInterval(m_rng);
+}
+
+TraceSamplerState::~TraceSamplerState()
+{
+
+}
+
+PluginState *TraceSamplerState::clone() const
+{
+    TraceSamplerState *ret = new TraceSamplerState(*this);
+    ret->m_reseed = true;
+    return ret;
+}
+
+PluginState *TraceSamplerState::factory(Plugin *p, S2EExecutionState *s)
+{
+    return new TraceSamplerState(static_cast<TraceSampler*>(p), s);
+}
+
+} // namespace plugins
+} // namespace s2e
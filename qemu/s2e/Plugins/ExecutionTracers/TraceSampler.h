@@ -0,0 +1,132 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in the S2E-AUTHORS file.
+ */
+
+#ifndef S2E_PLUGINS_TRACESAMPLER_H
+#define S2E_PLUGINS_TRACESAMPLER_H
+
+#include <s2e/Plugin.h>
+#include <s2e/Plugins/CorePlugin.h>
+#include <s2e/S2EExecutionState.h>
+
+#include "ExecutionTracer.h"
+#include "TraceEntries.h"
+
+namespace s2e {
+namespace plugins {
+
+/**
+ *  Restricts InstructionTracer and MemoryTracer to samples of the execution.
+ *
+ *  A sample starts every period translation blocks of a state, after a
+ *  random number of blocks per state, or at the first block executed
+ *  after each timer period. The sampled block and the next ones in the
+ *  window are traced in detail, after a TRACE_SAMPLE item that records
+ *  how many blocks the sample stands for.
+ */
+class TraceSampler : public Plugin
+{
+    S2E_PLUGIN
+public:
+    enum Mode {
+        PERIOD = ExecutionTraceSample::SAMPLE_PERIOD,
+        RANDOM = ExecutionTraceSample::SAMPLE_RANDOM,
+        TIME = ExecutionTraceSample::SAMPLE_TIME
+    };
+
+    TraceSampler(S2E* s2e): Plugin(s2e) {}
+
+    void initialize();
+
+    /** Whether the block being executed by the state is sampled */
+    bool isSampling(const S2EExecutionState *state) const {
+        return state == m_sampledState;
+    }
+
+private:
+    ExecutionTracer *m_tracer;
+
+    Mode m_mode;
+    uint64_t m_period;
+    uint32_t m_window;
+    uint64_t m_seed;
+
+    unsigned m_timerPeriod;
+    unsigned m_elapsedTics;
+    bool m_timerArmed;
+
+    const S2EExecutionState *m_sampledState;
+
+    uint64_t nextInterval(uint64_t &rng) const;
+
+    void onTranslateBlockStart(ExecutionSignal *signal,
+                               S2EExecutionState *state,
+                               TranslationBlock *tb,
+                               uint64_t pc);
+
+    void onExecuteBlockStart(S2EExecutionState *state, uint64_t pc);
+
+    void onTimer();
+
+    friend class TraceSamplerState;
+};
+
+class TraceSamplerState: public PluginState
+{
+private:
+    //Blocks executed since the previous sample
+    uint64_t m_blocks;
+    //Blocks until the next sample, in period and random modes
+    uint64_t m_countdown;
+    //Blocks left in the current sampling window
+    uint32_t m_remaining;
+
+    uint64_t m_rng;
+    //Set on the copy made when the state forks, so that
+    //both paths do not draw the same intervals
+    bool m_reseed;
+
+public:
+    TraceSamplerState(TraceSampler *sampler, S2EExecutionState *s);
+    virtual ~TraceSamplerState();
+    virtual PluginState *clone() const;
+    static PluginState *factory(Plugin *p, S2EExecutionState *s);
+
+    friend class TraceSampler;
+};
+
+} // namespace plugins
+} // namespace s2e
+
+#endif
@@ -0,0 +1,532 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in the S2E-AUTHORS file.
+ */
+
+#include "TraceWriter.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace s2e {
+namespace plugins {
+
+//Duration of the initial calibration of the time stamp counter
+#define TRACE_CLOCK_CALIBRATION_USEC 10000
+
+//Maximum number of chunks written by one writev
+#define TRACE_WRITER_BATCH 16
+
+TraceClock::TraceClock()
+{
+    m_mult = 1ULL << 32;
+    m_maxDelta = ~0ULL >> 32;
+    m_lastUsec = 0;
+
+    m_baseTicks = ticks();
+    m_baseUsec = usec();
+
+#if defined(__i386__) || defined(__x86_64__)
+    while (usec() - m_baseUsec < TRACE_CLOCK_CALIBRATION_USEC)
+        ;
+    calibrate();
+#endif
+}
+
+uint64_t TraceClock::ticks()
+{
+#if defined(__i386__) || defined(__x86_64__)
+    uint32_t lo, hi;
+    __asm__ __volatile__("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((uint64_t) hi << 32) | lo;
+#else
+    return usec();
+#endif
+}
+
+uint64_t TraceClock::usec()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+void TraceClock::calibrate()
+{
+    uint64_t curTicks = ticks();
+    uint64_t curUsec = usec();
+
+#if defined(__i386__) || defined(__x86_64__)
+    uint64_t elapsedTicks = curTicks - m_baseTicks;
+    uint64_t elapsedUsec = curUsec - m_baseUsec;
+
+    //Keep the previous scale if the interval is too short to be precise
+    if (elapsedUsec >= TRACE_CLOCK_CALIBRATION_USEC && elapsedTicks > 0 &&
+        elapsedUsec < (1ULL << 32)) {
+        m_mult = (elapsedUsec << 32) / elapsedTicks;
+        if (!m_mult) {
+            m_mult = 1;
+        }
+        m_maxDelta = ~0ULL / m_mult;
+    }
+#endif
+
+    m_baseTicks = curTicks;
+    m_baseUsec = curUsec;
+}
+
+/***/
+
+TraceWriter::TraceWriter(unsigned chunkSize, unsigned chunkCount, bool compress, bool encode)
+{
+    //Chunks are made of whole pages
+    m_chunkSize = (chunkSize + 4095) & ~4095;
+    m_chunkCount = chunkCount < 2 ? 2 : chunkCount;
+
+    void *ring;
+    if (posix_memalign(&ring, 4096, (size_t) m_chunkSize * m_chunkCount)) {
+        fprintf(stderr, "TraceWriter: could not allocate %u chunks of %u bytes\n",
+                m_chunkCount, m_chunkSize);
+        exit(-1);
+    }
+
+    m_ring = (uint8_t*) ring;
+    m_compress = compress;
+    if (m_compress) {
+        m_compressed.resize(TRACE_WRITER_BATCH * traceCompressBound(m_chunkSize));
+    }
+
+    m_encode = encode;
+    if (m_encode) {
+        m_encoded.resize(TRACE_WRITER_BATCH * traceEncodeBound(m_chunkSize));
+    }
+
+    m_head = m_tail = 0;
+    m_current = NULL;
+    m_fd = -1;
+    m_fileOffset = 0;
+    m_fileItems = 0;
+    m_stop = false;
+    m_writeError = false;
+    memset(&m_stats, 0, sizeof(m_stats));
+
+    qemu_mutex_init(&m_mutex);
+    qemu_cond_init(&m_dataCond);
+    qemu_cond_init(&m_spaceCond);
+}
+
+TraceWriter::~TraceWriter()
+{
+    close();
+
+    qemu_cond_destroy(&m_spaceCond);
+    qemu_cond_destroy(&m_dataCond);
+    qemu_mutex_destroy(&m_mutex);
+    free(m_ring);
+}
+
+bool TraceWriter::open(const std::string &fileName, bool append)
+{
+    assert(m_fd < 0);
+
+    int flags = O_RDWR | O_CREAT | (append ? 0 : O_TRUNC);
+    m_fd = ::open(fileName.c_str(), flags, 0644);
+    if (m_fd < 0) {
+        return false;
+    }
+
+    m_index.clear();
+    m_fileOffset = 0;
+    m_fileItems = 0;
+
+    off_t fileSize = lseek(m_fd, 0, SEEK_END);
+    bool ok;
+
+    if (fileSize == 0) {
+        ExecutionTraceFileHeader hdr;
+        memcpy(hdr.magic, EXECTRACE_MAGIC, sizeof(hdr.magic));
+        hdr.version = EXECTRACE_VERSION;
+        hdr.flags = 0;
+        ok = writeFully(&hdr, sizeof(hdr));
+        m_fileOffset = sizeof(hdr);
+    } else {
+        //New chunks overwrite the index, which is rewritten on close
+        ok = fileSize > 0 && loadIndex(fileSize) &&
+             lseek(m_fd, m_fileOffset, SEEK_SET) == (off_t) m_fileOffset &&
+             ftruncate(m_fd, m_fileOffset) == 0;
+    }
+
+    if (!ok) {
+        ::close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+
+    m_stop = false;
+    m_writeError = false;
+    qemu_thread_create(&m_thread, &TraceWriter::writerThread, this, QEMU_THREAD_JOINABLE);
+    return true;
+}
+
+void TraceWriter::close()
+{
+    if (m_fd < 0) {
+        return;
+    }
+
+    flush();
+
+    qemu_mutex_lock(&m_mutex);
+    m_stop = true;
+    qemu_cond_signal(&m_dataCond);
+    qemu_mutex_unlock(&m_mutex);
+    qemu_thread_join(&m_thread);
+
+    if (!writeIndex()) {
+        fprintf(stderr, "TraceWriter: could not write the trace index\n");
+    }
+
+    ::close(m_fd);
+    m_fd = -1;
+}
+
+/**
+ *  Reads the index of an existing trace. The chunk headers are scanned
+ *  if the trace has no index, e.g., because S2E was killed.
+ */
+bool TraceWriter::loadIndex(uint64_t fileSize)
+{
+    ExecutionTraceFileHeader fileHdr;
+    if (pread(m_fd, &fileHdr, sizeof(fileHdr), 0) != sizeof(fileHdr) ||
+        memcmp(fileHdr.magic, EXECTRACE_MAGIC, sizeof(fileHdr.magic)) ||
+        fileHdr.version != EXECTRACE_VERSION) {
+        fprintf(stderr, "TraceWriter: cannot append to a trace in another format\n");
+        return false;
+    }
+
+    ExecutionTraceFooter footer;
+    if (fileSize >= sizeof(fileHdr) + sizeof(footer) &&
+        pread(m_fd, &footer, sizeof(footer), fileSize - sizeof(footer)) == sizeof(footer) &&
+        footer.magic == EXECTRACE_INDEX_MAGIC &&
+        footer.indexOffset + (uint64_t) footer.chunkCount * sizeof(ExecutionTraceIndexEntry) +
+            sizeof(footer) == fileSize) {
+        m_index.resize(footer.chunkCount);
+        size_t indexSize = footer.chunkCount * sizeof(ExecutionTraceIndexEntry);
+        if (indexSize && pread(m_fd, &m_index[0], indexSize, footer.indexOffset) != (ssize_t) indexSize) {
+            return false;
+        }
+        m_fileOffset = footer.indexOffset;
+        m_fileItems = footer.itemCount;
+        return true;
+    }
+
+    uint64_t offset = sizeof(fileHdr);
+    ExecutionTraceChunkHeader hdr;
+    while (offset + sizeof(hdr) <= fileSize) {
+        if (pread(m_fd, &hdr, sizeof(hdr), offset) != sizeof(hdr) ||
+            hdr.magic != EXECTRACE_CHUNK_MAGIC ||
+            offset + sizeof(hdr) + hdr.storedSize > fileSize) {
+            //Drop the incomplete chunk
+            break;
+        }
+
+        ExecutionTraceIndexEntry entry = { offset, hdr.firstItem, hdr.itemCount,
+                                           hdr.stateId, hdr.typeMask };
+        m_index.push_back(entry);
+        m_fileItems = hdr.firstItem + hdr.itemCount;
+        offset += sizeof(hdr) + hdr.storedSize;
+    }
+
+    m_fileOffset = offset;
+    return true;
+}
+
+bool TraceWriter::writeIndex()
+{
+    ExecutionTraceFooter footer;
+    footer.indexOffset = m_fileOffset;
+    footer.itemCount = m_fileItems;
+    footer.chunkCount = m_index.size();
+    footer.magic = EXECTRACE_INDEX_MAGIC;
+
+    if (!m_index.empty() &&
+        !writeFully(&m_index[0], m_index.size() * sizeof(ExecutionTraceIndexEntry))) {
+        return false;
+    }
+
+    return writeFully(&footer, sizeof(footer));
+}
+
+void TraceWriter::startChunk(uint32_t stateId, uint64_t pid)
+{
+    commit();
+
+    //Wait for the writer to free a chunk
+    if (m_tail - m_head >= m_chunkCount) {
+        ++m_stats.stalls;
+        qemu_mutex_lock(&m_mutex);
+        while (m_tail - m_head >= m_chunkCount) {
+            qemu_cond_wait(&m_spaceCond, &m_mutex);
+        }
+        qemu_mutex_unlock(&m_mutex);
+    }
+
+    m_current = (ExecutionTraceChunkHeader*) getChunk(m_tail);
+    m_current->magic = EXECTRACE_CHUNK_MAGIC;
+    m_current->size = 0;
+    m_current->encodedSize = 0;
+    m_current->storedSize = 0;
+    m_current->flags = 0;
+    m_current->itemCount = 0;
+    m_current->stateId = stateId;
+    m_current->pid = pid;
+    m_current->firstItem = m_fileItems;
+    m_current->typeMask = 0;
+}
+
+void TraceWriter::commit()
+{
+    if (!m_current) {
+        return;
+    }
+
+    m_current = NULL;
+    ++m_stats.chunks;
+
+    //Publishes the chunk contents along with the new tail
+    qemu_mutex_lock(&m_mutex);
+    ++m_tail;
+    qemu_cond_signal(&m_dataCond);
+    qemu_mutex_unlock(&m_mutex);
+}
+
+void TraceWriter::flush()
+{
+    commit();
+
+    qemu_mutex_lock(&m_mutex);
+    while (m_head != m_tail) {
+        qemu_cond_wait(&m_spaceCond, &m_mutex);
+    }
+    qemu_mutex_unlock(&m_mutex);
+}
+
+/** Items that do not fit in a chunk get an uncompressed chunk of their own */
+void TraceWriter::writeLargeItem(uint32_t stateId, uint64_t pid, uint8_t type,
+                                 const void *data, uint32_t size)
+{
+    flush();
+
+    ExecutionTraceChunkItemHeader item;
+    item.timeStamp = m_clock.now();
+    item.size = size;
+    item.type = type;
+
+    ExecutionTraceChunkHeader hdr;
+    hdr.magic = EXECTRACE_CHUNK_MAGIC;
+    hdr.size = sizeof(item) + size;
+    hdr.encodedSize = hdr.size;
+    hdr.storedSize = hdr.size;
+    hdr.flags = 0;
+    hdr.itemCount = 1;
+    hdr.stateId = stateId;
+    hdr.pid = pid;
+    hdr.firstItem = m_fileItems;
+    hdr.typeMask = 1 << type;
+
+    struct iovec iov[3];
+    iov[0].iov_base = &hdr;
+    iov[0].iov_len = sizeof(hdr);
+    iov[1].iov_base = &item;
+    iov[1].iov_len = sizeof(item);
+    iov[2].iov_base = (void*) data;
+    iov[2].iov_len = size;
+
+    if (!writeVector(iov, 3, sizeof(hdr) + hdr.size)) {
+        m_writeError = true;
+    }
+
+    //The writer thread is idle after the flush
+    qemu_mutex_lock(&m_mutex);
+    ExecutionTraceIndexEntry entry = { m_fileOffset, hdr.firstItem, 1, stateId, hdr.typeMask };
+    m_index.push_back(entry);
+    m_fileOffset += sizeof(hdr) + hdr.size;
+    m_stats.rawBytes += hdr.size;
+    m_stats.bytes += sizeof(hdr) + hdr.size;
+    qemu_mutex_unlock(&m_mutex);
+
+    ++m_fileItems;
+    ++m_stats.items;
+    ++m_stats.chunks;
+}
+
+bool TraceWriter::writeFully(const void *buffer, size_t size)
+{
+    const uint8_t *p = (const uint8_t*) buffer;
+    while (size > 0) {
+        ssize_t ret = ::write(m_fd, p, size);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        p += ret;
+        size -= ret;
+    }
+    return true;
+}
+
+bool TraceWriter::writeVector(struct iovec *iov, unsigned count, size_t size)
+{
+    ssize_t written = writev(m_fd, iov, count);
+    if (written < 0) {
+        return false;
+    }
+
+    if ((size_t) written == size) {
+        return true;
+    }
+
+    //Short write, finish it piece by piece
+    size_t skip = written;
+    for (unsigned i = 0; i < count; ++i) {
+        if (skip >= iov[i].iov_len) {
+            skip -= iov[i].iov_len;
+            continue;
+        }
+        if (!writeFully((uint8_t*) iov[i].iov_base + skip, iov[i].iov_len - skip)) {
+            return false;
+        }
+        skip = 0;
+    }
+    return true;
+}
+
+void *TraceWriter::writerThread(void *opaque)
+{
+    static_cast<TraceWriter*>(opaque)->writeChunks();
+    return NULL;
+}
+
+void TraceWriter::writeChunks()
+{
+    qemu_mutex_lock(&m_mutex);
+
+    for (;;) {
+        while (m_head == m_tail && !m_stop) {
+            qemu_cond_wait(&m_dataCond, &m_mutex);
+        }
+
+        if (m_head == m_tail) {
+            break;
+        }
+
+        uint64_t head = m_head, tail = m_tail;
+        uint64_t offset = m_fileOffset;
+        qemu_mutex_unlock(&m_mutex);
+
+        //Gather the committed chunks into as few system calls as possible
+        struct iovec iov[2 * TRACE_WRITER_BATCH];
+        ExecutionTraceIndexEntry entries[TRACE_WRITER_BATCH];
+        unsigned count = 0;
+        size_t bytes = 0, rawBytes = 0;
+        do {
+            ExecutionTraceChunkHeader *hdr = (ExecutionTraceChunkHeader*) getChunk(head);
+            uint8_t *stored = (uint8_t*) (hdr + 1);
+
+            //Each encoding is kept only if it makes the chunk smaller
+            hdr->encodedSize = hdr->size;
+            if (m_encode) {
+                uint8_t *out = &m_encoded[count * traceEncodeBound(m_chunkSize)];
+                unsigned encodedSize = traceEncodeItems(stored, hdr->size, out);
+                if (encodedSize < hdr->size) {
+                    stored = out;
+                    hdr->encodedSize = encodedSize;
+                    hdr->flags |= EXECTRACE_CHUNK_DELTA;
+                }
+            }
+
+            hdr->storedSize = hdr->encodedSize;
+            if (m_compress) {
+                uint8_t *out = &m_compressed[count * traceCompressBound(m_chunkSize)];
+                unsigned compressedSize = traceCompress(stored, hdr->encodedSize, out);
+                if (compressedSize < hdr->encodedSize) {
+                    stored = out;
+                    hdr->storedSize = compressedSize;
+                    hdr->flags |= EXECTRACE_CHUNK_COMPRESSED;
+                }
+            }
+
+            ExecutionTraceIndexEntry entry = { offset + bytes, hdr->firstItem, hdr->itemCount,
+                                               hdr->stateId, hdr->typeMask };
+            entries[count] = entry;
+
+            iov[2 * count].iov_base = hdr;
+            iov[2 * count].iov_len = sizeof(*hdr);
+            iov[2 * count + 1].iov_base = stored;
+            iov[2 * count + 1].iov_len = hdr->storedSize;
+
+            bytes += sizeof(*hdr) + hdr->storedSize;
+            rawBytes += hdr->size;
+            ++head;
+            ++count;
+        } while (head != tail && count < TRACE_WRITER_BATCH);
+
+        bool ok = writeVector(iov, 2 * count, bytes);
+
+        qemu_mutex_lock(&m_mutex);
+        if (!ok && !m_writeError) {
+            m_writeError = true;
+            fprintf(stderr, "TraceWriter: could not write the trace (%s)\n", strerror(errno));
+        }
+
+        m_index.insert(m_index.end(), entries, entries + count);
+        m_fileOffset += bytes;
+        m_stats.rawBytes += rawBytes;
+        m_stats.bytes += bytes;
+        m_head = head;
+        qemu_cond_broadcast(&m_spaceCond);
+    }
+
+    qemu_mutex_unlock(&m_mutex);
+}
+
+} // namespace plugins
+} // namespace s2e
@@ -0,0 +1,220 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in the S2E-AUTHORS file.
+ */
+
+#ifndef S2E_PLUGINS_TRACEWRITER_H
+#define S2E_PLUGINS_TRACEWRITER_H
+
+#include <inttypes.h>
+#include <sys/uio.h>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <qemu-thread.h>
+}
+
+#include "TraceCompression.h"
+#include "TraceEncoding.h"
+#include "TraceEntries.h"
+
+namespace s2e {
+namespace plugins {
+
+/**
+ *  Cheap wall clock for trace time stamps.
+ *  Reads the time stamp counter and scales it to microseconds.
+ *  The scale is refined each time calibrate() is called.
+ */
+class TraceClock
+{
+    uint64_t m_baseTicks;
+    uint64_t m_baseUsec;
+    uint64_t m_mult; //usec = base + (ticks * mult) >> 32
+    uint64_t m_maxDelta;
+    uint64_t m_lastUsec;
+
+public:
+    TraceClock();
+
+    static uint64_t ticks();
+    static uint64_t usec();
+
+    void calibrate();
+
+    uint64_t now() {
+        uint64_t delta = ticks() - m_baseTicks;
+        if (delta > m_maxDelta) {
+            calibrate();
+            delta = ticks() - m_baseTicks;
+        }
+
+        uint64_t ret = m_baseUsec + ((delta * m_mult) >> 32);
+        //Recalibration must not make time go backwards
+        if (ret < m_lastUsec) {
+            ret = m_lastUsec;
+        }
+        m_lastUsec = ret;
+        return ret;
+    }
+
+    //Accumulated tick counts are not bounded by m_maxDelta,
+    //ticks * m_mult would overflow 64 bits.
+    double ticksToSeconds(uint64_t ticks) const {
+        return (double) ((long double) ticks * m_mult / 4294967296.0L / 1000000.0L);
+    }
+};
+
+/**
+ *  Writes a chunked execution trace.
+ *
+ *  Items are appended to the current chunk of a preallocated ring without
+ *  any locking. Full chunks (or the current one, on commit) are handed to
+ *  a background thread that encodes and compresses them and writes them
+ *  to the file.
+ *  Each chunk holds the items of only one state. The emulation thread
+ *  only blocks when the ring is full.
+ *
+ *  The chunk index is written at the end of the file when it is closed.
+ *  Reopening the file to append to it removes the index, which is then
+ *  rewritten on the next close.
+ */
+class TraceWriter
+{
+public:
+    struct Stats {
+        uint64_t items;
+        uint64_t chunks;
+        uint64_t rawBytes; //Size of the items before encoding and compression
+        uint64_t bytes;    //Size written to the file
+        uint64_t stalls;   //Times the producer waited for a free chunk
+    };
+
+private:
+    unsigned m_chunkSize;
+    unsigned m_chunkCount;
+    uint8_t *m_ring;
+    bool m_compress;
+    bool m_encode;
+    std::vector<uint8_t> m_compressed;
+    std::vector<uint8_t> m_encoded;
+
+    //Chunks handed to the writer thread (m_tail) and written (m_head).
+    //They only grow, the slot of a chunk is its number modulo m_chunkCount.
+    volatile uint64_t m_head;
+    volatile uint64_t m_tail;
+
+    //The chunk being filled, NULL if none
+    ExecutionTraceChunkHeader *m_current;
+
+    int m_fd;
+    uint64_t m_fileOffset;
+    uint64_t m_fileItems;
+    std::vector<ExecutionTraceIndexEntry> m_index;
+
+    bool m_stop;
+    bool m_writeError;
+    QemuThread m_thread;
+    QemuMutex m_mutex;
+    QemuCond m_dataCond;
+    QemuCond m_spaceCond;
+
+    TraceClock m_clock;
+    Stats m_stats;
+
+    uint8_t *getChunk(uint64_t number) const {
+        return m_ring + (number % m_chunkCount) * m_chunkSize;
+    }
+
+    void startChunk(uint32_t stateId, uint64_t pid);
+    void writeLargeItem(uint32_t stateId, uint64_t pid, uint8_t type,
+                        const void *data, uint32_t size);
+    bool writeFully(const void *buffer, size_t size);
+    bool writeVector(struct iovec *iov, unsigned count, size_t size);
+    bool loadIndex(uint64_t fileSize);
+    bool writeIndex();
+
+    static void *writerThread(void *opaque);
+    void writeChunks();
+
+public:
+    TraceWriter(unsigned chunkSize, unsigned chunkCount, bool compress, bool encode);
+    ~TraceWriter();
+
+    bool open(const std::string &fileName, bool append);
+    void close();
+    bool isOpen() const { return m_fd >= 0; }
+
+    void write(uint32_t stateId, uint64_t pid, uint8_t type,
+               const void *data, uint32_t size) {
+        uint32_t itemSize = sizeof(ExecutionTraceChunkItemHeader) + size;
+
+        if (!m_current || m_current->stateId != stateId || m_current->pid != pid ||
+            sizeof(ExecutionTraceChunkHeader) + m_current->size + itemSize > m_chunkSize) {
+            if (itemSize + sizeof(ExecutionTraceChunkHeader) > m_chunkSize) {
+                writeLargeItem(stateId, pid, type, data, size);
+                return;
+            }
+            startChunk(stateId, pid);
+        }
+
+        uint8_t *dst = (uint8_t*) (m_current + 1) + m_current->size;
+
+        ExecutionTraceChunkItemHeader *hdr = (ExecutionTraceChunkItemHeader*) dst;
+        hdr->timeStamp = m_clock.now();
+        hdr->size = size;
+        hdr->type = type;
+        memcpy(dst + sizeof(*hdr), data, size);
+
+        m_current->size += itemSize;
+        ++m_current->itemCount;
+        m_current->typeMask |= 1 << type;
+        ++m_fileItems;
+        ++m_stats.items;
+    }
+
+    /** Hands the current chunk to the writer thread */
+    void commit();
+
+    /** Commits and waits until everything is in the file */
+    void flush();
+
+    TraceClock &getClock() { return m_clock; }
+    const Stats &getStats() const { return m_stats; }
+};
+
+} // namespace plugins
+} // namespace s2e
+
+#endif
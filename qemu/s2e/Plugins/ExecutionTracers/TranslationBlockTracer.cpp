@@ -136,6 +136,9 @@ void TranslationBlockTracer::trace(S2EExecutionState *state, uint64_t pc, ExecTr
 {
     ExecutionTraceTb tb;
 
+    //Keep the unused registers constant so that they delta-encode to nothing
+    memset(&tb, 0, sizeof(tb));
+
     if (type == TRACE_TB_START) {
         if (pc != state->getTb()->pc) {
             s2e()->getWarningsStream() << "BUG! pc=" << hexval(pc)
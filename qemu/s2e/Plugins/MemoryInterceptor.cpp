@@ -66,8 +66,9 @@ S2E_DEFINE_PLUGIN(MemoryInterceptor, "Plugin to coordinate which other plugins c
 
 MemoryInterceptor::MemoryInterceptor(S2E* s2e)
     : Plugin(s2e),
-      m_readInterceptorRegistered(false),
-      m_writeInterceptorRegistered(false)
+      m_nextId(0),
+      m_checkStates(false),
+      m_verbose(false)
 {
 }
 
@@ -78,6 +79,9 @@ void MemoryInterceptor::initialize()
 
     m_verbose =
           cfg->getBool(getConfigKey() + ".verbose", false, &ok) ? 1 : 0;
+
+    //Only the pages covered by a handler need to go through the hijack signals
+    s2e()->getCorePlugin()->enableHijackPageFilter(true);
 }
 
 klee::ref<klee::Expr> MemoryInterceptor::slotMemoryRead(S2EExecutionState *state,
@@ -135,22 +139,9 @@ klee::ref<klee::Expr> MemoryInterceptor::slotMemoryRead(S2EExecutionState *state
                 << '\n';
     }
 
-    for (std::list< MemoryAccessHandler* >::iterator listener_itr = this->m_listeners.begin();
-         listener_itr != this->m_listeners.end();
-         listener_itr++)
-    {
-        if (
-                //If access type matches desired mask and either address is symbolic or matches the given range
-                ((*listener_itr)->getAccessMask() & access_type) == access_type &&
-                (
-                    (access_type & ACCESS_TYPE_SYMBOLIC_ADDRESS) ||
-                    ((*listener_itr)->getAddress() <= address &&
-                     (*listener_itr)->getAddress() + (*listener_itr)->getSize() > address)
-                )
-            )
-        {
-            return (*listener_itr)->read(state, virtaddr, hostaddr, size, is_io, is_code);
-        }
+    MemoryAccessHandler *handler = lookup(state, address, access_type);
+    if (handler) {
+        return handler->read(state, virtaddr, hostaddr, size, is_io, is_code);
     }
 
     //No handler found
@@ -212,95 +203,256 @@ bool MemoryInterceptor::slotMemoryWrite(S2EExecutionState *state,
             << '\n';
     }
 
-    for (std::list<  MemoryAccessHandler* >::iterator listener_itr = this->m_listeners.begin();
-         listener_itr != this->m_listeners.end();
-         listener_itr++)
-    {
-        if (
-                //If access type matches desired mask and either address is symbolic or matches the given range
-                ((*listener_itr)->getAccessMask() & access_type) == access_type &&
-                (
-                    (access_type & ACCESS_TYPE_SYMBOLIC_ADDRESS) ||
-                    ((*listener_itr)->getAddress() <= address &&
-                     (*listener_itr)->getAddress() + (*listener_itr)->getSize() > address)
-                )
-            )
-        {
-            return (*listener_itr)->write(state, virtaddr, hostaddr, value, is_io);
-        }
+    MemoryAccessHandler *handler = lookup(state, address, access_type);
+    if (handler) {
+        return handler->write(state, virtaddr, hostaddr, value, is_io);
     }
 
     //No handler found
     return false;
 }
 
+/**
+ *  Returns the first enabled handler whose mask accepts the access and,
+ *  for concrete addresses, whose range contains the address.
+ */
+MemoryAccessHandler *MemoryInterceptor::lookup(S2EExecutionState *state,
+                                               uint64_t address, int access_type)
+{
+    MemoryInterceptorState *plgState = NULL;
+    if (m_checkStates) {
+        plgState = static_cast<MemoryInterceptorState*>(
+                getPluginState(state, &MemoryInterceptorState::factory));
+        if (plgState->m_disabled.empty()) {
+            plgState = NULL;
+        }
+    }
+
+    if (access_type & ACCESS_TYPE_SYMBOLIC_ADDRESS) {
+        //Any range may be hit, go through all handlers
+        foreach2(it, m_listeners.begin(), m_listeners.end()) {
+            if ((it->mask & access_type) == access_type &&
+                (!plgState || !plgState->m_disabled.count(it->id))) {
+                return it->handler;
+            }
+        }
+        return NULL;
+    }
+
+    Segments::const_iterator sit = m_segments.upper_bound(address);
+    if (sit == m_segments.begin()) {
+        return NULL;
+    }
+    --sit;
+
+    const std::vector<Interceptor> &interceptors = sit->second;
+    for (unsigned i = 0; i < interceptors.size(); ++i) {
+        const Interceptor &it = interceptors[i];
+        if ((it.mask & access_type) == access_type &&
+            (!plgState || !plgState->m_disabled.count(it.id))) {
+            return it.handler;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ *  Cuts the handler ranges at all their boundaries, so that each
+ *  resulting segment is covered by the same set of handlers.
+ */
+void MemoryInterceptor::rebuildSegments()
+{
+    std::set<uint64_t> bounds;
+    foreach2(it, m_listeners.begin(), m_listeners.end()) {
+        bounds.insert(it->start);
+        if (it->end) {
+            bounds.insert(it->end);
+        }
+    }
+
+    m_segments.clear();
+    foreach2(bit, bounds.begin(), bounds.end()) {
+        std::vector<Interceptor> &interceptors = m_segments[*bit];
+        foreach2(it, m_listeners.begin(), m_listeners.end()) {
+            if (it->contains(*bit)) {
+                interceptors.push_back(*it);
+            }
+        }
+    }
+
+    CorePlugin *core = s2e()->getCorePlugin();
+    core->clearHijackedPages();
+    foreach2(it, m_listeners.begin(), m_listeners.end()) {
+        core->addHijackedPages(it->start, it->end ? it->end - it->start : ~(uint64_t) 0 - it->start);
+    }
+}
+
+void MemoryInterceptor::updateConnections()
+{
+    int masks = 0;
+    foreach2(it, m_listeners.begin(), m_listeners.end()) {
+        masks |= it->mask;
+    }
+
+    if ((masks & (ACCESS_TYPE_READ | ACCESS_TYPE_EXECUTE)) && !m_readConnection.connected()) {
+        m_readConnection = s2e()->getCorePlugin()->onHijackMemoryRead.connect(
+                sigc::mem_fun(*this, &MemoryInterceptor::slotMemoryRead));
+    } else if (!(masks & (ACCESS_TYPE_READ | ACCESS_TYPE_EXECUTE)) && m_readConnection.connected()) {
+        m_readConnection.disconnect();
+    }
+
+    if ((masks & ACCESS_TYPE_WRITE) && !m_writeConnection.connected()) {
+        m_writeConnection = s2e()->getCorePlugin()->onHijackMemoryWrite.connect(
+                sigc::mem_fun(*this, &MemoryInterceptor::slotMemoryWrite));
+    } else if (!(masks & ACCESS_TYPE_WRITE) && m_writeConnection.connected()) {
+        m_writeConnection.disconnect();
+    }
+}
+
+const MemoryInterceptor::Interceptor *MemoryInterceptor::findInterceptor(
+        MemoryAccessHandler* handler) const
+{
+    foreach2(it, m_listeners.begin(), m_listeners.end()) {
+        if (it->handler == handler) {
+            return &*it;
+        }
+    }
+    return NULL;
+}
+
 void MemoryInterceptor::addInterceptor(MemoryAccessHandler* listener)
 {
-    //TODO: Check that there is no intersection with an already added plugin
-    for (std::list< MemoryAccessHandler* >::const_iterator itr = m_listeners.begin();
-         itr != m_listeners.end();
-         itr++)
-    {
+    Interceptor interceptor;
+    interceptor.handler = listener;
+    interceptor.id = m_nextId++;
+    interceptor.start = listener->getAddress();
+    interceptor.end = listener->getAddress() + listener->getSize();
+    interceptor.mask = listener->getAccessMask();
+
+    //Check that the range monitored by the new interceptor does not intersect
+    //with any range currently monitored for the same kind of access.
+    //Only the segments overlapping the new range need to be looked at.
+    Segments::const_iterator sit = m_segments.upper_bound(interceptor.start);
+    if (sit != m_segments.begin()) {
+        --sit;
+    }
+
+    for (; sit != m_segments.end() &&
+           (!interceptor.end || sit->first < interceptor.end); ++sit) {
+        foreach2(it, sit->second.begin(), sit->second.end()) {
+            if (!(it->mask & interceptor.mask)) {
+                continue;
+            }
 
-        //This condition checks that the range monitored by the new interceptor does not intersect with any
-        //range currently monitored
-        if (
-             (
-               (listener->getAddress() >= (*itr)->getAddress() &&
-                 listener->getAddress() < (*itr)->getAddress() + (*itr)->getSize()) ||
-               (listener->getAddress() + listener->getSize() > (*itr)->getAddress() &&
-                 listener->getAddress() + listener->getSize() <= (*itr)->getAddress() + (*itr)->getSize()) ||
-               (listener->getAddress() < (*itr)->getAddress() &&
-                 listener->getAddress() + listener->getSize() >= (*itr)->getAddress() + (*itr)->getSize())) &&
-             (listener->getAccessMask() & (*itr)->getAccessMask()) != 0)
-        {
             s2e()->getWarningsStream()
                     << "Trying to add memory access handler for address range "
-                    << hexval(listener->getAddress()) << "-"
-                    << hexval(listener->getAddress()  + listener->getSize())
-                    << " (access " << hexval(listener->getAccessMask())
+                    << hexval(interceptor.start) << "-"
+                    << hexval(interceptor.end)
+                    << " (access " << hexval(interceptor.mask)
                     << ") is intersecting with already registered handler "
-                    << hexval((*itr)->getAddress()) << "-"
-                    << hexval((*itr)->getAddress()  + (*itr)->getSize())
-                    << " (access " << hexval((*itr)->getAccessMask()) << "). "
+                    << hexval(it->start) << "-"
+                    << hexval(it->end)
+                    << " (access " << hexval(it->mask) << "). "
                     << "Not adding new listener." << '\n';
             assert(false);
+            return;
         }
     }
 
-    if (!(listener->getAccessMask() & ACCESS_TYPE_SIZE_ANY)) {
+    if (!(interceptor.mask & ACCESS_TYPE_SIZE_ANY)) {
     	s2e()->getWarningsStream()
 					<< "Trying to add memory access handler for address range "
-					<< hexval(listener->getAddress()) << "-"
-					<< hexval(listener->getAddress()  + listener->getSize())
-					<< " (access " << hexval(listener->getAccessMask())
+					<< hexval(interceptor.start) << "-"
+					<< hexval(interceptor.end)
+					<< " (access " << hexval(interceptor.mask)
 					<< ") without specifying any size that it should listen for."
 					<< "Not adding new listener." << '\n';
     	assert(false);
+    	return;
     }
 
-    m_listeners.push_back(listener);
+    m_listeners.push_back(interceptor);
+    rebuildSegments();
+    updateConnections();
 
-    if ((listener->getAccessMask() & (ACCESS_TYPE_READ | ACCESS_TYPE_EXECUTE)) && !m_readInterceptorRegistered)
-    {
-        s2e()->getCorePlugin()->onHijackMemoryRead.connect(sigc::mem_fun(*this, &MemoryInterceptor::slotMemoryRead));
-        m_readInterceptorRegistered = true;
+    if (m_verbose) {
+        s2e()->getDebugStream()
+                << "[MemoryInterceptor] added handler for " << hexval(interceptor.start)
+                << "-" << hexval(interceptor.end)
+                << ", " << m_listeners.size() << " handlers in "
+                << m_segments.size() << " segments" << '\n';
     }
+}
 
-    if ((listener->getAccessMask() & ACCESS_TYPE_WRITE) && !m_writeInterceptorRegistered)
-    {
-        s2e()->getCorePlugin()->onHijackMemoryWrite.connect(sigc::mem_fun(*this, &MemoryInterceptor::slotMemoryWrite));
-        m_writeInterceptorRegistered = true;
+void MemoryInterceptor::removeInterceptor(MemoryAccessHandler* listener)
+{
+    foreach2(it, m_listeners.begin(), m_listeners.end()) {
+        if (it->handler == listener) {
+            m_listeners.erase(it);
+            rebuildSegments();
+            updateConnections();
+            return;
+        }
     }
+
+    s2e()->getWarningsStream()
+            << "[MemoryInterceptor] Trying to remove a memory access handler "
+            << "that was not registered" << '\n';
 }
 
-void MemoryInterceptor::removeInterceptor(MemoryAccessHandler* listener)
+void MemoryInterceptor::setInterceptorEnabled(S2EExecutionState *state,
+                                              MemoryAccessHandler* handler,
+                                              bool enabled)
 {
-	//TODO: implement
-	assert(false);
+    const Interceptor *interceptor = findInterceptor(handler);
+    if (!interceptor) {
+        s2e()->getWarningsStream(state)
+                << "[MemoryInterceptor] Trying to enable or disable a memory access handler "
+                << "that was not registered" << '\n';
+        return;
+    }
+
+    DECLARE_PLUGINSTATE(MemoryInterceptorState, state);
+    if (enabled) {
+        plgState->m_disabled.erase(interceptor->id);
+    } else {
+        plgState->m_disabled.insert(interceptor->id);
+        m_checkStates = true;
+    }
+}
+
+bool MemoryInterceptor::isInterceptorEnabled(S2EExecutionState *state,
+                                             MemoryAccessHandler* handler)
+{
+    const Interceptor *interceptor = findInterceptor(handler);
+    if (!interceptor) {
+        return false;
+    }
+
+    DECLARE_PLUGINSTATE(MemoryInterceptorState, state);
+    return !plgState->m_disabled.count(interceptor->id);
+}
+
+MemoryInterceptorState::MemoryInterceptorState()
+{
+
 }
 
+MemoryInterceptorState::~MemoryInterceptorState()
+{
 
+}
+
+MemoryInterceptorState* MemoryInterceptorState::clone() const
+{
+    return new MemoryInterceptorState(*this);
+}
+
+PluginState *MemoryInterceptorState::factory(Plugin *p, S2EExecutionState *s)
+{
+    return new MemoryInterceptorState();
+}
 
 } // namespace plugins
 } // namespace s2e
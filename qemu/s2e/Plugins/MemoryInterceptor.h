@@ -37,6 +37,9 @@
 #define S2E_PLUGINS_MEMORY_INTERCEPTOR_H
 
 #include <list>
+#include <map>
+#include <set>
+#include <vector>
 
 #include <s2e/Plugin.h>
 #include <s2e/Plugins/CorePlugin.h>
@@ -99,6 +102,15 @@ protected:
     uint64_t m_mask;
 };
 
+/**
+ *  Dispatches hijacked memory accesses to the registered handlers.
+ *
+ *  The address range and access mask of a handler are read once when it is
+ *  added. Handler ranges are cut into disjoint segments kept in a sorted map,
+ *  so that finding the handler of a concrete address is a single O(log n)
+ *  lookup regardless of the number of registered ranges. When several
+ *  handlers match an access, the one registered first wins.
+ */
 class MemoryInterceptor : public Plugin
 {
     S2E_PLUGIN
@@ -117,15 +129,69 @@ public:
             bool isIO);
     void initialize();
     void addInterceptor(MemoryAccessHandler* handler);
+
+    /** Unregisters the handler. The caller keeps ownership of the object. */
     void removeInterceptor(MemoryAccessHandler* handler);
-//    void registerInterceptors();
+
+    /**
+     *  Enables or disables a registered handler in the given state only.
+     *  Handlers are enabled by default, and forked states inherit the
+     *  setting of their parent.
+     */
+    void setInterceptorEnabled(S2EExecutionState *state,
+                               MemoryAccessHandler* handler, bool enabled);
+    bool isInterceptorEnabled(S2EExecutionState *state,
+                              MemoryAccessHandler* handler);
 
 private:
-    bool m_readInterceptorRegistered;
-    bool m_writeInterceptorRegistered;
-    std::list< MemoryAccessHandler* > m_listeners;
+    struct Interceptor {
+        MemoryAccessHandler *handler;
+        /* Unique across registrations, so that per-state settings
+           never apply to a handler registered later at the same address */
+        unsigned id;
+        uint64_t start;
+        /* One past the last byte, 0 if the range goes up to the end of the address space */
+        uint64_t end;
+        int mask;
+
+        bool contains(uint64_t address) const {
+            return address >= start && (end == 0 || address < end);
+        }
+    };
+
+    typedef std::list<Interceptor> Interceptors;
+    /* Segment start => handlers covering the segment, in registration order.
+       A segment lasts until the start of the next one. */
+    typedef std::map<uint64_t, std::vector<Interceptor> > Segments;
+
+    sigc::connection m_readConnection;
+    sigc::connection m_writeConnection;
+    /* In registration order */
+    Interceptors m_listeners;
+    Segments m_segments;
+    unsigned m_nextId;
+    /* Set once a handler was disabled in some state */
+    bool m_checkStates;
     bool m_verbose;
 
+    void rebuildSegments();
+    const Interceptor *findInterceptor(MemoryAccessHandler* handler) const;
+    MemoryAccessHandler *lookup(S2EExecutionState *state, uint64_t address, int accessType);
+    void updateConnections();
+};
+
+class MemoryInterceptorState : public PluginState
+{
+    /* Ids of the handlers disabled in this state */
+    std::set<unsigned> m_disabled;
+
+public:
+    MemoryInterceptorState();
+    virtual ~MemoryInterceptorState();
+    virtual MemoryInterceptorState* clone() const;
+    static PluginState *factory(Plugin *p, S2EExecutionState *s);
+
+    friend class MemoryInterceptor;
 };
 
 } // namespace plugins
@@ -72,6 +72,7 @@ extern "C" {
 #include <stdlib.h>
 #include <unistd.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
 #include <sys/types.h>
@@ -131,6 +132,8 @@ std::vector<int> split_to_int(std::string input)
 }
 
 TCPClient::TCPClient(std::string host, int port)
+    : m_rxPos(0),
+      m_rxLen(0)
 {
     /* ソケットの作成 */
     m_sock = socket(AF_INET, SOCK_STREAM, 0);
@@ -152,6 +155,10 @@ TCPClient::TCPClient(std::string host, int port)
     else{
         std::cout << "[*] TCPClient: connected to " << host << ":" << port << '\n';
     }
+
+    // Requests are small and latency bound, don't let Nagle delay them
+    int one = 1;
+    setsockopt(m_sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
 }
 
 TCPClient::~TCPClient()
@@ -166,17 +173,37 @@ void TCPClient::sendline(std::string msg)
     write(m_sock, msg.c_str(), msg.size());
 }
 
+/**
+ * Returns the next received character, refilling the buffer with
+ * a single read() when it is empty. Returns 0 when the peer closed
+ * the connection.
+ */
+int TCPClient::recvchar(char *c)
+{
+    if (m_rxPos == m_rxLen) {
+        int count = read(m_sock, m_rxBuf, sizeof(m_rxBuf));
+        if (count <= 0) {
+            return 0;
+        }
+        m_rxPos = 0;
+        m_rxLen = count;
+    }
+
+    *c = m_rxBuf[m_rxPos++];
+    return 1;
+}
+
 std::string TCPClient::recvline()
 {
-    char c;
+    char c = 0;
     int count;
     m_buf = "";
-    count = read(m_sock, &c, 1);
-    if (c != '\r' && c!= '\0' && count > 0) {
+    count = recvchar(&c);
+    if (c != '\r' && c!= '\0' && c != '\n' && count > 0) {
         m_buf += c;
     }
     while(count > 0 && c != '\n'){
-        count = read(m_sock, &c, 1);
+        count = recvchar(&c);
         if(c == '\r'){
             continue;
         }
@@ -184,32 +211,16 @@ std::string TCPClient::recvline()
             m_buf += c;
         }
     }
-    // std::string buf = m_buf;
-    // std::string::size_type pos;
-    // pos = buf.find("\r");
-    // if (pos != std::string::npos) {
-    //     buf.replace(pos, 1, "\\r");
-    // }
-    // pos = buf.find("\n");
-    // if (pos != std::string::npos) {
-    //     buf.replace(pos, 1, "\\n");
-    // }
-    // if(m_buf.size() == 1){
-    //     std::cout << "[*] m_buf[0] = " << (int) m_buf[0] << '\n';
-    // }
-    // std::cout << "[*] TCPClient::recvline(): recieved '" << buf << "' (length = " << m_buf.size() << ")" << '\n';
     return m_buf;
 }
 
 std::string TCPClient::recvuntil(std::string terminator)
 {
     char c;
-    int count;
-    unsigned int len_terminator = terminator.size();
     m_buf = "";
-    while(m_buf.size() < len_terminator){
-        count = read(m_sock, &c, 1);
-        if(count == 0){ // tcp.flag.fin == 1
+    while(m_buf.size() < terminator.size() ||
+          m_buf.compare(m_buf.size() - terminator.size(), terminator.size(), terminator) != 0){
+        if(recvchar(&c) == 0){ // tcp.flag.fin == 1
             return m_buf;
         }
         if(c == '\r'){
@@ -217,22 +228,12 @@ std::string TCPClient::recvuntil(std::string terminator)
         }
         m_buf += c;
     }
-    while(m_buf.find(terminator) == std::string::npos){
-        count = read(m_sock, &c, 1);
-        if(count == 0){ // tcp.flag.fin == 1
-            return m_buf;
-        }
-        if(c == '\r'){
-            continue;
-        }        
-        m_buf += c;
-    }
     // std::cout << "[*] recieved " << m_buf << '\n';
     return m_buf;
 }
 
-OpenOCD::OpenOCD():
-    m_openocd("127.0.0.1", 4444)
+OpenOCD::OpenOCD(std::string host, int port):
+    m_openocd(host, port)
 {
     m_openocd.recvline(); // "Open On-Chip Debugger"
 }
@@ -259,21 +260,89 @@ std::string OpenOCD::command(std::string cmd, bool expect_response){
 }
 
 
-std::vector<int> OpenOCD::mdw(int addr, int count)
+std::vector<int> OpenOCD::md(std::string cmd, uint32_t addr, int count)
 {
+    std::vector<int> values;
     std::string res;
-    res = command("mdw " + std::to_string(addr) + " " + std::to_string(count)); // compile error 
-    res = res.substr(res.find(":") + 2);
-    return split_to_int(res);
+    res = command(cmd + " " + intToHex(addr) + " " + std::to_string(count));
+
+    // OpenOCD prints at most 32 bytes per line, each line prefixed by "<address>: "
+    for (;;) {
+        std::string::size_type pos = res.find(": ");
+        if (pos == std::string::npos) {
+            std::cout << "[!] OpenOCD: unexpected answer to " << cmd << ": '" << res << "'" << '\n';
+            break;
+        }
+
+        std::vector<int> line = split_to_int(res.substr(pos + 2));
+        values.insert(values.end(), line.begin(), line.end());
+        if ((int) values.size() >= count) {
+            break;
+        }
+        res = m_openocd.recvline();
+    }
+
+    values.resize(count, 0);
+    return values;
+}
+
+std::vector<int> OpenOCD::mdw(uint32_t addr, int count)
+{
+    return md("mdw", addr, count);
 }
 
-void OpenOCD::mww(int addr, int content)
+void OpenOCD::mww(uint32_t addr, int content)
 {
     std::string res;
-    res = command("mww " + std::to_string(addr) + " " + std::to_string(content), false);
+    res = command("mww " + intToHex(addr) + " " + intToHex((uint32_t) content), false);
     std::cout << res << '\n';
 }
 
+void OpenOCD::readWords(uint64_t address, unsigned count, std::vector<uint32_t> &words)
+{
+    std::vector<int> values = mdw(address, count);
+    words.assign(values.begin(), values.end());
+}
+
+uint64_t OpenOCD::readValue(uint64_t address, unsigned size)
+{
+    switch (size) {
+    case 1: return (uint8_t) md("mdb", address, 1)[0];
+    case 2: return (uint16_t) md("mdh", address, 1)[0];
+    default: return (uint32_t) md("mdw", address, 1)[0];
+    }
+}
+
+/**
+ * All writes go on a single line, separated by ';'.
+ * OpenOCD echoes the line and prints nothing else for mw[bhw],
+ * so the whole batch costs one round-trip.
+ */
+void OpenOCD::writeBatch(const std::vector<s2e::plugins::RemoteMemoryWrite> &writes)
+{
+    std::string line;
+
+    for (unsigned i = 0; i < writes.size(); ++i) {
+        const s2e::plugins::RemoteMemoryWrite &w = writes[i];
+
+        if (!line.empty()) {
+            line += "; ";
+        }
+
+        switch (w.size) {
+        case 1: line += "mwb " + intToHex(w.address) + " " + intToHex(w.value & 0xff); break;
+        case 2: line += "mwh " + intToHex(w.address) + " " + intToHex(w.value & 0xffff); break;
+        case 8:
+            line += "mww " + intToHex(w.address) + " " + intToHex(w.value & 0xffffffff) + "; ";
+            line += "mww " + intToHex(w.address + 4) + " " + intToHex(w.value >> 32);
+            break;
+        default: line += "mww " + intToHex(w.address) + " " + intToHex(w.value & 0xffffffff); break;
+        }
+    }
+
+    command(line, false);
+}
+
 // void print_vector(std::vector<int> vec)
 // {
 //     // std::copy(vec.begin(), vec.end(), std::ostream_iterator<int>(std::cout,", "));
@@ -286,6 +355,37 @@ void OpenOCD::mww(int addr, int content)
 namespace s2e {
 namespace plugins {
     
+/*
+ * Example configuration:
+ *      RemoteMemory = {
+ *          listen = ":5555",
+ *          target = "openocd",
+ *          protocol = "binary",
+ *          maxInFlight = 64,
+ *          sendCpuState = false,
+ *          openocdHost = "127.0.0.1",
+ *          openocdPort = 4444,
+ *          cacheLineSize = 64,
+ *          maxPendingWrites = 32,
+ *          statsInterval = 10,
+ *          recordFile = "board.rmtrace",
+ *          -- replayFile = "board.rmtrace",
+ *          -- replayFallback = false,
+ *          -- replayWindow = 256,
+ *          ranges = {
+ *              sram = {
+ *                  address = 0x20000000,
+ *                  size = 0x10000,
+ *                  cacheable = true
+ *              },
+ *              peripherals = {
+ *                  address = 0x40000000,
+ *                  size = 0x100000
+ *              }
+ *          }
+ *      }
+ */
+
 S2E_DEFINE_PLUGIN(RemoteMemory, "Asks a remote program what the memory contents actually should be", "RemoteMemory", "MemoryInterceptor", "Initializer");
 
 void RemoteMemory::initialize()
@@ -298,9 +398,66 @@ void RemoteMemory::initialize()
 	bool writeBack =
 		cfg->getBool(getConfigKey() + ".writeBack", false, &ok);
       
-    std::string serverSocketAddress = cfg->getString(getConfigKey() + ".listen", ":5555", &ok);
-    
-    m_remoteInterface = std::tr1::shared_ptr<RemoteMemoryInterface>(new RemoteMemoryInterface(s2e(), serverSocketAddress, m_verbose)); 
+    RemoteMemoryOptions options;
+    options.listenAddress = cfg->getString(getConfigKey() + ".listen", ":5555", &ok);
+
+    //Where memory is read from: "openocd", or "avatar" for the remote end of the listen socket
+    std::string target = cfg->getString(getConfigKey() + ".target", "openocd", &ok);
+    if (target != "openocd" && target != "avatar") {
+        s2e()->getWarningsStream() << "[RemoteMemory] Unknown target " << target << '\n';
+        exit(-1);
+    }
+    options.useOpenOCD = target == "openocd";
+
+    //OpenOCD telnet server, or the loopback stand-in from tools/tools/scripts
+    options.openocdHost = cfg->getString(getConfigKey() + ".openocdHost", "127.0.0.1", &ok);
+    options.openocdPort = cfg->getInt(getConfigKey() + ".openocdPort", 4444, &ok);
+
+    //Encoding used on the listen socket, JSON is kept for older peers
+    std::string protocol = cfg->getString(getConfigKey() + ".protocol", "json", &ok);
+    if (protocol != "json" && protocol != "binary") {
+        s2e()->getWarningsStream() << "[RemoteMemory] Unknown protocol " << protocol << '\n';
+        exit(-1);
+    }
+    options.protocol = protocol == "binary" ? REMOTE_PROTOCOL_BINARY : REMOTE_PROTOCOL_JSON;
+
+    //Number of requests that may wait for their reply at the same time
+    options.maxInFlight = cfg->getInt(getConfigKey() + ".maxInFlight", 64, &ok);
+    if (options.maxInFlight == 0) {
+        options.maxInFlight = 1;
+    }
+
+    //Send all the registers with each JSON request, not only the pc
+    options.sendCpuState = cfg->getBool(getConfigKey() + ".sendCpuState", false, &ok);
+
+    //Size of the lines fetched at once from cacheable ranges
+    options.cacheLineSize = cfg->getInt(getConfigKey() + ".cacheLineSize", 64, &ok);
+    if ((options.cacheLineSize < 4) || (options.cacheLineSize & (options.cacheLineSize - 1))) {
+        s2e()->getWarningsStream() << "[RemoteMemory] cacheLineSize must be a power of 2 and at least 4" << '\n';
+        exit(-1);
+    }
+
+    //Number of writes queued before they are sent to the target
+    options.maxPendingWrites = cfg->getInt(getConfigKey() + ".maxPendingWrites", 32, &ok);
+    if (options.maxPendingWrites == 0) {
+        options.maxPendingWrites = 1;
+    }
+
+    m_statsInterval = cfg->getInt(getConfigKey() + ".statsInterval", 0, &ok);
+
+    //Record the accesses to a trace, or answer them from a recorded trace.
+    //Without replayFallback, replay runs do not need the board at all.
+    options.recordFile = cfg->getString(getConfigKey() + ".recordFile", "", &ok);
+    options.replayFile = cfg->getString(getConfigKey() + ".replayFile", "", &ok);
+    options.replayFallback = cfg->getBool(getConfigKey() + ".replayFallback", false, &ok);
+    options.replayWindow = cfg->getInt(getConfigKey() + ".replayWindow", 256, &ok);
+    if (!options.recordFile.empty() && !options.replayFile.empty()) {
+        s2e()->getWarningsStream() << "[RemoteMemory] recordFile and replayFile are mutually exclusive" << '\n';
+        exit(-1);
+    }
+
+    m_remoteInterface = std::tr1::shared_ptr<RemoteMemoryInterface>(
+            new RemoteMemoryInterface(s2e(), this, options, m_verbose));
 	m_remoteInterface->m_writeBack = writeBack;
     MemoryInterceptor* memoryInterceptor = static_cast<MemoryInterceptor *>(s2e()->getPlugin("MemoryInterceptor"));
     assert(memoryInterceptor);
@@ -351,12 +508,19 @@ void RemoteMemory::initialize()
 
                  uint64_t address = cfg->getInt(getConfigKey() + ".ranges." + *itr + ".address");
                  uint64_t size = cfg->getInt(getConfigKey() + ".ranges." + *itr + ".size");
+
+                 //RAM-like ranges may be cached, MMIO ranges must not
+                 bool cacheable = cfg->getBool(getConfigKey() + ".ranges." + *itr + ".cacheable", false);
+                 if (m_remoteInterface->getEngine()) {
+                     m_remoteInterface->getEngine()->addRange(address, size, cacheable);
+                 }
 				 int mask = ACCESS_TYPE_READ | ACCESS_TYPE_WRITE |
 					 ACCESS_TYPE_EXECUTE | ACCESS_TYPE_CONCRETE_VALUE |
 					 ACCESS_TYPE_SYMBOLIC_VALUE |
 					 ACCESS_TYPE_CONCRETE_ADDRESS | ACCESS_TYPE_IO |
 					 ACCESS_TYPE_NON_IO | ACCESS_TYPE_SIZE_ANY;
-                 s2e()->getDebugStream() << "[RemoteMemory] Monitoring memory range " << *itr << ": " << hexval(address) << "-" << hexval(address + size) << '\n';
+                 s2e()->getDebugStream() << "[RemoteMemory] Monitoring memory range " << *itr << ": " << hexval(address) << "-" << hexval(address + size)
+                                         << (cacheable ? " (cacheable)" : " (volatile)") << '\n';
                  memoryInterceptor->addInterceptor(new RemoteMemoryListener(
                         s2e(), 
                         m_remoteInterface.get(), 
@@ -380,12 +544,47 @@ void RemoteMemory::initialize()
      }
     
       
+    //Queued writes must reach the target before the guest can observe
+    //their side effects (interrupts) or before another state runs.
+    s2e()->getCorePlugin()->onException.connect(
+            sigc::mem_fun(*this, &RemoteMemory::onException));
+    s2e()->getCorePlugin()->onStateSwitch.connect(
+            sigc::mem_fun(*this, &RemoteMemory::onStateSwitch));
+    s2e()->getCorePlugin()->onTimer.connect(
+            sigc::mem_fun(*this, &RemoteMemory::onTimer));
+
     if (m_verbose)
         s2e()->getDebugStream() << "[RemoteMemory]: initialized" << '\n';
 }
 
 RemoteMemory::~RemoteMemory()
 {
+    if (m_remoteInterface) {
+        m_remoteInterface->flush();
+        m_remoteInterface->flushTrace();
+        m_remoteInterface->printStats(s2e()->getMessagesStream());
+    }
+}
+
+void RemoteMemory::onException(S2EExecutionState *state, unsigned index, uint64_t pc)
+{
+    m_remoteInterface->flush();
+}
+
+void RemoteMemory::onStateSwitch(S2EExecutionState *currentState, S2EExecutionState *nextState)
+{
+    m_remoteInterface->flush();
+}
+
+void RemoteMemory::onTimer()
+{
+    m_remoteInterface->flush();
+    m_remoteInterface->flushTrace();
+
+    if (m_statsInterval && ++m_elapsedTicks >= m_statsInterval) {
+        m_elapsedTicks = 0;
+        m_remoteInterface->printStats(s2e()->getMessagesStream());
+    }
 }
 
 std::string intToHex(uint64_t val)
@@ -407,153 +606,101 @@ std::string intToHex(uint64_t val)
 //     return val;
 // }
 
-RemoteMemoryInterface::RemoteMemoryInterface(S2E* s2e, std::string remoteSockAddress, bool verbose) 
+RemoteMemoryInterface::RemoteMemoryInterface(S2E* s2e, RemoteMemory *plugin,
+                                             const RemoteMemoryOptions &options, bool verbose)
     : m_s2e(s2e), 
-      m_cancelThread(false), 
+      m_plugin(plugin),
       m_socket(std::tr1::shared_ptr<QemuTcpSocket>(new QemuTcpSocket())),
-      m_state(NULL),
       m_verbose(verbose)
 {   
-    qemu_mutex_init(&m_mutex);
-    qemu_cond_init(&m_responseCond);
-    
-    QemuTcpServerSocket serverSock(remoteSockAddress.c_str());
-    m_s2e->getMessagesStream() << "[RemoteMemory]: Waiting for connection on " << remoteSockAddress << '\n';
-    serverSock.accept(*m_socket);
-    
-    qemu_thread_create(&m_thread, &RemoteMemoryInterface::receiveThread, this, 0);
-}
+    if (!options.recordFile.empty()) {
+        m_recorder = std::tr1::shared_ptr<RemoteMemoryRecorder>(new RemoteMemoryRecorder());
+        if (!m_recorder->open(options.recordFile)) {
+            m_s2e->getWarningsStream() << "[RemoteMemory] Could not create trace file "
+                    << options.recordFile << ": " << strerror(errno) << '\n';
+            exit(-1);
+        }
+        m_s2e->getMessagesStream() << "[RemoteMemory] Recording accesses to " << options.recordFile << '\n';
+    }
 
-void * RemoteMemoryInterface::receiveThread(void * opaque)
-{
-    RemoteMemoryInterface * rmi = static_cast<RemoteMemoryInterface *>(opaque);
-    while (!rmi->m_cancelThread)
-    {
-        std::string token;
-            
-        getline(*rmi->m_socket, token, '\n');
-
-        if (token.size() == 0 && !rmi->m_socket->isConnected())
-        {
-            //TODO: do something to gracefully shutdown qemu (i,.e. unblock main thread, return dummy value, shutdown vm)
-            rmi->m_s2e->getWarningsStream() << "[RemoteMemory] Remote end disconnected, machine is dead" << '\n';
-            ::exit(1);
-            break;
+    if (!options.replayFile.empty()) {
+        m_replayer = std::tr1::shared_ptr<RemoteMemoryReplayer>(new RemoteMemoryReplayer(options.replayWindow));
+        if (!m_replayer->open(options.replayFile)) {
+            m_s2e->getWarningsStream() << "[RemoteMemory] Could not load trace file "
+                    << options.replayFile << '\n';
+            exit(-1);
+        }
+        m_s2e->getMessagesStream() << "[RemoteMemory] Replaying " << m_replayer->getRecordCount()
+                << " accesses from " << options.replayFile << '\n';
+
+        if (!options.replayFallback) {
+            return;
         }
-        
-        
-        rmi->parse(token);
     }
-    
-    return NULL;
+
+    QemuTcpServerSocket serverSock(options.listenAddress.c_str());
+    m_s2e->getMessagesStream() << "[RemoteMemory]: Waiting for connection on " << options.listenAddress << '\n';
+    serverSock.accept(*m_socket);
+
+    m_transport = std::tr1::shared_ptr<RemoteMemoryTransport>(new RemoteMemoryTransport(
+            s2e, m_socket, options.protocol, options.maxInFlight, options.sendCpuState, verbose));
+    m_transport->start();
+
+    RemoteMemoryTarget *target = m_transport.get();
+    if (options.useOpenOCD) {
+        m_openocd_client = std::tr1::shared_ptr<OpenOCD>(new OpenOCD(options.openocdHost, options.openocdPort));
+        target = m_openocd_client.get();
+    }
+
+    m_engine = std::tr1::shared_ptr<RemoteMemoryEngine>(
+            new RemoteMemoryEngine(target, options.cacheLineSize, options.maxPendingWrites));
 }
 
-void RemoteMemoryInterface::parse(std::string& token)
+/**
+ * FNV-1a hash of the general purpose registers. Symbolic registers
+ * are hashed as 0.
+ */
+static uint32_t cpuStateDigest(S2EExecutionState *state)
 {
-    std::tr1::shared_ptr<json::Object> jsonObject = std::tr1::shared_ptr<json::Object>(new json::Object());
+    uint32_t hash = 2166136261u;
 
-    std::istringstream tokenAsStream(token);
-    
-    try
-    {
-        json::Reader::Read(*jsonObject, tokenAsStream);
-        
-        if(jsonObject->Find("reply") != jsonObject->End())
-        {
-            //TODO: notify and pass object
-            qemu_mutex_lock(&m_mutex);
-            m_responseQueue.push(jsonObject);
-            qemu_cond_signal(&m_responseCond);
-            qemu_mutex_unlock(&m_mutex);
+#ifdef TARGET_ARM
+#define CPU_NB_REGS 16
+#endif
+    for (int i = 0; i < CPU_NB_REGS; i++) {
+        target_ulong reg = 0;
+        if (!state->readCpuRegisterConcrete(CPU_REG_OFFSET(i), &reg, sizeof(reg))) {
+            reg = 0;
         }
-        else
-        {
-            try
-            {
-                json::Object::iterator itrCmd = jsonObject->Find("cmd");
-                if (itrCmd == jsonObject->End())
-                {
-                    m_s2e->getWarningsStream() << "[RemoteMemory] Received json object that was neither a cmd nor a reply: " << token << '\n';
-                    return;
-                }
-                
-                json::String& cmd = itrCmd->element;
-                
-                handleClientCommand(cmd, jsonObject);
-            }
-            catch (json::Exception& ex)
-            {
-                m_s2e->getWarningsStream() << "[RemoteMemory] JSON exception while handling a command from the client" << '\n';
-            }
+
+        for (unsigned j = 0; j < sizeof(reg); j++) {
+            hash ^= (reg >> (8 * j)) & 0xff;
+            hash *= 16777619u;
         }
     }
-    catch (json::Exception& ex)
-    {
-        m_s2e->getWarningsStream() <<  "[RemoteMemory] Exception in JSON data: '" << token << "'" << '\n';
-    }
-}
 
-void RemoteMemoryInterface::handleClientCommand(std::string cmd, std::tr1::shared_ptr<json::Object> params)
-{
-    qemu_mutex_lock(&m_mutex);
-    m_interruptQueue.push(params);
-    qemu_mutex_unlock(&m_mutex);
+    return hash;
 }
 
-  
 /**
  * Calls the remote helper to read a value from memory.
  */
 uint64_t RemoteMemoryInterface::readMemory(S2EExecutionState * state, uint32_t address, int size)
 {
-     json::Object request;
-     json::Object params;
-     json::Object cpu_state;
-     
 	 setHit();
      if (m_verbose)
         m_s2e->getDebugStream() << "[RemoteMemory] reading memory from address " << hexval(address) << "[" << size << "]" << '\n';
-     request.Insert(json::Object::Member("cmd", json::String("read")));
-     
-     //HACK: Instead of using the physical address switch here, this should be specified somehow ...
-     klee::ref<klee::Expr> exprValue = state->readMemory(address, size << 3, S2EExecutionState::PhysicalAddress);
-     
-     if (exprValue.isNull())
-     {
-         if (m_verbose)
-            m_s2e->getDebugStream() << "[RemoteMemory] Failed to read old memory value at address " << hexval(address) << '\n';
-     }
-     else if (isa<klee::ConstantExpr>(exprValue))
-     {
-         params.Insert(json::Object::Member("old_value", json::String(intToHex(cast<klee::ConstantExpr>(exprValue)->getZExtValue()))));
-     }
-     else
-     {
-         m_s2e->getWarningsStream() << "[RemoteMemory] Old value of memory at 0x" << hexval(address) << " is symbolic (currently not supported)" << '\n';
+
+     uint64_t ret_val;
+     if (m_replayer) {
+         ret_val = replayRead(state, address, size);
+     } else {
+         m_transport->setState(state);
+         ret_val = m_engine->read(address, size);
+         if (m_recorder) {
+             record(state, REMOTE_TRACE_READ, address, size, ret_val);
+         }
      }
-         
-     
-     params.Insert(json::Object::Member("address", json::String(intToHex(address))));
-     params.Insert(json::Object::Member("size", json::String(intToHex(size))));
-     
-	 buildCPUState(state, cpu_state, "read");
-     request.Insert(json::Object::Member("params", params));
-     request.Insert(json::Object::Member("cpu_state", cpu_state));
-
-	//  std::tr1::shared_ptr<json::Object> response;
-	//  submitAndWait(state, request, response);
-
-	// //TODO: There could be multiple responses, but we assume the first is the right
- //     json::String& strValue = (*response)["value"];
- //     uint64_t ret_val = hexBufToInt(strValue);
-
-     uint64_t ret_val = m_openocd_client.mdw(address, 1)[0];
-     // std::cout << "ret_val = " << ret_val << '\n';
-     // uint64_t ret_val;
-     // for(int i = 0; i < 100; i++){
-     //    std::cout << "Test Loop #" << i << '\n';
-     //    ret_val = m_openocd_client.mdw(address, 1)[0];
-     // }
 
 	if (m_writeBack) {
 #ifdef TARGET_WORDS_BIGENDIAN
@@ -569,141 +716,119 @@ uint64_t RemoteMemoryInterface::readMemory(S2EExecutionState * state, uint32_t a
 	return ret_val;
 }
 
-bool RemoteMemoryInterface::waitForAnswer(S2EExecutionState *state,
-		std::tr1::shared_ptr<json::Object> &response)
-{
-	qemu_mutex_lock(&m_mutex);
-	m_state = state;
-
-	while (m_responseQueue.empty())  {
-		qemu_cond_wait(&m_responseCond, &m_mutex);
-	}
-
-	response = m_responseQueue.front();
-	m_responseQueue.pop();
-	m_state = NULL;
-	qemu_mutex_unlock(&m_mutex);
-	return true;
-}
-  
 /**
  * Calls the remote helper to write a value to memory.
- * This method returns immediatly, as there is not return value to wait for.
+ * This method returns immediatly, the write is acknowledged asynchronously.
  */
 void RemoteMemoryInterface::writeMemory(S2EExecutionState * state, uint32_t address, int size, uint64_t value)
 {
-     json::Object request;
-     json::Object params;
-     json::Object cpu_state;
-     
 	 setHit();
      if (m_verbose)
         m_s2e->getDebugStream() << "[RemoteMemory] writing memory at address " << hexval(address) << "[" << size << "] = " << hexval(value) << '\n';
-     request.Insert(json::Object::Member("cmd", json::String("write")));
-     
-     params.Insert(json::Object::Member("value", json::String(intToHex(value))));
-         
-     
-     params.Insert(json::Object::Member("address", json::String(intToHex(address))));
-     params.Insert(json::Object::Member("size", json::String(intToHex(size))));
-     
-     
-	 buildCPUState(state, cpu_state, "write");
-     request.Insert(json::Object::Member("params", params));
-     request.Insert(json::Object::Member("cpu_state", cpu_state));
 
-	 submitRequest(state, request);
+     //The live target, if any, only answers reads that diverge from the trace
+     if (m_replayer) {
+         DECLARE_PLUGINSTATE_P(m_plugin, RemoteMemoryState, state);
+         m_replayer->write(plgState->m_cursor, cpuStateDigest(state),
+                           state->getPc(), address, size, value);
+         return;
+     }
+
+     //Queued, sent to the target on the next barrier
+     m_transport->setState(state);
+     m_engine->write(address, size, value);
+     if (m_recorder) {
+         record(state, REMOTE_TRACE_WRITE, address, size, value);
+     }
 }
 
-bool RemoteMemoryInterface::buildCPUState(S2EExecutionState *state,
-		json::Object &cpu_state,
-		std::string op = "access")
+void RemoteMemoryInterface::record(S2EExecutionState *state, uint8_t type,
+                                   uint32_t address, int size, uint64_t value)
 {
-	bool ret = true;
+    RemoteMemoryTraceRecord record;
+    record.type = type;
+    record.size = size;
+    record.cpuDigest = cpuStateDigest(state);
+    record.pc = state->getPc();
+    record.address = address;
+    record.value = value;
+    m_recorder->record(record);
+}
 
-#ifdef TARGET_ARM
-#define CPU_NB_REGS 16
-#endif
-	for (int i = 0; i < CPU_NB_REGS - 1; i++)
-	{
-		std::stringstream ss;
-
-		ss << "r";
-		ss << i;
-
-		klee::ref<klee::Expr> exprReg =
-			state->readCpuRegister(CPU_REG_OFFSET(i),
-					CPU_REG_SIZE << 3);
-		if (isa<klee::ConstantExpr>(exprReg))
-		{
-			cpu_state.Insert(json::Object::Member(ss.str(),
-						json::String(intToHex(cast<klee::ConstantExpr>(exprReg)->getZExtValue()))));
-		}
-		else
-		{
-			std::string example =
-				intToHex(m_s2e->getExecutor()->toConstantSilent(*state,
-							exprReg)->getZExtValue());
-			m_s2e->getWarningsStream() << "[RemoteMemory] Register "
-				<< i << " was symbolic during a " << op << " at "
-				<< hexval(state->getPc()) << ", taking " <<
-				example << " as an example" << '\n';
-			cpu_state.Insert(json::Object::Member(ss.str(),
-						json::String(example)));
-			ret = false;
-		}
-	}
-	cpu_state.Insert(json::Object::Member("pc",
-				json::String(intToHex(state->getPc()))));
+/**
+ * Answers a read from the trace. Reads that diverge go to the live target
+ * if there is one, otherwise the value recorded for the closest read of
+ * the same address is returned.
+ */
+uint64_t RemoteMemoryInterface::replayRead(S2EExecutionState *state, uint32_t address, int size)
+{
+    DECLARE_PLUGINSTATE_P(m_plugin, RemoteMemoryState, state);
+    RemoteMemoryReplayCursor &cursor = plgState->m_cursor;
 
-#ifdef TARGET_ARM
-	//TODO: Fill CPSR register
-	//     cpsr.Insert(json::Object::Member("cf", json::Bool(
-	cpu_state.Insert(json::Object::Member("cpsr",
-				json::String(intToHex(state->getFlags()))));
-#endif
-	return ret;
+    uint64_t value = 0;
+    if (m_replayer->read(cursor, cpuStateDigest(state), state->getPc(), address, size, value)) {
+        return value;
+    }
+
+    if (!cursor.diverged) {
+        m_s2e->getWarningsStream(state) << "[RemoteMemory] Replay diverged from the trace at pc "
+                << hexval(state->getPc()) << " reading " << hexval(address) << "[" << size << "]"
+                << (m_engine ? ", asking the target" : "") << '\n';
+        cursor.diverged = true;
+    }
+
+    if (m_engine) {
+        m_transport->setState(state);
+        return m_engine->read(address, size);
+    }
+
+    if (!m_replayer->guess(cursor, address, size, value) && m_verbose) {
+        m_s2e->getDebugStream() << "[RemoteMemory] No recorded value for " << hexval(address) << '\n';
+    }
+
+    return value;
 }
 
-void RemoteMemoryInterface::submitRequest(S2EExecutionState *state,
-		json::Object &request)
+void RemoteMemoryInterface::printStats(llvm::raw_ostream &os)
 {
-	qemu_mutex_lock(&m_mutex);
-	m_state = state;
-	json::Writer::Write(request, *m_socket);
-	m_socket->flush();
-	qemu_mutex_unlock(&m_mutex);
+    if (m_engine) {
+        os << "[RemoteMemory] ";
+        m_engine->printStats(os);
+        os << "[RemoteMemory] ";
+        m_transport->printStats(os);
+    }
+
+    if (m_recorder) {
+        os << "[RemoteMemory] recorded " << m_recorder->getRecordCount() << " accesses" << '\n';
+    }
+
+    if (m_replayer) {
+        os << "[RemoteMemory] ";
+        m_replayer->printStats(os);
+    }
 }
-bool RemoteMemoryInterface::submitAndWait(S2EExecutionState *state,
-		json::Object &request,
-		std::tr1::shared_ptr<json::Object> &response)
+
+RemoteMemoryInterface::~RemoteMemoryInterface()
 {
-	qemu_mutex_lock(&m_mutex);
-	m_state = state;
-	json::Writer::Write(request, *m_socket);
-	m_socket->flush();
+    flush();
+}
 
+RemoteMemoryState::RemoteMemoryState()
+{
+}
 
-	/* TODO: test if this is our request reply.
-	 * Right now, the hidden assumption is that each submited request
-	 * that requires an aswer is submited via this function i.e. we're
-	 * *always* popping the reply
-	 */
-	while (m_responseQueue.empty())  {
-		qemu_cond_wait(&m_responseCond, &m_mutex);
-	}
-	response = m_responseQueue.front();
-	m_responseQueue.pop();
-	m_state = NULL;
-	qemu_mutex_unlock(&m_mutex);
+RemoteMemoryState::~RemoteMemoryState()
+{
+}
 
-	return true;
+PluginState *RemoteMemoryState::clone() const
+{
+    return new RemoteMemoryState(*this);
 }
 
-RemoteMemoryInterface::~RemoteMemoryInterface()
+PluginState *RemoteMemoryState::factory(Plugin *p, S2EExecutionState *s)
 {
-    qemu_cond_destroy(&m_responseCond);
-    qemu_mutex_destroy(&m_mutex);
+    return new RemoteMemoryState();
 }
 
 
@@ -40,6 +40,9 @@
 #include <s2e/Plugins/CorePlugin.h>
 #include <s2e/S2EExecutionState.h>
 #include <s2e/Plugins/MemoryInterceptor.h>
+#include <s2e/Plugins/RemoteMemoryEngine.h>
+#include <s2e/Plugins/RemoteMemoryTransport.h>
+#include <s2e/Plugins/RemoteMemoryTrace.h>
 
 
 extern "C" {
@@ -65,61 +68,111 @@ private:
     int m_sock;
     struct sockaddr_in m_addr;
     std::string m_buf;
+
+    /* Bytes received from the socket but not consumed yet */
+    char m_rxBuf[4096];
+    unsigned m_rxPos;
+    unsigned m_rxLen;
+    int recvchar(char *c);
 };
 
-class OpenOCD {
+class OpenOCD : public s2e::plugins::RemoteMemoryTarget {
 public:
-    OpenOCD();
+    OpenOCD(std::string host = "127.0.0.1", int port = 4444);
     ~OpenOCD();
     std::string command(std::string cmd, bool expect_response = true);
-    std::vector<int> mdw(int addr, int count);
-    void mww(int addr, int content);
+    std::vector<int> mdw(uint32_t addr, int count);
+    void mww(uint32_t addr, int content);
+
+    /* RemoteMemoryTarget */
+    virtual void readWords(uint64_t address, unsigned count, std::vector<uint32_t> &words);
+    virtual uint64_t readValue(uint64_t address, unsigned size);
+    virtual void writeBatch(const std::vector<s2e::plugins::RemoteMemoryWrite> &writes);
 private:
     TCPClient m_openocd;
+    std::vector<int> md(std::string cmd, uint32_t addr, int count);
 };
 
 namespace s2e {
 namespace plugins {
     
+struct RemoteMemoryOptions {
+    /* Address of the socket the Avatar side connects to */
+    std::string listenAddress;
+
+    /* Memory is read from OpenOCD if set, from the Avatar side otherwise */
+    bool useOpenOCD;
+    std::string openocdHost;
+    int openocdPort;
+
+    RemoteMemoryProtocol protocol;
+    unsigned maxInFlight;
+    bool sendCpuState;
+
+    unsigned cacheLineSize;
+    unsigned maxPendingWrites;
+
+    /* Trace all accesses to this file, if not empty */
+    std::string recordFile;
+
+    /* Answer reads from this trace, if not empty */
+    std::string replayFile;
+    /* Connect to the target in replay mode, to answer reads that diverge */
+    bool replayFallback;
+    unsigned replayWindow;
+};
+
+class RemoteMemory;
+
 class RemoteMemoryInterface
 {
 public:
-    RemoteMemoryInterface(S2E* s2e, std::string sockAddress, bool verbose = false);
+    RemoteMemoryInterface(S2E* s2e, RemoteMemory *plugin, const RemoteMemoryOptions &options, bool verbose = false);
     virtual ~RemoteMemoryInterface();
     void writeMemory(S2EExecutionState*, uint32_t address, int size, uint64_t value);
     uint64_t readMemory(S2EExecutionState*, uint32_t address, int size);
 
-	/* low level operations */
-	void submitRequest(S2EExecutionState *, json::Object &request);
-	bool waitForAnswer(S2EExecutionState *, std::tr1::shared_ptr<json::Object> &response);
-	bool submitAndWait(S2EExecutionState *,
-			json::Object &request,
-			std::tr1::shared_ptr<json::Object> &response);
-	bool buildCPUState(S2EExecutionState *, json::Object &cpu_state, std::string op);
-    
-    void parse(std::string& token);
+    RemoteMemoryEngine *getEngine() {return m_engine.get();}
+
+    RemoteMemoryTransport *getTransport() {return m_transport.get();}
+
+    /** Execution barrier: pending writes must reach the target */
+    void flush() {
+        if (m_engine) {
+            m_engine->flush();
+        }
+    }
+
+    /** Makes the records written so far visible in the trace file */
+    void flushTrace() {
+        if (m_recorder) {
+            m_recorder->flush();
+        }
+    }
+
+    void printStats(llvm::raw_ostream &os);
+
 	bool wasHit() {return m_hit;}
 	void resetHit() {m_hit = false;}
 	bool m_writeBack;
     
 private:
-    static void * receiveThread(void *);
-    void handleClientCommand(std::string cmd, std::tr1::shared_ptr<json::Object> params);
-    
     S2E* m_s2e;
-    QemuMutex m_mutex;
-    QemuCond m_responseCond;
-    QemuThread m_thread;
-    std::queue<std::tr1::shared_ptr<json::Object> > m_interruptQueue;
-    std::queue<std::tr1::shared_ptr<json::Object> > m_responseQueue;
-    bool m_cancelThread;
+    RemoteMemory *m_plugin;
     std::tr1::shared_ptr<s2e::QemuTcpSocket> m_socket;
-    S2EExecutionState * m_state;
     bool m_verbose;
 	bool m_hit;
 	void setHit() {m_hit = true;}
 
-    OpenOCD m_openocd_client;
+    std::tr1::shared_ptr<RemoteMemoryTransport> m_transport;
+    std::tr1::shared_ptr<OpenOCD> m_openocd_client;
+    std::tr1::shared_ptr<RemoteMemoryEngine> m_engine;
+
+    std::tr1::shared_ptr<RemoteMemoryRecorder> m_recorder;
+    std::tr1::shared_ptr<RemoteMemoryReplayer> m_replayer;
+
+    void record(S2EExecutionState *state, uint8_t type, uint32_t address, int size, uint64_t value);
+    uint64_t replayRead(S2EExecutionState *state, uint32_t address, int size);
 };
     
 class RemoteMemoryListener : public MemoryAccessHandler
@@ -154,7 +207,9 @@ class RemoteMemory : public Plugin
 public:
     RemoteMemory(S2E* s2e)
         : Plugin(s2e),
-          m_verbose(false)
+          m_verbose(false),
+          m_statsInterval(0),
+          m_elapsedTicks(0)
     {
     }
 
@@ -170,7 +225,29 @@ private:
     
     bool m_verbose;
     std::tr1::shared_ptr<RemoteMemoryInterface> m_remoteInterface;
-    
+
+    /* Seconds between two statistics dumps, 0 to disable */
+    unsigned m_statsInterval;
+    unsigned m_elapsedTicks;
+
+    void onException(S2EExecutionState *state, unsigned index, uint64_t pc);
+    void onStateSwitch(S2EExecutionState *currentState, S2EExecutionState *nextState);
+    void onTimer();
+};
+
+class RemoteMemoryState : public PluginState
+{
+private:
+    /* Position of the state in the replayed trace */
+    RemoteMemoryReplayCursor m_cursor;
+
+public:
+    RemoteMemoryState();
+    virtual ~RemoteMemoryState();
+    virtual PluginState *clone() const;
+    static PluginState *factory(Plugin *p, S2EExecutionState *s);
+
+    friend class RemoteMemoryInterface;
 };
 
 std::string intToHex(uint64_t);
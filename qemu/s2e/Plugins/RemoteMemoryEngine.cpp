@@ -0,0 +1,294 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in the S2E-AUTHORS file.
+ */
+
+#include "RemoteMemoryEngine.h"
+
+#include <algorithm>
+#include <cassert>
+#include <llvm/Support/TimeValue.h>
+
+namespace s2e {
+namespace plugins {
+
+static uint64_t getTimeUs()
+{
+    return llvm::sys::TimeValue::now().usec();
+}
+
+RemoteMemoryEngine::RemoteMemoryEngine(RemoteMemoryTarget *target,
+                                       unsigned lineSize,
+                                       unsigned maxPendingWrites)
+    : m_target(target),
+      m_lineSize(lineSize),
+      m_maxPendingWrites(maxPendingWrites)
+{
+    assert(m_target);
+
+    //Lines are filled with whole words
+    assert(m_lineSize >= sizeof(uint32_t) && !(m_lineSize & (m_lineSize - 1)));
+}
+
+void RemoteMemoryEngine::addRange(uint64_t address, uint64_t size, bool cacheable)
+{
+    Range range;
+    range.start = address;
+    range.size = size;
+    range.cacheable = cacheable;
+    m_ranges[address] = range;
+}
+
+RemoteMemoryEngine::Range *RemoteMemoryEngine::findRange(uint64_t address, unsigned size)
+{
+    Ranges::iterator it = m_ranges.upper_bound(address);
+    if (it == m_ranges.begin()) {
+        return NULL;
+    }
+
+    --it;
+
+    //The access must be entirely contained in the range
+    if (address + size - it->second.start > it->second.size) {
+        return NULL;
+    }
+
+    return &it->second;
+}
+
+/**
+ *  Fetches the line starting at lineAddress with a single
+ *  multi-word read. The fill is clipped to the boundaries of the range,
+ *  so that neighbouring (possibly volatile) memory is never touched:
+ *  when the range is not word-aligned, its edge bytes are read separately.
+ */
+std::vector<uint8_t> &RemoteMemoryEngine::fetchLine(Range &range, uint64_t lineAddress)
+{
+    //Pending writes to this line must reach the target before we read it back
+    flush();
+
+    uint64_t start = std::max(lineAddress, range.start);
+    uint64_t end = std::min(lineAddress + m_lineSize, range.start + range.size);
+
+    //Whole words are only read inside the range. The bytes at the unaligned
+    //edges of the range are read one by one.
+    uint64_t wordStart = (start + 3) & ~(uint64_t) 3;
+    uint64_t wordEnd = end & ~(uint64_t) 3;
+    if (wordStart >= wordEnd) {
+        wordStart = wordEnd = end;
+    }
+
+    std::vector<uint8_t> &line = range.lines[lineAddress];
+    line.resize(m_lineSize);
+
+    uint64_t t0 = getTimeUs();
+    for (uint64_t address = start; address < wordStart; ++address) {
+        line[address - lineAddress] = m_target->readValue(address, 1);
+        ++m_stats.roundTrips;
+    }
+
+    if (wordStart < wordEnd) {
+        std::vector<uint32_t> words;
+        m_target->readWords(wordStart, (wordEnd - wordStart) / sizeof(uint32_t), words);
+        ++m_stats.roundTrips;
+
+        uint64_t offset = wordStart - lineAddress;
+        for (unsigned i = 0; i < words.size() && offset + 4 * i < m_lineSize; ++i) {
+            for (unsigned j = 0; j < sizeof(uint32_t); ++j) {
+                line[offset + 4 * i + j] = (words[i] >> (8 * j)) & 0xff;
+            }
+        }
+    }
+
+    for (uint64_t address = wordEnd; address < end; ++address) {
+        line[address - lineAddress] = m_target->readValue(address, 1);
+        ++m_stats.roundTrips;
+    }
+    m_stats.targetTime += getTimeUs() - t0;
+    ++m_stats.lineFills;
+
+    return line;
+}
+
+uint64_t RemoteMemoryEngine::read(uint64_t address, unsigned size)
+{
+    ++m_stats.reads;
+
+    Range *range = findRange(address, size);
+
+    if (!range || !range->cacheable) {
+        //Volatile memory: keep the ordering with queued writes
+        //and go to the target for exactly the requested bytes.
+        flush();
+
+        uint64_t value;
+        uint64_t t0 = getTimeUs();
+        if (size <= sizeof(uint32_t)) {
+            value = m_target->readValue(address, size);
+        } else {
+            std::vector<uint32_t> words;
+            m_target->readWords(address, 2, words);
+            value = (uint64_t) words[0] | ((uint64_t) words[1] << 32);
+        }
+        m_stats.targetTime += getTimeUs() - t0;
+        ++m_stats.roundTrips;
+        ++m_stats.volatileReads;
+        return value;
+    }
+
+    uint64_t value = 0;
+    bool hit = true;
+    std::vector<uint8_t> *line = NULL;
+    uint64_t currentLine = 0;
+
+    for (unsigned i = 0; i < size && i < sizeof(value); ++i) {
+        uint64_t byteAddress = address + i;
+        uint64_t lineAddress = byteAddress & ~(uint64_t) (m_lineSize - 1);
+
+        if (!line || lineAddress != currentLine) {
+            Lines::iterator it = range->lines.find(lineAddress);
+            if (it == range->lines.end()) {
+                line = &fetchLine(*range, lineAddress);
+                hit = false;
+            } else {
+                line = &it->second;
+            }
+            currentLine = lineAddress;
+        }
+
+        value |= (uint64_t) (*line)[byteAddress - lineAddress] << (8 * i);
+    }
+
+    if (hit) {
+        ++m_stats.cacheHits;
+    }
+
+    return value;
+}
+
+void RemoteMemoryEngine::updateCachedLines(Range &range, uint64_t address,
+                                           unsigned size, uint64_t value)
+{
+    for (unsigned i = 0; i < size && i < sizeof(value); ++i) {
+        uint64_t byteAddress = address + i;
+        uint64_t lineAddress = byteAddress & ~(uint64_t) (m_lineSize - 1);
+
+        Lines::iterator it = range.lines.find(lineAddress);
+        if (it != range.lines.end()) {
+            it->second[byteAddress - lineAddress] = (value >> (8 * i)) & 0xff;
+        }
+    }
+}
+
+void RemoteMemoryEngine::write(uint64_t address, unsigned size, uint64_t value)
+{
+    ++m_stats.writes;
+
+    Range *range = findRange(address, size);
+    bool merged = false;
+
+    if (range && range->cacheable) {
+        updateCachedLines(*range, address, size, value);
+
+        //Back-to-back stores to the same RAM location only need the last
+        //value. Don't merge across other writes, they may be MMIO.
+        if (!m_pendingWrites.empty()) {
+            RemoteMemoryWrite &w = m_pendingWrites.back();
+            if (w.address == address && w.size == size) {
+                w.value = value;
+                merged = true;
+            }
+        }
+    }
+
+    if (!merged) {
+        RemoteMemoryWrite w;
+        w.address = address;
+        w.size = size;
+        w.value = value;
+        m_pendingWrites.push_back(w);
+    }
+
+    if (m_pendingWrites.size() >= m_maxPendingWrites) {
+        flush();
+    }
+}
+
+void RemoteMemoryEngine::flush()
+{
+    if (m_pendingWrites.empty()) {
+        return;
+    }
+
+    uint64_t t0 = getTimeUs();
+    m_target->writeBatch(m_pendingWrites);
+    m_stats.targetTime += getTimeUs() - t0;
+    ++m_stats.roundTrips;
+    ++m_stats.writeBatches;
+
+    m_pendingWrites.clear();
+}
+
+void RemoteMemoryEngine::invalidate()
+{
+    for (Ranges::iterator it = m_ranges.begin(); it != m_ranges.end(); ++it) {
+        it->second.lines.clear();
+    }
+}
+
+void RemoteMemoryEngine::printStats(llvm::raw_ostream &os) const
+{
+    uint64_t accesses = m_stats.reads + m_stats.writes;
+
+    os << "reads: " << m_stats.reads
+       << " writes: " << m_stats.writes
+       << " cache hits: " << m_stats.cacheHits
+       << " line fills: " << m_stats.lineFills
+       << " volatile reads: " << m_stats.volatileReads
+       << " write batches: " << m_stats.writeBatches
+       << " round-trips: " << m_stats.roundTrips
+       << " target time: " << m_stats.targetTime << "us";
+
+    if (m_stats.roundTrips) {
+        os << " avg latency: " << m_stats.targetTime / m_stats.roundTrips << "us";
+    }
+
+    if (m_stats.targetTime) {
+        os << " accesses/s: " << accesses * 1000000 / m_stats.targetTime;
+    }
+
+    os << '\n';
+}
+
+} // namespace plugins
+} // namespace s2e
@@ -0,0 +1,161 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in the S2E-AUTHORS file.
+ */
+
+#ifndef S2E_PLUGINS_REMOTE_MEMORY_ENGINE_H
+#define S2E_PLUGINS_REMOTE_MEMORY_ENGINE_H
+
+#include <inttypes.h>
+#include <map>
+#include <vector>
+
+#include <llvm/Support/raw_ostream.h>
+
+namespace s2e {
+namespace plugins {
+
+/** A write that was queued by the engine and not yet sent to the target */
+struct RemoteMemoryWrite {
+    uint64_t address;
+    unsigned size;
+    uint64_t value;
+};
+
+/**
+ *  Low-level access to the memory of the remote target (e.g., OpenOCD).
+ *  Each call is expected to cost one round-trip to the target.
+ */
+class RemoteMemoryTarget
+{
+public:
+    virtual ~RemoteMemoryTarget() {}
+
+    /** Reads count consecutive 32-bit words starting at address */
+    virtual void readWords(uint64_t address, unsigned count,
+                           std::vector<uint32_t> &words) = 0;
+
+    /** Reads exactly size bytes at address, without touching neighbouring bytes */
+    virtual uint64_t readValue(uint64_t address, unsigned size) = 0;
+
+    /** Sends all the writes, in order */
+    virtual void writeBatch(const std::vector<RemoteMemoryWrite> &writes) = 0;
+};
+
+struct RemoteMemoryStats {
+    uint64_t reads;
+    uint64_t writes;
+    uint64_t cacheHits;
+    uint64_t lineFills;
+    uint64_t volatileReads;
+    uint64_t writeBatches;
+    uint64_t roundTrips;
+    /** Time spent waiting for the target, in microseconds */
+    uint64_t targetTime;
+
+    RemoteMemoryStats() {
+        reads = writes = cacheHits = lineFills = 0;
+        volatileReads = writeBatches = roundTrips = targetTime = 0;
+    }
+};
+
+/**
+ *  Sits between RemoteMemory and the remote target to cut the number
+ *  of round-trips.
+ *
+ *  - Reads from cacheable (RAM-like) ranges are served from a line cache.
+ *    A miss fetches the whole line with a single multi-word read.
+ *  - Reads from volatile (MMIO) ranges always go to the target.
+ *  - Writes are queued and sent as one batch on the next read that goes
+ *    to the target, when the queue is full, or on an explicit flush()
+ *    (execution barrier).
+ *
+ *  The engine assumes a little-endian target.
+ */
+class RemoteMemoryEngine
+{
+public:
+    RemoteMemoryEngine(RemoteMemoryTarget *target,
+                       unsigned lineSize = 64,
+                       unsigned maxPendingWrites = 32);
+
+    /** Declares a remote range. Addresses outside of all ranges are volatile. */
+    void addRange(uint64_t address, uint64_t size, bool cacheable);
+
+    uint64_t read(uint64_t address, unsigned size);
+    void write(uint64_t address, unsigned size, uint64_t value);
+
+    /** Sends all pending writes to the target */
+    void flush();
+
+    /** Drops all cached lines, e.g., when the target was reset */
+    void invalidate();
+
+    const RemoteMemoryStats &getStats() const {
+        return m_stats;
+    }
+
+    void printStats(llvm::raw_ostream &os) const;
+
+private:
+    /* Line address => line contents */
+    typedef std::map<uint64_t, std::vector<uint8_t> > Lines;
+
+    struct Range {
+        uint64_t start;
+        uint64_t size;
+        bool cacheable;
+        Lines lines;
+    };
+
+    /* Start address => range */
+    typedef std::map<uint64_t, Range> Ranges;
+
+    RemoteMemoryTarget *m_target;
+    unsigned m_lineSize;
+    unsigned m_maxPendingWrites;
+
+    Ranges m_ranges;
+    std::vector<RemoteMemoryWrite> m_pendingWrites;
+
+    RemoteMemoryStats m_stats;
+
+    Range *findRange(uint64_t address, unsigned size);
+    std::vector<uint8_t> &fetchLine(Range &range, uint64_t lineAddress);
+    void updateCachedLines(Range &range, uint64_t address, unsigned size, uint64_t value);
+};
+
+} // namespace plugins
+} // namespace s2e
+
+#endif // S2E_PLUGINS_REMOTE_MEMORY_ENGINE_H
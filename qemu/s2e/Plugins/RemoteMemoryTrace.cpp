@@ -0,0 +1,307 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in the S2E-AUTHORS file.
+ */
+
+#include "RemoteMemoryTrace.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace s2e {
+namespace plugins {
+
+static void putLE(uint8_t *buf, uint64_t value, unsigned size)
+{
+    for (unsigned i = 0; i < size; ++i) {
+        buf[i] = (value >> (8 * i)) & 0xff;
+    }
+}
+
+static uint64_t getLE(const uint8_t *buf, unsigned size)
+{
+    uint64_t value = 0;
+    for (unsigned i = 0; i < size; ++i) {
+        value |= (uint64_t) buf[i] << (8 * i);
+    }
+    return value;
+}
+
+RemoteMemoryRecorder::RemoteMemoryRecorder()
+    : m_file(NULL), m_records(0)
+{
+}
+
+RemoteMemoryRecorder::~RemoteMemoryRecorder()
+{
+    if (m_file) {
+        fclose(m_file);
+    }
+}
+
+bool RemoteMemoryRecorder::open(const std::string &path)
+{
+    assert(!m_file);
+
+    m_file = fopen(path.c_str(), "wb");
+    if (!m_file) {
+        return false;
+    }
+
+    //Records are small, don't pay a write() for each of them
+    setvbuf(m_file, NULL, _IOFBF, 1 << 20);
+
+    uint8_t header[REMOTE_TRACE_HEADER_SIZE];
+    memset(header, 0, sizeof(header));
+    memcpy(header, REMOTE_TRACE_MAGIC, sizeof(REMOTE_TRACE_MAGIC));
+    putLE(header + 8, REMOTE_TRACE_VERSION, 4);
+    putLE(header + 12, REMOTE_TRACE_RECORD_SIZE, 4);
+
+    return fwrite(header, sizeof(header), 1, m_file) == 1;
+}
+
+void RemoteMemoryRecorder::record(const RemoteMemoryTraceRecord &record)
+{
+    uint8_t buf[REMOTE_TRACE_RECORD_SIZE];
+
+    buf[0] = record.type;
+    buf[1] = record.size;
+    putLE(buf + 2, 0, 2);
+    putLE(buf + 4, record.cpuDigest, 4);
+    putLE(buf + 8, record.pc, 8);
+    putLE(buf + 16, record.address, 8);
+    putLE(buf + 24, record.value, 8);
+
+    fwrite(buf, sizeof(buf), 1, m_file);
+    ++m_records;
+}
+
+void RemoteMemoryRecorder::flush()
+{
+    if (m_file) {
+        fflush(m_file);
+    }
+}
+
+RemoteMemoryReplayer::RemoteMemoryReplayer(unsigned resyncWindow)
+    : m_data(NULL), m_mappedSize(0), m_count(0),
+      m_resyncWindow(resyncWindow)
+{
+}
+
+RemoteMemoryReplayer::~RemoteMemoryReplayer()
+{
+    if (m_data) {
+        munmap((void*) m_data, m_mappedSize);
+    }
+}
+
+bool RemoteMemoryReplayer::open(const std::string &path)
+{
+    assert(!m_data);
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t) st.st_size < REMOTE_TRACE_HEADER_SIZE) {
+        ::close(fd);
+        return false;
+    }
+
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+
+    m_data = (const uint8_t*) data;
+    m_mappedSize = st.st_size;
+
+    if (memcmp(m_data, REMOTE_TRACE_MAGIC, sizeof(REMOTE_TRACE_MAGIC)) ||
+        getLE(m_data + 8, 4) != REMOTE_TRACE_VERSION ||
+        getLE(m_data + 12, 4) != REMOTE_TRACE_RECORD_SIZE) {
+        return false;
+    }
+
+    //A truncated last record (e.g., the recording run crashed) is ignored
+    m_count = (m_mappedSize - REMOTE_TRACE_HEADER_SIZE) / REMOTE_TRACE_RECORD_SIZE;
+
+    for (uint64_t i = 0; i < m_count; ++i) {
+        RemoteMemoryTraceRecord record;
+        getRecord(i, record);
+        if (record.type == REMOTE_TRACE_READ) {
+            m_reads[record.address].push_back(i);
+        }
+    }
+
+    return true;
+}
+
+void RemoteMemoryReplayer::getRecord(uint64_t index, RemoteMemoryTraceRecord &record) const
+{
+    assert(index < m_count);
+    const uint8_t *buf = m_data + REMOTE_TRACE_HEADER_SIZE + index * REMOTE_TRACE_RECORD_SIZE;
+
+    record.type = buf[0];
+    record.size = buf[1];
+    record.cpuDigest = getLE(buf + 4, 4);
+    record.pc = getLE(buf + 8, 8);
+    record.address = getLE(buf + 16, 8);
+    record.value = getLE(buf + 24, 8);
+}
+
+bool RemoteMemoryReplayer::find(RemoteMemoryReplayCursor &cursor, uint32_t cpuDigest,
+                                uint8_t type, uint64_t pc, uint64_t address, unsigned size,
+                                RemoteMemoryTraceRecord &record)
+{
+    uint64_t end = std::min(m_count, cursor.position + m_resyncWindow + 1);
+
+    //First record that matches the access, whatever its digest
+    uint64_t first = end;
+
+    uint64_t i;
+    for (i = cursor.position; i < end; ++i) {
+        getRecord(i, record);
+        if (record.type != type || record.pc != pc ||
+            record.address != address || record.size != size) {
+            continue;
+        }
+
+        if (record.cpuDigest == cpuDigest) {
+            break;
+        }
+
+        if (first == end) {
+            first = i;
+        }
+    }
+
+    if (i == end) {
+        if (first == end) {
+            ++m_stats.divergences;
+            return false;
+        }
+
+        //The registers differ from the recording (e.g., symbolic ones)
+        ++m_stats.digestMismatches;
+        i = first;
+        getRecord(i, record);
+    }
+
+    if (i == cursor.position) {
+        ++m_stats.hits;
+    } else {
+        ++m_stats.resyncs;
+    }
+    cursor.position = i + 1;
+    return true;
+}
+
+bool RemoteMemoryReplayer::read(RemoteMemoryReplayCursor &cursor, uint32_t cpuDigest,
+                                uint64_t pc, uint64_t address, unsigned size, uint64_t &value)
+{
+    ++m_stats.reads;
+
+    RemoteMemoryTraceRecord record;
+    if (!find(cursor, cpuDigest, REMOTE_TRACE_READ, pc, address, size, record)) {
+        return false;
+    }
+
+    value = record.value;
+    return true;
+}
+
+bool RemoteMemoryReplayer::write(RemoteMemoryReplayCursor &cursor, uint32_t cpuDigest,
+                                 uint64_t pc, uint64_t address, unsigned size, uint64_t value)
+{
+    ++m_stats.writes;
+
+    RemoteMemoryTraceRecord record;
+    if (!find(cursor, cpuDigest, REMOTE_TRACE_WRITE, pc, address, size, record)) {
+        return false;
+    }
+
+    if (record.value != value) {
+        ++m_stats.valueMismatches;
+    }
+    return true;
+}
+
+bool RemoteMemoryReplayer::guess(const RemoteMemoryReplayCursor &cursor,
+                                 uint64_t address, unsigned size, uint64_t &value) const
+{
+    ReadIndex::const_iterator it = m_reads.find(address);
+    if (it == m_reads.end()) {
+        return false;
+    }
+
+    const std::vector<uint64_t> &indexes = it->second;
+    std::vector<uint64_t>::const_iterator next =
+            std::lower_bound(indexes.begin(), indexes.end(), cursor.position);
+    if (next == indexes.end()) {
+        --next;
+    }
+
+    RemoteMemoryTraceRecord record;
+    getRecord(*next, record);
+    value = record.value;
+    if (size < sizeof(value)) {
+        value &= ((uint64_t) 1 << (8 * size)) - 1;
+    }
+    return true;
+}
+
+void RemoteMemoryReplayer::printStats(llvm::raw_ostream &os) const
+{
+    os << "replay: records: " << m_count
+       << " reads: " << m_stats.reads
+       << " writes: " << m_stats.writes
+       << " hits: " << m_stats.hits
+       << " resyncs: " << m_stats.resyncs
+       << " divergences: " << m_stats.divergences
+       << " write value mismatches: " << m_stats.valueMismatches
+       << " register mismatches: " << m_stats.digestMismatches
+       << '\n';
+}
+
+} // namespace plugins
+} // namespace s2e
@@ -0,0 +1,212 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in the S2E-AUTHORS file.
+ */
+
+#ifndef S2E_PLUGINS_REMOTE_MEMORY_TRACE_H
+#define S2E_PLUGINS_REMOTE_MEMORY_TRACE_H
+
+#include <inttypes.h>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <llvm/Support/raw_ostream.h>
+
+namespace s2e {
+namespace plugins {
+
+/**
+ *  Trace of the accesses forwarded to the remote target, used to run
+ *  RemoteMemory without the board attached.
+ *
+ *  The file starts with a 16-byte header:
+ *    char     magic[8]       REMOTE_TRACE_MAGIC
+ *    uint32_t version        REMOTE_TRACE_VERSION
+ *    uint32_t recordSize     sizeof a record, 32
+ *
+ *  followed by one record per access, in execution order.
+ *  All fields are little endian.
+ *    uint8_t  type           RemoteMemoryTraceType
+ *    uint8_t  size           access size in bytes
+ *    uint16_t reserved
+ *    uint32_t cpuDigest      hash of the registers when the access happened
+ *    uint64_t pc
+ *    uint64_t address
+ *    uint64_t value          value read or written
+ */
+#define REMOTE_TRACE_MAGIC "S2ERMEM"
+#define REMOTE_TRACE_VERSION 1
+#define REMOTE_TRACE_HEADER_SIZE 16
+#define REMOTE_TRACE_RECORD_SIZE 32
+
+enum RemoteMemoryTraceType {
+    REMOTE_TRACE_READ = 1,
+    REMOTE_TRACE_WRITE = 2
+};
+
+struct RemoteMemoryTraceRecord {
+    uint8_t type;
+    uint8_t size;
+    uint32_t cpuDigest;
+    uint64_t pc;
+    uint64_t address;
+    uint64_t value;
+};
+
+/** Appends the accesses to a trace file */
+class RemoteMemoryRecorder
+{
+public:
+    RemoteMemoryRecorder();
+    ~RemoteMemoryRecorder();
+
+    bool open(const std::string &path);
+    void record(const RemoteMemoryTraceRecord &record);
+    void flush();
+
+    uint64_t getRecordCount() const {
+        return m_records;
+    }
+
+private:
+    FILE *m_file;
+    uint64_t m_records;
+};
+
+struct RemoteMemoryReplayStats {
+    uint64_t reads;
+    uint64_t writes;
+    /* Accesses that matched the next record of the trace */
+    uint64_t hits;
+    /* Accesses that matched a record further in the trace */
+    uint64_t resyncs;
+    /* Accesses with no matching record nearby */
+    uint64_t divergences;
+    /* Matching writes with a different value than recorded */
+    uint64_t valueMismatches;
+    /* Matching accesses made with different registers than recorded */
+    uint64_t digestMismatches;
+
+    RemoteMemoryReplayStats() {
+        reads = writes = hits = resyncs = divergences = valueMismatches = 0;
+        digestMismatches = 0;
+    }
+};
+
+/**
+ *  Position of an execution path in the trace. Each state keeps its own
+ *  cursor, a state that forks continues from the same position on both
+ *  paths.
+ */
+struct RemoteMemoryReplayCursor {
+    /* Index of the next record expected */
+    uint64_t position;
+    /* Set once the path read a value that is not in the trace */
+    bool diverged;
+
+    RemoteMemoryReplayCursor() : position(0), diverged(false) {}
+};
+
+/**
+ *  Answers reads from a recorded trace.
+ *
+ *  Accesses are matched against the trace in order, on their type, pc,
+ *  address and size. The next record is used if it also has the digest
+ *  of the current registers. Otherwise the following records (up to the
+ *  resync window) are searched for one that has it, so that a few extra
+ *  or missing accesses, or a loop polling the same address, do not make
+ *  the rest of the trace unusable. If no record in the window has the
+ *  digest, the first one that matches the access is used.
+ *
+ *  The replayer holds no position: the caller passes the cursor of the
+ *  path that makes the access. The file is mapped read-only, many replays
+ *  can share one recording.
+ */
+class RemoteMemoryReplayer
+{
+public:
+    RemoteMemoryReplayer(unsigned resyncWindow = 256);
+    ~RemoteMemoryReplayer();
+
+    bool open(const std::string &path);
+
+    /** Returns false if the read diverges from the trace */
+    bool read(RemoteMemoryReplayCursor &cursor, uint32_t cpuDigest,
+              uint64_t pc, uint64_t address, unsigned size, uint64_t &value);
+
+    /** Returns false if the write diverges from the trace */
+    bool write(RemoteMemoryReplayCursor &cursor, uint32_t cpuDigest,
+               uint64_t pc, uint64_t address, unsigned size, uint64_t value);
+
+    /**
+     *  Best guess for a read that diverged: the next recorded read of
+     *  the same address, or the last one if there is none after the
+     *  position of the cursor. Returns false if the address was never read.
+     */
+    bool guess(const RemoteMemoryReplayCursor &cursor,
+               uint64_t address, unsigned size, uint64_t &value) const;
+
+    uint64_t getRecordCount() const {
+        return m_count;
+    }
+
+    const RemoteMemoryReplayStats &getStats() const {
+        return m_stats;
+    }
+
+    void printStats(llvm::raw_ostream &os) const;
+
+private:
+    /* Indexes of the read records of an address */
+    typedef std::map<uint64_t, std::vector<uint64_t> > ReadIndex;
+
+    const uint8_t *m_data;
+    size_t m_mappedSize;
+    uint64_t m_count;
+    unsigned m_resyncWindow;
+    ReadIndex m_reads;
+
+    RemoteMemoryReplayStats m_stats;
+
+    void getRecord(uint64_t index, RemoteMemoryTraceRecord &record) const;
+    bool find(RemoteMemoryReplayCursor &cursor, uint32_t cpuDigest,
+              uint8_t type, uint64_t pc, uint64_t address, unsigned size,
+              RemoteMemoryTraceRecord &record);
+};
+
+} // namespace plugins
+} // namespace s2e
+
+#endif // S2E_PLUGINS_REMOTE_MEMORY_TRACE_H
@@ -0,0 +1,672 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in the S2E-AUTHORS file.
+ */
+
+extern "C" {
+#include <qemu-common.h>
+#include <cpu-all.h>
+#include <exec-all.h>
+}
+
+#include "RemoteMemoryTransport.h"
+
+#include <s2e/S2E.h>
+#include <s2e/S2EExecutionState.h>
+#include <s2e/S2EExecutor.h>
+#include <s2e/Utils.h>
+
+#include <s2e/cajun/json/reader.h>
+#include <s2e/cajun/json/writer.h>
+
+#include <sstream>
+#include <string.h>
+
+namespace s2e {
+namespace plugins {
+
+static std::string toHex(uint64_t val)
+{
+    std::stringstream ss;
+    ss << "0x" << std::hex << val;
+    return ss.str();
+}
+
+static uint64_t fromHex(const std::string &str)
+{
+    uint64_t val = 0;
+    std::stringstream ss(str);
+    ss >> std::hex >> val;
+    return val;
+}
+
+static void putLE(uint8_t *buf, uint64_t value, unsigned size)
+{
+    for (unsigned i = 0; i < size; ++i) {
+        buf[i] = (value >> (8 * i)) & 0xff;
+    }
+}
+
+static uint64_t getLE(const uint8_t *buf, unsigned size)
+{
+    uint64_t value = 0;
+    for (unsigned i = 0; i < size; ++i) {
+        value |= (uint64_t) buf[i] << (8 * i);
+    }
+    return value;
+}
+
+/** Consumes count bytes of the stream without storing them */
+static bool skipBytes(std::istream &in, uint64_t count)
+{
+    char buf[4096];
+    while (count) {
+        std::streamsize chunk = count < sizeof(buf) ? count : sizeof(buf);
+        in.read(buf, chunk);
+        if (in.gcount() != chunk) {
+            return false;
+        }
+        count -= chunk;
+    }
+    return true;
+}
+
+RemoteMemoryTransport::RemoteMemoryTransport(S2E *s2e,
+                                             std::tr1::shared_ptr<QemuTcpSocket> socket,
+                                             RemoteMemoryProtocol protocol,
+                                             unsigned maxInFlight,
+                                             bool sendCpuState,
+                                             bool verbose)
+    : m_s2e(s2e),
+      m_socket(socket),
+      m_protocol(protocol),
+      m_maxInFlight(maxInFlight ? maxInFlight : 1),
+      m_sendCpuState(sendCpuState),
+      m_verbose(verbose),
+      m_state(NULL),
+      m_started(false),
+      m_nextId(1),
+      m_sent(0),
+      m_maxObservedInFlight(0),
+      m_failedWrites(0)
+{
+    qemu_mutex_init(&m_mutex);
+    qemu_cond_init(&m_replyCond);
+}
+
+RemoteMemoryTransport::~RemoteMemoryTransport()
+{
+    qemu_cond_destroy(&m_replyCond);
+    qemu_mutex_destroy(&m_mutex);
+}
+
+void RemoteMemoryTransport::start()
+{
+    assert(!m_started);
+    m_started = true;
+    qemu_thread_create(&m_thread, &RemoteMemoryTransport::receiveThread, this, 0);
+}
+
+void *RemoteMemoryTransport::receiveThread(void *opaque)
+{
+    RemoteMemoryTransport *transport = static_cast<RemoteMemoryTransport *>(opaque);
+
+    if (transport->m_protocol == REMOTE_PROTOCOL_BINARY) {
+        transport->receiveBinary();
+    } else {
+        transport->receiveJson();
+    }
+
+    //TODO: do something to gracefully shutdown qemu (i,.e. unblock main thread, return dummy value, shutdown vm)
+    transport->m_s2e->getWarningsStream() << "[RemoteMemory] Remote end disconnected, machine is dead" << '\n';
+    ::exit(1);
+    return NULL;
+}
+
+void RemoteMemoryTransport::receiveBinary()
+{
+    std::istream &in = *m_socket;
+    uint8_t header[REMOTE_REPLY_SIZE];
+    bool resynced = false;
+
+    for (;;) {
+        if (!resynced) {
+            in.read((char *) header, sizeof(header));
+            if (in.gcount() != (std::streamsize) sizeof(header)) {
+                return;
+            }
+        }
+        resynced = false;
+
+        if (header[0] != REMOTE_FRAME_MAGIC) {
+            //Start over at the next byte that may begin a frame. The replies
+            //in between are lost, so their requests must not keep waiting.
+            m_s2e->getWarningsStream() << "[RemoteMemory] Corrupted frame received" << '\n';
+            failPendingRequests();
+
+            uint8_t *next = (uint8_t *) memchr(header + 1, REMOTE_FRAME_MAGIC, sizeof(header) - 1);
+            unsigned kept = next ? header + sizeof(header) - next : 0;
+            if (next) {
+                memmove(header, next, kept);
+            }
+
+            in.read((char *) header + kept, sizeof(header) - kept);
+            if (in.gcount() != (std::streamsize) (sizeof(header) - kept)) {
+                return;
+            }
+            resynced = true;
+            continue;
+        }
+
+        uint8_t type = header[1];
+        bool failed = header[2] != 0;
+        uint32_t id = getLE(header + 4, 4);
+        uint64_t value = getLE(header + 8, 8);
+
+        if (type == REMOTE_MSG_EVENT) {
+            std::tr1::shared_ptr<json::Object> command(new json::Object());
+            command->Insert(json::Object::Member("cmd", json::String("event")));
+            command->Insert(json::Object::Member("value", json::String(toHex(value))));
+            pushCommand(command);
+            continue;
+        }
+
+        std::vector<uint32_t> words;
+        if (type == REMOTE_MSG_READ_WORDS) {
+            //The payload size comes from the peer, only allocate it when it
+            //matches the request. Otherwise skip it and fail the request.
+            RemoteMemoryMessageType requestType;
+            unsigned expected = 0;
+            if (findRequest(true, id, requestType, expected) &&
+                requestType != REMOTE_MSG_READ_WORDS) {
+                expected = 0;
+            }
+
+            if (value != expected) {
+                m_s2e->getWarningsStream() << "[RemoteMemory] Reply " << id << " carries "
+                                           << value << " words, expected "
+                                           << expected << '\n';
+
+                //No request can ask for that many words (16-bit size field):
+                //the frame is corrupted, look for the next one.
+                if (value > 0xffff) {
+                    failPendingRequests();
+                    continue;
+                }
+
+                if (!skipBytes(in, value * sizeof(uint32_t))) {
+                    return;
+                }
+                completeRequest(id, true, 0, words);
+                continue;
+            }
+
+            std::vector<uint8_t> payload(value * sizeof(uint32_t));
+            if (!payload.empty()) {
+                in.read((char *) &payload[0], payload.size());
+                if (in.gcount() != (std::streamsize) payload.size()) {
+                    return;
+                }
+            }
+
+            words.resize(value);
+            for (unsigned i = 0; i < value; ++i) {
+                words[i] = getLE(&payload[i * sizeof(uint32_t)], sizeof(uint32_t));
+            }
+        }
+
+        completeRequest(id, failed, value, words);
+    }
+}
+
+void RemoteMemoryTransport::receiveJson()
+{
+    for (;;) {
+        std::string token;
+
+        getline(*m_socket, token, '\n');
+
+        if (token.size() == 0) {
+            if (!m_socket->isConnected()) {
+                return;
+            }
+            continue;
+        }
+
+        std::tr1::shared_ptr<json::Object> object(new json::Object());
+        std::istringstream tokenAsStream(token);
+
+        try {
+            json::Reader::Read(*object, tokenAsStream);
+
+            if (object->Find("reply") != object->End()) {
+                bool hasId = object->Find("id") != object->End();
+                uint32_t id = 0;
+                uint64_t value = 0;
+                std::vector<uint32_t> words;
+
+                if (hasId) {
+                    json::Number &idNumber = (*object)["id"];
+                    id = (uint32_t) idNumber.Value();
+                }
+
+                RemoteMemoryMessageType type;
+                unsigned expected;
+                if (!findRequest(hasId, id, type, expected)) {
+                    m_s2e->getWarningsStream() << "[RemoteMemory] Dropping reply to no request in flight: " << token << '\n';
+                    continue;
+                }
+
+                bool failed = object->Find("error") != object->End();
+                bool hasValue = object->Find("value") != object->End();
+                bool hasValues = object->Find("values") != object->End();
+
+                //The request can't be answered by a reply of another kind
+                if ((type == REMOTE_MSG_READ && !hasValue) ||
+                    (type == REMOTE_MSG_READ_WORDS && !hasValues)) {
+                    m_s2e->getWarningsStream() << "[RemoteMemory] Reply does not match request " << id << ": " << token << '\n';
+                    failed = true;
+                }
+
+                if (hasValue) {
+                    json::String &strValue = (*object)["value"];
+                    value = fromHex(strValue);
+                }
+
+                if (hasValues) {
+                    json::Array &values = (*object)["values"];
+                    if (values.Size() != expected) {
+                        m_s2e->getWarningsStream() << "[RemoteMemory] Reply " << id << " carries "
+                                                   << values.Size() << " words, expected "
+                                                   << expected << '\n';
+                        failed = true;
+                        values.Clear();
+                    }
+                    for (json::Array::iterator it = values.Begin(); it != values.End(); ++it) {
+                        json::String &strWord = *it;
+                        words.push_back(fromHex(strWord));
+                    }
+                }
+
+                completeRequest(id, failed, value, words);
+            } else if (object->Find("cmd") != object->End()) {
+                pushCommand(object);
+            } else {
+                m_s2e->getWarningsStream() << "[RemoteMemory] Received json object that was neither a cmd nor a reply: " << token << '\n';
+            }
+        } catch (json::Exception &ex) {
+            m_s2e->getWarningsStream() << "[RemoteMemory] Exception in JSON data: '" << token << "'" << '\n';
+        }
+    }
+}
+
+/**
+ *  Looks up the request in flight answered by a reply, and returns its
+ *  type and the number of words it asked for (0 unless it is a multi-word
+ *  read). Older JSON peers don't send ids but answer in order: their
+ *  replies go to the oldest request still waiting, whose id is returned.
+ */
+bool RemoteMemoryTransport::findRequest(bool hasId, uint32_t &id,
+                                        RemoteMemoryMessageType &type, unsigned &count)
+{
+    bool found = false;
+
+    qemu_mutex_lock(&m_mutex);
+    Requests::iterator it;
+    if (hasId) {
+        it = m_requests.find(id);
+    } else {
+        for (it = m_requests.begin(); it != m_requests.end(); ++it) {
+            if (!it->second.done) {
+                break;
+            }
+        }
+    }
+
+    if (it != m_requests.end()) {
+        id = it->first;
+        type = it->second.type;
+        count = it->second.count;
+        found = true;
+    }
+    qemu_mutex_unlock(&m_mutex);
+
+    return found;
+}
+
+/**
+ *  Fails every request in flight, when their replies can't be found in
+ *  the stream any more.
+ */
+void RemoteMemoryTransport::failPendingRequests()
+{
+    qemu_mutex_lock(&m_mutex);
+    Requests::iterator it = m_requests.begin();
+    while (it != m_requests.end()) {
+        if (it->second.type == REMOTE_MSG_WRITE) {
+            ++m_failedWrites;
+            m_requests.erase(it++);
+            continue;
+        }
+        if (!it->second.done) {
+            it->second.done = true;
+            it->second.failed = true;
+        }
+        ++it;
+    }
+    qemu_cond_broadcast(&m_replyCond);
+    qemu_mutex_unlock(&m_mutex);
+}
+
+/** Called by the receive thread */
+void RemoteMemoryTransport::completeRequest(uint32_t id, bool failed,
+                                            uint64_t value, const std::vector<uint32_t> &words)
+{
+    bool unexpected = false;
+    bool writeFailed = false;
+
+    qemu_mutex_lock(&m_mutex);
+
+    Requests::iterator it = m_requests.find(id);
+    if (it == m_requests.end()) {
+        unexpected = true;
+    } else if (it->second.type == REMOTE_MSG_WRITE) {
+        //Writes are acknowledged out of band, nobody waits for them
+        if (failed) {
+            ++m_failedWrites;
+            writeFailed = true;
+        }
+        m_requests.erase(it);
+    } else {
+        it->second.done = true;
+        it->second.failed = failed;
+        it->second.value = value;
+        it->second.words = words;
+    }
+
+    qemu_cond_broadcast(&m_replyCond);
+    qemu_mutex_unlock(&m_mutex);
+
+    if (unexpected) {
+        m_s2e->getWarningsStream() << "[RemoteMemory] Reply to unknown request " << id << '\n';
+    } else if (writeFailed) {
+        m_s2e->getWarningsStream() << "[RemoteMemory] Remote write " << id << " failed" << '\n';
+    }
+}
+
+void RemoteMemoryTransport::pushCommand(std::tr1::shared_ptr<json::Object> command)
+{
+    qemu_mutex_lock(&m_mutex);
+    m_commands.push(command);
+    qemu_mutex_unlock(&m_mutex);
+}
+
+bool RemoteMemoryTransport::popCommand(std::tr1::shared_ptr<json::Object> &command)
+{
+    bool ret = false;
+
+    qemu_mutex_lock(&m_mutex);
+    if (!m_commands.empty()) {
+        command = m_commands.front();
+        m_commands.pop();
+        ret = true;
+    }
+    qemu_mutex_unlock(&m_mutex);
+
+    return ret;
+}
+
+/**
+ *  Registers a new request and sends it without waiting for the reply.
+ *  Blocks only when the window of requests in flight is full.
+ *  JSON writes are not acknowledged by older peers, so they are not tracked.
+ */
+uint32_t RemoteMemoryTransport::submit(RemoteMemoryMessageType type, uint64_t address,
+                                       unsigned size, uint64_t value)
+{
+    bool tracked = type != REMOTE_MSG_WRITE || m_protocol == REMOTE_PROTOCOL_BINARY;
+
+    qemu_mutex_lock(&m_mutex);
+    while (m_requests.size() >= m_maxInFlight) {
+        qemu_cond_wait(&m_replyCond, &m_mutex);
+    }
+
+    uint32_t id = m_nextId++;
+
+    if (tracked) {
+        Request &request = m_requests[id];
+        request.type = type;
+        request.count = type == REMOTE_MSG_READ_WORDS ? size : 0;
+        request.done = false;
+        request.failed = false;
+        request.value = 0;
+    }
+
+    ++m_sent;
+    if (m_requests.size() > m_maxObservedInFlight) {
+        m_maxObservedInFlight = m_requests.size();
+    }
+    qemu_mutex_unlock(&m_mutex);
+
+    //Sending must not hold the lock: the receive thread needs it to
+    //retire replies, otherwise both ends could block on full socket buffers.
+    if (m_protocol == REMOTE_PROTOCOL_BINARY) {
+        sendBinary(id, type, address, size, value);
+    } else {
+        sendJson(id, type, address, size, value);
+    }
+
+    return id;
+}
+
+void RemoteMemoryTransport::sendBinary(uint32_t id, RemoteMemoryMessageType type,
+                                       uint64_t address, unsigned size, uint64_t value)
+{
+    uint8_t frame[REMOTE_REQUEST_SIZE];
+
+    frame[0] = REMOTE_FRAME_MAGIC;
+    frame[1] = type;
+    putLE(frame + 2, size, 2);
+    putLE(frame + 4, id, 4);
+    putLE(frame + 8, address, 8);
+    putLE(frame + 16, value, 8);
+    putLE(frame + 24, m_state ? m_state->getPc() : 0, 8);
+
+    std::ostream &out = *m_socket;
+    out.write((const char *) frame, sizeof(frame));
+}
+
+void RemoteMemoryTransport::sendJson(uint32_t id, RemoteMemoryMessageType type,
+                                     uint64_t address, unsigned size, uint64_t value)
+{
+    json::Object request;
+    json::Object params;
+    json::Object cpu_state;
+
+    switch (type) {
+    case REMOTE_MSG_READ:
+        request.Insert(json::Object::Member("cmd", json::String("read")));
+        params.Insert(json::Object::Member("size", json::String(toHex(size))));
+        break;
+    case REMOTE_MSG_READ_WORDS:
+        request.Insert(json::Object::Member("cmd", json::String("read_words")));
+        params.Insert(json::Object::Member("count", json::String(toHex(size))));
+        break;
+    default:
+        request.Insert(json::Object::Member("cmd", json::String("write")));
+        params.Insert(json::Object::Member("size", json::String(toHex(size))));
+        params.Insert(json::Object::Member("value", json::String(toHex(value))));
+        break;
+    }
+
+    request.Insert(json::Object::Member("id", json::Number(id)));
+    params.Insert(json::Object::Member("address", json::String(toHex(address))));
+
+    buildCPUState(cpu_state);
+    request.Insert(json::Object::Member("params", params));
+    request.Insert(json::Object::Member("cpu_state", cpu_state));
+
+    //Writer::Write terminates the object with std::endl, which also flushes
+    json::Writer::Write(request, *m_socket);
+}
+
+void RemoteMemoryTransport::wait(uint32_t id, Request &reply)
+{
+    qemu_mutex_lock(&m_mutex);
+
+    Requests::iterator it = m_requests.find(id);
+    assert(it != m_requests.end());
+
+    while (!it->second.done) {
+        qemu_cond_wait(&m_replyCond, &m_mutex);
+        it = m_requests.find(id);
+        assert(it != m_requests.end());
+    }
+
+    reply = it->second;
+    m_requests.erase(it);
+    qemu_mutex_unlock(&m_mutex);
+}
+
+uint64_t RemoteMemoryTransport::readValue(uint64_t address, unsigned size)
+{
+    uint32_t id = submit(REMOTE_MSG_READ, address, size, 0);
+    m_socket->flush();
+
+    Request reply;
+    wait(id, reply);
+
+    if (reply.failed) {
+        m_s2e->getWarningsStream() << "[RemoteMemory] Remote read at " << hexval(address) << " failed" << '\n';
+    }
+
+    return reply.value;
+}
+
+void RemoteMemoryTransport::readWords(uint64_t address, unsigned count, std::vector<uint32_t> &words)
+{
+    uint32_t id = submit(REMOTE_MSG_READ_WORDS, address, count, 0);
+    m_socket->flush();
+
+    Request reply;
+    wait(id, reply);
+
+    if (reply.failed) {
+        m_s2e->getWarningsStream() << "[RemoteMemory] Remote read of " << count
+                                   << " words at " << hexval(address) << " failed" << '\n';
+    }
+
+    words.swap(reply.words);
+    words.resize(count, 0);
+}
+
+void RemoteMemoryTransport::writeBatch(const std::vector<RemoteMemoryWrite> &writes)
+{
+    for (unsigned i = 0; i < writes.size(); ++i) {
+        submit(REMOTE_MSG_WRITE, writes[i].address, writes[i].size, writes[i].value);
+    }
+    m_socket->flush();
+}
+
+void RemoteMemoryTransport::drain()
+{
+    qemu_mutex_lock(&m_mutex);
+    while (!m_requests.empty()) {
+        qemu_cond_wait(&m_replyCond, &m_mutex);
+    }
+    qemu_mutex_unlock(&m_mutex);
+}
+
+void RemoteMemoryTransport::printStats(llvm::raw_ostream &os)
+{
+    qemu_mutex_lock(&m_mutex);
+    os << "requests sent: " << m_sent
+       << " max in flight: " << m_maxObservedInFlight
+       << " failed writes: " << m_failedWrites << '\n';
+    qemu_mutex_unlock(&m_mutex);
+}
+
+/**
+ *  Only used by the JSON protocol. The pc is always sent, the other
+ *  registers only when sendCpuState is set.
+ */
+bool RemoteMemoryTransport::buildCPUState(json::Object &cpu_state)
+{
+    bool ret = true;
+    S2EExecutionState *state = m_state;
+
+    if (!state) {
+        return false;
+    }
+
+    cpu_state.Insert(json::Object::Member("pc",
+                json::String(toHex(state->getPc()))));
+
+    if (!m_sendCpuState) {
+        return true;
+    }
+
+#ifdef TARGET_ARM
+#define CPU_NB_REGS 16
+#endif
+    for (int i = 0; i < CPU_NB_REGS - 1; i++) {
+        std::stringstream ss;
+        ss << "r" << i;
+
+        klee::ref<klee::Expr> exprReg =
+            state->readCpuRegister(CPU_REG_OFFSET(i), CPU_REG_SIZE << 3);
+
+        if (isa<klee::ConstantExpr>(exprReg)) {
+            cpu_state.Insert(json::Object::Member(ss.str(),
+                    json::String(toHex(cast<klee::ConstantExpr>(exprReg)->getZExtValue()))));
+        } else {
+            std::string example =
+                toHex(m_s2e->getExecutor()->toConstantSilent(*state, exprReg)->getZExtValue());
+            m_s2e->getWarningsStream() << "[RemoteMemory] Register "
+                << i << " was symbolic at "
+                << hexval(state->getPc()) << ", taking "
+                << example << " as an example" << '\n';
+            cpu_state.Insert(json::Object::Member(ss.str(), json::String(example)));
+            ret = false;
+        }
+    }
+
+#ifdef TARGET_ARM
+    cpu_state.Insert(json::Object::Member("cpsr",
+            json::String(toHex(state->getFlags()))));
+#endif
+    return ret;
+}
+
+} // namespace plugins
+} // namespace s2e
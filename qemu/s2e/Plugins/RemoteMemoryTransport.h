@@ -0,0 +1,207 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in the S2E-AUTHORS file.
+ */
+
+#ifndef S2E_PLUGINS_REMOTE_MEMORY_TRANSPORT_H
+#define S2E_PLUGINS_REMOTE_MEMORY_TRANSPORT_H
+
+#include <tr1/memory>
+#include <map>
+#include <queue>
+#include <vector>
+
+#include <s2e/QemuSocket.h>
+#include <s2e/cajun/json/elements.h>
+#include <s2e/Plugins/RemoteMemoryEngine.h>
+
+extern "C" {
+#include <qemu-thread.h>
+}
+
+namespace s2e {
+
+class S2E;
+class S2EExecutionState;
+
+namespace plugins {
+
+/** Encoding of the messages exchanged with the Avatar side */
+enum RemoteMemoryProtocol {
+    /* One JSON object per line, kept for compatibility */
+    REMOTE_PROTOCOL_JSON,
+    /* Fixed-size little-endian frames, see below */
+    REMOTE_PROTOCOL_BINARY
+};
+
+/**
+ *  Binary frames. All fields are little endian.
+ *
+ *  Request (32 bytes):
+ *    uint8_t  magic          REMOTE_FRAME_MAGIC
+ *    uint8_t  type           RemoteMemoryMessageType
+ *    uint16_t size           access size in bytes, or word count for READ_WORDS
+ *    uint32_t id
+ *    uint64_t address
+ *    uint64_t value          value to write
+ *    uint64_t pc             guest pc that caused the access
+ *
+ *  Reply and event (16 bytes):
+ *    uint8_t  magic
+ *    uint8_t  type           type of the request being answered, or EVENT
+ *    uint8_t  status         0 on success
+ *    uint8_t  reserved
+ *    uint32_t id
+ *    uint64_t value          value read, or word count for READ_WORDS
+ *  A READ_WORDS reply is followed by count 32-bit words.
+ */
+enum RemoteMemoryMessageType {
+    REMOTE_MSG_READ = 1,
+    REMOTE_MSG_READ_WORDS = 2,
+    REMOTE_MSG_WRITE = 3,
+    REMOTE_MSG_EVENT = 4
+};
+
+static const uint8_t REMOTE_FRAME_MAGIC = 0xA5;
+static const unsigned REMOTE_REQUEST_SIZE = 32;
+static const unsigned REMOTE_REPLY_SIZE = 16;
+
+/**
+ *  Pipelined request/reply channel to the Avatar side.
+ *
+ *  Every request carries an id. Several requests may be in flight:
+ *  writes return as soon as they are sent and their acknowledgment is
+ *  retired by the receive thread, reads only wait for their own reply.
+ *  JSON replies without an id come from older peers, which answer in
+ *  order: they go to the oldest request still waiting. Replies to no
+ *  request in flight are dropped. A reply that does not match its
+ *  request, e.g., a multi-word reply with another number of words than
+ *  requested, fails that request. Bad replies never stop the transport.
+ *
+ *  Messages initiated by the remote side (commands, events) are queued
+ *  and can be fetched with popCommand().
+ */
+class RemoteMemoryTransport : public RemoteMemoryTarget
+{
+public:
+    RemoteMemoryTransport(S2E *s2e,
+                          std::tr1::shared_ptr<QemuTcpSocket> socket,
+                          RemoteMemoryProtocol protocol,
+                          unsigned maxInFlight,
+                          bool sendCpuState,
+                          bool verbose);
+    virtual ~RemoteMemoryTransport();
+
+    /** Spawns the receive thread */
+    void start();
+
+    /** State on behalf of which the next requests are sent */
+    void setState(S2EExecutionState *state) {
+        m_state = state;
+    }
+
+    /* RemoteMemoryTarget */
+    virtual void readWords(uint64_t address, unsigned count, std::vector<uint32_t> &words);
+    virtual uint64_t readValue(uint64_t address, unsigned size);
+    virtual void writeBatch(const std::vector<RemoteMemoryWrite> &writes);
+
+    /** Waits until every request in flight has been answered */
+    void drain();
+
+    /** Gets the next command sent by the remote side, if any */
+    bool popCommand(std::tr1::shared_ptr<json::Object> &command);
+
+    void printStats(llvm::raw_ostream &os);
+
+private:
+    struct Request {
+        RemoteMemoryMessageType type;
+        /* Number of words, for multi-word reads */
+        unsigned count;
+        bool done;
+        bool failed;
+        uint64_t value;
+        std::vector<uint32_t> words;
+    };
+
+    /* id => request still waiting for its reply */
+    typedef std::map<uint32_t, Request> Requests;
+
+    S2E *m_s2e;
+    std::tr1::shared_ptr<QemuTcpSocket> m_socket;
+    RemoteMemoryProtocol m_protocol;
+    unsigned m_maxInFlight;
+    bool m_sendCpuState;
+    bool m_verbose;
+
+    S2EExecutionState *m_state;
+
+    QemuMutex m_mutex;
+    QemuCond m_replyCond;
+    QemuThread m_thread;
+    bool m_started;
+
+    uint32_t m_nextId;
+    Requests m_requests;
+    std::queue<std::tr1::shared_ptr<json::Object> > m_commands;
+
+    /* Statistics, protected by m_mutex */
+    uint64_t m_sent;
+    uint64_t m_maxObservedInFlight;
+    uint64_t m_failedWrites;
+
+    static void *receiveThread(void *opaque);
+    void receiveBinary();
+    void receiveJson();
+    bool findRequest(bool hasId, uint32_t &id,
+                     RemoteMemoryMessageType &type, unsigned &count);
+    void failPendingRequests();
+    void completeRequest(uint32_t id, bool failed,
+                         uint64_t value, const std::vector<uint32_t> &words);
+    void pushCommand(std::tr1::shared_ptr<json::Object> command);
+
+    uint32_t submit(RemoteMemoryMessageType type, uint64_t address,
+                    unsigned size, uint64_t value);
+    void sendBinary(uint32_t id, RemoteMemoryMessageType type,
+                    uint64_t address, unsigned size, uint64_t value);
+    void sendJson(uint32_t id, RemoteMemoryMessageType type,
+                  uint64_t address, unsigned size, uint64_t value);
+    void wait(uint32_t id, Request &reply);
+
+    bool buildCPUState(json::Object &cpu_state);
+};
+
+} // namespace plugins
+} // namespace s2e
+
+#endif // S2E_PLUGINS_REMOTE_MEMORY_TRANSPORT_H
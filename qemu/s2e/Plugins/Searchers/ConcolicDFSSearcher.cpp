@@ -81,6 +81,14 @@ klee::ExecutionState& ConcolicDFSSearcher::selectState()
     } else {
         assert(!m_speculativeStates.empty());
         state = *m_speculativeStates.begin();
+
+        //Prefer the states whose values are not being computed
+        foreach2(it, m_speculativeStates.begin(), m_speculativeStates.end()) {
+            if (!(*it)->isSolutionPending()) {
+                state = *it;
+                break;
+            }
+        }
     }
 
     return *state;
@@ -293,6 +293,8 @@ S2E::~S2E()
     assert(shared->processIds[m_currentProcessId] == m_currentProcessIndex);
     shared->processIds[m_currentProcessId] = (unsigned) -1;
     shared->processPids[m_currentProcessId] = (unsigned) -1;
+    shared->workerLoads[m_currentProcessId].states = 0;
+    shared->workerLoads[m_currentProcessId].weight = 0;
     --shared->currentProcessCount;
 
     m_sync.release();
@@ -668,6 +670,8 @@ int S2E::fork()
             if (shared->processIds[i] == (unsigned)-1) {
                 shared->processIds[i] = newProcessIndex;
                 shared->processPids[i] = getpid();
+                shared->workerLoads[i].states = 0;
+                shared->workerLoads[i].weight = 0;
                 m_currentProcessId = i;
                 break;
             }
@@ -761,6 +765,8 @@ bool S2E::checkDeadProcesses()
             //Process is dead, we have to decrement everything
             shared->processIds[i] = (unsigned) -1;
             shared->processPids[i] = (unsigned) -1;
+            shared->workerLoads[i].states = 0;
+            shared->workerLoads[i].weight = 0;
             --shared->currentProcessCount;
             ret = true;
         }
@@ -770,6 +776,52 @@ bool S2E::checkDeadProcesses()
     return ret;
 }
 
+void S2E::publishLoad(unsigned states, uint64_t weight)
+{
+    S2EShared *shared = m_sync.acquire();
+    shared->workerLoads[m_currentProcessId].states = states;
+    shared->workerLoads[m_currentProcessId].weight = weight;
+    m_sync.release();
+}
+
+bool S2E::hasMostLoad()
+{
+    S2EShared *shared = m_sync.acquire();
+    const S2EWorkerLoad &mine = shared->workerLoads[m_currentProcessId];
+    bool ret = true;
+
+    for (unsigned i=0; i<m_maxProcesses; ++i) {
+        if (i == m_currentProcessId || shared->processIds[i] == (unsigned)-1) {
+            continue;
+        }
+
+        //Ties go to the lowest slot, so that exactly one instance forks
+        const S2EWorkerLoad &other = shared->workerLoads[i];
+        if (other.weight > mine.weight ||
+            (other.weight == mine.weight && i < m_currentProcessId)) {
+            ret = false;
+            break;
+        }
+    }
+
+    m_sync.release();
+    return ret;
+}
+
+bool S2E::markCovered(uint64_t pc)
+{
+    uint8_t *coverage = m_sync.get()->coverage;
+    uint64_t bit = (pc * 0x9E3779B97F4A7C15ULL) >> (64 - S2E_COVERAGE_BITMAP_BITS);
+    uint8_t mask = 1 << (bit & 7);
+
+    //Covered blocks are the common case, avoid the locked instruction
+    if (coverage[bit >> 3] & mask) {
+        return false;
+    }
+
+    return !(__sync_fetch_and_or(&coverage[bit >> 3], mask) & mask);
+}
+
 } // namespace s2e
 
 /******************************/
@@ -43,6 +43,7 @@
 #include <vector>
 //#include <tr1/unordered_map>
 #include <map>
+#include <cstring>
 #include <llvm/Support/raw_ostream.h>
 
 #include "s2e_config.h"
@@ -69,6 +70,17 @@ class S2EExecutionState;
 
 class Database;
 
+//Size of the coverage bitmap shared by all instances, in bits
+#define S2E_COVERAGE_BITMAP_BITS 19
+
+//Work left in an instance, published for the load balancer
+struct S2EWorkerLoad {
+    //Number of states that can still run
+    unsigned states;
+    //Sum of the weights of these states (see S2EExecutor::getStateWeight)
+    uint64_t weight;
+};
+
 //Structure used for synchronization among multiple instances of S2E
 struct S2EShared {
     unsigned currentProcessCount;
@@ -83,11 +95,22 @@ struct S2EShared {
     //the instance index.
     unsigned processIds[S2E_MAX_PROCESSES];
     unsigned processPids[S2E_MAX_PROCESSES];
+
+    //Indexed like processIds
+    S2EWorkerLoad workerLoads[S2E_MAX_PROCESSES];
+
+    //Translation blocks executed by any instance, hashed by pc.
+    //Updated with atomic operations, without taking the lock.
+    uint8_t coverage[1 << (S2E_COVERAGE_BITMAP_BITS - 3)];
+
     S2EShared() {
         for (unsigned i=0; i<S2E_MAX_PROCESSES; ++i)    {
             processIds[i] = (unsigned)-1;
             processPids[i] = (unsigned)-1;
+            workerLoads[i].states = 0;
+            workerLoads[i].weight = 0;
         }
+        memset(coverage, 0, sizeof(coverage));
     }
 };
 
@@ -237,6 +260,17 @@ public:
 
     bool checkDeadProcesses();
 
+    /** Tells the other instances how much work is left in this one */
+    void publishLoad(unsigned states, uint64_t weight);
+
+    /** Whether this instance has the most work left among all running
+        instances. Only that one should fill free process slots. */
+    bool hasMostLoad();
+
+    /** Marks the translation block at pc as covered. Returns true
+        if no instance had executed it before. */
+    bool markCovered(uint64_t pc);
+
     inline uint64_t getStartTime() const {
         return m_startTimeSeconds;
     }
@@ -58,6 +58,7 @@ extern CPUArchState *env;
 #include <s2e/s2e_config.h>
 #include <s2e/S2EDeviceState.h>
 #include <s2e/S2EExecutor.h>
+#include <s2e/S2EStatsTracker.h>
 #include <s2e/Plugin.h>
 #include <s2e/Utils.h>
 
@@ -90,6 +91,7 @@ extern llvm::cl::opt<bool> PrintForkingStatus;
 extern llvm::cl::opt<bool> ConcolicMode;
 extern llvm::cl::opt<bool> VerboseStateDeletion;
 extern llvm::cl::opt<bool> DebugConstraints;
+extern llvm::cl::opt<bool> ShareRamPages;
 
 namespace s2e {
 
@@ -105,6 +107,7 @@ S2EExecutionState::S2EExecutionState(klee::KFunction *kf) :
         klee::ExecutionState(kf), m_stateID(g_s2e->fetchAndIncrementStateId()),
         m_symbexEnabled(true), m_startSymbexAtPC((uint64_t) -1),
         m_active(true), m_zombie(false), m_yielded(false), m_runningConcrete(true),
+        m_recentlyCoveredNew(false),
         m_cpuRegistersObject(NULL), m_cpuSystemObject(NULL),
         m_deviceState(this),
         m_qemuIcount(0),
@@ -283,11 +286,76 @@ void S2EExecutionState::addressSpaceChange(const klee::MemoryObject *mo,
     }
 }
 
+/**
+ *  Called when the state forks. The guest RAM pages it wrote since its
+ *  previous fork become shared with the new state and stay unmodified
+ *  until the next write, which copies them. Their stores are looked up
+ *  by content, so that all the states holding the same page contents
+ *  keep a single copy of it.
+ *
+ *  Only the pages owned by this state are considered: no other state
+ *  references them, so the only cached pointers to their stores are the
+ *  S2E TLB entries of this state, both live and in the CPU snapshot
+ *  taken by notifyBranch.
+ */
+void S2EExecutionState::shareRamPages()
+{
+#ifdef S2E_ENABLE_S2E_TLB
+    CPUArchState *cpus[2];
+    cpus[0] = (CPUArchState*)(m_cpuSystemState->address - CPU_CONC_LIMIT);
+    cpus[1] = (CPUArchState*)(m_cpuSystemObject->getConcreteStore(true) - CPU_CONC_LIMIT);
+#endif
+
+    uint64_t shared = 0;
+
+    foreach2(it, addressSpace.objects.begin(), addressSpace.objects.end()) {
+        const MemoryObject *mo = (*it).first;
+        ObjectState *os = const_cast<ObjectState*>((*it).second);
+
+        if (!mo->isUserSpecified || mo->isSharedConcrete ||
+            mo->size != S2E_RAM_OBJECT_SIZE ||
+            !addressSpace.isOwnedByUs(os) || os->isConcreteStoreShared()) {
+            continue;
+        }
+
+        const uint8_t *oldStore = static_cast<const ObjectState*>(os)->getConcreteStore(true);
+        os->shareConcreteStore(oldStore);
+        ++shared;
+
+#ifdef S2E_ENABLE_S2E_TLB
+        TlbMap::iterator tlbIt = m_tlbMap.find(os);
+        if (tlbIt == m_tlbMap.end()) {
+            continue;
+        }
+
+        const uint8_t *newStore = static_cast<const ObjectState*>(os)->getConcreteStore(true);
+        const ObjectStateTlbReferences &vec = (*tlbIt).second;
+        for (unsigned i = 0; i < vec.size(); ++i) {
+            const TlbCoordinates &coords = vec[i];
+            for (unsigned j = 0; j < 2; ++j) {
+                S2ETLBEntry *entry = &cpus[j]->s2e_tlb_table[coords.first][coords.second];
+                if (entry->objectState == (void*) os) {
+                    //The page is no longer writable in place
+                    entry->addend = (entry->addend & ~1)
+                            - (uintptr_t) oldStore + (uintptr_t) newStore;
+                }
+            }
+        }
+#endif
+    }
+
+    stats::forkPagesShared += shared;
+}
+
 ExecutionState* S2EExecutionState::clone()
 {
     // When cloning, all ObjectState becomes not owned by neither of states
     // This means that we must clean owned-by-us flag in S2E TLB
     assert(m_active && m_cpuSystemState);
+
+    if (ShareRamPages) {
+        shareRamPages();
+    }
 #ifdef S2E_ENABLE_S2E_TLB
     CPUArchState* cpu = (CPUArchState*)(m_cpuSystemState->address
                           - CPU_CONC_LIMIT);
@@ -1930,15 +1998,16 @@ void S2EExecutionState::dmaRead(uint64_t hostAddress, uint8_t *buf, unsigned siz
         }
         assert(op.first && op.second && op.first->address == hostPage);
         ObjectState *os = const_cast<ObjectState*>(op.second);
-        uint8_t *concreteStore;
+        const uint8_t *concreteStore;
 
         unsigned offset = hostAddress & (S2E_RAM_OBJECT_SIZE-1);
 
         if (op.first->isSharedConcrete) {
-            concreteStore = (uint8_t*)op.first->address;
+            concreteStore = (const uint8_t*)op.first->address;
             memcpy(buf, concreteStore + offset, length);
         } else {
-            concreteStore = os->getConcreteStore(true);
+            //The store may be shared with other states, do not copy it
+            concreteStore = op.second->getConcreteStore(true);
             for (unsigned i=0; i<length; ++i) {
                 if (_s2e_check_concrete(os, offset+i, 1)) {
                     buf[i] = concreteStore[offset+i];
@@ -143,6 +143,12 @@ protected:
     */
     bool m_runningConcrete;
 
+    /** Set when the state executes a block that no instance executed
+        before. Cleared when load balancing keeps the state, so that
+        it only reflects coverage found since the last split. Unlike
+        klee's coveredNew, this is only used to weigh states. */
+    bool m_recentlyCoveredNew;
+
     typedef std::set<std::pair<uint64_t,uint64_t> > ToRunSymbolically;
     ToRunSymbolically m_toRunSymbolically;
 
@@ -192,6 +198,7 @@ protected:
     bool m_runningExceptionEmulationCode;
 
     ExecutionState* clone();
+    void shareRamPages();
     void addressSpaceChange(const klee::MemoryObject *mo,
                             const klee::ObjectState *oldState,
                             klee::ObjectState *newState);
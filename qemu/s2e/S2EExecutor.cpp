@@ -117,6 +117,7 @@ uint64_t helper_set_cc_op_eflags(void);
 #include <llvm/Support/TimeValue.h>
 
 #include <vector>
+#include <algorithm>
 
 #include <sstream>
 
@@ -225,6 +226,11 @@ namespace {
     cl::opt<unsigned>
     ClockSlowDownFastHelpers("clock-slow-down-fast-helpers",
                    cl::desc("Slow down factor when interpreting LLVM code and using fast helpers"),  cl::init(11));
+
+    cl::opt<unsigned>
+    NewCoverageStateWeight("new-coverage-state-weight",
+                   cl::desc("How many ordinary states a state that recently covered new code "
+                            "is worth when splitting states between processes"),  cl::init(4));
 }
 
 //The logs may be flooded with messages when switching execution mode.
@@ -248,6 +254,11 @@ cl::opt<bool>
 ConcolicMode("use-concolic-execution",
                cl::desc("Concolic execution mode"),  cl::init(true));
 
+cl::opt<bool>
+ShareRamPages("share-ram-pages",
+               cl::desc("Keep a single copy of the guest RAM pages that forked states hold with the same contents"),
+               cl::init(true));
+
 cl::opt<bool>
 DebugConstraints("debug-constraints",
                cl::desc("Check that added constraints are satisfiable"),  cl::init(false));
@@ -1232,30 +1243,73 @@ bool S2EExecutor::copyInConcretes(klee::ExecutionState &state)
     return true;
 }
 
-void S2EExecutor::doLoadBalancing()
+/**
+ * States that recently covered code no instance had executed before are
+ * likely to find more, and states that spent a long time in the solver
+ * are likely to keep doing so. Both count as more work.
+ */
+uint64_t S2EExecutor::getStateWeight(S2EExecutionState *state) const
 {
-    if (states.size() < 2) {
-        return;
+    uint64_t weight = 1;
+    if (state->m_recentlyCoveredNew) {
+        weight += NewCoverageStateWeight;
     }
+    weight += (uint64_t) state->queryCost;
+    return weight;
+}
 
-    //Don't bother copying stuff if it's obvious that it'll very likely fail
-    if (m_s2e->getCurrentProcessCount() == m_s2e->getMaxProcesses()) {
+static bool compareWeights(const std::pair<uint64_t, S2EExecutionState*> &a,
+                           const std::pair<uint64_t, S2EExecutionState*> &b)
+{
+    return a.first > b.first;
+}
+
+void S2EExecutor::doLoadBalancing()
+{
+    if (m_s2e->getMaxProcesses() < 2) {
         return;
     }
 
-    std::vector<ExecutionState*> allStates;
+    std::vector<std::pair<uint64_t, S2EExecutionState*> > allStates;
+    uint64_t totalWeight = 0;
 
     foreach2(it, states.begin(), states.end()) {
         S2EExecutionState *s2estate = static_cast<S2EExecutionState*>(*it);
         if (!s2estate->isZombie()) {
-            allStates.push_back(s2estate);
+            uint64_t weight = getStateWeight(s2estate);
+            allStates.push_back(std::make_pair(weight, s2estate));
+            totalWeight += weight;
         }
     }
 
+    m_s2e->publishLoad(allStates.size(), totalWeight);
+
     if (allStates.size() < 2) {
         return;
     }
 
+    //Don't bother copying stuff if it's obvious that it'll very likely fail
+    if (m_s2e->getCurrentProcessCount() == m_s2e->getMaxProcesses()) {
+        return;
+    }
+
+    //A free slot is filled by the instance that has the most work left,
+    //not by whichever instance happens to have two states first.
+    if (!m_s2e->hasMostLoad()) {
+        return;
+    }
+
+    //Split the states in two halves of similar weight: heaviest first,
+    //each one going to the lighter half. Promising states end up spread
+    //over both processes.
+    std::sort(allStates.begin(), allStates.end(), compareWeights);
+    std::vector<bool> toChild(allStates.size());
+    uint64_t parentWeight = 0, childWeight = 0;
+    for (unsigned i = 0; i < allStates.size(); ++i) {
+        toChild[i] = childWeight < parentWeight;
+        (toChild[i] ? childWeight : parentWeight) += allStates[i].first;
+    }
+
     g_s2e->getDebugStream() << "LoadBalancing: starting\n";
 
     m_inLoadBalancing = true;
@@ -1273,20 +1327,26 @@ void S2EExecutor::doLoadBalancing()
         return;
     }
 
-    unsigned size = allStates.size();
-    unsigned n = size / 2;
-    unsigned lower = child ? 0 : n;
-    unsigned upper = child ? n : size;
-
     m_s2e->getCorePlugin()->onProcessFork.emit(false, child, parentId);
 
     g_s2e->getDebugStream() << "LoadBalancing: terminating states\n";
 
-    for (unsigned i=lower; i<upper; ++i) {
-        S2EExecutionState *s2estate = static_cast<S2EExecutionState*>(allStates[i]);
-        terminateStateAtFork(*s2estate);
+    uint64_t keptWeight = 0;
+    unsigned keptStates = 0;
+    for (unsigned i = 0; i < allStates.size(); ++i) {
+        S2EExecutionState *s2estate = allStates[i].second;
+        if (toChild[i] != (child != 0)) {
+            terminateStateAtFork(*s2estate);
+        } else {
+            //Only coverage found from now on makes a state promising
+            s2estate->m_recentlyCoveredNew = false;
+            keptWeight += getStateWeight(s2estate);
+            ++keptStates;
+        }
     }
 
+    m_s2e->publishLoad(keptStates, keptWeight);
+
     m_s2e->getCorePlugin()->onProcessForkComplete.emit(child);
 
     m_inLoadBalancing = false;
@@ -1325,6 +1385,9 @@ void S2EExecutor::doStateSwitch(S2EExecutionState* oldState,
     assert(!newState || !newState->m_active);
     assert(!newState || !newState->m_runningConcrete);
 
+    TimerStatIncrementer t(stats::stateSwitchTime);
+    ++stats::stateSwitches;
+
     //Some state save/restore logic in QEMU flushes the cache.
     //This can have bad effects in case of saving/restoring states
     //that were in the middle of a memory operation. Therefore,
@@ -1402,31 +1465,60 @@ void S2EExecutor::doStateSwitch(S2EExecutionState* oldState,
         s2e_phys_section_check(cpu_state);
     }
 
+    //The objects are at most one page long. Only the pages the old state
+    //modified are saved, which avoids copy-on-write clones of the pages it
+    //shares with other states, and only the pages that differ between the
+    //two states are restored. Saved pages are deduplicated by content, so
+    //states that wrote the same data keep a single copy of it.
     uint64_t totalCopied = 0;
     uint64_t objectsCopied = 0;
+    uint64_t objectsShared = 0;
     foreach(MemoryObject* mo, m_saveOnContextSwitch) {
         if(mo == cpuMo)
             continue;
 
+        const ObjectState *oldOS = NULL;
         if(oldState) {
-            const ObjectState *oldOS = oldState->addressSpace.findObject(mo);
-            ObjectState *oldWOS = oldState->addressSpace.getWriteable(mo, oldOS);
-            uint8_t *oldStore = oldWOS->getConcreteStore();
+            oldOS = oldState->addressSpace.findObject(mo);
+            const uint8_t *oldStore = oldOS->getConcreteStore();
             assert(oldStore);
-            memcpy(oldStore, (uint8_t*) mo->address, mo->size);
+
+            if (memcmp(oldStore, (uint8_t*) mo->address, mo->size)) {
+                ObjectState *oldWOS = oldState->addressSpace.getWriteable(mo, oldOS);
+                if (oldWOS->shareConcreteStore((uint8_t*) mo->address)) {
+                    objectsShared++;
+                }
+                oldOS = oldWOS;
+                totalCopied += mo->size;
+                objectsCopied++;
+            }
         }
 
         if(newState) {
             const ObjectState *newOS = newState->addressSpace.findObject(mo);
+
+            //Both states still share the page that is in memory
+            if (newOS == oldOS) {
+                continue;
+            }
+
             const uint8_t *newStore = newOS->getConcreteStore();
             assert(newStore);
+
+            //Different pages with the same contents
+            if (oldOS && newStore == oldOS->getConcreteStore()) {
+                continue;
+            }
+
             memcpy((uint8_t*) mo->address, newStore, mo->size);
+            totalCopied += mo->size;
+            objectsCopied++;
         }
-
-        totalCopied += mo->size;
-        objectsCopied++;
     }
 
+    stats::stateSwitchBytesCopied += totalCopied;
+    stats::stateSwitchObjectsShared += objectsShared;
+
     cpu_enable_ticks();
 
     if (VerboseStateSwitching) {
@@ -1446,6 +1538,11 @@ ExecutionState* S2EExecutor::selectNonSpeculativeState(S2EExecutionState *state)
     ExecutionState *newState;
     std::set<ExecutionState*> empty;
 
+    //Apply the concolic values computed in the background so far,
+    //and drop the speculative states that turned out to be infeasible.
+    processSpeculativeResults(false);
+    updateStates(state);
+
     do {
         if (searcher->empty()) {
             newState = NULL;
@@ -1454,11 +1551,25 @@ ExecutionState* S2EExecutor::selectNonSpeculativeState(S2EExecutionState *state)
 
         newState = &searcher->selectState();
 
+        if (newState->isSolutionPending()) {
+            //Waiting for the background solver could take as long as
+            //all the queries queued before this one. Solving this state
+            //alone is never slower than without background solving.
+            dropSpeculativeTicket(*newState);
+            ++stats::concolicTicketsDropped;
+        }
+
         if (newState->isSpeculative()) {
             //The searcher wants us to execute a speculative state.
             //The engine must make sure that such a state
             //satisfies all the path constraints.
-            if (!resolveSpeculativeState(*newState)) {
+            bool resolved;
+            {
+                TimerStatIncrementer t(stats::concolicResolveTime);
+                resolved = resolveSpeculativeState(*newState);
+            }
+
+            if (!resolved) {
                 terminateState(*newState);
                 updateStates(state);
                 continue;
@@ -1865,6 +1976,11 @@ uintptr_t S2EExecutor::executeTranslationBlock(
 
     bool executeKlee = m_executeAlwaysKlee;
 
+    //Tell the load balancer which states reach code nobody executed yet
+    if (m_s2e->getMaxProcesses() > 1 && m_s2e->markCovered(tb->pc)) {
+        state->m_recentlyCoveredNew = true;
+    }
+
     /* Think how can we optimize if symbex is disabled */
     if(true/* state->m_symbexEnabled*/) {
         if(state->m_startSymbexAtPC != (uint64_t) -1) {
@@ -2207,6 +2323,13 @@ void S2EExecutor::terminateState(ExecutionState &s)
     S2EExecutionState& state = static_cast<S2EExecutionState&>(s);
     m_s2e->getCorePlugin()->onStateKill.emit(&state);
 
+    uint64_t exclusive, shared;
+    state.constraints.getMemoryUsage(exclusive, shared);
+    m_s2e->getDebugStream(&state) << "Terminating state " << state.getID()
+            << " with " << state.constraints.size() << " constraints ("
+            << exclusive << " bytes exclusive, " << shared
+            << " bytes shared with other states)\n";
+
     terminateStateAtFork(state);
     state.zombify();
 
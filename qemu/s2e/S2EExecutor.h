@@ -291,6 +291,9 @@ protected:
 
     void doLoadBalancing();
 
+    /** Estimate of the work left in a state, used by the load balancer */
+    uint64_t getStateWeight(S2EExecutionState *state) const;
+
     /** Copy concrete values to their proper location, concretizing
         if necessary (most importantly it will concretize CPU registers.
         Note: this is required only to execute generated code,
@@ -74,6 +74,17 @@ namespace stats {
 
     Statistic concreteModeTime("ConcreteModeTime", "ConcModeTime");
     Statistic symbolicModeTime("SymbolicModeTime", "SymbModeTime");
+
+    Statistic stateSwitches("StateSwitches", "Switches");
+    Statistic stateSwitchTime("StateSwitchTime", "SwitchTime");
+    Statistic stateSwitchBytesCopied("StateSwitchBytesCopied", "SwitchBytes");
+    Statistic stateSwitchObjectsShared("StateSwitchObjectsShared", "SwitchShared");
+    Statistic forkPagesShared("ForkPagesShared", "ForkShared");
+
+    //Speculative states selected while their background query was pending,
+    //and time spent computing the inputs of speculative states on selection
+    Statistic concolicTicketsDropped("ConcolicTicketsDropped", "ConcDropped");
+    Statistic concolicResolveTime("ConcolicResolveTime", "ConcResolveTime");
 } // namespace stats
 } // namespace klee
 
@@ -165,6 +176,14 @@ void S2EStatsTracker::writeStatsHeader() {
              << "'ForkTime',"
              << "'ResolveTime',"
              << "'MemoryUsage',"
+             << "'StateSwitches',"
+             << "'StateSwitchTime',"
+             << "'StateSwitchBytesCopied',"
+             << "'StateSwitchObjectsShared',"
+             << "'ForkPagesShared',"
+             << "'ConcolicTicketsDropped',"
+             << "'ConcolicResolveTime',"
+             << "'ConstraintMemory',"
              << ")\n";
   statsFile->flush();
 }
@@ -196,6 +215,14 @@ void S2EStatsTracker::writeStatsLine() {
              << "," << stats::forkTime / 1000000.
              << "," << stats::resolveTime / 1000000.
              << "," << getProcessMemoryUsage() //sys::Process::GetTotalMemoryUsage()
+             << "," << stats::stateSwitches
+             << "," << stats::stateSwitchTime / 1000000.
+             << "," << stats::stateSwitchBytesCopied
+             << "," << stats::stateSwitchObjectsShared
+             << "," << stats::forkPagesShared
+             << "," << stats::concolicTicketsDropped
+             << "," << stats::concolicResolveTime / 1000000.
+             << "," << klee::ConstraintManager::getTotalMemoryUsage()
              << ")\n";
   statsFile->flush();
 }
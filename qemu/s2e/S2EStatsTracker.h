@@ -51,6 +51,15 @@ namespace stats {
 
     extern klee::Statistic concreteModeTime;
     extern klee::Statistic symbolicModeTime;
+
+    extern klee::Statistic stateSwitches;
+    extern klee::Statistic stateSwitchTime;
+    extern klee::Statistic stateSwitchBytesCopied;
+    extern klee::Statistic stateSwitchObjectsShared;
+    extern klee::Statistic forkPagesShared;
+
+    extern klee::Statistic concolicTicketsDropped;
+    extern klee::Statistic concolicResolveTime;
 } // namespace stats
 } // namespace klee
 
@@ -153,6 +153,31 @@ int s2e_hijack_memory_access(uint64_t vaddr, uint64_t haddr,
 
 extern unsigned g_s2e_enable_mmio_checks;
 
+/** Granularity of the hijacked page bitmap, independent of TARGET_PAGE_BITS */
+#define S2E_HIJACK_PAGE_BITS 12
+
+/** One bit per page of the low 4GB of the address space. Only accesses to
+    marked pages are passed to s2e_hijack_memory_access. */
+extern uint8_t g_s2e_hijacked_pages[1 << (32 - S2E_HIJACK_PAGE_BITS - 3)];
+
+/** Set when some hijacked range lies above 4GB */
+extern unsigned g_s2e_hijack_high_pages;
+
+/** Set when the bitmap is not used, i.e., every access must be checked */
+extern unsigned g_s2e_hijack_all_pages;
+
+static inline int s2e_is_hijacked_page(uint64_t vaddr)
+{
+    uint64_t page = vaddr >> S2E_HIJACK_PAGE_BITS;
+    if (g_s2e_hijack_all_pages) {
+        return 1;
+    }
+    if (page >> (32 - S2E_HIJACK_PAGE_BITS)) {
+        return g_s2e_hijack_high_pages;
+    }
+    return g_s2e_hijacked_pages[page >> 3] & (1 << (page & 7));
+}
+
 /** Called on port access from helper code */
 void s2e_trace_port_access(
         struct S2E *s2e, struct S2EExecutionState* state,
@@ -135,7 +135,8 @@
 
 #define S2E_HIJACK_MEMORY_READ(vaddr, haddr, value, isIO, origCode) \
         do { \
-            if (unlikely(s2e_hijack_memory_access(vaddr, haddr, \
+            if (unlikely(s2e_is_hijacked_page(vaddr)) && \
+                unlikely(s2e_hijack_memory_access(vaddr, haddr, \
                             (uint8_t*)&value, DATA_SIZE, 0, isIO, ACCESS_TYPE == (NB_MMU_MODES + 1)))) { \
             } \
             else { \
@@ -145,7 +146,8 @@
 
 #define S2E_HIJACK_MEMORY_WRITE(vaddr, haddr, value, isIO, origCode) \
         do { \
-            if (unlikely(s2e_hijack_memory_access(vaddr, haddr, \
+            if (unlikely(s2e_is_hijacked_page(vaddr)) && \
+                unlikely(s2e_hijack_memory_access(vaddr, haddr, \
                             (uint8_t*)&value, DATA_SIZE, 1, isIO, 0))) { \
             } \
             else { \
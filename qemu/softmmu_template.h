@@ -121,7 +121,8 @@
 
 #define S2E_HIJACK_MEMORY_READ(vaddr, haddr, value, isIO, origCode) \
         do { \
-            if (unlikely(s2e_hijack_memory_access(vaddr, haddr, \
+            if (unlikely(s2e_is_hijacked_page(vaddr)) && \
+                unlikely(s2e_hijack_memory_access(vaddr, haddr, \
                             (uint8_t*)&value, DATA_SIZE, 0, isIO, READ_ACCESS_TYPE == 2))) { \
             } \
             else { \
@@ -131,7 +132,8 @@
 
 #define S2E_HIJACK_MEMORY_WRITE(vaddr, haddr, value, isIO, origCode) \
         do { \
-            if (unlikely(s2e_hijack_memory_access(vaddr, haddr, \
+            if (unlikely(s2e_is_hijacked_page(vaddr)) && \
+                unlikely(s2e_hijack_memory_access(vaddr, haddr, \
                             (uint8_t*)&value, DATA_SIZE, 1, isIO, 0))) { \
             } \
             else { \
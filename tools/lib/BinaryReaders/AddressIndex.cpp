@@ -0,0 +1,312 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in the S2E-AUTHORS file.
+ */
+
+#include "AddressIndex.h"
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <iostream>
+
+namespace s2etools
+{
+
+AddressIndex::AddressIndex(const std::string &fileName)
+{
+    m_fileName = fileName;
+    m_mapping = NULL;
+    m_mappingSize = 0;
+    m_header = NULL;
+    m_functions = NULL;
+    m_blocks = NULL;
+    m_lines = NULL;
+    m_strings = NULL;
+}
+
+AddressIndex::~AddressIndex()
+{
+    if (m_mapping) {
+        munmap(m_mapping, m_mappingSize);
+    }
+}
+
+bool AddressIndex::isUpToDate(const std::string &indexFile, const std::string &moduleFile)
+{
+    struct stat indexStat, moduleStat;
+    if (stat(indexFile.c_str(), &indexStat) < 0) {
+        return false;
+    }
+
+    //The index may be shipped without the module
+    if (stat(moduleFile.c_str(), &moduleStat) < 0) {
+        return true;
+    }
+
+    return indexStat.st_mtime >= moduleStat.st_mtime;
+}
+
+bool AddressIndex::open()
+{
+    if (m_mapping) {
+        return true;
+    }
+
+    int fd = ::open(m_fileName.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (uint64_t) st.st_size < sizeof(AddressIndexHeader)) {
+        std::cerr << m_fileName << " is not an address index" << std::endl;
+        close(fd);
+        return false;
+    }
+
+    void *mapping = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "Could not map " << m_fileName << std::endl;
+        return false;
+    }
+
+    const AddressIndexHeader *hdr = static_cast<const AddressIndexHeader*>(mapping);
+    uint64_t size = st.st_size - sizeof(*hdr);
+    uint64_t maxEntries = size / sizeof(AddressIndexEntry);
+
+    //Indexes in an older layout are stale, the binary is used instead
+    if (memcmp(hdr->magic, ADDRESS_INDEX_MAGIC, sizeof(hdr->magic)) ||
+        hdr->version != ADDRESS_INDEX_VERSION) {
+        std::cerr << m_fileName << " is not an address index of version "
+                  << ADDRESS_INDEX_VERSION << ", rebuild it with mkindex" << std::endl;
+        munmap(mapping, st.st_size);
+        return false;
+    }
+
+    bool valid = hdr->functionCount <= maxEntries &&
+                 hdr->blockCount <= maxEntries - hdr->functionCount &&
+                 hdr->lineCount <= maxEntries - hdr->functionCount - hdr->blockCount &&
+                 hdr->stringsSize > 0 &&
+                 hdr->stringsSize == size - (hdr->functionCount + hdr->blockCount + hdr->lineCount) *
+                                            sizeof(AddressIndexEntry);
+
+    const char *strings = (const char*) (hdr + 1) +
+            (hdr->functionCount + hdr->blockCount + hdr->lineCount) * sizeof(AddressIndexEntry);
+
+    if (!valid || strings[hdr->stringsSize - 1] != 0) {
+        std::cerr << m_fileName << " is not a valid address index" << std::endl;
+        munmap(mapping, st.st_size);
+        return false;
+    }
+
+    m_mapping = mapping;
+    m_mappingSize = st.st_size;
+    m_header = hdr;
+    m_functions = reinterpret_cast<const AddressIndexEntry*>(hdr + 1);
+    m_blocks = m_functions + hdr->functionCount;
+    m_lines = m_blocks + hdr->blockCount;
+    m_strings = strings;
+    return true;
+}
+
+const AddressIndexEntry *AddressIndex::find(const AddressIndexEntry *entries,
+                                            uint64_t count, uint64_t address)
+{
+    //Look for the last entry that starts at or before the address
+    uint64_t low = 0, high = count;
+    while (low < high) {
+        uint64_t mid = low + (high - low) / 2;
+        if (entries[mid].start <= address) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    if (low == 0) {
+        return NULL;
+    }
+
+    const AddressIndexEntry *e = &entries[low - 1];
+    return address < e->end ? e : NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+AddressIndexBuilder::AddressIndexBuilder()
+{
+    //Offset 0 is the empty string
+    m_stringTable.push_back(0);
+    m_strings[""] = 0;
+}
+
+uint32_t AddressIndexBuilder::addString(const std::string &s)
+{
+    Strings::const_iterator it = m_strings.find(s);
+    if (it != m_strings.end()) {
+        return (*it).second;
+    }
+
+    uint32_t offset = m_stringTable.size();
+    m_stringTable.append(s.c_str(), s.size() + 1);
+    m_strings[s] = offset;
+    return offset;
+}
+
+void AddressIndexBuilder::addFunction(uint64_t start, uint64_t end, const std::string &name)
+{
+    AddressIndexEntry e;
+    memset(&e, 0, sizeof(e));
+    e.start = start;
+    e.end = end;
+    e.function = addString(name);
+    m_functions.push_back(e);
+}
+
+void AddressIndexBuilder::addBlock(uint64_t start, uint64_t end, const std::string &function,
+                                   const std::string &source, uint64_t line)
+{
+    AddressIndexEntry e;
+    memset(&e, 0, sizeof(e));
+    e.start = start;
+    e.end = end;
+    e.function = addString(function);
+    e.source = addString(source);
+    e.line = line;
+    m_blocks.push_back(e);
+}
+
+void AddressIndexBuilder::addLine(uint64_t start, uint64_t end, const std::string &function,
+                                  const std::string &source, uint64_t line)
+{
+    AddressIndexEntry e;
+    memset(&e, 0, sizeof(e));
+    e.start = start;
+    e.end = end;
+    e.function = addString(function);
+    e.source = addString(source);
+    e.line = line;
+    m_lines.push_back(e);
+}
+
+static bool compareStart(const AddressIndexEntry &e1, const AddressIndexEntry &e2)
+{
+    return e1.start < e2.start;
+}
+
+//Sorts the entries and truncates the ranges that overlap the next one,
+//so that a binary search on the start address finds the innermost entry
+void AddressIndexBuilder::normalize(std::vector<AddressIndexEntry> &entries)
+{
+    std::stable_sort(entries.begin(), entries.end(), compareStart);
+
+    std::vector<AddressIndexEntry> result;
+    for (unsigned i = 0; i < entries.size(); ++i) {
+        const AddressIndexEntry &e = entries[i];
+        if (e.end <= e.start) {
+            continue;
+        }
+
+        if (!result.empty()) {
+            AddressIndexEntry &prev = result.back();
+            if (prev.start == e.start) {
+                continue;
+            }
+            if (prev.end > e.start) {
+                prev.end = e.start;
+            }
+        }
+        result.push_back(e);
+    }
+
+    entries.swap(result);
+}
+
+bool AddressIndexBuilder::write(const std::string &fileName, const std::string &moduleName,
+                                uint64_t imageBase, uint64_t imageSize)
+{
+    normalize(m_functions);
+    normalize(m_blocks);
+    normalize(m_lines);
+
+    AddressIndexHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, ADDRESS_INDEX_MAGIC, sizeof(hdr.magic));
+    hdr.version = ADDRESS_INDEX_VERSION;
+    hdr.moduleName = addString(moduleName);
+    hdr.imageBase = imageBase;
+    hdr.imageSize = imageSize;
+    hdr.functionCount = m_functions.size();
+    hdr.blockCount = m_blocks.size();
+    hdr.lineCount = m_lines.size();
+    hdr.stringsSize = m_stringTable.size();
+
+    //Tools that are running keep the old file mapped
+    std::string tmpName = fileName + ".tmp";
+    FILE *fp = fopen(tmpName.c_str(), "wb");
+    if (!fp) {
+        std::cerr << "Could not create " << tmpName << std::endl;
+        return false;
+    }
+
+    bool ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1;
+    if (ok && !m_functions.empty()) {
+        ok = fwrite(&m_functions[0], sizeof(AddressIndexEntry), m_functions.size(), fp) == m_functions.size();
+    }
+    if (ok && !m_blocks.empty()) {
+        ok = fwrite(&m_blocks[0], sizeof(AddressIndexEntry), m_blocks.size(), fp) == m_blocks.size();
+    }
+    if (ok && !m_lines.empty()) {
+        ok = fwrite(&m_lines[0], sizeof(AddressIndexEntry), m_lines.size(), fp) == m_lines.size();
+    }
+    ok = ok && fwrite(m_stringTable.data(), m_stringTable.size(), 1, fp) == 1;
+    ok = fclose(fp) == 0 && ok;
+
+    if (!ok || rename(tmpName.c_str(), fileName.c_str())) {
+        std::cerr << "Could not write " << fileName << std::endl;
+        remove(tmpName.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+}
@@ -0,0 +1,195 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in the S2E-AUTHORS file.
+ */
+
+#ifndef S2ETOOLS_ADDRESSINDEX_H
+#define S2ETOOLS_ADDRESSINDEX_H
+
+#include <string>
+#include <map>
+#include <vector>
+#include <inttypes.h>
+
+namespace s2etools
+{
+
+/**
+ *  Layout of the address index files.
+ *
+ *  The header is followed by functionCount function entries, blockCount
+ *  basic block entries, lineCount line entries, and stringsSize bytes of
+ *  null-terminated strings. Each table is sorted by start address and its
+ *  ranges do not overlap. Names are offsets in the string table, 0 is the
+ *  empty string.
+ *
+ *  The line entries are the line table of the binary: each one is a range
+ *  of code that maps to the same source line.
+ */
+#define ADDRESS_INDEX_MAGIC "S2EINDEX"
+#define ADDRESS_INDEX_VERSION 2
+#define ADDRESS_INDEX_SUFFIX ".idx"
+
+struct AddressIndexHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t moduleName;
+    uint64_t imageBase;
+    uint64_t imageSize;
+    uint64_t functionCount;
+    uint64_t blockCount;
+    uint64_t lineCount;
+    uint64_t stringsSize;
+};
+
+struct AddressIndexEntry {
+    uint64_t start, end;    //end is excluded
+    uint32_t function;
+    uint32_t source;        //Source file of the start address
+    uint32_t line;          //Source line of the start address
+    uint32_t reserved;
+};
+
+/**
+ *  Read-only view of an address index file, which is mapped in memory.
+ *  Lookups are binary searches in the sorted tables of the file and do
+ *  not allocate memory.
+ */
+class AddressIndex
+{
+private:
+    std::string m_fileName;
+    void *m_mapping;
+    uint64_t m_mappingSize;
+
+    const AddressIndexHeader *m_header;
+    const AddressIndexEntry *m_functions;
+    const AddressIndexEntry *m_blocks;
+    const AddressIndexEntry *m_lines;
+    const char *m_strings;
+
+    static const AddressIndexEntry *find(const AddressIndexEntry *entries,
+                                         uint64_t count, uint64_t address);
+
+public:
+    AddressIndex(const std::string &fileName);
+    ~AddressIndex();
+
+    /** Maps the file and checks its layout */
+    bool open();
+
+    /** Whether the index exists and is not older than the module */
+    static bool isUpToDate(const std::string &indexFile, const std::string &moduleFile);
+
+    const AddressIndexEntry *findFunction(uint64_t address) const {
+        return find(m_functions, m_header->functionCount, address);
+    }
+
+    const AddressIndexEntry *findBlock(uint64_t address) const {
+        return find(m_blocks, m_header->blockCount, address);
+    }
+
+    const AddressIndexEntry *findLine(uint64_t address) const {
+        return find(m_lines, m_header->lineCount, address);
+    }
+
+    const char *getString(uint32_t offset) const {
+        return offset < m_header->stringsSize ? m_strings + offset : "";
+    }
+
+    const AddressIndexHeader &getHeader() const {
+        return *m_header;
+    }
+
+    const AddressIndexEntry *getFunctions() const {
+        return m_functions;
+    }
+
+    const AddressIndexEntry *getBlocks() const {
+        return m_blocks;
+    }
+
+    const AddressIndexEntry *getLines() const {
+        return m_lines;
+    }
+};
+
+/**
+ *  Collects the functions, basic blocks and line table of a module and
+ *  writes them in the layout of AddressIndex.
+ */
+class AddressIndexBuilder
+{
+private:
+    typedef std::map<std::string, uint32_t> Strings;
+
+    std::vector<AddressIndexEntry> m_functions;
+    std::vector<AddressIndexEntry> m_blocks;
+    std::vector<AddressIndexEntry> m_lines;
+    std::string m_stringTable;
+    Strings m_strings;
+
+    uint32_t addString(const std::string &s);
+    static void normalize(std::vector<AddressIndexEntry> &entries);
+
+public:
+    AddressIndexBuilder();
+
+    void addFunction(uint64_t start, uint64_t end, const std::string &name);
+
+    void addBlock(uint64_t start, uint64_t end, const std::string &function,
+                  const std::string &source, uint64_t line);
+
+    void addLine(uint64_t start, uint64_t end, const std::string &function,
+                 const std::string &source, uint64_t line);
+
+    /** Sorts the tables and atomically replaces the index file */
+    bool write(const std::string &fileName, const std::string &moduleName,
+               uint64_t imageBase, uint64_t imageSize);
+
+    unsigned getFunctionCount() const {
+        return m_functions.size();
+    }
+
+    unsigned getBlockCount() const {
+        return m_blocks.size();
+    }
+
+    unsigned getLineCount() const {
+        return m_lines.size();
+    }
+};
+
+}
+
+#endif
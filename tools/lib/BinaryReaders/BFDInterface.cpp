@@ -42,6 +42,7 @@
 #include "llvm/Support/system_error.h"
 
 #include <stdlib.h>
+#include <string.h>
 #include <cassert>
 
 #include <algorithm>
@@ -279,6 +280,103 @@ uint64_t BFDInterface::getImageSize() const
     return bfd_get_size(m_bfd);
 }
 
+void BFDInterface::getFunctions(FunctionRanges &functions) const
+{
+    if (!m_bfd) {
+        return;
+    }
+
+    //Functions start at the symbols of code sections and extend
+    //until the next symbol or the end of the section
+    typedef std::map<uint64_t, std::pair<const asymbol*, uint64_t> > Symbols;
+    Symbols symbols;
+
+    for (long i = 0; i < m_symbolCount; ++i) {
+        const asymbol *sym = m_symbolTable[i];
+        if (!(sym->flags & (BSF_FUNCTION | BSF_GLOBAL | BSF_LOCAL))) {
+            continue;
+        }
+        if (sym->flags & (BSF_SECTION_SYM | BSF_DEBUGGING | BSF_FILE)) {
+            continue;
+        }
+
+        const asection *section = sym->section;
+        if (!section || !(section->flags & SEC_CODE)) {
+            continue;
+        }
+
+        uint64_t start = bfd_asymbol_value(sym);
+        if (symbols.find(start) == symbols.end() || (sym->flags & BSF_FUNCTION)) {
+            symbols[start] = std::make_pair(sym, (uint64_t) (section->vma + section->size));
+        }
+    }
+
+    for (Symbols::const_iterator it = symbols.begin(); it != symbols.end(); ++it) {
+        FunctionRange f;
+        f.start = (*it).first;
+        f.end = (*it).second.second;
+        f.name = (*it).second.first->name;
+
+        Symbols::const_iterator next = it;
+        ++next;
+        if (next != symbols.end() && (*next).first < f.end) {
+            f.end = (*next).first;
+        }
+
+        functions.push_back(f);
+    }
+}
+
+void BFDInterface::getLines(LineRanges &lines)
+{
+    if (!m_bfd) {
+        return;
+    }
+
+    //BFD cannot enumerate the line table, so look up every byte of the
+    //code sections and merge the consecutive ones with the same answer
+    for (Sections::const_iterator it = m_sections.begin(); it != m_sections.end(); ++it) {
+        asection *section = (*it).second;
+        if (!(section->flags & SEC_CODE)) {
+            continue;
+        }
+
+        bool inRange = false;
+        for (uint64_t offset = 0; offset < section->size; ++offset) {
+            const char *filename;
+            const char *funcname;
+            unsigned int sourceline;
+
+            if (!bfd_find_nearest_line(m_bfd, section, m_symbolTable, offset,
+                                       &filename, &funcname, &sourceline) ||
+                (!filename && !sourceline && !funcname)) {
+                inRange = false;
+                continue;
+            }
+
+            std::string source = filename ? filename : "<unknown source>";
+            std::string function = funcname ? funcname : "<unknown function>";
+
+            if (inRange) {
+                LineRange &last = lines.back();
+                if (last.line == sourceline && last.source == source && last.function == function) {
+                    last.end = section->vma + offset + 1;
+                    continue;
+                }
+            }
+
+            LineRange l;
+            l.start = section->vma + offset;
+            l.end = l.start + 1;
+            l.source = source;
+            l.line = sourceline;
+            l.function = function;
+            lines.push_back(l);
+            inRange = true;
+        }
+    }
+}
+
 uint64_t BFDInterface::getEntryPoint() const
 {
     if (!m_bfd) {
@@ -316,16 +414,47 @@ bool BFDInterface::read(uint64_t va, void *dest, unsigned size) const
     }
 
     bool b = bfd_get_section_contents(m_bfd, section, dest, va - section->vma, size);
-    //Check for written changes
-    for (unsigned i=0; i<size; ++i) {
-        std::map<uint64_t, uint8_t>::const_iterator it = m_cowBuffer.find(va+i);
-        if (it != m_cowBuffer.end()) {
-            *(((uint8_t*)dest) + i) = (*it).second;
-        }
+    if (m_cowBuffer.empty()) {
+        return b;
+    }
+
+    //Check for written changes, one page at a time
+    CowPages::const_iterator it = m_cowBuffer.lower_bound(va & ~(COW_PAGE_SIZE - 1));
+    for (; it != m_cowBuffer.end() && (*it).first < va + size; ++it) {
+        uint64_t start = std::max(va, (*it).first);
+        uint64_t end = std::min(va + size, (*it).first + COW_PAGE_SIZE);
+        memcpy((uint8_t*)dest + (start - va), &(*it).second[start - (*it).first], end - start);
     }
     return b;
 }
 
+//Returns the copy of the page, initialized with the contents of the sections
+std::vector<uint8_t> &BFDInterface::getCowPage(uint64_t page)
+{
+    CowPages::iterator it = m_cowBuffer.find(page);
+    if (it != m_cowBuffer.end()) {
+        return (*it).second;
+    }
+
+    std::vector<uint8_t> &contents = m_cowBuffer[page];
+    contents.resize(COW_PAGE_SIZE, 0);
+
+    uint64_t va = page;
+    while (va < page + COW_PAGE_SIZE) {
+        asection *section = getSection(va, 1);
+        if (!section) {
+            ++va;
+            continue;
+        }
+
+        uint64_t end = std::min(page + COW_PAGE_SIZE, (uint64_t) (section->vma + section->size));
+        bfd_get_section_contents(m_bfd, section, &contents[va - page], va - section->vma, end - va);
+        va = end;
+    }
+
+    return contents;
+}
+
 bool BFDInterface::write(uint64_t va, void *source, unsigned size)
 {
     asection *section = getSection(va, 1);
@@ -334,8 +463,14 @@ bool BFDInterface::write(uint64_t va, void *source, unsigned size)
     }
 
     //Write data to a local buffer instead of the bfd
-    for (unsigned i=0; i<size; ++i) {
-        m_cowBuffer[va+i] = *(((uint8_t*)source) + i);
+    uint64_t end = va + size;
+    while (va < end) {
+        uint64_t page = va & ~(COW_PAGE_SIZE - 1);
+        uint64_t chunkEnd = std::min(end, page + COW_PAGE_SIZE);
+        std::vector<uint8_t> &contents = getCowPage(page);
+        memcpy(&contents[va - page], source, chunkEnd - va);
+        source = (uint8_t*)source + (chunkEnd - va);
+        va = chunkEnd;
     }
     return true;
     //XXX: This always seems to fail, because bfd_direction is not properly set for
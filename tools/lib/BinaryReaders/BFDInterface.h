@@ -44,6 +44,7 @@ extern "C" {
 #include <string>
 #include <map>
 #include <set>
+#include <vector>
 #include <inttypes.h>
 
 #include "ExecutableFile.h"
@@ -126,8 +127,11 @@ private:
     llvm::OwningPtr<llvm::MemoryBuffer> m_file;
     Binary *m_binary;
 
-    //This for copy-on-write, when we need to write stuff to the BFD
-    std::map<uint64_t, uint8_t> m_cowBuffer;
+    //This for copy-on-write, when we need to write stuff to the BFD.
+    //Written pages are copied whole, reads overlay them on the BFD contents.
+    static const uint64_t COW_PAGE_SIZE = 0x1000;
+    typedef std::map<uint64_t, std::vector<uint8_t> > CowPages;
+    CowPages m_cowBuffer;
 
     RelocationEntries m_relocations;
     Imports m_imports;
@@ -136,6 +140,7 @@ private:
 
     bool initPeImports();
     asection *getSection(uint64_t va, unsigned size) const;
+    std::vector<uint8_t> &getCowPage(uint64_t page);
 
 public:
     BFDInterface(const std::string &fileName);
@@ -156,6 +161,8 @@ public:
     virtual bool getModuleName(std::string &name ) const;
     virtual uint64_t getImageBase() const;
     virtual uint64_t getImageSize() const;
+    virtual void getFunctions(FunctionRanges &functions) const;
+    virtual void getLines(LineRanges &lines);
 
     //Gets the address of the first executable instruction of the file
     uint64_t getEntryPoint() const;
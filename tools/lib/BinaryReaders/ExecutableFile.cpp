@@ -36,6 +36,7 @@
 #include "ExecutableFile.h"
 #include "BFDInterface.h"
 #include "TextModule.h"
+#include "IndexedModule.h"
 
 namespace s2etools
 {
@@ -51,6 +52,20 @@ ExecutableFile::~ExecutableFile()
 }
 
 ExecutableFile *ExecutableFile::create(const std::string &fileName)
+{
+    //Use the prebuilt address index, which is much faster to load and query.
+    //It has everything the binary would answer, the binary is only read
+    //when the index is missing or older than it.
+    IndexedModule *im = new IndexedModule(fileName);
+    if (im->initialize() && im->inited()) {
+        return im;
+    }
+    delete im;
+
+    return createFromBinary(fileName);
+}
+
+ExecutableFile *ExecutableFile::createFromBinary(const std::string &fileName)
 {
     //Try to see if we can open the binary using BFD
     BFDInterface *bfd = new BFDInterface(fileName);
@@ -67,7 +82,6 @@ ExecutableFile *ExecutableFile::create(const std::string &fileName)
     delete tm;
 
     return NULL;
-
 }
 
 }
@@ -38,11 +38,30 @@
 
 
 #include <string>
+#include <vector>
 #include <inttypes.h>
 
 namespace s2etools
 {
 
+struct FunctionRange
+{
+    uint64_t start, end;    //end is excluded
+    std::string name;
+};
+
+typedef std::vector<FunctionRange> FunctionRanges;
+
+struct LineRange
+{
+    uint64_t start, end;    //end is excluded
+    std::string source;
+    uint64_t line;
+    std::string function;
+};
+
+typedef std::vector<LineRange> LineRanges;
+
 /**
  *  XXX:We should get rid of BFD eventually because it does not handle all we needs
  *  For now the missing functionality is implemented by subclasses of Binary
@@ -62,9 +81,19 @@ public:
 
     static ExecutableFile *create(const std::string &fileName);
 
+    //Opens the binary itself with BFD or its text description, ignoring its index
+    static ExecutableFile *createFromBinary(const std::string &fileName);
+
     virtual bool getModuleName(std::string &name ) const = 0;
     virtual uint64_t getImageBase() const  = 0;
     virtual uint64_t getImageSize() const  = 0;
+
+    //Lists the address ranges of the known functions, in no particular order
+    virtual void getFunctions(FunctionRanges &functions) const {}
+
+    //Lists the address ranges of the code for which getInfo() returns the
+    //same source line, in address order
+    virtual void getLines(LineRanges &lines) {}
 };
 
 
@@ -0,0 +1,136 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in the S2E-AUTHORS file.
+ */
+
+#include "IndexedModule.h"
+
+namespace s2etools
+{
+
+IndexedModule::IndexedModule(const std::string &fileName):
+        ExecutableFile(fileName), m_index(fileName + ADDRESS_INDEX_SUFFIX)
+{
+    m_inited = false;
+}
+
+IndexedModule::~IndexedModule()
+{
+
+}
+
+bool IndexedModule::initialize()
+{
+    if (m_inited) {
+        return true;
+    }
+
+    if (!AddressIndex::isUpToDate(m_fileName + ADDRESS_INDEX_SUFFIX, m_fileName)) {
+        return false;
+    }
+
+    m_inited = m_index.open();
+    return m_inited;
+}
+
+bool IndexedModule::getInfo(uint64_t addr, std::string &source, uint64_t &line, std::string &function)
+{
+    if (!m_inited) {
+        return false;
+    }
+
+    const AddressIndexEntry *e = m_index.findLine(addr);
+    if (!e) {
+        e = m_index.findBlock(addr);
+    }
+
+    if (e) {
+        source = m_index.getString(e->source);
+        line = e->line;
+        function = m_index.getString(e->function);
+        return true;
+    }
+
+    e = m_index.findFunction(addr);
+    if (e) {
+        source = "<unknown source>";
+        line = 0;
+        function = m_index.getString(e->function);
+        return true;
+    }
+
+    return false;
+}
+
+bool IndexedModule::inited() const
+{
+    return m_inited;
+}
+
+bool IndexedModule::getModuleName(std::string &name) const
+{
+    if (!m_inited) {
+        return false;
+    }
+
+    name = m_index.getString(m_index.getHeader().moduleName);
+    return true;
+}
+
+uint64_t IndexedModule::getImageBase() const
+{
+    return m_inited ? m_index.getHeader().imageBase : 0;
+}
+
+uint64_t IndexedModule::getImageSize() const
+{
+    return m_inited ? m_index.getHeader().imageSize : 0;
+}
+
+void IndexedModule::getFunctions(FunctionRanges &functions) const
+{
+    if (!m_inited) {
+        return;
+    }
+
+    const AddressIndexEntry *e = m_index.getFunctions();
+    for (uint64_t i = 0; i < m_index.getHeader().functionCount; ++i) {
+        FunctionRange f;
+        f.start = e[i].start;
+        f.end = e[i].end;
+        f.name = m_index.getString(e[i].function);
+        functions.push_back(f);
+    }
+}
+
+}
@@ -0,0 +1,83 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in the S2E-AUTHORS file.
+ */
+
+#ifndef S2ETOOLS_INDEXEDMODULE_H
+#define S2ETOOLS_INDEXEDMODULE_H
+
+#include <string>
+#include <inttypes.h>
+
+#include "ExecutableFile.h"
+#include "AddressIndex.h"
+
+namespace s2etools
+{
+
+/**
+ *  Answers the lookups of a module from its prebuilt address index,
+ *  without opening the module itself. The index is built by the
+ *  mkindex tool.
+ *
+ *  Addresses are looked up in the line table of the index, then in its
+ *  basic blocks, whose line is the one of their start, and last in its
+ *  functions, which only give a name.
+ */
+class IndexedModule : public ExecutableFile
+{
+private:
+    AddressIndex m_index;
+    bool m_inited;
+
+public:
+    IndexedModule(const std::string &fileName);
+    virtual ~IndexedModule();
+
+    virtual bool initialize();
+    virtual bool getInfo(uint64_t addr, std::string &source, uint64_t &line, std::string &function);
+    virtual bool inited() const;
+
+    virtual bool getModuleName(std::string &name ) const;
+    virtual uint64_t getImageBase() const;
+    virtual uint64_t getImageSize() const;
+    virtual void getFunctions(FunctionRanges &functions) const;
+
+    const AddressIndex &getIndex() const {
+        return m_index;
+    }
+};
+
+}
+
+#endif
@@ -76,12 +76,14 @@ Library::~Library()
 void Library::addPath(const std::string &path)
 {
     m_libpath.push_back(path);
+    m_modules.clear();
 }
 
 void Library::setPaths(const PathList &s)
 {
     m_libpath.clear();
     m_libpath = s;
+    m_modules.clear();
 }
 
 //Cycles through the list of paths and attempts to find the specified library
@@ -173,22 +175,22 @@ bool Library::addLibraryAbs(const std::string &libName)
 //Get a library using a name
 ExecutableFile *Library::get(const std::string &name)
 {
-    std::string s;
-    if (!findLibrary(name, s)) {
-        return NULL;
-    }
-
-    if (!addLibraryAbs(s)) {
-        return NULL;
+    ModuleNameToExec::const_iterator mit = m_modules.find(name);
+    if (mit != m_modules.end()) {
+        return (*mit).second;
     }
 
-    ModuleNameToExec::const_iterator it = m_libraries.find(s);
-    if (it == m_libraries.end()) {
-
-        return NULL;
+    ExecutableFile *exec = NULL;
+    std::string s;
+    if (findLibrary(name, s) && addLibraryAbs(s)) {
+        ModuleNameToExec::const_iterator it = m_libraries.find(s);
+        if (it != m_libraries.end()) {
+            exec = (*it).second;
+        }
     }
 
-    return (*it).second;
+    m_modules[name] = exec;
+    return exec;
 }
 
 bool Library::getInfo(const ModuleInstance *mi, uint64_t pc, std::string &file, uint64_t &line, std::string &func)
@@ -86,6 +86,9 @@ private:
     PathList m_libpath;
     //std::string m_libpath;
     ModuleNameToExec m_libraries;
+    //Same files by module name, NULL if not found, so that
+    //lookups do not search the paths again
+    ModuleNameToExec m_modules;
     StringSet m_badLibraries;
 
 };
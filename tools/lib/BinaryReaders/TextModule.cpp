@@ -108,6 +108,18 @@ uint64_t TextModule::getImageSize() const
     return m_imageSize;
 }
 
+void TextModule::getFunctions(FunctionRanges &functions) const
+{
+    RangeToNameMap::const_iterator it;
+    for (it = m_ObjectNames.begin(); it != m_ObjectNames.end(); ++it) {
+        FunctionRange f;
+        //The end address of the description is included
+        f.start = (*it).first.start;
+        f.end = (*it).first.end + 1;
+        f.name = (*it).second;
+        functions.push_back(f);
+    }
+}
 
 bool TextModule::processTextDescHeader(const char *str)
 {
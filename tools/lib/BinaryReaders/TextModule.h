@@ -105,6 +105,7 @@ public:
     virtual bool getModuleName(std::string &name ) const;
     virtual uint64_t getImageBase() const;
     virtual uint64_t getImageSize() const;
+    virtual void getFunctions(FunctionRanges &functions) const;
 };
 
 
@@ -63,6 +63,7 @@ void CacheProfiler::onItem(unsigned traceIndex,
     }
 
     ExecutionTraceCache *cacheItem = (ExecutionTraceCache*)item;
+    CacheProfilerState *state = static_cast<CacheProfilerState*>(m_events->getState(this, &CacheProfilerState::factory));
 
     switch(cacheItem->type) {
 
@@ -70,21 +71,21 @@ void CacheProfiler::onItem(unsigned traceIndex,
         //Actual parameters will come later in the trace
         case s2e::plugins::CACHE_NAME: {
             std::string s((const char*)cacheItem->name.name, cacheItem->name.length);
-            m_cacheIds[cacheItem->name.id] = s;
+            state->m_cacheIds[cacheItem->name.id] = s;
         }
         break;
 
         //Create the cache according to the parameters
         //in the trace
         case s2e::plugins::CACHE_PARAMS: {
-            CacheIdToName::iterator it = m_cacheIds.find(cacheItem->params.cacheId);
-            assert(it != m_cacheIds.end());
+            CacheIdToName::iterator it = state->m_cacheIds.find(cacheItem->params.cacheId);
+            assert(it != state->m_cacheIds.end());
 
-            Cache *params = new Cache((*it).second, cacheItem->params.lineSize,
-                                      cacheItem->params.size, cacheItem->params.associativity);
+            Cache params((*it).second, cacheItem->params.lineSize,
+                         cacheItem->params.size, cacheItem->params.associativity);
 
-            assert(m_caches.find(cacheItem->params.cacheId) == m_caches.end());
-            m_caches[cacheItem->params.cacheId] = params;
+            assert(state->m_caches.find(cacheItem->params.cacheId) == state->m_caches.end());
+            state->m_caches.insert(std::make_pair(cacheItem->params.cacheId, params));
             //XXX: fix that when needed
             //params->setUpperCache(NULL);
         }
@@ -92,8 +93,6 @@ void CacheProfiler::onItem(unsigned traceIndex,
 
         case s2e::plugins::CACHE_ENTRY: {
             const ExecutionTraceCacheSimEntry *se = &cacheItem->entry;
-
-            CacheProfilerState *state = static_cast<CacheProfilerState*>(m_events->getState(this, &CacheProfilerState::factory));
             state->processCacheItem(this, hdr, *se);
         }
         break;
@@ -131,11 +130,10 @@ void CacheProfilerState::processCacheItem(CacheProfiler *cp,
                       const s2e::plugins::ExecutionTraceItemHeader &hdr,
                       const s2e::plugins::ExecutionTraceCacheSimEntry &e)
 {
-    CacheProfiler::Caches::iterator it = cp->m_caches.find(e.cacheId);
-    assert(it != cp->m_caches.end());
+    CacheProfiler::Caches::iterator it = m_caches.find(e.cacheId);
+    assert(it != m_caches.end());
 
-    Cache *c = (*it).second;
-    assert(c);
+    Cache *c = &(*it).second;
 
     CacheStatistics addend(e.isWrite ? 0 : e.missCount,
                            e.isWrite ? e.missCount : 0);
@@ -40,22 +40,50 @@
 
 namespace s2etools {
 
-class Cache;
+class Cache
+{
+private:
+    unsigned m_size;
+    unsigned m_lineSize;
+    unsigned m_associativity;
+    std::string m_name;
+    Cache *m_upper;
+
+
+public:
+    Cache(const std::string &name,
+          unsigned lineSize, unsigned size, unsigned assoc)
+    {
+        m_size = size;
+        m_lineSize = lineSize;
+        m_associativity = assoc;
+        m_name = name;
+        m_upper = NULL;
+    }
+
+    void setUpperCache(Cache *p) {
+        m_upper = p;
+    }
+
+    void print(std::ostream &os);
+
+    std::string getName() const {
+        return m_name;
+    }
+};
+
 class CacheProfilerState;
 
 class CacheProfiler
 {
 public:
-    typedef std::map<uint32_t, Cache *> Caches;
+    typedef std::map<uint32_t, Cache> Caches;
     typedef std::map<uint32_t, std::string> CacheIdToName;
 
 private:
     sigc::connection m_connection;
     LogEvents *m_events;
 
-    Caches m_caches;
-    CacheIdToName m_cacheIds;
-
     void onItem(unsigned traceIndex,
                 const s2e::plugins::ExecutionTraceItemHeader &hdr,
                 void *item);
@@ -109,6 +137,12 @@ public:
     CacheStats m_cacheStats;
     CacheStatistics m_globalStats;
 
+    //The cache declarations precede the entries in the trace. They are
+    //kept in the state so that a path can be processed from any of its
+    //segments without the items of the other paths.
+    CacheProfiler::CacheIdToName m_cacheIds;
+    CacheProfiler::Caches m_caches;
+
 public:
 
     CacheProfilerState();
@@ -124,38 +158,6 @@ public:
     friend class CacheProfiler;
 };
 
-/////////////////////////////////////
-class Cache
-{
-private:
-    unsigned m_size;
-    unsigned m_lineSize;
-    unsigned m_associativity;
-    std::string m_name;
-    Cache *m_upper;
-
-
-public:
-    Cache(const std::string &name,
-          unsigned lineSize, unsigned size, unsigned assoc)
-    {
-        m_size = size;
-        m_lineSize = lineSize;
-        m_associativity = assoc;
-        m_name = name;
-        m_upper = NULL;
-    }
-
-    void setUpperCache(Cache *p) {
-        m_upper = p;
-    }
-
-    void print(std::ostream &os);
-
-    std::string getName() const {
-        return m_name;
-    }
-};
 /////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
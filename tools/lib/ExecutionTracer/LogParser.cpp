@@ -35,8 +35,12 @@
 
 #include <iostream>
 #include <cassert>
+#include <cstring>
 #include "LogParser.h"
 
+#include <s2e/Plugins/ExecutionTracers/TraceCompression.h>
+#include <s2e/Plugins/ExecutionTracers/TraceEncoding.h>
+
 #ifdef _WIN32
 #include <windows.h>
 #else
@@ -85,10 +89,25 @@ LogEvents::~LogEvents()
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 
+//Number of decompressed chunks kept in memory
+#define LOGPARSER_DECODED_CHUNKS 16
+
+LogParser::ChunkCache::ChunkCache()
+{
+    m_useCount = 0;
+
+    m_decoded.resize(LOGPARSER_DECODED_CHUNKS);
+    for (unsigned i = 0; i < m_decoded.size(); ++i) {
+        m_decoded[i].file = -1;
+        m_decoded[i].lastUse = 0;
+    }
+}
+
 LogParser::LogParser():LogEvents()
 {
     m_cachedProcessor = NULL;
     m_cachedState = NULL;
+    m_itemCount = 0;
 }
 
 LogParser::~LogParser()
@@ -180,62 +199,299 @@ bool LogParser::parse(const std::string &fileName)
 #endif
 
 
-    uint64_t currentOffset = 0;
-    unsigned currentItem = m_ItemAddresses.size();
+    element.m_firstItem = m_itemCount;
+    m_files.push_back(element);
 
-    uint8_t *buffer = (uint8_t*)element.m_File;
+    unsigned fileIndex = m_files.size() - 1;
+    const s2e::plugins::ExecutionTraceFileHeader *fileHdr =
+            (const s2e::plugins::ExecutionTraceFileHeader *)element.m_File;
 
-    while(currentOffset < element.m_size) {
+    if (element.m_size >= sizeof(*fileHdr) &&
+        !memcmp(fileHdr->magic, EXECTRACE_MAGIC, sizeof(fileHdr->magic))) {
+        if (fileHdr->version != EXECTRACE_VERSION) {
+            std::cerr << "LogParser: " << fileName << " has unsupported version "
+                      << fileHdr->version << std::endl;
+            return false;
+        }
+        return parseChunked(fileIndex);
+    }
+
+    return parseFlat(fileIndex);
+}
+
+bool LogParser::parseFlat(unsigned fileIndex)
+{
+    LogFile &file = m_files[fileIndex];
+    uint8_t *buffer = (uint8_t*)file.m_File;
+    uint64_t currentOffset = 0;
+
+    while(currentOffset < file.m_size) {
 
         s2e::plugins::ExecutionTraceItemHeader *hdr =
                 (s2e::plugins::ExecutionTraceItemHeader *)(buffer);
 
-        if (currentOffset + sizeof(s2e::plugins::ExecutionTraceItemHeader) > element.m_size) {
+        if (currentOffset + sizeof(s2e::plugins::ExecutionTraceItemHeader) > file.m_size) {
             std::cerr << "LogParser: Could not read header " << std::endl;
             return false;
         }
 
-        buffer += sizeof(*hdr);
-
         if (hdr->size > 0) {
-            if (currentOffset + hdr->size > element.m_size) {
+            if (currentOffset + sizeof(*hdr) + hdr->size > file.m_size) {
                 std::cerr << "LogParser: Could not read payload " << std::endl;
                 return false;
             }
         }
 
+        unsigned currentItem = m_itemCount;
+        file.m_items.push_back(buffer);
+        ++file.m_itemCount;
+        ++m_itemCount;
+
 #ifdef DEBUG_PB
-        std::cout << fileName <<  " item=" << currentItem << " buffer="   << (void*)buffer <<
+        std::cout << "item=" << currentItem << " buffer="   << (void*)buffer <<
                      " ts=" << hdr->timeStamp <<  " offset=" << currentOffset << std::endl;
 #endif
-        processItem(currentItem, *hdr, buffer);
-        buffer+=hdr->size;
-
-        m_ItemAddresses.push_back(currentOffset + (uint8_t*)element.m_File);
+        onItemRange.emit(currentItem, 1, hdr->stateId, 1 << hdr->type);
+        processItem(currentItem, *hdr, buffer + sizeof(*hdr));
 
+        buffer += sizeof(*hdr) + hdr->size;
         currentOffset += sizeof(s2e::plugins::ExecutionTraceItemHeader)  + hdr->size;
+    }
 
-        ++currentItem;
+    return true;
+}
+
+/**
+ *  Reads the chunk index at the end of the file. Traces that were not
+ *  closed properly have no index, it is rebuilt from the chunk headers.
+ */
+bool LogParser::loadIndex(LogFile &file)
+{
+    uint8_t *buffer = (uint8_t*)file.m_File;
+    uint64_t size = file.m_size;
+
+    const s2e::plugins::ExecutionTraceFooter *footer =
+            (const s2e::plugins::ExecutionTraceFooter *)(buffer + size - sizeof(*footer));
+
+    if (size >= sizeof(s2e::plugins::ExecutionTraceFileHeader) + sizeof(*footer) &&
+        footer->magic == EXECTRACE_INDEX_MAGIC &&
+        footer->indexOffset + (uint64_t) footer->chunkCount *
+            sizeof(s2e::plugins::ExecutionTraceIndexEntry) + sizeof(*footer) == size) {
+        const s2e::plugins::ExecutionTraceIndexEntry *entries =
+                (const s2e::plugins::ExecutionTraceIndexEntry *)(buffer + footer->indexOffset);
+        file.m_chunks.assign(entries, entries + footer->chunkCount);
+        file.m_itemCount = footer->itemCount;
+        return true;
+    }
+
+    std::cerr << "LogParser: trace has no index, scanning the chunks" << std::endl;
+
+    uint64_t offset = sizeof(s2e::plugins::ExecutionTraceFileHeader);
+    while (offset < size) {
+        const s2e::plugins::ExecutionTraceChunkHeader *chunk =
+                (const s2e::plugins::ExecutionTraceChunkHeader *)(buffer + offset);
+
+        if (offset + sizeof(*chunk) > size || chunk->magic != EXECTRACE_CHUNK_MAGIC ||
+            offset + sizeof(*chunk) + chunk->storedSize > size) {
+            std::cerr << "LogParser: Could not read chunk " << std::endl;
+            return false;
+        }
+
+        s2e::plugins::ExecutionTraceIndexEntry entry = {
+            offset, chunk->firstItem, chunk->itemCount, chunk->stateId, chunk->typeMask
+        };
+        file.m_chunks.push_back(entry);
+        file.m_itemCount = chunk->firstItem + chunk->itemCount;
+
+        offset += sizeof(*chunk) + chunk->storedSize;
     }
 
-    m_files.push_back(element);
-    //fclose(file);
     return true;
 }
 
+bool LogParser::parseChunked(unsigned fileIndex)
+{
+    LogFile &file = m_files[fileIndex];
+    file.m_chunked = true;
+
+    //An incomplete trace is still usable up to the first broken chunk
+    bool complete = loadIndex(file);
+    m_itemCount += file.m_itemCount;
+
+    s2e::plugins::ExecutionTraceItemHeader hdr;
+
+    for (unsigned i = 0; i < file.m_chunks.size(); ++i) {
+        const s2e::plugins::ExecutionTraceIndexEntry &entry = file.m_chunks[i];
+        unsigned firstItem = file.m_firstItem + entry.firstItem;
+
+        onItemRange.emit(firstItem, entry.itemCount, entry.stateId, entry.typeMask);
+
+        if (onEachItem.empty()) {
+            continue;
+        }
+
+        const ChunkCache::DecodedChunk *chunk = decodeChunk(fileIndex, i, m_cache);
+        if (!chunk) {
+            return false;
+        }
+
+        hdr.stateId = chunk->stateId;
+        hdr.pid = chunk->pid;
+
+        for (unsigned j = 0; j < chunk->offsets.size(); ++j) {
+            const uint8_t *item = chunk->data + chunk->offsets[j];
+            const s2e::plugins::ExecutionTraceChunkItemHeader *itemHdr =
+                    (const s2e::plugins::ExecutionTraceChunkItemHeader *)item;
+
+            hdr.timeStamp = itemHdr->timeStamp;
+            hdr.size = itemHdr->size;
+            hdr.type = itemHdr->type;
+            processItem(firstItem + j, hdr, (void*) (item + sizeof(*itemHdr)));
+        }
+    }
+
+    return complete;
+}
+
+const LogParser::ChunkCache::DecodedChunk *LogParser::decodeChunk(unsigned fileIndex,
+                                                                 unsigned chunkIndex,
+                                                                 ChunkCache &cache) const
+{
+    ChunkCache::DecodedChunk *victim = &cache.m_decoded[0];
+    for (unsigned i = 0; i < cache.m_decoded.size(); ++i) {
+        ChunkCache::DecodedChunk &c = cache.m_decoded[i];
+        if (c.file == (int) fileIndex && c.chunk == chunkIndex) {
+            c.lastUse = ++cache.m_useCount;
+            return &c;
+        }
+        if (c.lastUse < victim->lastUse) {
+            victim = &c;
+        }
+    }
+
+    const LogFile &file = m_files[fileIndex];
+    const s2e::plugins::ExecutionTraceIndexEntry &entry = file.m_chunks[chunkIndex];
+    const uint8_t *buffer = (const uint8_t*)file.m_File;
+    const s2e::plugins::ExecutionTraceChunkHeader *hdr =
+            (const s2e::plugins::ExecutionTraceChunkHeader *)(buffer + entry.offset);
+
+    if (entry.offset + sizeof(*hdr) > file.m_size || hdr->magic != EXECTRACE_CHUNK_MAGIC ||
+        entry.offset + sizeof(*hdr) + hdr->storedSize > file.m_size) {
+        std::cerr << "LogParser: Could not read chunk " << chunkIndex << std::endl;
+        return NULL;
+    }
+
+    ChunkCache::DecodedChunk &c = *victim;
+    c.file = -1;
+
+    //Undo the compression, then the delta encoding
+    const uint8_t *encoded = (const uint8_t*) (hdr + 1);
+    if (hdr->flags & EXECTRACE_CHUNK_COMPRESSED) {
+        bool delta = hdr->flags & EXECTRACE_CHUNK_DELTA;
+        std::vector<uint8_t> &out = delta ? cache.m_encoded : c.buffer;
+        out.resize(hdr->encodedSize + 1);
+        if (!s2e::plugins::traceDecompress(encoded, hdr->storedSize,
+                                           &out[0], hdr->encodedSize)) {
+            std::cerr << "LogParser: Could not decompress chunk " << chunkIndex << std::endl;
+            return NULL;
+        }
+        encoded = &out[0];
+    }
+
+    if (hdr->flags & EXECTRACE_CHUNK_DELTA) {
+        c.buffer.resize(hdr->size + 1);
+        if (!s2e::plugins::traceDecodeItems(encoded, hdr->encodedSize, hdr->itemCount,
+                                            &c.buffer[0], hdr->size)) {
+            std::cerr << "LogParser: Could not decode chunk " << chunkIndex << std::endl;
+            return NULL;
+        }
+        encoded = &c.buffer[0];
+    }
+    c.data = encoded;
+
+    c.offsets.clear();
+    uint32_t offset = 0;
+    for (unsigned i = 0; i < hdr->itemCount; ++i) {
+        const s2e::plugins::ExecutionTraceChunkItemHeader *itemHdr =
+                (const s2e::plugins::ExecutionTraceChunkItemHeader *)(c.data + offset);
+        if (offset + sizeof(*itemHdr) > hdr->size ||
+            offset + sizeof(*itemHdr) + itemHdr->size > hdr->size) {
+            std::cerr << "LogParser: Could not read payload " << std::endl;
+            return NULL;
+        }
+        c.offsets.push_back(offset);
+        offset += sizeof(*itemHdr) + itemHdr->size;
+    }
+
+    c.file = fileIndex;
+    c.chunk = chunkIndex;
+    c.stateId = hdr->stateId;
+    c.pid = hdr->pid;
+    c.lastUse = ++cache.m_useCount;
+    return &c;
+}
+
 bool LogParser::getItem(unsigned index, s2e::plugins::ExecutionTraceItemHeader &hdr, void **data)
 {
-    if (index >= m_ItemAddresses.size() ) {
+    return getItem(index, hdr, data, m_cache);
+}
+
+bool LogParser::getItem(unsigned index, s2e::plugins::ExecutionTraceItemHeader &hdr, void **data,
+                        ChunkCache &cache) const
+{
+    if (index >= m_itemCount) {
         assert(false);
         return false;
     }
 
-    uint8_t *buffer = m_ItemAddresses[index];
-    hdr = *(s2e::plugins::ExecutionTraceItemHeader*)buffer;
+    unsigned fileIndex = 0;
+    while (index >= m_files[fileIndex].m_firstItem + m_files[fileIndex].m_itemCount) {
+        ++fileIndex;
+    }
+
+    const LogFile &file = m_files[fileIndex];
+    uint64_t localIndex = index - file.m_firstItem;
+
+    if (!file.m_chunked) {
+        uint8_t *buffer = file.m_items[localIndex];
+        hdr = *(s2e::plugins::ExecutionTraceItemHeader*)buffer;
+
+        *data = NULL;
+        if (hdr.size > 0) {
+            *data = buffer + sizeof(s2e::plugins::ExecutionTraceItemHeader);
+        }
+        return true;
+    }
+
+    //Last chunk that starts at or before the item
+    unsigned lo = 0, hi = file.m_chunks.size();
+    while (hi - lo > 1) {
+        unsigned mid = (lo + hi) / 2;
+        if (file.m_chunks[mid].firstItem <= localIndex) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    const ChunkCache::DecodedChunk *chunk = decodeChunk(fileIndex, lo, cache);
+    if (!chunk || localIndex - file.m_chunks[lo].firstItem >= chunk->offsets.size()) {
+        return false;
+    }
+
+    const uint8_t *item = chunk->data + chunk->offsets[localIndex - file.m_chunks[lo].firstItem];
+    const s2e::plugins::ExecutionTraceChunkItemHeader *itemHdr =
+            (const s2e::plugins::ExecutionTraceChunkItemHeader *)item;
+
+    hdr.timeStamp = itemHdr->timeStamp;
+    hdr.size = itemHdr->size;
+    hdr.type = itemHdr->type;
+    hdr.stateId = chunk->stateId;
+    hdr.pid = chunk->pid;
 
     *data = NULL;
     if (hdr.size > 0) {
-        *data = buffer + sizeof(s2e::plugins::ExecutionTraceItemHeader);
+        *data = (void*) (item + sizeof(*itemHdr));
     }
 
     return true;
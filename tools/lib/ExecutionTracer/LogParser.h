@@ -96,6 +96,36 @@ protected:
 
 class LogParser: public LogEvents
 {
+public:
+    /**
+     *  Recently used chunks, decompressed and decoded. A cache must not be
+     *  used by several threads at a time, threads that read the trace
+     *  concurrently each use their own.
+     */
+    class ChunkCache {
+        friend class LogParser;
+
+        struct DecodedChunk {
+            int file;
+            unsigned chunk;
+            uint64_t lastUse;
+            uint32_t stateId;
+            uint64_t pid;
+            const uint8_t *data;
+            std::vector<uint8_t> buffer;
+            std::vector<uint32_t> offsets;
+        };
+
+        std::vector<DecodedChunk> m_decoded;
+        uint64_t m_useCount;
+
+        //Decompressed delta-encoded items
+        std::vector<uint8_t> m_encoded;
+
+    public:
+        ChunkCache();
+    };
+
 private:
 
     struct LogFile {
@@ -106,6 +136,16 @@ private:
         void *m_File;
         uint64_t m_size;
 
+        //Position of the items of this file in the whole trace
+        uint64_t m_firstItem;
+        uint64_t m_itemCount;
+
+        //Flat traces have the address of each item,
+        //chunked traces have the index of the chunks
+        bool m_chunked;
+        std::vector<uint8_t*> m_items;
+        std::vector<s2e::plugins::ExecutionTraceIndexEntry> m_chunks;
+
         LogFile() {
             #ifdef _WIN32
             m_hFile = NULL;
@@ -113,29 +153,55 @@ private:
             #endif
             m_File = NULL;
             m_size = 0;
+            m_firstItem = 0;
+            m_itemCount = 0;
+            m_chunked = false;
         }
     };
 
     typedef std::vector<LogFile> LogFiles;
 
     LogFiles m_files;
-    std::vector<uint8_t*> m_ItemAddresses;
+    uint64_t m_itemCount;
+    ChunkCache m_cache;
 
     ItemProcessors m_ItemProcessors;
     void *m_cachedProcessor;
     ItemProcessorState* m_cachedState;
 
 protected:
-
+    bool parseFlat(unsigned fileIndex);
+    bool parseChunked(unsigned fileIndex);
+    bool loadIndex(LogFile &file);
+    const ChunkCache::DecodedChunk *decodeChunk(unsigned fileIndex, unsigned chunkIndex,
+                                                ChunkCache &cache) const;
 
 public:
+    /**
+     *  Emitted for consecutive items of a state, before the items themselves
+     *  are sent to onEachItem. Chunked traces emit it once per chunk. The
+     *  chunks are not decompressed while parsing if onEachItem has no
+     *  listeners, which makes indexing much faster.
+     *  Parameters: first item, item count, state id, mask of item types.
+     */
+    sigc::signal<void, unsigned, unsigned, uint32_t, uint32_t> onItemRange;
+
     LogParser();
     virtual ~LogParser();
 
     bool parse(const std::vector<std::string> fileNames);
     bool parse(const std::string &file);
+
+    /**
+     *  Chunked traces are decompressed on demand. The returned data
+     *  remains valid until a few other chunks have been accessed.
+     */
     bool getItem(unsigned index, s2e::plugins::ExecutionTraceItemHeader &hdr, void **data);
 
+    /** Same as above, safe to call from several threads with different caches */
+    bool getItem(unsigned index, s2e::plugins::ExecutionTraceItemHeader &hdr, void **data,
+                 ChunkCache &cache) const;
+
     virtual ItemProcessorState* getState(void *processor, ItemProcessorStateFactory f);
     virtual ItemProcessorState* getState(void *processor, uint32_t pathId);
     virtual void getPaths(PathSet &s);
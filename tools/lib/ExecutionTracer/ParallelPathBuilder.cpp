@@ -0,0 +1,283 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in the S2E-AUTHORS file.
+ */
+
+#include <s2e/Plugins/ExecutionTracers/TraceEntries.h>
+#include <cassert>
+#include <iostream>
+#include <unistd.h>
+#include "ParallelPathBuilder.h"
+
+namespace s2etools
+{
+
+/**
+ *  The events of one worker. The states of the segment being processed
+ *  are keyed by the processors of this worker.
+ */
+class ParallelPathBuilder::Worker: public LogEvents
+{
+public:
+    ParallelPathBuilder *m_owner;
+    AnalysisSet *m_set;
+    std::vector<void*> m_processors;
+    LogParser::ChunkCache m_cache;
+    PathSegment *m_segment;
+    pthread_t m_thread;
+
+    Worker(ParallelPathBuilder *owner) {
+        m_owner = owner;
+        m_set = NULL;
+        m_segment = NULL;
+    }
+
+    ~Worker() {
+        delete m_set;
+    }
+
+    void *toLocal(void *processor) const {
+        std::map<void*, unsigned>::const_iterator it = m_owner->m_processorIndex.find(processor);
+        if (it == m_owner->m_processorIndex.end()) {
+            std::cerr << "ParallelPathBuilder: a processor is missing from AnalysisSet::getProcessors()"
+                      << std::endl;
+            assert(false);
+            return processor;
+        }
+        return m_processors[(*it).second];
+    }
+
+    void processSegment(PathSegment *seg);
+
+    virtual ItemProcessorState* getState(void *processor, ItemProcessorStateFactory f);
+    virtual ItemProcessorState* getState(void *processor, uint32_t pathId);
+    virtual void getPaths(PathSet &s);
+};
+
+void ParallelPathBuilder::Worker::processSegment(PathSegment *seg)
+{
+    PathSegmentStateMap &m = seg->getStateMap();
+    PathSegmentStateMap::iterator it;
+
+    //The parent is done, its states are keyed by the first set
+    assert(m.empty());
+    if (seg->getParent()) {
+        PathSegmentStateMap &pm = seg->getParent()->getStateMap();
+        for (it = pm.begin(); it != pm.end(); ++it) {
+            m[toLocal((*it).first)] = (*it).second->clone();
+        }
+    }
+
+    m_segment = seg;
+
+    LogParser *parser = m_owner->m_builder->getParser();
+    const PathFragmentList &fra = seg->getFragmentList();
+    PathFragmentList::const_iterator fit;
+    s2e::plugins::ExecutionTraceItemHeader hdr;
+    void *data;
+
+    for (fit = fra.begin(); fit != fra.end(); ++fit) {
+        for (uint32_t s = (*fit).startIndex; s <= (*fit).endIndex; ++s) {
+            if (!parser->getItem(s, hdr, &data, m_cache)) {
+                assert(false && "Trace is broken");
+            }
+            assert(hdr.stateId == seg->getStateId());
+            processItem(s, hdr, data);
+        }
+    }
+
+    m_segment = NULL;
+
+    //Hand the states over to the first set
+    if (this != m_owner->m_workers[0]) {
+        PathSegmentStateMap local;
+        local.swap(m);
+        for (it = local.begin(); it != local.end(); ++it) {
+            for (unsigned i = 0; i < m_processors.size(); ++i) {
+                if (m_processors[i] == (*it).first) {
+                    m[m_owner->m_workers[0]->m_processors[i]] = (*it).second;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+ItemProcessorState* ParallelPathBuilder::Worker::getState(void *processor,
+                                                          ItemProcessorStateFactory f)
+{
+    PathSegmentStateMap &m = m_segment->getStateMap();
+    PathSegmentStateMap::iterator it = m.find(processor);
+    if (it != m.end()) {
+        return (*it).second;
+    }
+
+    ItemProcessorState *s = f();
+    m[processor] = s;
+    return s;
+}
+
+/** Only meaningful once the tree has been processed */
+ItemProcessorState* ParallelPathBuilder::Worker::getState(void *processor, uint32_t pathId)
+{
+    for (unsigned i = 0; i < m_processors.size(); ++i) {
+        if (m_processors[i] == processor) {
+            return m_owner->m_builder->getState(m_owner->m_workers[0]->m_processors[i], pathId);
+        }
+    }
+    return NULL;
+}
+
+void ParallelPathBuilder::Worker::getPaths(PathSet &s)
+{
+    m_owner->m_builder->getPaths(s);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+ParallelPathBuilder::ParallelPathBuilder(PathBuilder *builder, unsigned numThreads)
+{
+    m_builder = builder;
+    m_numThreads = numThreads;
+    if (!m_numThreads) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        m_numThreads = cpus > 0 ? cpus : 1;
+    }
+
+    m_pending = 0;
+    pthread_mutex_init(&m_mutex, NULL);
+    pthread_cond_init(&m_cond, NULL);
+}
+
+ParallelPathBuilder::~ParallelPathBuilder()
+{
+    destroyWorkers(0);
+    pthread_cond_destroy(&m_cond);
+    pthread_mutex_destroy(&m_mutex);
+}
+
+void ParallelPathBuilder::destroyWorkers(unsigned first)
+{
+    for (unsigned i = first; i < m_workers.size(); ++i) {
+        delete m_workers[i];
+    }
+    m_workers.resize(first);
+}
+
+void *ParallelPathBuilder::workerThread(void *opaque)
+{
+    Worker *worker = static_cast<Worker*>(opaque);
+    worker->m_owner->processSegments(worker);
+    return NULL;
+}
+
+void ParallelPathBuilder::processSegments(Worker *worker)
+{
+    pthread_mutex_lock(&m_mutex);
+
+    for (;;) {
+        while (m_ready.empty() && m_pending) {
+            pthread_cond_wait(&m_cond, &m_mutex);
+        }
+
+        if (m_ready.empty()) {
+            break;
+        }
+
+        //Depth first, like PathBuilder::processTree()
+        PathSegment *seg = m_ready.back();
+        m_ready.pop_back();
+        pthread_mutex_unlock(&m_mutex);
+
+        worker->processSegment(seg);
+
+        pthread_mutex_lock(&m_mutex);
+        const PathSegmentList &children = seg->getChildren();
+        m_ready.insert(m_ready.end(), children.begin(), children.end());
+        m_pending += children.size();
+        --m_pending;
+
+        if (!children.empty() || !m_pending) {
+            pthread_cond_broadcast(&m_cond);
+        }
+    }
+
+    pthread_mutex_unlock(&m_mutex);
+}
+
+AnalysisSet *ParallelPathBuilder::processTree(AnalysisSetFactory &factory)
+{
+    destroyWorkers(0);
+    m_processorIndex.clear();
+    m_builder->resetTree();
+
+    for (unsigned i = 0; i < m_numThreads; ++i) {
+        Worker *worker = new Worker(this);
+        worker->m_set = factory.create(worker);
+        worker->m_set->getProcessors(worker->m_processors);
+        assert(!i || worker->m_processors.size() == m_workers[0]->m_processors.size());
+        m_workers.push_back(worker);
+    }
+
+    for (unsigned i = 0; i < m_workers[0]->m_processors.size(); ++i) {
+        m_processorIndex[m_workers[0]->m_processors[i]] = i;
+    }
+
+    m_ready.clear();
+    m_ready.push_back(m_builder->getRoot());
+    m_pending = 1;
+
+    //The calling thread is the first worker
+    unsigned started = 1;
+    for (; started < m_workers.size(); ++started) {
+        if (pthread_create(&m_workers[started]->m_thread, NULL, workerThread, m_workers[started])) {
+            std::cerr << "ParallelPathBuilder: could not create worker thread" << std::endl;
+            break;
+        }
+    }
+
+    processSegments(m_workers[0]);
+
+    for (unsigned i = 1; i < started; ++i) {
+        pthread_join(m_workers[i]->m_thread, NULL);
+    }
+
+    for (unsigned i = 1; i < m_workers.size(); ++i) {
+        m_workers[0]->m_set->merge(*m_workers[i]->m_set);
+    }
+    destroyWorkers(1);
+
+    return m_workers[0]->m_set;
+}
+
+}
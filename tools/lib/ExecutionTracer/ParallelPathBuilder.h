@@ -0,0 +1,140 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in the S2E-AUTHORS file.
+ */
+
+#ifndef S2ETOOLS_EXECTRACER_PARALLEL_H
+#define S2ETOOLS_EXECTRACER_PARALLEL_H
+
+#include <pthread.h>
+#include <deque>
+#include <map>
+#include <vector>
+
+#include "LogParser.h"
+#include "Path.h"
+
+namespace s2etools
+{
+
+/**
+ *  The trace processors of one worker thread of ParallelPathBuilder.
+ *
+ *  Each worker creates its own set, whose processors are connected to the
+ *  events of that worker. All sets must create the same processors in the
+ *  same order, so that the n-th processor of every set runs the same analysis.
+ */
+class AnalysisSet
+{
+public:
+    virtual ~AnalysisSet() {}
+
+    /**
+     *  Returns every object that the processors pass to LogEvents::getState(),
+     *  in the same order in all sets.
+     */
+    virtual void getProcessors(std::vector<void*> &processors) = 0;
+
+    /**
+     *  Accumulates the results that the processors of another set keep
+     *  outside of their ItemProcessorState. Nothing to do for processors
+     *  that keep all their results in ItemProcessorState.
+     */
+    virtual void merge(AnalysisSet &other) {}
+};
+
+class AnalysisSetFactory
+{
+public:
+    virtual ~AnalysisSetFactory() {}
+    virtual AnalysisSet *create(LogEvents *events) = 0;
+};
+
+/**
+ *  Runs several analyses over the fork tree of a PathBuilder in one pass,
+ *  on several threads.
+ *
+ *  Each segment of the tree is a work unit, which becomes ready when its
+ *  parent has been processed. As in PathBuilder::processTree(), the
+ *  processors start a segment with a copy of the states at the end of its
+ *  parent. The workers read the trace with their own chunk caches and
+ *  send the items to their own processors.
+ *
+ *  When processing is done, the states of the segments are keyed by the
+ *  processors of the set returned by processTree(), into which the sets of
+ *  the other workers were merged. They are retrieved with
+ *  PathBuilder::getState() as usual. Processors whose output depends on
+ *  the order in which paths are processed must not be run in parallel.
+ */
+class ParallelPathBuilder
+{
+private:
+    class Worker;
+
+    PathBuilder *m_builder;
+    unsigned m_numThreads;
+    std::vector<Worker*> m_workers;
+
+    //Processor of the first set to its position in the sets
+    std::map<void*, unsigned> m_processorIndex;
+
+    //Segments whose parent has been processed
+    std::deque<PathSegment*> m_ready;
+    //Segments ready or being processed
+    unsigned m_pending;
+    pthread_mutex_t m_mutex;
+    pthread_cond_t m_cond;
+
+    static void *workerThread(void *opaque);
+    void processSegments(Worker *worker);
+    void destroyWorkers(unsigned first);
+
+public:
+    /** numThreads is 0 to use one thread per processor */
+    ParallelPathBuilder(PathBuilder *builder, unsigned numThreads);
+    ~ParallelPathBuilder();
+
+    /**
+     *  Creates the processors of each worker with the factory and processes
+     *  the whole tree. The returned set remains owned by ParallelPathBuilder.
+     */
+    AnalysisSet *processTree(AnalysisSetFactory &factory);
+
+    unsigned getNumThreads() const {
+        return m_numThreads;
+    }
+};
+
+}
+
+#endif
@@ -150,6 +150,9 @@ private:
     LogParser *m_Parser;
     sigc::connection m_connection;
 
+    void onItemRange(unsigned firstItem, unsigned itemCount,
+                     uint32_t stateId, uint32_t typeMask);
+    void appendItems(unsigned first, unsigned last, uint32_t stateId);
     void onItem(unsigned traceIndex,
                 const s2e::plugins::ExecutionTraceItemHeader &hdr,
                 void *item);
@@ -169,6 +172,15 @@ public:
     void processTree();
 
     void resetTree();
+
+    PathSegment *getRoot() const {
+        return m_Root;
+    }
+
+    LogParser *getParser() const {
+        return m_Parser;
+    }
+
     virtual ItemProcessorState* getState(void *processor, ItemProcessorStateFactory f);
     virtual ItemProcessorState* getState(void *processor, uint32_t pathId);
     virtual void getPaths(PathSet &s);
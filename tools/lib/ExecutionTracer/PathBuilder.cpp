@@ -116,8 +116,8 @@ PathBuilder::PathBuilder(LogParser *log)
 {
     m_Parser = log;
 
-    m_connection = log->onEachItem.connect(
-            sigc::mem_fun(*this, &PathBuilder::onItem)
+    m_connection = log->onItemRange.connect(
+            sigc::mem_fun(*this, &PathBuilder::onItemRange)
     );
 
     m_Root = new PathSegment(NULL, 0, 0);
@@ -141,23 +141,44 @@ PathBuilder::~PathBuilder()
     }
 }
 
-void PathBuilder::onItem(unsigned traceIndex,
-            const s2e::plugins::ExecutionTraceItemHeader &hdr,
-            void *item)
+/**
+ *  Only forks change the shape of the tree. The items of a range without
+ *  forks simply extend the current fragment of the state, so that the
+ *  chunks of a trace need not be read.
+ */
+void PathBuilder::onItemRange(unsigned firstItem, unsigned itemCount,
+                              uint32_t stateId, uint32_t typeMask)
+{
+    if (!(typeMask & (1 << s2e::plugins::TRACE_FORK))) {
+        appendItems(firstItem, firstItem + itemCount - 1, stateId);
+        return;
+    }
+
+    for (unsigned i = firstItem; i < firstItem + itemCount; ++i) {
+        s2e::plugins::ExecutionTraceItemHeader hdr;
+        void *item;
+        if (!m_Parser->getItem(i, hdr, &item)) {
+            assert(false && "Trace is broken");
+        }
+        onItem(i, hdr, item);
+    }
+}
+
+void PathBuilder::appendItems(unsigned first, unsigned last, uint32_t stateId)
 {
     assert(m_CurrentSegment);
 #ifdef DEBUG_PB
-    std::cout << "PB: ID=" << (unsigned)hdr.stateId << " T=" << (unsigned)hdr.type << std::endl;
+    std::cout << "PB: ID=" << stateId << " items=" << first << "-" << last << std::endl;
 #endif
 
-    if (hdr.stateId != m_CurrentSegment->getStateId()) {
+    if (stateId != m_CurrentSegment->getStateId()) {
         //Lookup the current state
-        StateToSegments::iterator it = m_Leaves.find(hdr.stateId);
+        StateToSegments::iterator it = m_Leaves.find(stateId);
 
         //There must have been a fork that generated the state
         if (it == m_Leaves.end()) {
             std::cout << "Encountered a state id that was not forked before " <<
-                    (int) hdr.stateId << std::endl;
+                    (int) stateId << std::endl;
             assert(false);
         }
 
@@ -174,16 +195,16 @@ void PathBuilder::onItem(unsigned traceIndex,
 
 
         //Check that the segment really belongs to us
-        assert(m_CurrentSegment->getStateId() == hdr.stateId);
+        assert(m_CurrentSegment->getStateId() == stateId);
 
         //Since we have just switched to a new state, we must start a new fragment
-        m_CurrentSegment->appendFragment(PathFragment(traceIndex, traceIndex));
+        m_CurrentSegment->appendFragment(PathFragment(first, first));
 
         //m_CurrentSegment->print(std::cout);
     }
 
     ///////////////////////////
-    assert(m_CurrentSegment->getStateId() == hdr.stateId);
+    assert(m_CurrentSegment->getStateId() == stateId);
 
     //Extend the current segment with a fragment
     //Note that forks are the last items in each fragment
@@ -191,15 +212,22 @@ void PathBuilder::onItem(unsigned traceIndex,
         #ifdef DEBUG_PB
         std::cout << "Creating new fragment for segment " << m_CurrentSegment->getStateId() << std::endl;
         #endif
-        m_CurrentSegment->appendFragment(PathFragment(traceIndex, traceIndex));
+        m_CurrentSegment->appendFragment(PathFragment(first, last));
     }else
     {
-        m_CurrentSegment->expandLastFragment(traceIndex);
+        m_CurrentSegment->expandLastFragment(last);
     }
 
     #ifdef DEBUG_PB
     m_CurrentSegment->print(std::cout);
     #endif
+}
+
+void PathBuilder::onItem(unsigned traceIndex,
+            const s2e::plugins::ExecutionTraceItemHeader &hdr,
+            void *item)
+{
+    appendItems(traceIndex, traceIndex, hdr.stateId);
 
     ///////////////////////////
     if (hdr.type == s2e::plugins::TRACE_FORK) {
@@ -0,0 +1,148 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in the S2E-AUTHORS file.
+ */
+
+#include "SampleProfiler.h"
+
+using namespace s2e::plugins;
+
+namespace s2etools {
+
+SampleProfiler::SampleProfiler(LogEvents *events, ModuleCache *mc)
+{
+    m_events = events;
+    m_mc = mc;
+    m_totalSamples = 0;
+    m_totalWeight = 0;
+    m_connection = events->onEachItem.connect(
+            sigc::mem_fun(*this, &SampleProfiler::onItem));
+}
+
+SampleProfiler::~SampleProfiler()
+{
+    m_connection.disconnect();
+}
+
+SampleProfiler::HotSpot &SampleProfiler::getHotSpot(uint64_t pid, uint64_t pc)
+{
+    Location loc;
+
+    ModuleCacheState *mcs = static_cast<ModuleCacheState*>(m_events->getState(m_mc, &ModuleCacheState::factory));
+    const ModuleInstance *mi = mcs->getInstance(pid, pc);
+    if (mi) {
+        loc.module = mi->Name;
+        loc.pid = 0;
+        loc.pc = pc - mi->LoadBase + mi->ImageBase;
+    } else {
+        loc.pid = pid;
+        loc.pc = pc;
+    }
+
+    return m_profile[loc];
+}
+
+void SampleProfiler::onItem(unsigned traceIndex,
+        const s2e::plugins::ExecutionTraceItemHeader &hdr,
+        void *item)
+{
+    if (hdr.type == TRACE_SAMPLE) {
+        const ExecutionTraceSample *e = static_cast<const ExecutionTraceSample*>(item);
+        SampleProfilerState *state = static_cast<SampleProfilerState*>(m_events->getState(this, &SampleProfilerState::factory));
+
+        //The weight counts every block of the window, each of them
+        //only stands for its share of it.
+        state->m_weight = (double) e->weight / (e->window ? e->window : 1);
+
+        HotSpot &hs = getHotSpot(hdr.pid, e->pc);
+        hs.samples++;
+        hs.blocks += e->weight;
+
+        m_totalSamples++;
+        m_totalWeight += e->weight;
+    } else if (hdr.type == TRACE_INSTR_START) {
+        const ExecutionTraceInstr *e = static_cast<const ExecutionTraceInstr*>(item);
+        SampleProfilerState *state = static_cast<SampleProfilerState*>(m_events->getState(this, &SampleProfilerState::factory));
+
+        HotSpot &hs = getHotSpot(hdr.pid, e->pc);
+        hs.instructions++;
+        hs.estInstructions += state->m_weight;
+    } else if (hdr.type == TRACE_MEMORY) {
+        const ExecutionTraceMemory *e = static_cast<const ExecutionTraceMemory*>(item);
+        SampleProfilerState *state = static_cast<SampleProfilerState*>(m_events->getState(this, &SampleProfilerState::factory));
+
+        HotSpot &hs = getHotSpot(hdr.pid, e->pc);
+        hs.memoryAccesses++;
+        hs.estMemoryAccesses += state->m_weight;
+    }
+}
+
+void SampleProfiler::merge(const SampleProfiler &other)
+{
+    Profile::const_iterator it;
+    for (it = other.m_profile.begin(); it != other.m_profile.end(); ++it) {
+        HotSpot &hs = m_profile[(*it).first];
+        const HotSpot &ohs = (*it).second;
+        hs.samples += ohs.samples;
+        hs.blocks += ohs.blocks;
+        hs.instructions += ohs.instructions;
+        hs.estInstructions += ohs.estInstructions;
+        hs.memoryAccesses += ohs.memoryAccesses;
+        hs.estMemoryAccesses += ohs.estMemoryAccesses;
+    }
+
+    m_totalSamples += other.m_totalSamples;
+    m_totalWeight += other.m_totalWeight;
+}
+
+ItemProcessorState *SampleProfilerState::factory()
+{
+    return new SampleProfilerState();
+}
+
+SampleProfilerState::SampleProfilerState()
+{
+    m_weight = 1;
+}
+
+SampleProfilerState::~SampleProfilerState()
+{
+
+}
+
+ItemProcessorState *SampleProfilerState::clone() const
+{
+    return new SampleProfilerState(*this);
+}
+
+}
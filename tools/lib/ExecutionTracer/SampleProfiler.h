@@ -0,0 +1,144 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in the S2E-AUTHORS file.
+ */
+
+#ifndef S2ETOOLS_EXECTRACER_SAMPLEPROFILER_H
+#define S2ETOOLS_EXECTRACER_SAMPLEPROFILER_H
+
+#include <s2e/Plugins/ExecutionTracers/TraceEntries.h>
+#include "LogParser.h"
+#include "ModuleParser.h"
+
+#include <map>
+#include <string>
+
+namespace s2etools {
+
+/**
+ *  Builds a hot-spot profile from the items written by the TraceSampler
+ *  plugin. Each sample stands for the number of blocks given by its
+ *  weight. The weight covers all the blocks of the sample's window,
+ *  so each instruction and memory access traced in a window of n
+ *  blocks stands for weight / n executions.
+ *
+ *  The profile is kept outside of the path states, so that each
+ *  item is counted once when the tree is processed by segments.
+ */
+class SampleProfiler
+{
+public:
+    struct Location {
+        std::string module;  //Empty if unknown
+        uint64_t pid;        //0 if the module is known
+        uint64_t pc;         //Native address if the module is known
+
+        bool operator<(const Location &l) const {
+            if (module != l.module) {
+                return module < l.module;
+            }
+            if (pid != l.pid) {
+                return pid < l.pid;
+            }
+            return pc < l.pc;
+        }
+    };
+
+    struct HotSpot {
+        uint64_t samples;         //Samples starting at this block
+        uint64_t blocks;          //Estimated executions of this block
+        uint64_t instructions;    //Sampled executions of this instruction
+        double estInstructions;
+        uint64_t memoryAccesses;  //Sampled accesses made by this instruction
+        double estMemoryAccesses;
+
+        HotSpot() : samples(0), blocks(0), instructions(0), estInstructions(0),
+                    memoryAccesses(0), estMemoryAccesses(0) {}
+    };
+
+    typedef std::map<Location, HotSpot> Profile;
+
+private:
+    sigc::connection m_connection;
+    LogEvents *m_events;
+    ModuleCache *m_mc;
+
+    Profile m_profile;
+    uint64_t m_totalSamples;
+    uint64_t m_totalWeight;
+
+    void onItem(unsigned traceIndex,
+                const s2e::plugins::ExecutionTraceItemHeader &hdr,
+                void *item);
+
+    HotSpot &getHotSpot(uint64_t pid, uint64_t pc);
+
+public:
+    SampleProfiler(LogEvents *events, ModuleCache *mc);
+    ~SampleProfiler();
+
+    /** Adds the profile of another instance, e.g., of another thread */
+    void merge(const SampleProfiler &other);
+
+    const Profile &getProfile() const {
+        return m_profile;
+    }
+
+    uint64_t getTotalSamples() const {
+        return m_totalSamples;
+    }
+
+    uint64_t getTotalWeight() const {
+        return m_totalWeight;
+    }
+};
+
+class SampleProfilerState : public ItemProcessorState
+{
+private:
+    //Weight of the last sample, spread over the blocks of its window,
+    //which applies to the instructions and memory accesses that follow it.
+    //1 if the trace was not sampled.
+    double m_weight;
+
+public:
+    static ItemProcessorState *factory();
+    SampleProfilerState();
+    virtual ~SampleProfilerState();
+    virtual ItemProcessorState *clone() const;
+
+    friend class SampleProfiler;
+};
+
+}
+#endif
@@ -39,6 +39,7 @@
 
 #include <lib/ExecutionTracer/ModuleParser.h>
 #include <lib/ExecutionTracer/Path.h>
+#include <lib/ExecutionTracer/ParallelPathBuilder.h>
 #include <lib/ExecutionTracer/TestCase.h>
 #include <lib/ExecutionTracer/CacheProfiler.h>
 #include <lib/BinaryReaders/BFDInterface.h>
@@ -71,6 +72,36 @@ cl::opt<std::string>
 cl::list<std::string>
     ModPath("modpath", cl::desc("Path to modules"));
 
+cl::opt<unsigned>
+    Threads("threads", cl::desc("Number of analysis threads, 0 for one per processor"), cl::init(0));
+
+/** The processors of one analysis thread */
+class CacheProfilerAnalysis: public AnalysisSet
+{
+public:
+    ModuleCache m_moduleCache;
+    CacheProfiler m_cprof;
+    TestCase m_testCase;
+
+    CacheProfilerAnalysis(LogEvents *events):
+            m_moduleCache(events), m_cprof(events), m_testCase(events) {
+    }
+
+    virtual void getProcessors(std::vector<void*> &processors) {
+        processors.push_back(&m_moduleCache);
+        processors.push_back(&m_cprof);
+        processors.push_back(&m_testCase);
+    }
+};
+
+class CacheProfilerAnalysisFactory: public AnalysisSetFactory
+{
+public:
+    virtual AnalysisSet *create(LogEvents *events) {
+        return new CacheProfilerAnalysis(events);
+    }
+};
+
 }
 
 
@@ -154,18 +185,16 @@ int main(int argc, char **argv)
     PathBuilder pb(&parser);
     parser.parse(TraceFiles);
 
-    ModuleCache mc(&pb);
-
-    CacheProfiler cprof(&pb);
-    TestCase testCase(&pb);
-
-    pb.processTree();
+    ParallelPathBuilder ppb(&pb, Threads);
+    CacheProfilerAnalysisFactory factory;
+    CacheProfilerAnalysis *analysis =
+            static_cast<CacheProfilerAnalysis*>(ppb.processTree(factory));
 
     PathSet paths;
     pb.getPaths(paths);
 
 
-    printGlobalCacheStats(pb, cprof, paths, testCase);
+    printGlobalCacheStats(pb, analysis->m_cprof, paths, analysis->m_testCase);
 
     return 0;
 }
@@ -42,6 +42,7 @@
 
 #include <lib/ExecutionTracer/ModuleParser.h>
 #include <lib/ExecutionTracer/Path.h>
+#include <lib/ExecutionTracer/ParallelPathBuilder.h>
 #include <lib/ExecutionTracer/TestCase.h>
 #include <lib/BinaryReaders/BFDInterface.h>
 
@@ -77,6 +78,9 @@ ModDir("moddir", cl::desc("Directory containing binary modules, the basic block
 cl::opt<bool>
     Compact("compact", cl::desc("Do not display non-covered blocks"), cl::init(false));
 
+cl::opt<unsigned>
+    Threads("threads", cl::desc("Number of analysis threads, 0 for one per processor"), cl::init(0));
+
 
 //cl::opt<std::string>
 //    CovType("covtype", cl::desc("Coverage type"), cl::init("basicblock"));
@@ -176,6 +180,14 @@ bool BasicBlockCoverage::addTranslationBlock(uint64_t ts, uint64_t start, uint64
     return false;
 }
 
+void BasicBlockCoverage::merge(const BasicBlockCoverage &other)
+{
+    Blocks::const_iterator it;
+    for (it = other.m_uniqueTbs.begin(); it != other.m_uniqueTbs.end(); ++it) {
+        addTranslationBlock((*it).timeStamp, (*it).start, (*it).end);
+    }
+}
+
 void BasicBlockCoverage::convertTbToBb()
 {
     BasicBlocks::iterator it;
@@ -521,6 +533,65 @@ void Coverage::printErrors() const
     }
 }
 
+void Coverage::merge(Coverage &other)
+{
+    BbCoverageMap::iterator it;
+    for (it = other.m_bbCov.begin(); it != other.m_bbCov.end(); ++it) {
+        BbCoverageMap::iterator mine = m_bbCov.find((*it).first);
+        if (mine == m_bbCov.end()) {
+            m_bbCov[(*it).first] = (*it).second;
+        } else {
+            (*mine).second->merge(*(*it).second);
+            delete (*it).second;
+        }
+    }
+    other.m_bbCov.clear();
+
+    //Each set starts with one path
+    m_pathCount += other.m_pathCount - 1;
+    m_unknownModuleCount += other.m_unknownModuleCount;
+    m_notFoundModuleImages.insert(other.m_notFoundModuleImages.begin(),
+                                  other.m_notFoundModuleImages.end());
+    m_notFoundBbList.insert(other.m_notFoundBbList.begin(),
+                            other.m_notFoundBbList.end());
+}
+
+/** The processors of one analysis thread */
+class CoverageAnalysis: public AnalysisSet
+{
+public:
+    ModuleCache m_moduleCache;
+    Coverage m_coverage;
+
+    CoverageAnalysis(Library *library, LogEvents *events):
+            m_moduleCache(events), m_coverage(library, &m_moduleCache, events) {
+    }
+
+    virtual void getProcessors(std::vector<void*> &processors) {
+        processors.push_back(&m_moduleCache);
+        processors.push_back(&m_coverage);
+    }
+
+    virtual void merge(AnalysisSet &other) {
+        m_coverage.merge(static_cast<CoverageAnalysis&>(other).m_coverage);
+    }
+};
+
+class CoverageAnalysisFactory: public AnalysisSetFactory
+{
+private:
+    Library *m_library;
+
+public:
+    CoverageAnalysisFactory(Library *library) {
+        m_library = library;
+    }
+
+    virtual AnalysisSet *create(LogEvents *events) {
+        return new CoverageAnalysis(m_library, events);
+    }
+};
+
 CoverageTool::CoverageTool()
 {
     m_binaries.setPaths(ModDir);
@@ -536,13 +607,15 @@ void CoverageTool::flatTrace()
     PathBuilder pb(&m_parser);
     m_parser.parse(TraceFiles);
 
-    ModuleCache mc(&pb);
-    Coverage cov(&m_binaries, &mc, &pb);
-
-    pb.processTree();
-    cov.printErrors();
+    //Coverage only calls Library::findLibrary(), which is safe to
+    //share between the analysis threads.
+    ParallelPathBuilder ppb(&pb, Threads);
+    CoverageAnalysisFactory factory(&m_binaries);
+    CoverageAnalysis *analysis =
+            static_cast<CoverageAnalysis*>(ppb.processTree(factory));
 
-    cov.outputCoverage(LogDir);
+    analysis->m_coverage.printErrors();
+    analysis->m_coverage.outputCoverage(LogDir);
 }
 
 
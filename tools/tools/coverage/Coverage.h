@@ -135,6 +135,9 @@ public:
     //Start and end must be local to the module
     //Returns true if the added block resulted in covering new basic blocks
     bool addTranslationBlock(uint64_t ts, uint64_t start, uint64_t end);
+
+    //Adds the translation blocks covered in another instance of the module
+    void merge(const BasicBlockCoverage &other);
     uint64_t getTimeCoverage() const;
     void convertTbToBb();
     void printTimeCoverage(std::ostream &os) const;
@@ -190,6 +193,9 @@ public:
 
     void printErrors() const;
 
+    //Accumulates the coverage computed by another analysis thread
+    void merge(Coverage &other);
+
 };
 
 class CoverageTool
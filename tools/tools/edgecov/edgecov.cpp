@@ -0,0 +1,157 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in the S2E-AUTHORS file.
+ */
+
+#define __STDC_FORMAT_MACROS 1
+
+#include "llvm/Support/CommandLine.h"
+
+#include <s2e/Plugins/ExecutionTracers/TraceEntries.h>
+
+#include <stdio.h>
+#include <fstream>
+#include <iostream>
+#include <inttypes.h>
+#include <vector>
+
+using namespace llvm;
+using namespace s2e::plugins;
+
+namespace {
+
+cl::list<std::string>
+    BitmapFiles("bitmap", llvm::cl::value_desc("Input bitmap"), llvm::cl::Prefix,
+                llvm::cl::desc("Specify an EdgeCoverage.bitmap file. Several files are merged."));
+
+cl::opt<std::string>
+    LogDir("outputdir", cl::desc("Store the results into the given folder"), cl::init("."));
+
+}
+
+//Reads one bitmap file and merges it into the map, keeping the highest counters
+static bool mergeBitmap(const std::string &fileName, std::vector<uint8_t> &map,
+                        ExecutionTraceEdgeBitmapHeader &hdr)
+{
+    FILE *fp = fopen(fileName.c_str(), "rb");
+    if (!fp) {
+        std::cerr << "Could not open " << fileName << std::endl;
+        return false;
+    }
+
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+        hdr.magic != EXECTRACE_EDGE_MAGIC || hdr.version != EXECTRACE_EDGE_VERSION) {
+        std::cerr << fileName << " is not an edge coverage bitmap" << std::endl;
+        fclose(fp);
+        return false;
+    }
+
+    if (map.empty()) {
+        map.resize(hdr.mapSize, 0);
+    } else if (map.size() != hdr.mapSize) {
+        std::cerr << fileName << " has a map of " << hdr.mapSize <<
+                     " bytes, expected " << map.size() << std::endl;
+        fclose(fp);
+        return false;
+    }
+
+    std::vector<uint8_t> bitmap(hdr.mapSize);
+    bool ok = fread(&bitmap[0], bitmap.size(), 1, fp) == 1;
+    fclose(fp);
+    if (!ok) {
+        std::cerr << fileName << " is truncated" << std::endl;
+        return false;
+    }
+
+    for (unsigned i = 0; i < bitmap.size(); ++i) {
+        if (bitmap[i] > map[i]) {
+            map[i] = bitmap[i];
+        }
+    }
+
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    cl::ParseCommandLineOptions(argc, (char**) argv, " edgecov");
+
+    std::vector<uint8_t> map;
+
+    std::string summaryFileStr = LogDir + "/edgecov.log";
+    std::ofstream summaryFile(summaryFileStr.c_str());
+    summaryFile << "#File Edges LastNewEdge" << std::endl;
+
+    for (unsigned i = 0; i < BitmapFiles.size(); ++i) {
+        ExecutionTraceEdgeBitmapHeader hdr;
+        if (!mergeBitmap(BitmapFiles[i], map, hdr)) {
+            return -1;
+        }
+
+        summaryFile << BitmapFiles[i] << " " << std::dec << hdr.edgeCount <<
+                       " " << hdr.timeOfLastNewEdge << std::endl;
+    }
+
+    if (map.empty()) {
+        std::cerr << "No bitmap specified" << std::endl;
+        return -1;
+    }
+
+    //One line per covered edge, as afl-showmap prints them
+    std::string edgesFileStr = LogDir + "/edgecov.txt";
+    std::ofstream edgesFile(edgesFileStr.c_str());
+
+    unsigned edgeCount = 0;
+    for (unsigned i = 0; i < map.size(); ++i) {
+        if (map[i]) {
+            edgesFile << std::dec << i << ":" << (unsigned) map[i] << std::endl;
+            ++edgeCount;
+        }
+    }
+
+    summaryFile << "#Merged " << std::dec << edgeCount << std::endl;
+
+    //The raw merged map, which other tools can load as is
+    std::string rawFileStr = LogDir + "/edgecov.bitmap";
+    FILE *fp = fopen(rawFileStr.c_str(), "wb");
+    if (!fp || fwrite(&map[0], map.size(), 1, fp) != 1) {
+        std::cerr << "Could not write " << rawFileStr << std::endl;
+        if (fp) {
+            fclose(fp);
+        }
+        return -1;
+    }
+    fclose(fp);
+
+    return 0;
+}
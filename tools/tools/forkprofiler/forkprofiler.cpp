@@ -39,11 +39,13 @@
 
 #include <lib/ExecutionTracer/ModuleParser.h>
 #include <lib/ExecutionTracer/Path.h>
+#include <lib/ExecutionTracer/ParallelPathBuilder.h>
 #include <lib/ExecutionTracer/TestCase.h>
 #include <lib/BinaryReaders/BFDInterface.h>
 
 #include <s2e/Plugins/ExecutionTracers/TraceEntries.h>
 
+#include <algorithm>
 #include <stdio.h>
 #include <ostream>
 #include <fstream>
@@ -70,6 +72,9 @@ cl::opt<std::string>
 cl::list<std::string>
     ModDir("moddir", cl::desc("Directory containing the binary modules"));
 
+cl::opt<unsigned>
+    Threads("threads", cl::desc("Number of analysis threads, 0 for one per processor"), cl::init(0));
+
 }
 
 namespace s2etools
@@ -103,8 +108,6 @@ void ForkProfiler::doProfile(
     fp.count = 1;
     fp.line = 0;
 
-    m_library->getInfo(mi, te->pc, fp.file, fp.line, fp.function);
-
     ForkPoints::iterator it = m_forkPoints.find(fp);
     if (it == m_forkPoints.end()) {
         if (mi) {
@@ -125,7 +128,7 @@ void ForkProfiler::doProfile(
     }
 }
 
-void ForkProfiler::doGraph(
+void ForkProfiler::doGraph(unsigned traceIndex,
         const s2e::plugins::ExecutionTraceItemHeader &hdr,
         const s2e::plugins::ExecutionTraceFork *te)
 {
@@ -134,6 +137,7 @@ void ForkProfiler::doGraph(
     const ModuleInstance *mi = mcs->getInstance(hdr.pid, te->pc);
 
     Fork f;
+    f.traceIndex = traceIndex;
     f.id = hdr.stateId;
     f.pid = hdr.pid;
     f.pc = te->pc;
@@ -163,10 +167,49 @@ void ForkProfiler::onItem(unsigned traceIndex,
             (const s2e::plugins::ExecutionTraceFork*) item;
 
     doProfile(hdr, te);
-    doGraph(hdr, te);
+    doGraph(traceIndex, hdr, te);
 
 }
 
+void ForkProfiler::merge(ForkProfiler &other)
+{
+    ForkPoints::const_iterator it;
+    for (it = other.m_forkPoints.begin(); it != other.m_forkPoints.end(); ++it) {
+        ForkPoints::iterator mine = m_forkPoints.find(*it);
+        if (mine == m_forkPoints.end()) {
+            m_forkPoints.insert(*it);
+        } else {
+            ForkPoint fp = *mine;
+            fp.count += (*it).count;
+            m_forkPoints.erase(mine);
+            m_forkPoints.insert(fp);
+        }
+    }
+
+    m_forks.insert(m_forks.end(), other.m_forks.begin(), other.m_forks.end());
+}
+
+void ForkProfiler::finalize()
+{
+    //outputGraph() numbers the instances of each state in the order
+    //of the forks, which must be the order of the trace.
+    std::stable_sort(m_forks.begin(), m_forks.end(), ForkByTraceIndex());
+
+    //The library is not thread-safe, the debug information is therefore
+    //looked up once all the analysis threads are done.
+    ForkPoints resolved;
+    ForkPoints::const_iterator it;
+    for (it = m_forkPoints.begin(); it != m_forkPoints.end(); ++it) {
+        ForkPoint fp = *it;
+        if (fp.module.size() > 0) {
+            ModuleInstance mi(fp.module, fp.pid, fp.loadbase, 0, fp.imagebase);
+            m_library->getInfo(&mi, fp.pc, fp.file, fp.line, fp.function);
+        }
+        resolved.insert(fp);
+    }
+    m_forkPoints = resolved;
+}
+
 static std::string getColor(unsigned val, unsigned maxval)
 {
     uint32_t index = val * 10 / maxval;
@@ -273,6 +316,42 @@ void ForkProfiler::outputProfile(const std::string &path) const
 }
 
 
+/** The processors of one analysis thread */
+class ForkProfilerAnalysis: public AnalysisSet
+{
+public:
+    ModuleCache m_moduleCache;
+    ForkProfiler m_forkProfiler;
+
+    ForkProfilerAnalysis(Library *library, LogEvents *events):
+            m_moduleCache(events), m_forkProfiler(library, &m_moduleCache, events) {
+    }
+
+    virtual void getProcessors(std::vector<void*> &processors) {
+        processors.push_back(&m_moduleCache);
+        processors.push_back(&m_forkProfiler);
+    }
+
+    virtual void merge(AnalysisSet &other) {
+        m_forkProfiler.merge(static_cast<ForkProfilerAnalysis&>(other).m_forkProfiler);
+    }
+};
+
+class ForkProfilerAnalysisFactory: public AnalysisSetFactory
+{
+private:
+    Library *m_library;
+
+public:
+    ForkProfilerAnalysisFactory(Library *library) {
+        m_library = library;
+    }
+
+    virtual AnalysisSet *create(LogEvents *events) {
+        return new ForkProfilerAnalysis(m_library, events);
+    }
+};
+
 }
 
 
@@ -287,10 +366,13 @@ int main(int argc, char **argv)
     PathBuilder pb(&parser);
     parser.parse(TraceFiles);
 
-    ModuleCache mc(&pb);
-    ForkProfiler fp(&library, &mc, &pb);
+    ParallelPathBuilder ppb(&pb, Threads);
+    ForkProfilerAnalysisFactory factory(&library);
+    ForkProfilerAnalysis *analysis =
+            static_cast<ForkProfilerAnalysis*>(ppb.processTree(factory));
 
-    pb.processTree();
+    ForkProfiler &fp = analysis->m_forkProfiler;
+    fp.finalize();
 
     fp.outputProfile(LogDir);
     fp.outputGraph(LogDir);
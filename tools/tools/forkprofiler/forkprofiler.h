@@ -51,6 +51,7 @@ class ForkProfiler
 public:
 
     struct Fork {
+        unsigned traceIndex;
         uint32_t id;
         uint64_t pid;
         uint64_t relPc, pc;
@@ -74,6 +75,12 @@ public:
         }
     };
 
+    struct ForkByTraceIndex {
+        bool operator()(const Fork &f1, const Fork &f2) const {
+            return f1.traceIndex < f2.traceIndex;
+        }
+    };
+
     struct ForkPointByCount {
         bool operator()(const ForkPoint &fp1, const ForkPoint &fp2) const {
             if (fp1.count == fp2.count) {
@@ -107,7 +114,7 @@ private:
     void doProfile(
             const s2e::plugins::ExecutionTraceItemHeader &hdr,
             const s2e::plugins::ExecutionTraceFork *te);
-    void doGraph(
+    void doGraph(unsigned traceIndex,
             const s2e::plugins::ExecutionTraceItemHeader &hdr,
             const s2e::plugins::ExecutionTraceFork *te);
 
@@ -117,6 +124,13 @@ public:
 
     void process();
 
+    //Accumulates the forks seen by another analysis thread
+    void merge(ForkProfiler &other);
+
+    //Orders the forks as in the trace and looks up the debug information
+    //of the fork points. Must be called once processing is done.
+    void finalize();
+
     void outputProfile(const std::string &path) const;
     void outputGraph(const std::string &path) const;
 };
@@ -39,6 +39,7 @@
 
 #include <lib/ExecutionTracer/ModuleParser.h>
 #include <lib/ExecutionTracer/Path.h>
+#include <lib/ExecutionTracer/ParallelPathBuilder.h>
 #include <lib/ExecutionTracer/TestCase.h>
 #include <lib/ExecutionTracer/InstructionCounter.h>
 #include <lib/BinaryReaders/BFDInterface.h>
@@ -71,6 +72,9 @@ cl::opt<std::string>
 cl::list<std::string>
     ModPath("modpath", cl::desc("Path to modules"));
 
+cl::opt<unsigned>
+    Threads("threads", cl::desc("Number of analysis threads, 0 for one per processor"), cl::init(0));
+
 }
 
 
@@ -110,6 +114,33 @@ void InstructionCounterTool::onItem(unsigned traceIndex,
 }
 #endif
 
+/** The processors of one analysis thread */
+class InstructionCounterAnalysis: public AnalysisSet
+{
+public:
+    ModuleCache m_moduleCache;
+    InstructionCounter m_icounter;
+    TestCase m_testCase;
+
+    InstructionCounterAnalysis(LogEvents *events):
+            m_moduleCache(events), m_icounter(events), m_testCase(events) {
+    }
+
+    virtual void getProcessors(std::vector<void*> &processors) {
+        processors.push_back(&m_moduleCache);
+        processors.push_back(&m_icounter);
+        processors.push_back(&m_testCase);
+    }
+};
+
+class InstructionCounterAnalysisFactory: public AnalysisSetFactory
+{
+public:
+    virtual AnalysisSet *create(LogEvents *events) {
+        return new InstructionCounterAnalysis(events);
+    }
+};
+
 }
 
 int main(int argc, char **argv)
@@ -123,12 +154,10 @@ int main(int argc, char **argv)
     PathBuilder pb(&parser);
     parser.parse(TraceFiles);
 
-    ModuleCache mc(&pb);
-
-    InstructionCounter icounter(&pb);
-    TestCase testCase(&pb);
-
-    pb.processTree();
+    ParallelPathBuilder ppb(&pb, Threads);
+    InstructionCounterAnalysisFactory factory;
+    InstructionCounterAnalysis *analysis =
+            static_cast<InstructionCounterAnalysis*>(ppb.processTree(factory));
 
     PathSet paths;
     PathSet::const_iterator pit;
@@ -143,7 +172,7 @@ int main(int argc, char **argv)
     for(pit = paths.begin(); pit != paths.end(); ++pit) {
         outFile << std::dec << *pit << ": ";
 
-        ItemProcessorState *state = pb.getState(&icounter, *pit);
+        ItemProcessorState *state = pb.getState(&analysis->m_icounter, *pit);
         InstructionCounterState *ics = static_cast<InstructionCounterState*>(state);
 
         if (ics) {
@@ -154,7 +183,7 @@ int main(int argc, char **argv)
         }
 
 
-        state = pb.getState(&testCase, *pit);
+        state = pb.getState(&analysis->m_testCase, *pit);
         TestCaseState *testCaseState = static_cast<TestCaseState*>(state);
         if (testCaseState) {
             testCaseState->printInputsLine(outFile);
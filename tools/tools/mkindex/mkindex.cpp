@@ -0,0 +1,138 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in the S2E-AUTHORS file.
+ */
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/FileSystem.h"
+
+#include <lib/BinaryReaders/AddressIndex.h>
+#include <lib/BinaryReaders/ExecutableFile.h>
+#include <lib/Utils/BasicBlockListParser.h>
+
+#include <iostream>
+#include <memory>
+#include <set>
+
+using namespace llvm;
+using namespace s2etools;
+
+namespace {
+
+cl::list<std::string>
+    Modules("module", llvm::cl::value_desc("Module file"), llvm::cl::Prefix,
+            llvm::cl::desc("Binary to index. The index is written to the same folder, with the .idx suffix."));
+
+}
+
+static bool indexModule(const std::string &fileName)
+{
+    //Use the same readers as the tools, in the same order, even if
+    //the module already has an index
+    std::auto_ptr<ExecutableFile> exec(ExecutableFile::createFromBinary(fileName));
+    if (!exec.get()) {
+        std::cerr << "Could not open " << fileName << std::endl;
+        return false;
+    }
+
+    AddressIndexBuilder builder;
+
+    FunctionRanges functions;
+    exec->getFunctions(functions);
+    for (unsigned i = 0; i < functions.size(); ++i) {
+        builder.addFunction(functions[i].start, functions[i].end, functions[i].name);
+    }
+
+    //The line table answers the lookups of any address
+    LineRanges lines;
+    exec->getLines(lines);
+    for (unsigned i = 0; i < lines.size(); ++i) {
+        builder.addLine(lines[i].start, lines[i].end, lines[i].function,
+                        lines[i].source, lines[i].line);
+    }
+
+    //Resolve the source line of each basic block once and for all
+    llvm::sys::Path listing(fileName);
+    listing.appendSuffix("bblist");
+
+    bool exists = false;
+    llvm::sys::fs::exists(listing.str(), exists);
+
+    BasicBlockListParser::BasicBlocks blocks;
+    if (exists && !BasicBlockListParser::parseListing(listing, blocks)) {
+        std::cerr << "Some basic blocks of " << listing.str() << " were ignored" << std::endl;
+    }
+
+    BasicBlockListParser::BasicBlocks::const_iterator it;
+    for (it = blocks.begin(); it != blocks.end(); ++it) {
+        std::string source, function;
+        uint64_t line = 0;
+        if (!exec->getInfo((*it).start, source, line, function)) {
+            source = "";
+            line = 0;
+            function = (*it).function;
+        }
+        builder.addBlock((*it).start, (*it).start + (*it).size, function, source, line);
+    }
+
+    std::string moduleName = fileName;
+    size_t pos = moduleName.find_last_of("\\/");
+    if (pos != std::string::npos) {
+        moduleName = moduleName.substr(pos + 1);
+    }
+
+    std::string indexFile = fileName + ADDRESS_INDEX_SUFFIX;
+    if (!builder.write(indexFile, moduleName, exec->getImageBase(), exec->getImageSize())) {
+        return false;
+    }
+
+    std::cout << indexFile << ": " << std::dec << builder.getFunctionCount() << " functions, "
+              << builder.getBlockCount() << " basic blocks, "
+              << builder.getLineCount() << " line ranges" << std::endl;
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    cl::ParseCommandLineOptions(argc, (char**) argv, " mkindex");
+
+    int ret = 0;
+    for (unsigned i = 0; i < Modules.size(); ++i) {
+        if (!indexModule(Modules[i])) {
+            ret = -1;
+        }
+    }
+
+    return ret;
+}
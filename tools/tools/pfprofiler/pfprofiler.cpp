@@ -47,6 +47,7 @@
 
 #include <lib/ExecutionTracer/ModuleParser.h>
 #include <lib/ExecutionTracer/Path.h>
+#include <lib/ExecutionTracer/ParallelPathBuilder.h>
 #include <lib/ExecutionTracer/TestCase.h>
 #include <lib/ExecutionTracer/PageFault.h>
 #include <lib/ExecutionTracer/InstructionCounter.h>
@@ -108,6 +109,10 @@ cl::opt<std::string>
         CpOutFile("cpoutfile", cl::desc("CacheProfiler: output file"),
                         cl::init("stats.dat"));
 
+cl::opt<unsigned>
+        Threads("threads", cl::desc("Number of analysis threads for the aggregated analysis, 0 for one per processor"),
+                        cl::init(0));
+
 
 }
 
@@ -127,6 +132,39 @@ PfProfiler::~PfProfiler()
 
 }
 
+/** The processors of one thread of the aggregated analysis */
+class PageFaultAnalysis: public AnalysisSet
+{
+public:
+    TestCase m_testCase;
+    ModuleCache m_moduleCache;
+    InstructionCounter m_icounter;
+    PageFault m_pageFault;
+
+    PageFaultAnalysis(LogEvents *events):
+            m_testCase(events), m_moduleCache(events), m_icounter(events),
+            m_pageFault(events, &m_moduleCache) {
+        if (FilterModule.size() > 0) {
+            m_pageFault.setModule(FilterModule);
+        }
+    }
+
+    virtual void getProcessors(std::vector<void*> &processors) {
+        processors.push_back(&m_testCase);
+        processors.push_back(&m_moduleCache);
+        processors.push_back(&m_icounter);
+        processors.push_back(&m_pageFault);
+    }
+};
+
+class PageFaultAnalysisFactory: public AnalysisSetFactory
+{
+public:
+    virtual AnalysisSet *create(LogEvents *events) {
+        return new PageFaultAnalysis(events);
+    }
+};
+
 
 
 void PfProfiler::extractAggregatedData()
@@ -148,17 +186,10 @@ void PfProfiler::extractAggregatedData()
     PathBuilder pb(&m_Parser);
     m_Parser.parse(m_FileName);
 
-    TestCase tc(&pb);
-    ModuleCache mc(&pb);
-    InstructionCounter ic(&pb);
-    PageFault pf(&pb, &mc);
-
-    if (FilterModule.size() > 0) {
-        pf.setModule(FilterModule);
-    }
-
-
-    pb.processTree();
+    ParallelPathBuilder ppb(&pb, Threads);
+    PageFaultAnalysisFactory factory;
+    PageFaultAnalysis *analysis =
+            static_cast<PageFaultAnalysis*>(ppb.processTree(factory));
 
     PathSet paths;
     pb.getPaths(paths);
@@ -167,9 +198,9 @@ void PfProfiler::extractAggregatedData()
 
     for(pit = paths.begin(); pit != paths.end(); ++pit) {
 
-        PageFaultState *pfs = static_cast<PageFaultState*>(pb.getState(&pf, *pit));
-        TestCaseState *tcs = static_cast<TestCaseState*>(pb.getState(&tc, *pit));
-        InstructionCounterState *ics = static_cast<InstructionCounterState*>(pb.getState(&ic, *pit));
+        PageFaultState *pfs = static_cast<PageFaultState*>(pb.getState(&analysis->m_pageFault, *pit));
+        TestCaseState *tcs = static_cast<TestCaseState*>(pb.getState(&analysis->m_testCase, *pit));
+        InstructionCounterState *ics = static_cast<InstructionCounterState*>(pb.getState(&analysis->m_icounter, *pit));
 
         if (TerminatedPaths) {
             if (!tcs || !tcs->hasInputs()) {
@@ -219,6 +250,10 @@ void PfProfiler::process()
     }
 
 
+    //The cache analysis stays serial: its per-instruction statistics are
+    //keyed by the Cache objects of the processor that read the cache
+    //declarations, and TopMissesPerModule symbolizes them with the
+    //library, which is not thread-safe.
     PathBuilder pb(&m_Parser);
     m_Parser.parse(m_FileName);
 
@@ -0,0 +1,192 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in the S2E-AUTHORS file.
+ */
+
+#define __STDC_FORMAT_MACROS 1
+
+#include "llvm/Support/CommandLine.h"
+
+#include <lib/ExecutionTracer/ModuleParser.h>
+#include <lib/ExecutionTracer/Path.h>
+#include <lib/ExecutionTracer/ParallelPathBuilder.h>
+#include <lib/ExecutionTracer/SampleProfiler.h>
+#include <lib/BinaryReaders/BFDInterface.h>
+#include <lib/BinaryReaders/Library.h>
+
+#include <s2e/Plugins/ExecutionTracers/TraceEntries.h>
+
+#include <stdio.h>
+#include <algorithm>
+#include <ostream>
+#include <fstream>
+#include <iostream>
+#include <inttypes.h>
+#include <iomanip>
+#include <vector>
+
+using namespace llvm;
+using namespace s2etools;
+
+
+namespace {
+
+cl::list<std::string>
+    TraceFiles("trace", llvm::cl::value_desc("Input trace"), llvm::cl::Prefix,
+               llvm::cl::desc("Specify an execution trace file. The trace must be generated with the TraceSampler plugin enabled."));
+
+cl::opt<std::string>
+    LogDir("outputdir", cl::desc("Store the results into the given folder"), cl::init("."));
+
+cl::list<std::string>
+    ModPath("modpath", cl::desc("Path to modules"));
+
+cl::opt<unsigned>
+    Threads("threads", cl::desc("Number of analysis threads, 0 for one per processor"), cl::init(0));
+
+}
+
+
+
+namespace s2etools
+{
+
+/** The processors of one analysis thread */
+class SampleProfilerAnalysis: public AnalysisSet
+{
+public:
+    ModuleCache m_moduleCache;
+    SampleProfiler m_profiler;
+
+    SampleProfilerAnalysis(LogEvents *events):
+            m_moduleCache(events), m_profiler(events, &m_moduleCache) {
+    }
+
+    virtual void getProcessors(std::vector<void*> &processors) {
+        processors.push_back(&m_moduleCache);
+        processors.push_back(&m_profiler);
+    }
+
+    virtual void merge(AnalysisSet &other) {
+        m_profiler.merge(static_cast<SampleProfilerAnalysis&>(other).m_profiler);
+    }
+};
+
+class SampleProfilerAnalysisFactory: public AnalysisSetFactory
+{
+public:
+    virtual AnalysisSet *create(LogEvents *events) {
+        return new SampleProfilerAnalysis(events);
+    }
+};
+
+typedef std::pair<SampleProfiler::Location, SampleProfiler::HotSpot> HotSpotEntry;
+
+//Hottest blocks first, then hottest instructions
+static bool hotterThan(const HotSpotEntry &a, const HotSpotEntry &b)
+{
+    if (a.second.blocks != b.second.blocks) {
+        return a.second.blocks > b.second.blocks;
+    }
+    if (a.second.estInstructions != b.second.estInstructions) {
+        return a.second.estInstructions > b.second.estInstructions;
+    }
+    return a.first < b.first;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    cl::ParseCommandLineOptions(argc, (char**) argv, " sampleprof");
+
+    Library library;
+    library.setPaths(ModPath);
+
+    LogParser parser;
+    PathBuilder pb(&parser);
+    parser.parse(TraceFiles);
+
+    ParallelPathBuilder ppb(&pb, Threads);
+    SampleProfilerAnalysisFactory factory;
+    SampleProfilerAnalysis *analysis =
+            static_cast<SampleProfilerAnalysis*>(ppb.processTree(factory));
+
+    const SampleProfiler &profiler = analysis->m_profiler;
+    const SampleProfiler::Profile &profile = profiler.getProfile();
+
+    std::vector<HotSpotEntry> hotSpots(profile.begin(), profile.end());
+    std::sort(hotSpots.begin(), hotSpots.end(), hotterThan);
+
+    std::string outFileStr = LogDir + "/sampleprof.log";
+    std::ofstream outFile(outFileStr.c_str());
+
+    outFile << "#Samples: " << std::dec << profiler.getTotalSamples() <<
+               " Blocks: " << profiler.getTotalWeight() << std::endl;
+    outFile << "#Module Pc Samples Blocks %Blocks Instructions EstInstructions "
+               "MemAccesses EstMemAccesses Source" << std::endl;
+
+    uint64_t totalWeight = profiler.getTotalWeight();
+
+    std::vector<HotSpotEntry>::const_iterator it;
+    for (it = hotSpots.begin(); it != hotSpots.end(); ++it) {
+        const SampleProfiler::Location &loc = (*it).first;
+        const SampleProfiler::HotSpot &hs = (*it).second;
+
+        if (loc.module.empty()) {
+            outFile << "pid:0x" << std::hex << loc.pid;
+        } else {
+            outFile << loc.module;
+        }
+
+        outFile << " 0x" << std::hex << loc.pc << std::dec <<
+                   " " << hs.samples <<
+                   " " << hs.blocks <<
+                   " " << std::fixed << std::setprecision(2) <<
+                   (totalWeight ? 100.0 * hs.blocks / totalWeight : 0.0) <<
+                   " " << hs.instructions <<
+                   " " << hs.estInstructions <<
+                   " " << hs.memoryAccesses <<
+                   " " << hs.estMemoryAccesses;
+
+        std::string source;
+        if (!loc.module.empty() &&
+            library.print(loc.module, 0, 0, loc.pc, source, true, true, true)) {
+            outFile << " " << source;
+        }
+
+        outFile << std::endl;
+    }
+
+    return 0;
+}
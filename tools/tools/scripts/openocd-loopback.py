@@ -0,0 +1,321 @@
+#!/usr/bin/env python
+#
+# Local stand-in for the OpenOCD telnet server used by the RemoteMemory plugin.
+#
+# It understands the memory commands issued by RemoteMemory (mdw/mdh/mdb and
+# mww/mwh/mwb, possibly several of them on one line separated by ';') and backs
+# them with a sparse RAM. This allows measuring accesses per second and latency
+# without a board attached.
+#
+# Server mode (point RemoteMemory.openocdHost/openocdPort to it):
+#   openocd-loopback.py --port 4444 --latency 0.5 --avatar 127.0.0.1:5555
+#
+# With --avatar, the script also connects to the RemoteMemory listen socket
+# and answers the requests sent there (RemoteMemory.target = "avatar") from the
+# same RAM, using the framing selected with --protocol (binary or json).
+#
+# With --guard START:SIZE (repeatable), every read that is not entirely inside
+# one of the given ranges is reported. Declaring the RemoteMemory ranges there,
+# e.g., an unaligned one such as --guard 0x20000002:0x7b, checks that the plugin
+# never reads neighbouring memory when it fills its cache.
+#
+# With --no-ids, JSON replies carry no id, like the replies of older peers.
+#
+# Benchmark mode (against the stand-in or a real OpenOCD):
+#   openocd-loopback.py --bench 127.0.0.1:4444 --count 2000 --line 64
+#
+
+from __future__ import print_function
+
+import json
+import optparse
+import socket
+import struct
+import sys
+import threading
+import time
+
+BYTES_PER_LINE = 32
+WIDTHS = {'b': 1, 'h': 2, 'w': 4}
+
+
+class Memory(object):
+    def __init__(self, guards=()):
+        self.bytes = {}
+        self.guards = guards
+
+    def check(self, address, size):
+        for start, length in self.guards:
+            if start <= address and address + size <= start + length:
+                return
+        print('[loopback] read of %d bytes at 0x%x is outside the guarded ranges' % (size, address))
+
+    def read(self, address, size):
+        if self.guards:
+            self.check(address, size)
+        value = 0
+        for i in range(size):
+            value |= self.bytes.get(address + i, 0) << (8 * i)
+        return value
+
+    def write(self, address, size, value):
+        for i in range(size):
+            self.bytes[address + i] = (value >> (8 * i)) & 0xff
+
+
+class Stats(object):
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.lines = 0
+        self.reads = 0
+        self.writes = 0
+
+    def dump(self, elapsed):
+        with self.lock:
+            print('[loopback] %d round-trips, %d values read, %d values written, '
+                  '%.0f round-trips/s' % (self.lines, self.reads, self.writes,
+                                          self.lines / max(elapsed, 1e-6)))
+
+
+def parse_int(s):
+    return int(s, 0)
+
+
+def handle_command(mem, stats, cmd):
+    words = cmd.split()
+    if not words:
+        return ''
+
+    op = words[0]
+    if len(op) == 3 and op[:2] == 'md' and op[2] in WIDTHS:
+        width = WIDTHS[op[2]]
+        address = parse_int(words[1])
+        count = parse_int(words[2]) if len(words) > 2 else 1
+        out = []
+        per_line = BYTES_PER_LINE // width
+        for i in range(0, count, per_line):
+            base = address + i * width
+            n = min(per_line, count - i)
+            values = [mem.read(base + j * width, width) for j in range(n)]
+            out.append('0x%08x: %s \r\n' % (base, ' '.join('%0*x' % (2 * width, v) for v in values)))
+        with stats.lock:
+            stats.reads += count
+        return ''.join(out)
+
+    if len(op) == 3 and op[:2] == 'mw' and op[2] in WIDTHS:
+        mem.write(parse_int(words[1]), WIDTHS[op[2]], parse_int(words[2]))
+        with stats.lock:
+            stats.writes += 1
+        return ''
+
+    return 'invalid command name "%s"\r\n' % op
+
+
+def serve_client(conn, mem, stats, latency):
+    f = conn.makefile('rb')
+    conn.sendall(b'Open On-Chip Debugger\r\n> ')
+    for raw in f:
+        line = raw.decode('ascii', 'replace').strip()
+        if latency:
+            time.sleep(latency)
+        out = line + '\r\n'
+        for cmd in line.split(';'):
+            out += handle_command(mem, stats, cmd)
+        with stats.lock:
+            stats.lines += 1
+        conn.sendall((out + '> ').encode('ascii'))
+    conn.close()
+
+
+FRAME_MAGIC = 0xA5
+MSG_READ, MSG_READ_WORDS, MSG_WRITE = 1, 2, 3
+REQUEST = struct.Struct('<BBHIQQQ')
+REPLY = struct.Struct('<BBBBIQ')
+
+
+def recv_exactly(s, n):
+    data = b''
+    while len(data) < n:
+        chunk = s.recv(n - len(data))
+        if not chunk:
+            return None
+        data += chunk
+    return data
+
+
+def avatar_binary(s, mem, stats):
+    while True:
+        frame = recv_exactly(s, REQUEST.size)
+        if frame is None:
+            return
+        magic, type, size, id, address, value, pc = REQUEST.unpack(frame)
+        if magic != FRAME_MAGIC:
+            print('[loopback] corrupted frame')
+            return
+        if type == MSG_READ:
+            reply = REPLY.pack(FRAME_MAGIC, type, 0, 0, id, mem.read(address, size))
+        elif type == MSG_READ_WORDS:
+            words = [mem.read(address + 4 * i, 4) for i in range(size)]
+            reply = REPLY.pack(FRAME_MAGIC, type, 0, 0, id, size) + struct.pack('<%dI' % size, *words)
+        else:
+            mem.write(address, size, value)
+            reply = REPLY.pack(FRAME_MAGIC, type, 0, 0, id, 0)
+        with stats.lock:
+            stats.lines += 1
+        s.sendall(reply)
+
+
+def avatar_json(s, mem, stats, ids):
+    f = s.makefile('rb')
+    for line in f:
+        request = json.loads(line.decode('ascii'))
+        params = request['params']
+        address = int(params['address'], 16)
+        reply = {'reply': request['cmd']}
+        if ids:
+            reply['id'] = request.get('id')
+        if request['cmd'] == 'read':
+            reply['value'] = hex(mem.read(address, int(params['size'], 16)))
+        elif request['cmd'] == 'read_words':
+            count = int(params['count'], 16)
+            reply['values'] = [hex(mem.read(address + 4 * i, 4)) for i in range(count)]
+        else:
+            # Writes are not acknowledged in JSON mode
+            mem.write(address, int(params['size'], 16), int(params['value'], 16))
+            reply = None
+        with stats.lock:
+            stats.lines += 1
+        if reply is not None:
+            s.sendall((json.dumps(reply) + '\n').encode('ascii'))
+
+
+def serve_avatar(address, protocol, ids, mem, stats):
+    """RemoteMemory waits for an Avatar connection before starting."""
+    host, port = address.rsplit(':', 1)
+    s = socket.create_connection((host, int(port)))
+    s.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+    if protocol == 'binary':
+        avatar_binary(s, mem, stats)
+    else:
+        avatar_json(s, mem, stats, ids)
+
+
+def parse_guard(s):
+    start, size = s.split(':')
+    return parse_int(start), parse_int(size)
+
+
+def serve(options):
+    mem = Memory([parse_guard(g) for g in options.guard])
+    stats = Stats()
+
+    srv = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    srv.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    srv.bind(('127.0.0.1', options.port))
+    srv.listen(1)
+    print('[loopback] listening on 127.0.0.1:%d' % options.port)
+
+    if options.avatar:
+        t = threading.Thread(target=serve_avatar,
+                             args=(options.avatar, options.protocol, not options.no_ids, mem, stats))
+        t.daemon = True
+        t.start()
+
+    start = time.time()
+    try:
+        while True:
+            conn, _ = srv.accept()
+            conn.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+            serve_client(conn, mem, stats, options.latency / 1000.0)
+            stats.dump(time.time() - start)
+    except KeyboardInterrupt:
+        stats.dump(time.time() - start)
+
+
+class Client(object):
+    def __init__(self, address):
+        host, port = address.rsplit(':', 1)
+        self.sock = socket.create_connection((host, int(port)))
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.buf = b''
+        self.read_until(b'> ')
+
+    def read_until(self, terminator):
+        while terminator not in self.buf:
+            data = self.sock.recv(4096)
+            if not data:
+                raise IOError('connection closed')
+            self.buf += data
+        pos = self.buf.index(terminator) + len(terminator)
+        out, self.buf = self.buf[:pos], self.buf[pos:]
+        return out
+
+    def command(self, cmd):
+        self.sock.sendall((cmd + '\n').encode('ascii'))
+        return self.read_until(b'> ')
+
+
+def bench(options):
+    c = Client(options.bench)
+    base = options.base
+    count = options.count
+    words_per_line = options.line // 4
+
+    def run(name, fn, accesses):
+        t0 = time.time()
+        fn()
+        elapsed = time.time() - t0
+        print('%-22s %8d accesses %8.0f accesses/s %8.1f us/access' %
+              (name, accesses, accesses / elapsed, 1e6 * elapsed / accesses))
+
+    def per_word():
+        for i in range(count):
+            c.command('mdw 0x%x 1' % (base + 4 * i))
+
+    def coalesced():
+        for i in range(0, count, words_per_line):
+            c.command('mdw 0x%x %d' % (base + 4 * i, words_per_line))
+
+    def writes_single():
+        for i in range(count):
+            c.command('mww 0x%x 0x%x' % (base + 4 * i, i))
+
+    def writes_batched():
+        for i in range(0, count, options.batch):
+            n = min(options.batch, count - i)
+            c.command('; '.join('mww 0x%x 0x%x' % (base + 4 * (i + j), i + j) for j in range(n)))
+
+    run('reads, 1 word', per_word, count)
+    run('reads, %d-byte lines' % options.line, coalesced, count)
+    run('writes, 1 per line', writes_single, count)
+    run('writes, batch of %d' % options.batch, writes_batched, count)
+
+
+def main():
+    parser = optparse.OptionParser()
+    parser.add_option('--port', type='int', default=4444, help='telnet port to listen on')
+    parser.add_option('--latency', type='float', default=0.0,
+                      help='simulated per-round-trip target latency in ms')
+    parser.add_option('--avatar', default=None,
+                      help='host:port of the RemoteMemory listen socket to connect to')
+    parser.add_option('--protocol', default='json', choices=['json', 'binary'],
+                      help='framing used on the RemoteMemory listen socket')
+    parser.add_option('--no-ids', action='store_true', default=False,
+                      help='leave the id out of JSON replies, like older peers')
+    parser.add_option('--guard', action='append', default=[],
+                      help='START:SIZE range that reads must stay in (repeatable)')
+    parser.add_option('--bench', default=None, help='benchmark the server at host:port')
+    parser.add_option('--count', type='int', default=2000, help='accesses per benchmark')
+    parser.add_option('--line', type='int', default=64, help='coalesced read size in bytes')
+    parser.add_option('--batch', type='int', default=32, help='writes per batch')
+    parser.add_option('--base', type='int', default=0x20000000, help='benchmark base address')
+    options, _ = parser.parse_args()
+
+    if options.bench:
+        bench(options)
+    else:
+        serve(options)
+
+
+if __name__ == '__main__':
+    sys.exit(main())